@@ -0,0 +1,75 @@
+#ifndef ASSET_FILES_H
+#define ASSET_FILES_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+// Finding and reading the asset files, for the offline tools that walk the Assets directory
+// (AssetTool and TextureBench); the renderer only opens the paths it's given.
+
+// the files directly in a directory with one of the extensions (lower case, with the dot)
+inline std::vector<std::string> listFiles(const std::string& directory, const std::vector<std::string>& extensions)
+{
+	std::vector<std::string> names;
+#ifdef _WIN32
+	_finddata_t found;
+	intptr_t search = _findfirst((directory + "\\*").c_str(), &found);
+	if (search == -1)
+		return names;
+	do
+	{
+		if (!(found.attrib & _A_SUBDIR))
+			names.push_back(found.name);
+	} while (_findnext(search, &found) == 0);
+	_findclose(search);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (!dir)
+		return names;
+	while (dirent* entry = readdir(dir))
+		names.push_back(entry->d_name);
+	closedir(dir);
+#endif
+
+	std::vector<std::string> files;
+	for (const std::string& name : names)
+	{
+		size_t dot = name.find_last_of('.');
+		std::string extension = dot != std::string::npos ? name.substr(dot) : "";
+		for (char& c : extension)
+			c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		if (std::find(extensions.begin(), extensions.end(), extension) != extensions.end())
+			files.push_back(name);
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+// the png and jpg files directly in a directory
+inline std::vector<std::string> listImages(const std::string& directory)
+{
+	return listFiles(directory, { ".png", ".jpg", ".jpeg", ".tga" });
+}
+
+// the whole file; false when it can't be read or is empty
+inline bool readFile(const std::string& path, std::vector<uint8_t>& bytes)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+	bytes.resize(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	return !bytes.empty() && file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+}
+
+#endif
@@ -0,0 +1,396 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "Ktx2.h"
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// One file holding the assets the renderer would otherwise read loose: textures with their
+// mips in the layout GL takes them (the CPU mip chains of the images and the block compressed
+// KTX2 levels), shader sources and mesh vertex buffers. "AssetTool pack-assets" writes it;
+// the renderer maps it into memory and hands pointers into the mapping to glTexImage2D,
+// glShaderSource and glBufferData, so the bytes go from the page cache to the driver without
+// being read into buffers of their own first.
+//
+// Layout: an AssetPackHeader, the data of every entry aligned to ASSET_PACK_ALIGNMENT (a page,
+// so any entry could be mapped on its own), then the table of contents, one AssetPackEntry
+// per asset. Entries are named by the normalized path of the file they replace.
+
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint64_t ASSET_PACK_ALIGNMENT = 4096;
+const uint32_t ASSET_PACK_MAX_LEVELS = 16; // up to 32K textures
+const uint32_t ASSET_PACK_NAME_LENGTH = 120;
+
+enum AssetType : uint32_t {
+	ASSET_TEXTURE = 1,
+	ASSET_SHADER_SOURCE = 2,
+	ASSET_MESH = 3,
+};
+
+struct AssetPackHeader {
+	char magic[4]; // "APAK"
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	uint64_t tocOffset;
+};
+
+struct AssetPackEntry {
+	char name[ASSET_PACK_NAME_LENGTH]; // normalized, zero terminated
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset; // of the data in the file
+	uint64_t size;
+	// textures: the size of level 0, and either a KTX2 vkFormat or 0 with the channels of
+	// uncompressed 8 bit texels; meshes: the vertex count and the floats per vertex in width/height
+	uint32_t width;
+	uint32_t height;
+	uint32_t vkFormat;
+	uint32_t channels;
+	uint32_t levelCount;
+	uint32_t padding;
+	uint64_t levelOffsets[ASSET_PACK_MAX_LEVELS]; // from the entry's data
+	uint64_t levelBytes[ASSET_PACK_MAX_LEVELS];
+};
+
+// lower case, forward slashes, no "." or ".." segments, so every spelling of a path
+// (Windows paths are case insensitive) ends up on the same entry
+inline std::string normalizeAssetPath(const std::string& path)
+{
+	std::vector<std::string> segments;
+	std::string segment;
+	for (size_t i = 0; i <= path.size(); i++)
+	{
+		char c = i < path.size() ? path[i] : '/';
+		if (c != '/' && c != '\\')
+		{
+			segment += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+			continue;
+		}
+		if (segment == "..")
+		{
+			if (!segments.empty() && segments.back() != "..")
+				segments.pop_back();
+			else
+				segments.push_back(segment);
+		}
+		else if (!segment.empty() && segment != ".")
+		{
+			segments.push_back(segment);
+		}
+		segment.clear();
+	}
+
+	// keep absolute paths absolute
+	std::string normalized = !path.empty() && (path[0] == '/' || path[0] == '\\') ? "/" : "";
+	for (size_t i = 0; i < segments.size(); i++)
+	{
+		if (i > 0)
+			normalized += '/';
+		normalized += segments[i];
+	}
+	return normalized;
+}
+
+// A whole file mapped read-only into memory
+class MappedFile
+{
+    public:
+	MappedFile()
+	{
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+			bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		length = static_cast<size_t>(fileSize.QuadPart);
+#else
+		file = ::open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat status;
+		if (fstat(file, &status) != 0 || status.st_size == 0)
+		{
+			close();
+			return false;
+		}
+		void* view = mmap(NULL, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED)
+			bytes = static_cast<const uint8_t*>(view);
+		length = static_cast<size_t>(status.st_size);
+#endif
+		if (!bytes)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (bytes)
+			UnmapViewOfFile(bytes);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes)
+			munmap(const_cast<uint8_t*>(bytes), length);
+		if (file >= 0)
+			::close(file);
+		file = -1;
+#endif
+		bytes = NULL;
+		length = 0;
+	}
+
+	const uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+
+    private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#else
+	int file = -1;
+#endif
+	const uint8_t* bytes = NULL;
+	size_t length = 0;
+};
+
+// A pack file opened for reading; everything it hands out points into the mapping and stays
+// valid until the pack is closed
+class AssetPack
+{
+    public:
+	bool open(const char* path)
+	{
+		entries.clear();
+		entriesByName.clear();
+		if (!file.open(path))
+			return false;
+
+		AssetPackHeader header;
+		if (file.size() < sizeof(header))
+			return fail();
+		std::memcpy(&header, file.data(), sizeof(header));
+		if (std::memcmp(header.magic, "APAK", 4) != 0 || header.version != ASSET_PACK_VERSION
+			|| header.tocOffset + static_cast<uint64_t>(header.entryCount) * sizeof(AssetPackEntry) > file.size())
+			return fail();
+
+		entries.resize(header.entryCount);
+		std::memcpy(entries.data(), file.data() + header.tocOffset, entries.size() * sizeof(AssetPackEntry));
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			AssetPackEntry& entry = entries[i];
+			entry.name[ASSET_PACK_NAME_LENGTH - 1] = '\0';
+			if (entry.offset + entry.size > file.size() || entry.levelCount > ASSET_PACK_MAX_LEVELS)
+				return fail();
+			for (uint32_t level = 0; level < entry.levelCount; level++)
+			{
+				if (entry.levelOffsets[level] + entry.levelBytes[level] > entry.size)
+					return fail();
+			}
+			entriesByName[entry.name] = i;
+		}
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		entries.clear();
+		entriesByName.clear();
+	}
+
+	bool isOpen() const { return file.data() != NULL; }
+
+	// the entry replacing a file, NULL when the pack doesn't have it
+	const AssetPackEntry* find(const std::string& path, AssetType type) const
+	{
+		std::unordered_map<std::string, size_t>::const_iterator found = entriesByName.find(normalizeAssetPath(path));
+		if (found == entriesByName.end() || entries[found->second].type != type)
+			return NULL;
+		return &entries[found->second];
+	}
+
+	const uint8_t* data(const AssetPackEntry& entry) const { return file.data() + entry.offset; }
+	const uint8_t* levelData(const AssetPackEntry& entry, uint32_t level) const { return data(entry) + entry.levelOffsets[level]; }
+
+	size_t entryCount() const { return entries.size(); }
+	const AssetPackEntry& entry(size_t index) const { return entries[index]; }
+	size_t size() const { return file.size(); }
+
+    private:
+	MappedFile file;
+	std::vector<AssetPackEntry> entries;
+	std::unordered_map<std::string, size_t> entriesByName;
+
+	bool fail()
+	{
+		close();
+		return false;
+	}
+};
+
+// Collects assets and writes them as a pack; used by AssetTool
+class AssetPackWriter
+{
+    public:
+	// a mip chain as the loader builds it (see MipGenerator.h), under the name of its cache file
+	bool addTexture(const std::string& name, const MipChain& chain)
+	{
+		if (chain.levelCount() > ASSET_PACK_MAX_LEVELS)
+			return false;
+		AssetPackEntry entry = newEntry(name, ASSET_TEXTURE);
+		entry.width = chain.width;
+		entry.height = chain.height;
+		entry.channels = chain.channels;
+		entry.levelCount = chain.levelCount();
+		for (uint32_t level = 0; level < chain.levelCount(); level++)
+		{
+			entry.levelOffsets[level] = chain.levelOffsets[level];
+			entry.levelBytes[level] = chain.levelBytes(level);
+		}
+		add(entry, chain.data.data(), chain.data.size());
+		return true;
+	}
+
+	// the levels of a KTX2 file, level 0 first
+	bool addTexture(const std::string& name, const Ktx2Image& image)
+	{
+		if (image.levels.size() > ASSET_PACK_MAX_LEVELS)
+			return false;
+		AssetPackEntry entry = newEntry(name, ASSET_TEXTURE);
+		entry.width = image.width;
+		entry.height = image.height;
+		entry.vkFormat = image.vkFormat;
+		entry.levelCount = static_cast<uint32_t>(image.levels.size());
+		std::vector<uint8_t> levels;
+		for (uint32_t level = 0; level < entry.levelCount; level++)
+		{
+			entry.levelOffsets[level] = levels.size();
+			entry.levelBytes[level] = image.levels[level].byteLength;
+			const uint8_t* begin = image.data.data() + image.levels[level].byteOffset;
+			levels.insert(levels.end(), begin, begin + image.levels[level].byteLength);
+		}
+		add(entry, levels.data(), levels.size());
+		return true;
+	}
+
+	void addShaderSource(const std::string& name, const std::string& source)
+	{
+		add(newEntry(name, ASSET_SHADER_SOURCE), reinterpret_cast<const uint8_t*>(source.data()), source.size());
+	}
+
+	void addMesh(const std::string& name, const float* vertices, uint32_t vertexCount, uint32_t floatsPerVertex)
+	{
+		AssetPackEntry entry = newEntry(name, ASSET_MESH);
+		entry.width = vertexCount;
+		entry.height = floatsPerVertex;
+		add(entry, reinterpret_cast<const uint8_t*>(vertices), static_cast<size_t>(vertexCount) * floatsPerVertex * sizeof(float));
+	}
+
+	bool write(const char* path) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+		AssetPackHeader header = { { 'A', 'P', 'A', 'K' }, ASSET_PACK_VERSION, static_cast<uint32_t>(entries.size()), 0, tocOffset() };
+		std::vector<uint8_t> padding(static_cast<size_t>(ASSET_PACK_ALIGNMENT), 0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		uint64_t position = sizeof(header);
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			file.write(reinterpret_cast<const char*>(padding.data()), static_cast<std::streamsize>(entries[i].offset - position));
+			file.write(reinterpret_cast<const char*>(blobs[i].data()), blobs[i].size());
+			position = entries[i].offset + blobs[i].size();
+		}
+		file.write(reinterpret_cast<const char*>(padding.data()), static_cast<std::streamsize>(header.tocOffset - position));
+		file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetPackEntry));
+		return file.good();
+	}
+
+	size_t entryCount() const { return entries.size(); }
+
+    private:
+	std::vector<AssetPackEntry> entries;
+	std::vector<std::vector<uint8_t>> blobs;
+	uint64_t end = sizeof(AssetPackHeader);
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+	}
+
+	uint64_t tocOffset() const { return align(end); }
+
+	static AssetPackEntry newEntry(const std::string& name, AssetType type)
+	{
+		AssetPackEntry entry = {};
+		std::string normalized = normalizeAssetPath(name);
+		std::strncpy(entry.name, normalized.c_str(), ASSET_PACK_NAME_LENGTH - 1);
+		entry.type = type;
+		return entry;
+	}
+
+	void add(AssetPackEntry entry, const uint8_t* data, size_t size)
+	{
+		entry.offset = align(end);
+		entry.size = size;
+		end = entry.offset + size;
+		entries.push_back(entry);
+		blobs.push_back(std::vector<uint8_t>(data, data + size));
+	}
+};
+
+#endif
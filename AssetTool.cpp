@@ -0,0 +1,728 @@
+// Offline asset tool. Everything that is too slow to do at startup is precomputed here
+// and written next to the other assets for the renderer to load.
+//
+// usage: AssetTool <command> [options]
+
+#include "LightmapBaker.h"
+#include "ProbeGridBaker.h"
+#include "IBLBaker.h"
+#include "TextureCompressor.h"
+#include "MipGenerator.h"
+#include "AssetPack.h"
+#include "MeshSimplifier.h"
+#include "AssetFiles.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static void printUsage()
+{
+	std::cout << "usage: AssetTool <command> [options]\n"
+		<< "commands:\n"
+		<< "  bake-lightmap [output] [samples] [threads]\n"
+		<< "      path traces the static lights into a lightmap atlas (default Assets\\Baked\\scene.lightmap)\n"
+		<< "  bake-probes [output] [samples] [threads]\n"
+		<< "      bakes the ambient lighting into an SH irradiance probe grid (default Assets\\Baked\\scene.probes)\n"
+		<< "  bake-ibl [lut output] [environment output] [threads]\n"
+		<< "      precomputes the split sum BRDF LUT and the prefiltered environment for the PBR mode\n"
+		<< "      (default Assets\\Baked\\brdf.lut and Assets\\Baked\\environment.cube)\n"
+		<< "  bake-lods [output]\n"
+		<< "      simplifies the light marker sphere into a chain of levels of detail with their errors\n"
+		<< "      (default Assets\\Baked\\marker.lods)\n"
+		<< "  compress-textures [input dir] [output dir] [threads] [--bc7]\n"
+		<< "      block compresses every image with its mip chain into KTX2 files: BC4 for grayscale,\n"
+		<< "      BC1 for opaque color, BC7 for color with alpha or with --bc7\n"
+		<< "      (default Assets\\Images to Assets\\Baked\\Textures)\n"
+		<< "  pack-material [diffuse] [specular] [output] [threads]\n"
+		<< "      stores the specular mask in the alpha channel of the diffuse map, as one BC7 KTX2 texture\n"
+		<< "      (default the container maps to Assets\\Baked\\Textures\\container2_packed.ktx2)\n"
+		<< "  bake-all\n"
+		<< "      runs every bake above with its defaults, regenerating everything in Assets\\Baked; those\n"
+		<< "      files are checked in, rerun this and commit them after changing a baker or the scene\n"
+		<< "  generate-mips [input dir] [threads]\n"
+		<< "      builds the mip chain of every image, as sRGB encoded color, into the cache next to it (default Assets\\Images)\n"
+		<< "  pack-assets [output] [assets dir] [threads]\n"
+		<< "      puts the image mip chains, the KTX2 textures, the shader sources and the cube mesh into one\n"
+		<< "      memory mapped pack (default Assets to Assets\\assets.pack)\n"
+		<< "  bench-pack [pack] [assets dir]\n"
+		<< "      times reading the packed assets as loose files and from the pack, cold and warm\n";
+}
+
+static int bakeLightmap(int argc, char** argv)
+{
+	const char* output = argc > 2 ? argv[2] : "Assets\\Baked\\scene.lightmap";
+
+	LightmapSettings settings;
+	if (argc > 3)
+		settings.samplesPerTexel = static_cast<uint32_t>(std::atoi(argv[3]));
+	if (argc > 4)
+		settings.workerCount = static_cast<unsigned int>(std::atoi(argv[4]));
+
+	LightmapBaker baker(settings);
+	baker.bake();
+
+	const LightmapStats& stats = baker.getStats();
+	std::cout << "Baked " << baker.getAtlasSize() << "x" << baker.getAtlasSize() << " lightmap in " << stats.seconds << " s on "
+		<< stats.workerCount << " threads: " << stats.rays << " rays, "
+		<< stats.raysPerSecondPerCore() / 1e6 << " Mrays/s per core" << std::endl;
+
+	if (!baker.write(output))
+	{
+		std::cout << "Unable to write lightmap. Path: " << output << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+static int bakeProbes(int argc, char** argv)
+{
+	const char* output = argc > 2 ? argv[2] : "Assets\\Baked\\scene.probes";
+
+	ProbeGridSettings settings;
+	if (argc > 3)
+		settings.samplesPerProbe = static_cast<uint32_t>(std::atoi(argv[3]));
+	if (argc > 4)
+		settings.workerCount = static_cast<unsigned int>(std::atoi(argv[4]));
+
+	ProbeGridBaker baker(settings);
+	baker.bake();
+
+	const ProbeGridStats& stats = baker.getStats();
+	std::cout << "Baked " << settings.size[0] << "x" << settings.size[1] << "x" << settings.size[2] << " probe grid in " << stats.seconds << " s on "
+		<< stats.workerCount << " threads: " << stats.rays << " rays" << std::endl;
+
+	if (!baker.write(output))
+	{
+		std::cout << "Unable to write probe grid. Path: " << output << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+static int bakeIBL(int argc, char** argv)
+{
+	const char* lutOutput = argc > 2 ? argv[2] : "Assets\\Baked\\brdf.lut";
+	const char* environmentOutput = argc > 3 ? argv[3] : "Assets\\Baked\\environment.cube";
+	unsigned int workerCount = argc > 4 ? static_cast<unsigned int>(std::atoi(argv[4])) : 0;
+
+	const uint32_t lutSize = 128;
+	const uint32_t faceSize = 32;
+	const uint32_t mipCount = 5;
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<glm::vec2> lut = bakeBrdfLut(lutSize, 1024, workerCount);
+	auto lutDone = std::chrono::steady_clock::now();
+	std::vector<glm::vec3> environment = bakePrefilteredEnvironment(faceSize, mipCount, 1024, workerCount);
+	auto environmentDone = std::chrono::steady_clock::now();
+
+	std::cout << "Baked " << lutSize << "x" << lutSize << " BRDF LUT in " << std::chrono::duration<double>(lutDone - start).count()
+		<< " s and " << faceSize << "x" << faceSize << " prefiltered environment with " << mipCount << " mips in "
+		<< std::chrono::duration<double>(environmentDone - lutDone).count() << " s" << std::endl;
+
+	if (!writeBrdfLut(lutOutput, lutSize, lut))
+	{
+		std::cout << "Unable to write BRDF LUT. Path: " << lutOutput << std::endl;
+		return -1;
+	}
+	if (!writeEnvironment(environmentOutput, faceSize, mipCount, environment))
+	{
+		std::cout << "Unable to write environment. Path: " << environmentOutput << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+// picks the smallest format that keeps what the image has: grayscale -> BC4,
+// opaque color -> BC1, color with alpha -> BC7
+static uint32_t chooseFormat(const RgbaImage& image, bool forceBC7)
+{
+	bool grayscale = true;
+	bool opaque = true;
+	for (size_t i = 0; i < image.pixels.size(); i += 4)
+	{
+		const uint8_t* texel = &image.pixels[i];
+		grayscale = grayscale && texel[0] == texel[1] && texel[1] == texel[2];
+		opaque = opaque && texel[3] == 255;
+	}
+	if (forceBC7)
+		return grayscale ? KTX2_FORMAT_BC7_UNORM : KTX2_FORMAT_BC7_SRGB;
+	if (grayscale && opaque)
+		return KTX2_FORMAT_BC4_UNORM;
+	return opaque ? KTX2_FORMAT_BC1_RGB_SRGB : KTX2_FORMAT_BC7_SRGB;
+}
+
+// the block compressed mip chain of an image, down to 1x1, filtered like the mips the
+// renderer builds on the CPU (see MipGenerator.h)
+static std::vector<std::vector<uint8_t>> compressMipChain(const RgbaImage& image, uint32_t format, unsigned int workerCount)
+{
+	MipChain chain = generateMipChain(image.pixels.data(), image.width, image.height, 4, ktx2IsSrgb(format), workerCount);
+	std::vector<std::vector<uint8_t>> levels;
+	for (uint32_t level = 0; level < chain.levelCount(); level++)
+	{
+		RgbaImage mip;
+		mip.width = chain.levelWidth(level);
+		mip.height = chain.levelHeight(level);
+		mip.pixels.assign(chain.data.begin() + chain.levelOffsets[level], chain.data.begin() + chain.levelOffsets[level] + chain.levelBytes(level));
+		levels.push_back(compressImage(mip, format, workerCount));
+	}
+	return levels;
+}
+
+static int bakeLods(int argc, char** argv)
+{
+	const char* output = argc > 2 ? argv[2] : "Assets\\Baked\\marker.lods";
+
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	buildIcosphere(MARKER_SPHERE_SUBDIVISIONS, MARKER_SPHERE_RADIUS, positions, indices);
+
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<LodMesh> chain = buildLodChain(positions, indices, MARKER_LOD_MIN_TRIANGLES);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+	std::cout << "Simplified the marker sphere into " << chain.size() << " levels in " << milliseconds << " ms:" << std::endl;
+	for (size_t level = 0; level < chain.size(); level++)
+	{
+		std::cout << "  level " << level << ": " << chain[level].indices.size() / 3 << " triangles, " << chain[level].positions.size()
+			<< " vertices, error " << chain[level].error << std::endl;
+	}
+
+	if (!writeLodChain(output, chain))
+	{
+		std::cout << "Unable to write LOD chain. Path: " << output << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+static int compressTextures(int argc, char** argv)
+{
+	std::vector<std::string> arguments;
+	bool forceBC7 = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--bc7") == 0)
+			forceBC7 = true;
+		else
+			arguments.push_back(argv[i]);
+	}
+	std::string input = arguments.size() > 0 ? arguments[0] : "Assets\\Images";
+	std::string output = arguments.size() > 1 ? arguments[1] : "Assets\\Baked\\Textures";
+	unsigned int workerCount = arguments.size() > 2 ? static_cast<unsigned int>(std::atoi(arguments[2].c_str())) : 0;
+#ifdef _WIN32
+	const char separator = '\\';
+#else
+	const char separator = '/';
+#endif
+
+	std::vector<std::string> images = listImages(input);
+	if (images.empty())
+	{
+		std::cout << "No images to compress. Path: " << input << std::endl;
+		return -1;
+	}
+
+	size_t totalSource = 0, totalCompressed = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (const std::string& name : images)
+	{
+		std::string sourcePath = input + separator + name;
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, 4);
+		if (!pixels)
+		{
+			std::cout << "Unable to load image data. Path: " << sourcePath << std::endl;
+			return -1;
+		}
+		RgbaImage image;
+		image.width = static_cast<uint32_t>(width);
+		image.height = static_cast<uint32_t>(height);
+		image.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(pixels);
+
+		auto imageStart = std::chrono::steady_clock::now();
+		uint32_t format = chooseFormat(image, forceBC7);
+		std::vector<std::vector<uint8_t>> levels = compressMipChain(image, format, workerCount);
+
+		std::string outputPath = output + separator + name.substr(0, name.find_last_of('.')) + ".ktx2";
+		if (!writeKtx2(outputPath.c_str(), format, static_cast<uint32_t>(width), static_cast<uint32_t>(height), levels))
+		{
+			std::cout << "Unable to write texture. Path: " << outputPath << std::endl;
+			return -1;
+		}
+
+		// against the uncompressed RGBA8 mip chain the renderer would otherwise upload
+		size_t sourceBytes = static_cast<size_t>(width) * height * 4 * 4 / 3;
+		size_t compressedBytes = 0;
+		for (const std::vector<uint8_t>& level : levels)
+			compressedBytes += level.size();
+		totalSource += sourceBytes;
+		totalCompressed += compressedBytes;
+
+		const char* formatName = format == KTX2_FORMAT_BC4_UNORM ? "BC4" : format == KTX2_FORMAT_BC1_RGB_SRGB ? "BC1" : "BC7";
+		std::cout << name << ": " << width << "x" << height << " " << formatName << ", " << levels.size() << " mips, "
+			<< sourceBytes / 1024 << " KB -> " << compressedBytes / 1024 << " KB in "
+			<< std::chrono::duration<double>(std::chrono::steady_clock::now() - imageStart).count() << " s" << std::endl;
+	}
+
+	std::cout << "Compressed " << images.size() << " textures in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+		<< " s: " << totalSource / 1024 << " KB -> " << totalCompressed / 1024 << " KB ("
+		<< static_cast<double>(totalSource) / totalCompressed << ":1)" << std::endl;
+	return 0;
+}
+
+static int packMaterial(int argc, char** argv)
+{
+	const char* diffusePath = argc > 2 ? argv[2] : "Assets\\Images\\container2.png";
+	const char* specularPath = argc > 3 ? argv[3] : "Assets\\Images\\container2_specular.png";
+	const char* output = argc > 4 ? argv[4] : "Assets\\Baked\\Textures\\container2_packed.ktx2";
+	unsigned int workerCount = argc > 5 ? static_cast<unsigned int>(std::atoi(argv[5])) : 0;
+
+	int width, height, specularWidth, specularHeight, channels;
+	unsigned char* diffuse = stbi_load(diffusePath, &width, &height, &channels, 4);
+	if (!diffuse)
+	{
+		std::cout << "Unable to load image data. Path: " << diffusePath << std::endl;
+		return -1;
+	}
+	unsigned char* specular = stbi_load(specularPath, &specularWidth, &specularHeight, &channels, 4);
+	if (!specular || specularWidth != width || specularHeight != height)
+	{
+		std::cout << "Unable to load image data, or its size doesn't match the diffuse map. Path: " << specularPath << std::endl;
+		stbi_image_free(diffuse);
+		stbi_image_free(specular);
+		return -1;
+	}
+
+	// the shaders use the specular map as a gray mask, its luminance goes in the alpha
+	RgbaImage image;
+	image.width = static_cast<uint32_t>(width);
+	image.height = static_cast<uint32_t>(height);
+	image.pixels.assign(diffuse, diffuse + static_cast<size_t>(width) * height * 4);
+	for (size_t i = 0; i < image.pixels.size(); i += 4)
+	{
+		float luminance = 0.2126f * specular[i] + 0.7152f * specular[i + 1] + 0.0722f * specular[i + 2];
+		image.pixels[i + 3] = static_cast<uint8_t>(std::min(luminance + 0.5f, 255.0f));
+	}
+	stbi_image_free(diffuse);
+	stbi_image_free(specular);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::vector<uint8_t>> levels = compressMipChain(image, KTX2_FORMAT_BC7_SRGB, workerCount);
+	size_t compressedBytes = 0;
+	for (const std::vector<uint8_t>& level : levels)
+		compressedBytes += level.size();
+	std::cout << "Packed " << width << "x" << height << " material into BC7 with " << levels.size() << " mips in "
+		<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s: " << compressedBytes / 1024 << " KB" << std::endl;
+
+	if (!writeKtx2(output, KTX2_FORMAT_BC7_SRGB, image.width, image.height, levels))
+	{
+		std::cout << "Unable to write texture. Path: " << output << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+// what the renderer would otherwise do at every launch: one 2x2 box filter pass per level
+static void boxFilterMips(std::vector<uint8_t> pixels, uint32_t width, uint32_t height, uint32_t channels)
+{
+	while (width > 1 || height > 1)
+	{
+		uint32_t nextWidth = std::max(width / 2, 1u), nextHeight = std::max(height / 2, 1u);
+		std::vector<uint8_t> next(static_cast<size_t>(nextWidth) * nextHeight * channels);
+		for (uint32_t y = 0; y < nextHeight; y++)
+		{
+			for (uint32_t x = 0; x < nextWidth; x++)
+			{
+				for (uint32_t c = 0; c < channels; c++)
+				{
+					uint32_t x1 = std::min(x * 2 + 1, width - 1), y1 = std::min(y * 2 + 1, height - 1);
+					unsigned int sum = pixels[(y * 2 * width + x * 2) * channels + c] + pixels[(y * 2 * width + x1) * channels + c]
+						+ pixels[(y1 * width + x * 2) * channels + c] + pixels[(y1 * width + x1) * channels + c];
+					next[(y * nextWidth + x) * channels + c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+		pixels.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
+
+static int generateMips(int argc, char** argv)
+{
+	std::string input = argc > 2 ? argv[2] : "Assets\\Images";
+	unsigned int workerCount = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 0;
+#ifdef _WIN32
+	const char separator = '\\';
+#else
+	const char separator = '/';
+#endif
+
+	std::vector<std::string> images = listImages(input);
+	if (images.empty())
+	{
+		std::cout << "No images to generate mips for. Path: " << input << std::endl;
+		return -1;
+	}
+
+	double kaiserSeconds = 0.0, boxSeconds = 0.0;
+	for (const std::string& name : images)
+	{
+		// the same steps as AsyncTextureLoader, so the renderer finds the cache valid
+		std::string sourcePath = input + separator + name;
+		std::ifstream file(sourcePath, std::ios::binary | std::ios::ate);
+		std::vector<uint8_t> bytes(file ? static_cast<size_t>(file.tellg()) : 0);
+		file.seekg(0);
+		int width, height, channels;
+		unsigned char* pixels = NULL;
+		if (!bytes.empty() && file.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+			pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels, 0);
+		if (!pixels)
+		{
+			std::cout << "Unable to load image data. Path: " << sourcePath << std::endl;
+			return -1;
+		}
+		// the ".mips" cache is the one of color textures not sampled as sRGB, which is how the
+		// renderer loads them; the others get theirs at runtime
+		dropUnusedChannels(pixels, static_cast<size_t>(width) * height, channels, false);
+
+		auto start = std::chrono::steady_clock::now();
+		MipChain chain = generateMipChain(pixels, width, height, channels, true, workerCount);
+		auto kaiserDone = std::chrono::steady_clock::now();
+		boxFilterMips(std::vector<uint8_t>(pixels, pixels + static_cast<size_t>(width) * height * channels), width, height, channels);
+		auto boxDone = std::chrono::steady_clock::now();
+		stbi_image_free(pixels);
+
+		double kaiser = std::chrono::duration<double>(kaiserDone - start).count();
+		double box = std::chrono::duration<double>(boxDone - kaiserDone).count();
+		kaiserSeconds += kaiser;
+		boxSeconds += box;
+		std::cout << name << ": " << width << "x" << height << "x" << channels << ", " << chain.levelCount() << " levels in "
+			<< kaiser * 1000.0 << " ms (box filter " << box * 1000.0 << " ms)" << std::endl;
+
+		std::string cachePath = sourcePath + mipCacheSuffix(false, true);
+		if (!writeMipCache(cachePath.c_str(), bytes.size(), hashBytes(bytes.data(), bytes.size()), chain))
+		{
+			std::cout << "Unable to write mip cache. Path: " << cachePath << std::endl;
+			return -1;
+		}
+	}
+
+	std::cout << "Generated " << images.size() << " mip chains in " << kaiserSeconds * 1000.0 << " ms, box filter "
+		<< boxSeconds * 1000.0 << " ms" << std::endl;
+	return 0;
+}
+
+// A file the renderer reads at startup, and the pack entry replacing it
+struct PackedAsset {
+	std::string name; // the path the renderer asks for
+	std::string path; // where it is read from here
+	AssetType type;
+	std::string source; // mip caches: the image they were built from
+};
+
+// everything pack-assets puts into the pack besides the cube mesh: the mip chain of every
+// image (the sRGB one only when its cache exists), the KTX2 textures and the shader sources
+static std::vector<PackedAsset> collectAssets(const std::string& root)
+{
+#ifdef _WIN32
+	const char separator = '\\';
+#else
+	const char separator = '/';
+#endif
+	std::vector<PackedAsset> assets;
+	std::string images = root + separator + "Images" + separator;
+	for (const std::string& name : listImages(root + separator + "Images"))
+	{
+		PackedAsset mips = { "Assets\\Images\\" + name + ".mips", images + name + ".mips", ASSET_TEXTURE, images + name };
+		assets.push_back(mips);
+		// the other color spaces' chains, for the textures the renderer has loaded that way
+		for (const char* suffix : { ".srgb.mips", ".linear.mips" })
+		{
+			if (std::ifstream(images + name + suffix))
+			{
+				PackedAsset otherMips = { "Assets\\Images\\" + name + suffix, images + name + suffix, ASSET_TEXTURE, images + name };
+				assets.push_back(otherMips);
+			}
+		}
+	}
+	std::string textures = root + separator + "Baked" + separator + "Textures" + separator;
+	for (const std::string& name : listFiles(root + separator + "Baked" + separator + "Textures", { ".ktx2" }))
+	{
+		PackedAsset texture = { "Assets\\Baked\\Textures\\" + name, textures + name, ASSET_TEXTURE, "" };
+		assets.push_back(texture);
+	}
+	std::string shaders = root + separator + "Shaders" + separator;
+	for (const std::string& name : listFiles(root + separator + "Shaders", { ".vs", ".fs", ".comp" }))
+	{
+		PackedAsset shader = { "Assets\\Shaders\\" + name, shaders + name, ASSET_SHADER_SOURCE, "" };
+		assets.push_back(shader);
+	}
+	return assets;
+}
+
+// the mip chain of an image the way AsyncTextureLoader gets it: from the cache when it was
+// built from this version of the image, otherwise decoded and generated (and cached again)
+static bool loadImageMips(const PackedAsset& asset, unsigned int workerCount, MipChain& chain)
+{
+	std::vector<uint8_t> bytes;
+	if (!readFile(asset.source, bytes))
+		return false;
+	uint64_t hash = hashBytes(bytes.data(), bytes.size());
+	if (readMipCache(asset.path.c_str(), bytes.size(), hash, chain))
+		return true;
+
+	int width, height, channels;
+	unsigned char* pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels, 0);
+	if (!pixels)
+		return false;
+	auto endsWith = [&](const std::string& suffix) {
+		return asset.path.size() >= suffix.size() && asset.path.compare(asset.path.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	bool srgb = endsWith(".srgb.mips");
+	bool srgbEncoded = !endsWith(".linear.mips");
+	dropUnusedChannels(pixels, static_cast<size_t>(width) * height, channels, srgb);
+	chain = generateMipChain(pixels, width, height, channels, srgbEncoded, workerCount);
+	stbi_image_free(pixels);
+	writeMipCache(asset.path.c_str(), bytes.size(), hash, chain);
+	return true;
+}
+
+static int packAssets(int argc, char** argv)
+{
+	const char* output = argc > 2 ? argv[2] : "Assets\\assets.pack";
+	std::string root = argc > 3 ? argv[3] : "Assets";
+	unsigned int workerCount = argc > 4 ? static_cast<unsigned int>(std::atoi(argv[4])) : 0;
+
+	AssetPackWriter writer;
+	for (const PackedAsset& asset : collectAssets(root))
+	{
+		bool added = false;
+		if (asset.type == ASSET_SHADER_SOURCE)
+		{
+			std::vector<uint8_t> bytes;
+			if (readFile(asset.path, bytes))
+			{
+				writer.addShaderSource(asset.name, std::string(bytes.begin(), bytes.end()));
+				added = true;
+			}
+		}
+		else if (!asset.source.empty())
+		{
+			MipChain chain;
+			added = loadImageMips(asset, workerCount, chain) && writer.addTexture(asset.name, chain);
+		}
+		else
+		{
+			Ktx2Image image;
+			added = readKtx2(asset.path.c_str(), image) && writer.addTexture(asset.name, image);
+		}
+		if (!added)
+		{
+			std::cout << "Unable to pack asset. Path: " << asset.path << std::endl;
+			return -1;
+		}
+	}
+	writer.addMesh("Assets\\Meshes\\cube", cubeVertices, CUBE_VERTEX_COUNT, CUBE_VERTEX_STRIDE);
+
+	if (!writer.write(output))
+	{
+		std::cout << "Unable to write asset pack. Path: " << output << std::endl;
+		return -1;
+	}
+	std::cout << "Packed " << writer.entryCount() << " assets into " << output << std::endl;
+	return 0;
+}
+
+// asks the OS to forget the cached pages of a file, so the next read comes from the disk;
+// only Linux can do that without privileges, elsewhere the cold runs stay warm
+static bool dropFromPageCache(const std::string& path)
+{
+#if defined(__linux__)
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	// dirty pages (a pack that was just written) stay cached, write them out first
+	fdatasync(file);
+	bool dropped = posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(file);
+	return dropped;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+// reads the assets like the renderer does without a pack: the image is read and hashed to
+// check its mip cache, which is read whole, KTX2 files are read whole and shader sources go
+// through a stringstream; returns the bytes that would be handed to GL
+static size_t readLooseAssets(const std::vector<PackedAsset>& assets)
+{
+	size_t total = 0;
+	for (const PackedAsset& asset : assets)
+	{
+		if (asset.type == ASSET_SHADER_SOURCE)
+		{
+			std::ifstream file(asset.path);
+			std::stringstream stream;
+			stream << file.rdbuf();
+			total += stream.str().size();
+		}
+		else if (!asset.source.empty())
+		{
+			std::vector<uint8_t> bytes;
+			MipChain chain;
+			if (readFile(asset.source, bytes) && readMipCache(asset.path.c_str(), bytes.size(), hashBytes(bytes.data(), bytes.size()), chain))
+				total += chain.data.size();
+		}
+		else
+		{
+			Ktx2Image image;
+			if (readKtx2(asset.path.c_str(), image))
+				total += image.data.size();
+		}
+	}
+	return total;
+}
+
+// maps the pack and touches every page of every entry, as the driver reading the mapping would;
+// returns the bytes of the entries
+static size_t readPackedAssets(const char* path)
+{
+	AssetPack pack;
+	if (!pack.open(path))
+		return 0;
+	size_t total = 0;
+	volatile uint8_t sink = 0;
+	for (size_t i = 0; i < pack.entryCount(); i++)
+	{
+		const AssetPackEntry& entry = pack.entry(i);
+		const uint8_t* data = pack.data(entry);
+		for (uint64_t offset = 0; offset < entry.size; offset += ASSET_PACK_ALIGNMENT)
+			sink = sink + data[offset];
+		total += static_cast<size_t>(entry.size);
+	}
+	return total;
+}
+
+static double median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+static int benchPack(int argc, char** argv)
+{
+	const char* packPath = argc > 2 ? argv[2] : "Assets\\assets.pack";
+	std::string root = argc > 3 ? argv[3] : "Assets";
+	const int warmRuns = 5;
+
+	std::vector<PackedAsset> assets = collectAssets(root);
+	AssetPack pack;
+	if (assets.empty() || !pack.open(packPath))
+	{
+		std::cout << "Nothing to compare, run AssetTool pack-assets first. Path: " << packPath << std::endl;
+		return -1;
+	}
+	pack.close();
+
+	// cold: every file dropped from the page cache first
+	bool dropped = dropFromPageCache(packPath);
+	for (const PackedAsset& asset : assets)
+	{
+		dropped = dropFromPageCache(asset.path) && dropped;
+		if (!asset.source.empty())
+			dropped = dropFromPageCache(asset.source) && dropped;
+	}
+	auto start = std::chrono::steady_clock::now();
+	size_t looseBytes = readLooseAssets(assets);
+	double looseCold = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	start = std::chrono::steady_clock::now();
+	size_t packedBytes = readPackedAssets(packPath);
+	double packCold = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<double> looseWarm, packWarm;
+	for (int run = 0; run < warmRuns; run++)
+	{
+		start = std::chrono::steady_clock::now();
+		readLooseAssets(assets);
+		looseWarm.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		start = std::chrono::steady_clock::now();
+		readPackedAssets(packPath);
+		packWarm.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::cout << assets.size() << " loose files (" << looseBytes / 1024 << " KB for GL) against " << packPath << " ("
+		<< packedBytes / 1024 << " KB of entries)" << std::endl;
+	if (!dropped)
+		std::cout << "The page cache couldn't be dropped here, the cold numbers are warm ones" << std::endl;
+	std::cout << "cold: loose " << looseCold << " ms, pack " << packCold << " ms" << std::endl;
+	std::cout << "warm (median of " << warmRuns << "): loose " << median(looseWarm) << " ms, pack " << median(packWarm) << " ms" << std::endl;
+	return 0;
+}
+
+// the bakes only change with their bakers or the scene, and the renderer needs them at
+// startup, so they're checked in instead of made on every machine; the mip caches and the
+// pack are made by the renderer and pack-assets from what's checked in, and aren't checked
+// in themselves. Takes no arguments of its own: each bake is handed only argv[0] and the
+// command, so runs on its defaults
+static int bakeAll(int, char** argv)
+{
+	int (*const bakes[])(int, char**) = { bakeLightmap, bakeProbes, bakeIBL, bakeLods, compressTextures, packMaterial };
+	for (int (*bake)(int, char**) : bakes)
+	{
+		if (bake(2, argv) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printUsage();
+		return -1;
+	}
+
+	std::string command = argv[1];
+	if (command == "bake-lightmap")
+		return bakeLightmap(argc, argv);
+	if (command == "bake-probes")
+		return bakeProbes(argc, argv);
+	if (command == "bake-ibl")
+		return bakeIBL(argc, argv);
+	if (command == "bake-lods")
+		return bakeLods(argc, argv);
+	if (command == "compress-textures")
+		return compressTextures(argc, argv);
+	if (command == "pack-material")
+		return packMaterial(argc, argv);
+	if (command == "bake-all")
+		return bakeAll(argc, argv);
+	if (command == "generate-mips")
+		return generateMips(argc, argv);
+	if (command == "pack-assets")
+		return packAssets(argc, argv);
+	if (command == "bench-pack")
+		return benchPack(argc, argv);
+
+	std::cout << "Unknown command: " << command << std::endl;
+	printUsage();
+	return -1;
+}
@@ -1,10 +1,23 @@
 #version 330 core
+#ifdef LIGHTS_SSBO
+#extension GL_ARB_shader_storage_buffer_object : require
+#endif
+#ifdef MANY_LIGHTS
+#extension GL_ARB_shader_image_load_store : require
+#endif
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
 out vec4 FragColor;
 
 struct Material {
     sampler2D diffuse;
     sampler2D specular;
+    // the same maps once they're layers of texture arrays (see TextureArrayPool.h)
+    sampler2DArray diffuseArray;
+    sampler2DArray specularArray;
     float shininess;
+    bool specularInDiffuseAlpha; // packed by "AssetTool pack-material", specular isn't bound
 }; 
 
 struct DirLight {
@@ -44,26 +57,166 @@ struct SpotLight {
 
 #define NR_POINT_LIGHTS 4
 
+#ifdef LIGHTS_SSBO
+// the LightManager's GPU mirror, one array per light type (GPULight in LightManager.h)
+struct GPULight {
+    vec4 positionConstant;
+    vec4 directionLinear;
+    vec4 ambientQuadratic;
+    vec4 diffuseCutOff;
+    vec4 specularOuterCutOff;
+};
+
+layout(std430) readonly buffer DirLights { GPULight dirLights[]; };
+layout(std430) readonly buffer PointLights { GPULight pointLightBuffer[]; };
+layout(std430) readonly buffer SpotLights { GPULight spotLights[]; };
+
+uniform int dirLightCount;
+uniform int pointLightCount;
+uniform int spotLightCount;
+#endif
+
+#ifdef MANY_LIGHTS
+// stochastic many-light sampling (see LightSampler.h), needs LIGHTS_SSBO: the point lights are
+// picked from an alias table by weighted reservoir sampling, and every pixel keeps its
+// reservoir for the next frame. Hidden fragments must not overwrite it: the early tests alone
+// don't see to that, a farther fragment of the same draw can pass before the nearer one has
+// written its depth and still land its write last. So this pass always follows the depth
+// prepass with GL_EQUAL, where only the visible fragment passes, and the early tests make sure
+// the ones that fail don't run at all.
+layout(early_fragment_tests) in;
+
+struct AliasEntry {
+    float probability;
+    uint alias;
+    float pdf;
+    float padding;
+};
+
+struct Reservoir {
+    vec4 positionLight; // shaded point, chosen light index (uint bits) in w
+    vec4 normalWeight;  // surface normal, contribution weight W of the chosen light in w
+    vec4 historyCount;  // denoised point light color, M (candidates seen) in a
+};
+
+layout(std430) readonly buffer LightAliasTable { AliasEntry aliasTable[]; };
+layout(std430) readonly buffer PreviousReservoirs { Reservoir previousReservoirs[]; };
+layout(std430) writeonly buffer CurrentReservoirs { Reservoir currentReservoirs[]; };
+
+uniform int lightSampleCount;
+uniform int spatialSampleCount;
+uniform float spatialRadius;
+uniform int maxConfidence;
+uniform bool reuseReservoirs;
+uniform int frameIndex;
+uniform int screenWidth;
+uniform int screenHeight;
+uniform mat4 previousViewProjection;
+
+uint rngState;
+#endif
+
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in vec2 LightmapCoords;
+flat in ivec2 MaterialLayers;
+flat in int MaterialIndex;
+
+#ifdef BINDLESS
+// every material with its maps as texture handles, indexed per instance (see MaterialTable.h);
+// replaces the samplers of the material uniform
+struct GPUMaterial {
+    uvec2 diffuse;
+    uvec2 specular;
+    int diffuseLayer; // -1 when the handle is of a 2D texture
+    int specularLayer;
+    uint specularInDiffuseAlpha;
+    uint padding;
+};
+
+layout(std430) readonly buffer MaterialTable { GPUMaterial materials[]; };
+#endif
 
-uniform vec3 viewPos;
+// the same block as 1.colors.vs, for the camera position
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	mat4 inverseView;
+	mat4 inverseProjection;
+	mat4 inverseViewProjection;
+	vec4 position;
+} camera;
+
+#ifndef LIGHTS_SSBO
 uniform DirLight dirLight;
 uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight;
+#endif
 uniform Material material;
 
+// baked diffuse irradiance of the static lights (dirLight and pointLights)
+uniform bool useLightmap;
+uniform sampler2D lightmap;
+
+// baked SH irradiance probes replacing the per-light ambient terms (see ProbeGridBaker.h);
+// the lightmap has the static lights' ambient baked in, so they're left out under it
+uniform bool useProbes;
+uniform sampler3D probeGrid;
+uniform vec3 probeGridMin;
+uniform vec3 probeGridMax;
+uniform vec3 probeGridSize;
+
+#ifdef PBR
+// physically based mode: GGX/Smith/Schlick for the lights, split sum image based lighting
+// from the offline baked BRDF LUT and prefiltered environment (see IBLBaker.h)
+#define PI 3.14159265
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+uniform float prefilterMaxLod;
+uniform vec3 pbrAmbient; // diffuse ambient when the probes are off
+
+// surface properties, fetched once per fragment in main()
+vec3 surfaceAlbedo;
+float surfaceMetallic;
+float surfaceRoughness;
+vec3 surfaceF0;
+#endif
+
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 EvalProbeGrid(vec3 normal, vec3 fragPos);
+vec4 DiffuseTexel();
+vec3 SpecularMask();
+#ifdef LIGHTS_SSBO
+DirLight UnpackDirLight(GPULight light);
+PointLight UnpackPointLight(GPULight light);
+SpotLight UnpackSpotLight(GPULight light);
+#endif
+#ifdef MANY_LIGHTS
+vec3 SamplePointLights(vec3 normal, vec3 fragPos, vec3 viewDir);
+#endif
+#ifdef PBR
+vec3 CookTorrance(vec3 normal, vec3 viewDir, vec3 lightDir, vec3 radiance);
+vec3 CalcIBL(vec3 normal, vec3 viewDir, vec3 irradiance);
+#endif
 
 void main()
 {    
     // properties
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(camera.position.xyz - FragPos);
+#ifdef PBR
+    surfaceAlbedo = vec3(DiffuseTexel());
+    // the container's steel frame is where the specular map is bright
+    surfaceMetallic = SpecularMask().r;
+    // the Phong exponent mapped to the matching microfacet roughness
+    surfaceRoughness = clamp(sqrt(2.0 / (material.shininess + 2.0)), 0.05, 1.0);
+    surfaceF0 = mix(vec3(0.04), surfaceAlbedo, surfaceMetallic);
+#endif
     
     // == =====================================================
     // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
@@ -71,13 +224,49 @@ void main()
     // per lamp. In the main() function we take all the calculated colors and sum them up for
     // this fragment's final color.
     // == =====================================================
-    // phase 1: directional lighting
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+    vec3 result;
+    if (useLightmap)
+    {
+        // phases 1 and 2 were baked offline, diffuse and ambient only
+        result = texture(lightmap, LightmapCoords).rgb * vec3(DiffuseTexel());
+    }
+    else
+    {
+#ifdef LIGHTS_SSBO
+        result = vec3(0.0);
+        // phase 1: directional lighting
+        for(int i = 0; i < dirLightCount; i++)
+            result += CalcDirLight(UnpackDirLight(dirLights[i]), norm, viewDir);
+        // phase 2: point lights
+#ifdef MANY_LIGHTS
+        result += SamplePointLights(norm, FragPos, viewDir);
+#else
+        for(int i = 0; i < pointLightCount; i++)
+            result += CalcPointLight(UnpackPointLight(pointLightBuffer[i]), norm, FragPos, viewDir);
+#endif
+#else
+        // phase 1: directional lighting
+        result = CalcDirLight(dirLight, norm, viewDir);
+        // phase 2: point lights
+        for(int i = 0; i < NR_POINT_LIGHTS; i++)
+            result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+#endif
+    }
     // phase 3: spot light
+#ifdef LIGHTS_SSBO
+    for(int i = 0; i < spotLightCount; i++)
+        result += CalcSpotLight(UnpackSpotLight(spotLights[i]), norm, FragPos, viewDir);
+#else
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
+#endif
+    // ambient for all the lights at once, unless the lightmap already holds it
+#ifdef PBR
+    vec3 irradiance = useLightmap ? vec3(0.0) : (useProbes ? EvalProbeGrid(norm, FragPos) : pbrAmbient);
+    result += CalcIBL(norm, viewDir, irradiance);
+#else
+    if (useProbes && !useLightmap)
+        result += EvalProbeGrid(norm, FragPos) * vec3(DiffuseTexel());
+#endif
     
     FragColor = vec4(result, 1.0);
 }
@@ -86,22 +275,31 @@ void main()
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
+#ifdef PBR
+    return CookTorrance(normal, viewDir, lightDir, light.diffuse);
+#else
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = useProbes ? vec3(0.0) : light.ambient * vec3(DiffuseTexel());
+    vec3 diffuse = light.diffuse * diff * vec3(DiffuseTexel());
+    vec3 specular = light.specular * spec * SpecularMask();
     return (ambient + diffuse + specular);
+#endif
 }
 
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
+#ifdef PBR
+    float lightDistance = length(light.position - fragPos);
+    return CookTorrance(normal, viewDir, lightDir, light.diffuse)
+        / (light.constant + light.linear * lightDistance + light.quadratic * (lightDistance * lightDistance));
+#else
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
@@ -111,19 +309,26 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = useProbes ? vec3(0.0) : light.ambient * vec3(DiffuseTexel());
+    vec3 diffuse = light.diffuse * diff * vec3(DiffuseTexel());
+    vec3 specular = light.specular * spec * SpecularMask();
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
     return (ambient + diffuse + specular);
+#endif
 }
 
 // calculates the color when using a spot light.
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
+#ifdef PBR
+    float lightDistance = length(light.position - fragPos);
+    float cone = clamp((dot(lightDir, normalize(-light.direction)) - light.outerCutOff) / (light.cutOff - light.outerCutOff), 0.0, 1.0);
+    return CookTorrance(normal, viewDir, lightDir, light.diffuse) * cone
+        / (light.constant + light.linear * lightDistance + light.quadratic * (lightDistance * lightDistance));
+#else
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
@@ -137,11 +342,283 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = useProbes ? vec3(0.0) : light.ambient * vec3(DiffuseTexel());
+    vec3 diffuse = light.diffuse * diff * vec3(DiffuseTexel());
+    vec3 specular = light.specular * spec * SpecularMask();
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
     return (ambient + diffuse + specular);
-}
\ No newline at end of file
+#endif
+}
+
+// interpolates the SH probes around the fragment and evaluates the irradiance for its normal.
+// The 7 coefficient texels of a probe sit in 7 blocks along x; the coordinate is kept between
+// the first and last texel centers of a block so filtering never mixes neighbouring blocks.
+vec3 EvalProbeGrid(vec3 normal, vec3 fragPos)
+{
+    vec3 uvw = clamp((fragPos - probeGridMin) / (probeGridMax - probeGridMin), 0.0, 1.0);
+    vec3 texel = uvw * (probeGridSize - 1.0) + 0.5;
+    vec3 coord = texel / vec3(probeGridSize.x * 7.0, probeGridSize.y, probeGridSize.z);
+    float blockWidth = 1.0 / 7.0;
+
+    vec4 t0 = texture(probeGrid, coord);
+    vec4 t1 = texture(probeGrid, coord + vec3(blockWidth, 0.0, 0.0));
+    vec4 t2 = texture(probeGrid, coord + vec3(blockWidth * 2.0, 0.0, 0.0));
+    vec4 t3 = texture(probeGrid, coord + vec3(blockWidth * 3.0, 0.0, 0.0));
+    vec4 t4 = texture(probeGrid, coord + vec3(blockWidth * 4.0, 0.0, 0.0));
+    vec4 t5 = texture(probeGrid, coord + vec3(blockWidth * 5.0, 0.0, 0.0));
+    vec4 t6 = texture(probeGrid, coord + vec3(blockWidth * 6.0, 0.0, 0.0));
+
+    // the baker already folded the cosine convolution and basis constants into the coefficients
+    vec3 n = normal;
+    return max(t0.rgb
+        + vec3(t0.a, t1.rg) * n.y
+        + vec3(t1.ba, t2.r) * n.z
+        + t2.gba * n.x
+        + t3.rgb * (n.x * n.y)
+        + vec3(t3.a, t4.rg) * (n.y * n.z)
+        + vec3(t4.ba, t5.r) * (3.0 * n.z * n.z - 1.0)
+        + t5.gba * (n.x * n.z)
+        + t6.rgb * (n.x * n.x - n.y * n.y), 0.0);
+}
+
+vec4 DiffuseTexel()
+{
+#ifdef BINDLESS
+    GPUMaterial bindlessMaterial = materials[MaterialIndex];
+    if (bindlessMaterial.diffuseLayer >= 0)
+        return texture(sampler2DArray(bindlessMaterial.diffuse), vec3(TexCoords, bindlessMaterial.diffuseLayer));
+    return texture(sampler2D(bindlessMaterial.diffuse), TexCoords);
+#else
+    if (MaterialLayers.x >= 0)
+        return texture(material.diffuseArray, vec3(TexCoords, MaterialLayers.x));
+    return texture(material.diffuse, TexCoords);
+#endif
+}
+
+// the specular map, or the diffuse alpha it was packed into
+vec3 SpecularMask()
+{
+#ifdef BINDLESS
+    GPUMaterial bindlessMaterial = materials[MaterialIndex];
+    if (bindlessMaterial.specularInDiffuseAlpha != 0u)
+        return vec3(DiffuseTexel().a);
+    if (bindlessMaterial.specularLayer >= 0)
+        return vec3(texture(sampler2DArray(bindlessMaterial.specular), vec3(TexCoords, bindlessMaterial.specularLayer)));
+    return vec3(texture(sampler2D(bindlessMaterial.specular), TexCoords));
+#else
+    if (material.specularInDiffuseAlpha)
+        return vec3(DiffuseTexel().a);
+    if (MaterialLayers.y >= 0)
+        return vec3(texture(material.specularArray, vec3(TexCoords, MaterialLayers.y)));
+    return vec3(texture(material.specular, TexCoords));
+#endif
+}
+
+#ifdef LIGHTS_SSBO
+DirLight UnpackDirLight(GPULight light)
+{
+    return DirLight(light.directionLinear.xyz, light.ambientQuadratic.rgb, light.diffuseCutOff.rgb, light.specularOuterCutOff.rgb);
+}
+
+PointLight UnpackPointLight(GPULight light)
+{
+    return PointLight(light.positionConstant.xyz, light.positionConstant.w, light.directionLinear.w, light.ambientQuadratic.w,
+        light.ambientQuadratic.rgb, light.diffuseCutOff.rgb, light.specularOuterCutOff.rgb);
+}
+
+SpotLight UnpackSpotLight(GPULight light)
+{
+    return SpotLight(light.positionConstant.xyz, light.directionLinear.xyz, light.diffuseCutOff.w, light.specularOuterCutOff.w,
+        light.positionConstant.w, light.directionLinear.w, light.ambientQuadratic.w,
+        light.ambientQuadratic.rgb, light.diffuseCutOff.rgb, light.specularOuterCutOff.rgb);
+}
+#endif
+
+#ifdef MANY_LIGHTS
+float Random()
+{
+    // PCG hash of the running state
+    rngState = rngState * 747796405u + 2891336453u;
+    uint word = ((rngState >> ((rngState >> 28u) + 4u)) ^ rngState) * 277803737u;
+    return float(((word >> 22u) ^ word) >> 8u) / 16777216.0;
+}
+
+// cheap unshadowed estimate of what a point light adds here, the target of the resampling
+float LightTarget(uint index, vec3 normal, vec3 fragPos)
+{
+    GPULight light = pointLightBuffer[index];
+    vec3 toLight = light.positionConstant.xyz - fragPos;
+    float lightDistance = length(toLight);
+    float attenuation = 1.0 / (light.positionConstant.w + light.directionLinear.w * lightDistance + light.ambientQuadratic.w * (lightDistance * lightDistance));
+    vec3 radiance = light.ambientQuadratic.rgb + light.diffuseCutOff.rgb * max(dot(normal, toLight / lightDistance), 0.0);
+    return dot(radiance, vec3(0.2126, 0.7152, 0.0722)) * attenuation;
+}
+
+// a reservoir from last frame can be reused if it was on (nearly) the same surface
+bool CanReuse(Reservoir reservoir, vec3 normal, vec3 fragPos)
+{
+    return reservoir.historyCount.a > 0.0
+        && floatBitsToUint(reservoir.positionLight.w) < uint(pointLightCount)
+        && dot(reservoir.normalWeight.xyz, normal) > 0.9
+        && abs(dot(reservoir.positionLight.xyz - fragPos, normal)) < 0.05;
+}
+
+// picks one point light by resampling a fixed number of candidates, so the cost doesn't
+// depend on how many lights there are, and returns its contribution weighted by 1 / pdf
+vec3 SamplePointLights(vec3 normal, vec3 fragPos, vec3 viewDir)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    int pixelIndex = pixel.y * screenWidth + pixel.x;
+    rngState = uint(pixelIndex) * 9781u + uint(frameIndex) * 6271u;
+    Random();
+
+    uint lightCount = uint(pointLightCount);
+    uint chosen = 0u;
+    float chosenTarget = 0.0;
+    float weightSum = 0.0;
+    float count = 0.0;
+    vec3 history = vec3(0.0);
+    float historyCount = 0.0;
+    if (lightCount == 0u)
+        return vec3(0.0);
+
+    // 1. new candidates, drawn in proportion to the lights' brightness
+    for (int i = 0; i < lightSampleCount; i++)
+    {
+        uint bin = min(uint(Random() * float(lightCount)), lightCount - 1u);
+        uint candidate = Random() < aliasTable[bin].probability ? bin : aliasTable[bin].alias;
+        float target = LightTarget(candidate, normal, fragPos);
+        // the table never picks a light of pdf 0, but a 0 / 0 would poison the whole reservoir
+        float pdf = aliasTable[candidate].pdf;
+        float weight = pdf > 0.0 ? target / pdf : 0.0;
+        weightSum += weight;
+        if (Random() * weightSum < weight)
+        {
+            chosen = candidate;
+            chosenTarget = target;
+        }
+    }
+    count = float(lightSampleCount);
+
+    // 2. merge last frame's reservoir of this point (temporal) and of a few neighbours (spatial)
+    vec4 previousClip = previousViewProjection * vec4(fragPos, 1.0);
+    if (reuseReservoirs && previousClip.w > 0.0)
+    {
+        vec2 previousPixel = (previousClip.xy / previousClip.w * 0.5 + 0.5) * vec2(screenWidth, screenHeight);
+        vec3 neighbourHistory = vec3(0.0);
+        float neighbourCount = 0.0;
+        for (int i = 0; i <= spatialSampleCount; i++)
+        {
+            vec2 offset = vec2(0.0);
+            if (i > 0)
+            {
+                float angle = Random() * 6.2831853;
+                offset = vec2(cos(angle), sin(angle)) * (spatialRadius * sqrt(Random()));
+            }
+            ivec2 tap = ivec2(previousPixel + offset);
+            if (tap.x < 0 || tap.y < 0 || tap.x >= screenWidth || tap.y >= screenHeight)
+                continue;
+
+            Reservoir previous = previousReservoirs[tap.y * screenWidth + tap.x];
+            if (!CanReuse(previous, normal, fragPos))
+                continue;
+
+            // the capped M keeps stale samples from dominating forever
+            float previousCount = min(previous.historyCount.a, float(maxConfidence));
+            uint candidate = floatBitsToUint(previous.positionLight.w);
+            float target = LightTarget(candidate, normal, fragPos);
+            float weight = target * previous.normalWeight.w * previousCount;
+            weightSum += weight;
+            count += previousCount;
+            if (Random() * weightSum < weight)
+            {
+                chosen = candidate;
+                chosenTarget = target;
+            }
+
+            if (i == 0)
+            {
+                history = previous.historyCount.rgb;
+                historyCount = previousCount;
+            }
+            else
+            {
+                neighbourHistory += previous.historyCount.rgb;
+                neighbourCount += 1.0;
+            }
+        }
+
+        // disoccluded: nothing to accumulate on, start from the neighbours' average instead
+        if (historyCount == 0.0 && neighbourCount > 0.0)
+        {
+            history = neighbourHistory / neighbourCount;
+            historyCount = float(lightSampleCount);
+        }
+    }
+
+    // 3. shade the survivor only
+    float contributionWeight = chosenTarget > 0.0 ? weightSum / (count * chosenTarget) : 0.0;
+    vec3 color = vec3(0.0);
+    if (contributionWeight > 0.0)
+        color = CalcPointLight(UnpackPointLight(pointLightBuffer[chosen]), normal, fragPos, viewDir) * contributionWeight;
+
+    // 4. denoise with a moving average over the reprojected history, about as long as M
+    float frames = historyCount / float(lightSampleCount);
+    color = mix(history, color, 1.0 / (frames + 1.0));
+
+    // the only fragment of this pixel that gets here, see the early tests above
+    count = min(count, float(maxConfidence));
+    currentReservoirs[pixelIndex] = Reservoir(vec4(fragPos, uintBitsToFloat(chosen)), vec4(normal, contributionWeight), vec4(color, count));
+    return color;
+}
+#endif
+
+#ifdef PBR
+// Cook-Torrance with a GGX distribution, Smith/Schlick-GGX geometry and Schlick's Fresnel.
+// The Phong light colors are pre-divided by pi (they scale the diffuse map directly), so the
+// Lambert term gets no 1/pi either and a light looks equally bright in both modes.
+vec3 CookTorrance(vec3 normal, vec3 viewDir, vec3 lightDir, vec3 radiance)
+{
+    float NdotL = max(dot(normal, lightDir), 0.0);
+    if (NdotL <= 0.0)
+        return vec3(0.0);
+    vec3 halfway = normalize(viewDir + lightDir);
+    float NdotV = max(dot(normal, viewDir), 0.0001);
+    float NdotH = max(dot(normal, halfway), 0.0);
+
+    float a = surfaceRoughness * surfaceRoughness;
+    float a2 = a * a;
+    float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+    float D = a2 / (PI * d * d);
+
+    float k = (surfaceRoughness + 1.0) * (surfaceRoughness + 1.0) / 8.0;
+    float G = (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+
+    // (1 - cos)^5 with multiplies instead of pow()
+    float f = 1.0 - max(dot(halfway, viewDir), 0.0);
+    float f2 = f * f;
+    vec3 F = surfaceF0 + (1.0 - surfaceF0) * (f2 * f2 * f);
+
+    vec3 specular = D * G * F / (4.0 * NdotV * NdotL) * PI;
+    vec3 kD = (1.0 - F) * (1.0 - surfaceMetallic);
+    return (kD * surfaceAlbedo + specular) * radiance * NdotL;
+}
+
+// split sum image based lighting: one prefiltered environment fetch and one BRDF LUT fetch
+vec3 CalcIBL(vec3 normal, vec3 viewDir, vec3 irradiance)
+{
+    float NdotV = max(dot(normal, viewDir), 0.0);
+    float f = 1.0 - NdotV;
+    float f2 = f * f;
+    vec3 F = surfaceF0 + (max(vec3(1.0 - surfaceRoughness), surfaceF0) - surfaceF0) * (f2 * f2 * f);
+
+    vec3 prefiltered = textureLod(prefilterMap, reflect(-viewDir, normal), surfaceRoughness * prefilterMaxLod).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(NdotV, surfaceRoughness)).rg;
+    vec3 specular = prefiltered * (F * brdf.x + brdf.y);
+
+    vec3 kD = (1.0 - F) * (1.0 - surfaceMetallic);
+    return kD * surfaceAlbedo * irradiance + specular;
+}
+#endif
\ No newline at end of file
@@ -2,24 +2,55 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per instance: one cube drawn with glDrawArraysInstanced, or constant attributes when
+// each cube is drawn on its own
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in ivec2 aMaterialLayers; // diffuse and specular array layers, -1 for the 2D maps
+layout (location = 8) in int aLightmapTileBase;
+layout (location = 9) in int aMaterialIndex; // into the material table of the BINDLESS variant
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
+out vec2 LightmapCoords;
+flat out ivec2 MaterialLayers;
+flat out int MaterialIndex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// published once a frame by CameraBuffer.h
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	mat4 inverseView;
+	mat4 inverseProjection;
+	mat4 inverseViewProjection;
+	vec4 position;
+} camera;
+
+// lightmap atlas layout (see LightmapBaker.h); every face of the cube has its own tile
+uniform int lightmapTilesPerRow;
+uniform float lightmapTileSize;
+
+// the same position as the depth prepass (depth_prepass.vs), the lit pass tests GL_EQUAL against it
+invariant gl_Position;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
-	FragPos = vec3(model * vec4(aPos, 1.0));
+	gl_Position = camera.viewProjection * aModel * vec4(aPos, 1.0);
+	FragPos = vec3(aModel * vec4(aPos, 1.0));
 
 	// This should not be done here, since this operation
 	// is costly. That said, there is currently no way to do this outside
 	// of the shader, since the normal data is hard-coded.
 
-	Normal = mat3(transpose(inverse(model))) * aNormal;
+	Normal = mat3(transpose(inverse(aModel))) * aNormal;
 	TexCoords = aTexCoords;
+	MaterialLayers = aMaterialLayers;
+
+	// 6 vertices per face, so the face index comes straight from the vertex id
+	int tile = aLightmapTileBase + gl_VertexID / 6;
+	vec2 tileOrigin = vec2(tile % lightmapTilesPerRow, tile / lightmapTilesPerRow) * lightmapTileSize;
+	float atlasSize = lightmapTilesPerRow * lightmapTileSize;
+	// the baked texels sit on the face edges, so stay between the first and last texel centers
+	LightmapCoords = (tileOrigin + 0.5 + aTexCoords * (lightmapTileSize - 1.0)) / atlasSize;
 }
\ No newline at end of file
@@ -1,9 +1,24 @@
 #version 330 core
 
 out vec4 FragColor;
-  
+
+// the part of the 4x4 ordered dither this draw covers, [0, 1) for all of it; a LOD fading in
+// and the one fading out get the two sides of the same split
+uniform vec2 ditherRange;
+
+const float bayer[16] = float[16](
+	0.0, 8.0, 2.0, 10.0,
+	12.0, 4.0, 14.0, 6.0,
+	3.0, 11.0, 1.0, 9.0,
+	15.0, 7.0, 13.0, 5.0);
+
 void main()
 {
+	ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+	float dither = (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+	if (dither < ditherRange.x || dither >= ditherRange.y)
+		discard;
+
     // Light green
 	FragColor = vec4(vec3(0.0, 0.2, 0.0), 1.0);
-}
\ No newline at end of file
+}
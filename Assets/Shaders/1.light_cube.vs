@@ -2,12 +2,21 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// published once a frame by CameraBuffer.h
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	mat4 inverseView;
+	mat4 inverseProjection;
+	mat4 inverseViewProjection;
+	vec4 position;
+} camera;
 
 out vec4 pos;
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = camera.viewProjection * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,5 @@
+#version 330 core
+// depth only, the color writes are masked off during the prepass
+void main()
+{
+}
@@ -0,0 +1,23 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// the model matrix comes in the same attributes as in 1.colors.vs, so its VAOs draw both
+layout (location = 3) in mat4 aModel;
+
+// published once a frame by CameraBuffer.h
+layout (std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	mat4 inverseView;
+	mat4 inverseProjection;
+	mat4 inverseViewProjection;
+	vec4 position;
+} camera;
+
+// the lit pass tests GL_EQUAL against this depth, both have to end up at the very same positions
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = camera.viewProjection * aModel * vec4(aPos, 1.0);
+}
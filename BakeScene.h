@@ -0,0 +1,129 @@
+#ifndef BAKE_SCENE_H
+#define BAKE_SCENE_H
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// small per-task random generator, good enough for sampling directions
+struct BakeRandom {
+	uint32_t state;
+	float next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+inline glm::vec3 cosineSampleHemisphere(const glm::vec3& normal, float r1, float r2)
+{
+	float phi = 6.28318531f * r1;
+	float radius = std::sqrt(r2);
+	glm::vec3 tangent = std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	tangent = glm::normalize(glm::cross(tangent, normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+	return glm::normalize(tangent * (radius * std::cos(phi)) + bitangent * (radius * std::sin(phi)) + normal * std::sqrt(1.0f - r2));
+}
+
+inline glm::vec3 uniformSampleSphere(float r1, float r2)
+{
+	float z = 1.0f - 2.0f * r2;
+	float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+	float phi = 6.28318531f * r1;
+	return glm::vec3(radius * std::cos(phi), radius * std::sin(phi), z);
+}
+
+// The static scene from Scene.h in world space, ready to be ray traced by the offline bakers.
+class BakeScene
+{
+    public:
+	void build()
+	{
+		std::vector<glm::vec3> positions;
+		positions.reserve(NR_CUBES * CUBE_VERTEX_COUNT);
+		triangleNormals.clear();
+
+		for (unsigned int cube = 0; cube < NR_CUBES; cube++)
+		{
+			glm::mat4 model = cubeModelMatrix(cube);
+			glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+
+			for (unsigned int vertex = 0; vertex < CUBE_VERTEX_COUNT; vertex++)
+			{
+				const float* v = &cubeVertices[vertex * CUBE_VERTEX_STRIDE];
+				positions.push_back(glm::vec3(model * glm::vec4(v[0], v[1], v[2], 1.0f)));
+				if (vertex % 3 == 0)
+					triangleNormals.push_back(glm::normalize(normalMatrix * glm::vec3(v[3], v[4], v[5])));
+			}
+		}
+
+		bvh.build(positions);
+	}
+
+	// direct diffuse irradiance from the static lights, mirroring CalcDirLight/CalcPointLight
+	glm::vec3 directLight(const glm::vec3& position, const glm::vec3& normal, bool withAmbient, uint64_t& rays) const
+	{
+		const float bias = 1e-3f;
+		glm::vec3 origin = position + normal * bias;
+		glm::vec3 result(0.0f);
+
+		glm::vec3 lightDir = glm::normalize(-DIR_LIGHT_DIRECTION);
+		if (withAmbient)
+			result += DIR_LIGHT_AMBIENT;
+		float diff = glm::max(glm::dot(normal, lightDir), 0.0f);
+		if (diff > 0.0f)
+		{
+			rays++;
+			if (!bvh.occluded(origin, lightDir, 0.0f, FLT_MAX))
+				result += DIR_LIGHT_DIFFUSE * diff;
+		}
+
+		for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+		{
+			glm::vec3 toLight = pointLightPositions[i] - position;
+			float distance = glm::length(toLight);
+			lightDir = toLight / distance;
+			float attenuation = 1.0f / (POINT_LIGHT_CONSTANT + POINT_LIGHT_LINEAR * distance + POINT_LIGHT_QUADRATIC * (distance * distance));
+			if (withAmbient)
+				result += POINT_LIGHT_AMBIENT * attenuation;
+			diff = glm::max(glm::dot(normal, lightDir), 0.0f);
+			if (diff > 0.0f)
+			{
+				rays++;
+				if (!bvh.occluded(origin, lightDir, 0.0f, distance - bias))
+					result += POINT_LIGHT_DIFFUSE * diff * attenuation;
+			}
+		}
+		return result;
+	}
+
+	// closest surface along the ray; the returned normal faces back towards the ray origin
+	bool trace(const glm::vec3& origin, const glm::vec3& direction, glm::vec3& hitPosition, glm::vec3& hitNormal, uint64_t& rays) const
+	{
+		RayHit hit = {};
+		rays++;
+		if (!bvh.intersect(origin, direction, 0.0f, FLT_MAX, hit))
+			return false;
+
+		hitPosition = origin + direction * hit.t;
+		hitNormal = triangleNormals[hit.triangle];
+		if (glm::dot(hitNormal, direction) > 0.0f)
+			hitNormal = -hitNormal;
+		return true;
+	}
+
+    private:
+	TriangleBVH bvh;
+	std::vector<glm::vec3> triangleNormals;
+};
+
+#endif
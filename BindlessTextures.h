@@ -0,0 +1,58 @@
+#ifndef BINDLESS_TEXTURES_H
+#define BINDLESS_TEXTURES_H
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <unordered_map>
+
+// The resident ARB_bindless_texture handles of textures, one per texture for as long as it
+// lives. A handle stays valid only while its texture does and taking one freezes the
+// texture's state, so whatever deletes or replaces a texture that may have a handle calls
+// retire() first; the TextureCache and TextureArrayPool do when given this object.
+class BindlessTextures
+{
+    public:
+	BindlessTextures()
+	{
+	}
+
+	~BindlessTextures()
+	{
+		for (const std::pair<const unsigned int, GLuint64>& entry : handles)
+			glCaps().MakeTextureHandleNonResidentARB(entry.second);
+	}
+
+	BindlessTextures(const BindlessTextures&) = delete;
+	BindlessTextures& operator=(const BindlessTextures&) = delete;
+
+	// the resident handle of a texture, made on first use
+	GLuint64 handle(unsigned int texture)
+	{
+		std::unordered_map<unsigned int, GLuint64>::iterator found = handles.find(texture);
+		if (found != handles.end())
+			return found->second;
+		GLuint64 handle = glCaps().GetTextureHandleARB(texture);
+		glCaps().MakeTextureHandleResidentARB(handle);
+		handles[texture] = handle;
+		return handle;
+	}
+
+	// the texture is about to be deleted or replaced, its handle must not stay resident
+	void retire(unsigned int texture)
+	{
+		std::unordered_map<unsigned int, GLuint64>::iterator found = handles.find(texture);
+		if (found == handles.end())
+			return;
+		glCaps().MakeTextureHandleNonResidentARB(found->second);
+		handles.erase(found);
+	}
+
+	size_t residentHandles() const { return handles.size(); }
+
+    private:
+	std::unordered_map<unsigned int, GLuint64> handles;
+};
+
+#endif
@@ -4,7 +4,9 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 
+#include <cstdint>
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -21,9 +23,13 @@ const float PITCH = 0.0f;
 const float SPEED = 15.5f; // Changed camera for default values.
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 
 
-// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
+// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL.
+// The matrices are cached: the Process functions only mark them dirty, and they're rebuilt on
+// the first Get after that, once per change instead of every time they're asked for.
 class Camera
 {
     public:
@@ -61,9 +67,45 @@ class Camera
 	}
     
 	// returns the view matrix calculated using Euler Angles and the LookAt Matrix
-	glm::mat4 GetViewMatrix()
+	const glm::mat4& GetViewMatrix() { updateMatrices(); return view; }
+	// the perspective projection of Zoom degrees vertically, see SetPerspective
+	const glm::mat4& GetProjectionMatrix() { updateMatrices(); return projection; }
+	const glm::mat4& GetViewProjectionMatrix() { updateMatrices(); return viewProjection; }
+	const glm::mat4& GetInverseViewMatrix() { updateMatrices(); return inverseView; }
+	const glm::mat4& GetInverseProjectionMatrix() { updateMatrices(); return inverseProjection; }
+	const glm::mat4& GetInverseViewProjectionMatrix() { updateMatrices(); return inverseViewProjection; }
+
+	// changes whenever the matrices do, so whatever mirrors them can tell when it's behind
+	uint64_t GetVersion() { updateMatrices(); return version; }
+
+	void SetPerspective(float aspectRatio, float nearPlane, float farPlane)
+	{
+		aspect = aspectRatio;
+		nearDistance = nearPlane;
+		farDistance = farPlane;
+		projectionDirty = true;
+	}
+
+	float GetAspect() const { return aspect; }
+
+	// the ray through a point of the screen, in normalized device coordinates (-1 to 1, y up):
+	// from where it crosses the near plane, with a unit direction, unprojected with the cached
+	// inverse view projection so it matches what was drawn
+	void GetRay(float ndcX, float ndcY, glm::vec3& origin, glm::vec3& direction)
 	{
-		return glm::lookAt(Position, Position + Front, Up);
+		updateMatrices();
+		glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+		glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+		origin = glm::vec3(nearPoint) / nearPoint.w;
+		direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+	}
+
+	// for code writing Position, Yaw, Pitch, WorldUp or Zoom directly; the Process functions
+	// keep the matrices up to date on their own
+	void Invalidate()
+	{
+		updateCameraVectors();
+		projectionDirty = true;
 	}
     
 	// processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
@@ -78,6 +120,7 @@ class Camera
 			Position -= Right * velocity;
 		if (direction == RIGHT)
 			Position += Right * velocity;
+		viewDirty = true;
 	}
     
 	// processes input received from a mouse input system. Expects the offset value in both the x and y direction.
@@ -110,9 +153,44 @@ class Camera
 			Zoom = 1.0f;
 		if (Zoom > 45.0f)
 			Zoom = 45.0f;
+		projectionDirty = true;
 	}
     
     private:
+	float aspect = 1.0f;
+	float nearDistance = NEAR_PLANE;
+	float farDistance = FAR_PLANE;
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::mat4 inverseView;
+	glm::mat4 inverseProjection;
+	glm::mat4 inverseViewProjection;
+	bool viewDirty = true;
+	bool projectionDirty = true;
+	uint64_t version = 0;
+
+	void updateMatrices()
+	{
+		if (!viewDirty && !projectionDirty)
+			return;
+		if (viewDirty)
+		{
+			view = glm::lookAt(Position, Position + Front, Up);
+			inverseView = glm::affineInverse(view);
+		}
+		if (projectionDirty)
+		{
+			projection = glm::perspective(glm::radians(Zoom), aspect, nearDistance, farDistance);
+			inverseProjection = glm::inverse(projection);
+		}
+		viewProjection = projection * view;
+		inverseViewProjection = inverseView * inverseProjection;
+		viewDirty = projectionDirty = false;
+		version++;
+	}
+
 	// calculates the front vector from the Camera's (updated) Euler Angles
 	void updateCameraVectors()
 	{
@@ -125,6 +203,7 @@ class Camera
 		// also re-calculate the Right and Up vector
 		Right = glm::normalize(glm::cross(Front, WorldUp));  // normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
 		Up = glm::normalize(glm::cross(Right, Front));
+		viewDirty = true;
 	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef CAMERA_BUFFER_H
+#define CAMERA_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+
+#include <cstdint>
+
+// uniform buffer binding point of the camera, the one every program reads it from
+const GLuint CAMERA_BLOCK_BINDING = 0;
+
+// matches CameraBlock in the shaders (std140)
+struct CameraBlock {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::mat4 inverseView;
+	glm::mat4 inverseProjection;
+	glm::mat4 inverseViewProjection;
+	glm::vec4 position; // w unused
+};
+
+// The camera's matrices in a uniform buffer on CAMERA_BLOCK_BINDING, published once a frame
+// instead of set as uniforms of every program that draws with them. The programs only have to
+// declare CameraBlock and have it bound (Shader::bindUniformBlock). Nothing is uploaded while
+// the camera's matrices stay what they were at the last publish.
+class CameraBuffer
+{
+    public:
+	CameraBuffer()
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	~CameraBuffer()
+	{
+		glDeleteBuffers(1, &buffer);
+	}
+
+	// binds the buffer and brings it up to date with camera
+	void publish(Camera& camera)
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, buffer);
+		if (&camera == publishedCamera && camera.GetVersion() == publishedVersion)
+			return;
+
+		CameraBlock block;
+		block.view = camera.GetViewMatrix();
+		block.projection = camera.GetProjectionMatrix();
+		block.viewProjection = camera.GetViewProjectionMatrix();
+		block.inverseView = camera.GetInverseViewMatrix();
+		block.inverseProjection = camera.GetInverseProjectionMatrix();
+		block.inverseViewProjection = camera.GetInverseViewProjectionMatrix();
+		block.position = glm::vec4(camera.Position, 1.0f);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		publishedCamera = &camera;
+		publishedVersion = camera.GetVersion();
+		uploads++;
+	}
+
+	uint64_t uploadCount() const { return uploads; }
+
+    private:
+	GLuint buffer = 0;
+	const Camera* publishedCamera = NULL;
+	uint64_t publishedVersion = 0;
+	uint64_t uploads = 0;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#define FRUSTUM_CULLER_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE2
+#include <emmintrin.h>
+#endif
+
+// View frustum culling of bounding boxes and spheres. The bounds are kept as structure of
+// arrays, one array per component, so a plane test reads CULL_LANES objects with one load per
+// component and tests them with a handful of instructions: eight at a time with AVX, four with
+// SSE2, one at a time without either. An object is culled when it lies wholly behind any of the
+// six planes. Every group goes through all six planes and its indices are written without a
+// branch; stopping early when a whole group is out mispredicts more than it saves.
+
+#if defined(FRUSTUM_CULLER_AVX)
+const int CULL_LANES = 8;
+typedef __m256 CullFloats;
+inline CullFloats cullLoad(const float* values) { return _mm256_loadu_ps(values); }
+inline CullFloats cullSplat(float value) { return _mm256_set1_ps(value); }
+inline CullFloats cullAdd(CullFloats a, CullFloats b) { return _mm256_add_ps(a, b); }
+inline CullFloats cullSub(CullFloats a, CullFloats b) { return _mm256_sub_ps(a, b); }
+inline CullFloats cullMul(CullFloats a, CullFloats b) { return _mm256_mul_ps(a, b); }
+inline CullFloats cullMin(CullFloats a, CullFloats b) { return _mm256_min_ps(a, b); }
+inline CullFloats cullMax(CullFloats a, CullFloats b) { return _mm256_max_ps(a, b); }
+inline int cullSignMask(CullFloats values) { return _mm256_movemask_ps(values); }
+#elif defined(FRUSTUM_CULLER_SSE2)
+const int CULL_LANES = 4;
+typedef __m128 CullFloats;
+inline CullFloats cullLoad(const float* values) { return _mm_loadu_ps(values); }
+inline CullFloats cullSplat(float value) { return _mm_set1_ps(value); }
+inline CullFloats cullAdd(CullFloats a, CullFloats b) { return _mm_add_ps(a, b); }
+inline CullFloats cullSub(CullFloats a, CullFloats b) { return _mm_sub_ps(a, b); }
+inline CullFloats cullMul(CullFloats a, CullFloats b) { return _mm_mul_ps(a, b); }
+inline CullFloats cullMin(CullFloats a, CullFloats b) { return _mm_min_ps(a, b); }
+inline CullFloats cullMax(CullFloats a, CullFloats b) { return _mm_max_ps(a, b); }
+inline int cullSignMask(CullFloats values) { return _mm_movemask_ps(values); }
+#else
+const int CULL_LANES = 1;
+#endif
+
+// six planes (normal, distance) facing inwards: a point p is inside when dot(normal, p) + distance >= 0
+struct Frustum {
+	glm::vec4 planes[6]; // left, right, bottom, top, near, far
+};
+
+// the planes of a projection * view matrix, in world space (Gribb and Hartmann); normalized,
+// so a sphere's radius compares against the plane distance directly
+inline Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; row++)
+		rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+
+	Frustum frustum;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		frustum.planes[axis * 2] = rows[3] + rows[axis];
+		frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+	}
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+// axis aligned bounding boxes as centers and half extents
+struct CullBoxes {
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	size_t size() const { return centerX.size(); }
+
+	void clear()
+	{
+		centerX.clear(), centerY.clear(), centerZ.clear();
+		extentX.clear(), extentY.clear(), extentZ.clear();
+	}
+
+	void add(const glm::vec3& center, const glm::vec3& extent)
+	{
+		centerX.push_back(center.x), centerY.push_back(center.y), centerZ.push_back(center.z);
+		extentX.push_back(extent.x), extentY.push_back(extent.y), extentZ.push_back(extent.z);
+	}
+
+	// the world box around a box of the given half extents centered on the model's origin
+	void add(const glm::mat4& model, const glm::vec3& localExtent)
+	{
+		glm::vec3 extent(0.0f);
+		for (int column = 0; column < 3; column++)
+			extent += glm::abs(glm::vec3(model[column])) * localExtent[column];
+		add(glm::vec3(model[3]), extent);
+	}
+};
+
+struct CullSpheres {
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> radius;
+
+	size_t size() const { return centerX.size(); }
+
+	void clear()
+	{
+		centerX.clear(), centerY.clear(), centerZ.clear();
+		radius.clear();
+	}
+
+	void add(const glm::vec3& center, float sphereRadius)
+	{
+		centerX.push_back(center.x), centerY.push_back(center.y), centerZ.push_back(center.z);
+		radius.push_back(sphereRadius);
+	}
+};
+
+inline bool boxOutside(const Frustum& frustum, const CullBoxes& boxes, size_t i)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		float distance = plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i] + plane.z * boxes.centerZ[i] + plane.w;
+		float reach = std::fabs(plane.x) * boxes.extentX[i] + std::fabs(plane.y) * boxes.extentY[i] + std::fabs(plane.z) * boxes.extentZ[i];
+		if (distance + reach < 0.0f)
+			return true;
+	}
+	return false;
+}
+
+inline bool sphereOutside(const Frustum& frustum, const CullSpheres& spheres, size_t i)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		if (plane.x * spheres.centerX[i] + plane.y * spheres.centerY[i] + plane.z * spheres.centerZ[i] + plane.w + spheres.radius[i] < 0.0f)
+			return true;
+	}
+	return false;
+}
+
+// visible needs CULL_LANES entries of room past the last object, the indices are written
+// without branching on the result; it's only ever grown, so it can be kept across frames
+inline void reserveVisible(std::vector<uint32_t>& visible, size_t count)
+{
+	if (visible.size() < count + CULL_LANES)
+		visible.resize(count + CULL_LANES);
+}
+
+// writes the indices of the boxes inside or crossing the frustum to the front of visible, in
+// order, and returns how many there are
+inline size_t cullBoxes(const Frustum& frustum, const CullBoxes& boxes, std::vector<uint32_t>& visible)
+{
+	size_t count = boxes.size();
+	reserveVisible(visible, count);
+	size_t visibleCount = 0;
+	size_t i = 0;
+#if defined(FRUSTUM_CULLER_AVX) || defined(FRUSTUM_CULLER_SSE2)
+	// a box is outside a plane when its center is farther behind it than the box reaches,
+	// measured along the normal: dot(normal, center) + distance + dot(abs(normal), extent) < 0
+	CullFloats normalX[6], normalY[6], normalZ[6], distance[6], absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		normalX[p] = cullSplat(plane.x), normalY[p] = cullSplat(plane.y), normalZ[p] = cullSplat(plane.z);
+		distance[p] = cullSplat(plane.w);
+		absX[p] = cullSplat(std::fabs(plane.x)), absY[p] = cullSplat(std::fabs(plane.y)), absZ[p] = cullSplat(std::fabs(plane.z));
+	}
+	for (; i + CULL_LANES <= count; i += CULL_LANES)
+	{
+		CullFloats x = cullLoad(&boxes.centerX[i]), y = cullLoad(&boxes.centerY[i]), z = cullLoad(&boxes.centerZ[i]);
+		CullFloats ex = cullLoad(&boxes.extentX[i]), ey = cullLoad(&boxes.extentY[i]), ez = cullLoad(&boxes.extentZ[i]);
+		int outside = 0;
+		for (int p = 0; p < 6; p++)
+		{
+			CullFloats along = cullAdd(cullAdd(cullMul(normalX[p], x), cullMul(normalY[p], y)), cullAdd(cullMul(normalZ[p], z), distance[p]));
+			CullFloats reach = cullAdd(cullAdd(cullMul(absX[p], ex), cullMul(absY[p], ey)), cullMul(absZ[p], ez));
+			outside |= cullSignMask(cullAdd(along, reach));
+		}
+		for (int lane = 0; lane < CULL_LANES; lane++)
+		{
+			visible[visibleCount] = static_cast<uint32_t>(i + lane);
+			visibleCount += ((outside >> lane) & 1) ^ 1;
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		if (!boxOutside(frustum, boxes, i))
+			visible[visibleCount++] = static_cast<uint32_t>(i);
+	}
+	return visibleCount;
+}
+
+// cullBoxes for spheres: outside a plane when dot(normal, center) + distance + radius < 0
+inline size_t cullSpheres(const Frustum& frustum, const CullSpheres& spheres, std::vector<uint32_t>& visible)
+{
+	size_t count = spheres.size();
+	reserveVisible(visible, count);
+	size_t visibleCount = 0;
+	size_t i = 0;
+#if defined(FRUSTUM_CULLER_AVX) || defined(FRUSTUM_CULLER_SSE2)
+	CullFloats normalX[6], normalY[6], normalZ[6], distance[6];
+	for (int p = 0; p < 6; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		normalX[p] = cullSplat(plane.x), normalY[p] = cullSplat(plane.y), normalZ[p] = cullSplat(plane.z);
+		distance[p] = cullSplat(plane.w);
+	}
+	for (; i + CULL_LANES <= count; i += CULL_LANES)
+	{
+		CullFloats x = cullLoad(&spheres.centerX[i]), y = cullLoad(&spheres.centerY[i]), z = cullLoad(&spheres.centerZ[i]);
+		CullFloats radius = cullLoad(&spheres.radius[i]);
+		int outside = 0;
+		for (int p = 0; p < 6; p++)
+		{
+			CullFloats along = cullAdd(cullAdd(cullMul(normalX[p], x), cullMul(normalY[p], y)), cullAdd(cullMul(normalZ[p], z), distance[p]));
+			outside |= cullSignMask(cullAdd(along, radius));
+		}
+		for (int lane = 0; lane < CULL_LANES; lane++)
+		{
+			visible[visibleCount] = static_cast<uint32_t>(i + lane);
+			visibleCount += ((outside >> lane) & 1) ^ 1;
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		if (!sphereOutside(frustum, spheres, i))
+			visible[visibleCount++] = static_cast<uint32_t>(i);
+	}
+	return visibleCount;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad was generated for plain GL 3.3 core, so anything newer the renderer can use when the
+// driver offers it is declared and loaded here. Every feature has a flag in GLCapabilities;
+// callers check it and fall back to the 3.3 path when it's missing.
+
+// GL 4.3 / ARB_shader_storage_buffer_object
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_SHADER_STORAGE_BLOCK
+#define GL_SHADER_STORAGE_BLOCK 0x92E6
+#endif
+#ifndef GL_INVALID_INDEX
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+
+// GL 4.2 / ARB_shader_image_load_store
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+#ifndef GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+
+// GL 4.3 / ARB_compute_shader
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+
+// GL 4.0 / ARB_draw_indirect
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// EXT_texture_compression_s3tc (+ EXT_texture_sRGB) and GL 4.2 / ARB_texture_compression_bptc;
+// RGTC (BC4/BC5) is core in 3.3
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+typedef GLuint (APIENTRYP PFNGLGETPROGRAMRESOURCEINDEXPROC)(GLuint program, GLenum programInterface, const GLchar* name);
+typedef void (APIENTRYP PFNGLSHADERSTORAGEBLOCKBINDINGPROC)(GLuint program, GLuint storageBlockIndex, GLuint storageBlockBinding);
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void (APIENTRYP PFNGLBINDIMAGETEXTUREPROC)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer, GLenum access, GLenum format);
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+typedef void (APIENTRYP PFNGLDRAWARRAYSINDIRECTPROC)(GLenum mode, const void* indirect);
+typedef void (APIENTRYP PFNGLCOPYIMAGESUBDATAPROC)(GLuint srcName, GLenum srcTarget, GLint srcLevel, GLint srcX, GLint srcY, GLint srcZ,
+	GLuint dstName, GLenum dstTarget, GLint dstLevel, GLint dstX, GLint dstY, GLint dstZ, GLsizei srcWidth, GLsizei srcHeight, GLsizei srcDepth);
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+struct GLCapabilities {
+	int major = 3;
+	int minor = 3;
+	bool shaderStorage = false; // SSBOs, GL 4.3 or ARB_shader_storage_buffer_object
+	bool imageLoadStore = false; // early_fragment_tests, images and glMemoryBarrier, GL 4.2 or ARB_shader_image_load_store
+	bool computeShader = false; // GL 4.3 or ARB_compute_shader
+	bool drawIndirect = false; // glDrawArraysIndirect, GL 4.0 or ARB_draw_indirect
+	bool baseInstance = false; // the indirect commands' baseInstance is honoured, GL 4.2 or ARB_base_instance
+	bool textureCompressionS3TC = false; // BC1, EXT_texture_compression_s3tc (not core in any version)
+	bool textureCompressionBPTC = false; // BC7, GL 4.2 or ARB_texture_compression_bptc
+	bool copyImage = false; // glCopyImageSubData, GL 4.3 or ARB_copy_image
+	bool bindlessTexture = false; // texture handles, ARB_bindless_texture (not core in any version)
+
+	// entry points, only valid when the matching flag is set
+	PFNGLGETPROGRAMRESOURCEINDEXPROC GetProgramResourceIndex = NULL;
+	PFNGLSHADERSTORAGEBLOCKBINDINGPROC ShaderStorageBlockBinding = NULL;
+	PFNGLMEMORYBARRIERPROC MemoryBarrierGL = NULL; // plain MemoryBarrier is a macro in winnt.h
+	PFNGLBINDIMAGETEXTUREPROC BindImageTexture = NULL;
+	PFNGLDISPATCHCOMPUTEPROC DispatchCompute = NULL;
+	PFNGLDRAWARRAYSINDIRECTPROC DrawArraysIndirect = NULL;
+	PFNGLCOPYIMAGESUBDATAPROC CopyImageSubData = NULL;
+	PFNGLGETTEXTUREHANDLEARBPROC GetTextureHandleARB = NULL;
+	PFNGLMAKETEXTUREHANDLERESIDENTARBPROC MakeTextureHandleResidentARB = NULL;
+	PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC MakeTextureHandleNonResidentARB = NULL;
+};
+
+// the capabilities of the current context, filled in by loadGLExtensions
+inline GLCapabilities& glCaps()
+{
+	static GLCapabilities capabilities;
+	return capabilities;
+}
+
+inline bool hasGLExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension && std::strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+inline bool hasGLVersion(int major, int minor)
+{
+	const GLCapabilities& caps = glCaps();
+	return caps.major > major || (caps.major == major && caps.minor >= minor);
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void loadGLExtensions(GLADloadproc load)
+{
+	GLCapabilities& caps = glCaps();
+	glGetIntegerv(GL_MAJOR_VERSION, &caps.major);
+	glGetIntegerv(GL_MINOR_VERSION, &caps.minor);
+
+	if (hasGLVersion(4, 3) || hasGLExtension("GL_ARB_shader_storage_buffer_object"))
+	{
+		caps.GetProgramResourceIndex = reinterpret_cast<PFNGLGETPROGRAMRESOURCEINDEXPROC>(load("glGetProgramResourceIndex"));
+		caps.ShaderStorageBlockBinding = reinterpret_cast<PFNGLSHADERSTORAGEBLOCKBINDINGPROC>(load("glShaderStorageBlockBinding"));
+		caps.shaderStorage = caps.GetProgramResourceIndex && caps.ShaderStorageBlockBinding;
+	}
+
+	if (hasGLVersion(4, 2) || hasGLExtension("GL_ARB_shader_image_load_store"))
+	{
+		caps.MemoryBarrierGL = reinterpret_cast<PFNGLMEMORYBARRIERPROC>(load("glMemoryBarrier"));
+		caps.BindImageTexture = reinterpret_cast<PFNGLBINDIMAGETEXTUREPROC>(load("glBindImageTexture"));
+		caps.imageLoadStore = caps.MemoryBarrierGL && caps.BindImageTexture;
+	}
+
+	if (hasGLVersion(4, 3) || hasGLExtension("GL_ARB_compute_shader"))
+	{
+		caps.DispatchCompute = reinterpret_cast<PFNGLDISPATCHCOMPUTEPROC>(load("glDispatchCompute"));
+		caps.computeShader = caps.DispatchCompute != NULL;
+	}
+
+	if (hasGLVersion(4, 0) || hasGLExtension("GL_ARB_draw_indirect"))
+	{
+		caps.DrawArraysIndirect = reinterpret_cast<PFNGLDRAWARRAYSINDIRECTPROC>(load("glDrawArraysIndirect"));
+		caps.drawIndirect = caps.DrawArraysIndirect != NULL;
+	}
+
+	if (hasGLVersion(4, 3) || hasGLExtension("GL_ARB_copy_image"))
+	{
+		caps.CopyImageSubData = reinterpret_cast<PFNGLCOPYIMAGESUBDATAPROC>(load("glCopyImageSubData"));
+		caps.copyImage = caps.CopyImageSubData != NULL;
+	}
+
+	// the extension is written against GL 4.0 / GLSL 4.00
+	if (hasGLVersion(4, 0) && hasGLExtension("GL_ARB_bindless_texture"))
+	{
+		caps.GetTextureHandleARB = reinterpret_cast<PFNGLGETTEXTUREHANDLEARBPROC>(load("glGetTextureHandleARB"));
+		caps.MakeTextureHandleResidentARB = reinterpret_cast<PFNGLMAKETEXTUREHANDLERESIDENTARBPROC>(load("glMakeTextureHandleResidentARB"));
+		caps.MakeTextureHandleNonResidentARB = reinterpret_cast<PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC>(load("glMakeTextureHandleNonResidentARB"));
+		caps.bindlessTexture = caps.GetTextureHandleARB && caps.MakeTextureHandleResidentARB && caps.MakeTextureHandleNonResidentARB;
+	}
+
+	// format-only extensions, no entry points to load
+	caps.textureCompressionS3TC = hasGLExtension("GL_EXT_texture_compression_s3tc");
+	caps.textureCompressionBPTC = hasGLVersion(4, 2) || hasGLExtension("GL_ARB_texture_compression_bptc");
+	caps.baseInstance = hasGLVersion(4, 2) || hasGLExtension("GL_ARB_base_instance");
+}
+
+#endif
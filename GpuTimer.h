@@ -0,0 +1,94 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// Measures the GPU time and the number of fragments (samples that passed the depth test)
+// of a range of draw calls. Queries are kept in a small ring and read back a few frames
+// later, so measuring never stalls the pipeline waiting for the GPU.
+class GpuTimer
+{
+    public:
+	GpuTimer()
+	{
+		glGenQueries(QUERY_DEPTH, timeQueries);
+		glGenQueries(QUERY_DEPTH, sampleQueries);
+	}
+
+	~GpuTimer()
+	{
+		glDeleteQueries(QUERY_DEPTH, timeQueries);
+		glDeleteQueries(QUERY_DEPTH, sampleQueries);
+	}
+
+	// GL only allows one active query per target, so timers can't be nested
+	void begin()
+	{
+		collect();
+		glBeginQuery(GL_TIME_ELAPSED, timeQueries[head]);
+		glBeginQuery(GL_SAMPLES_PASSED, sampleQueries[head]);
+	}
+
+	void end()
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		glEndQuery(GL_TIME_ELAPSED);
+		head = (head + 1) % QUERY_DEPTH;
+		if (pending < QUERY_DEPTH)
+			pending++;
+	}
+
+	// averages since the last reset()
+	double averageMilliseconds() const { return frames > 0 ? totalNanoseconds / 1e6 / frames : 0.0; }
+	double averageFragments() const { return frames > 0 ? double(totalSamples) / frames : 0.0; }
+	double nanosecondsPerFragment() const { return totalSamples > 0 ? double(totalNanoseconds) / totalSamples : 0.0; }
+	uint64_t measuredFrames() const { return frames; }
+
+	void reset()
+	{
+		totalNanoseconds = 0;
+		totalSamples = 0;
+		frames = 0;
+	}
+
+    private:
+	static const unsigned int QUERY_DEPTH = 4;
+
+	GLuint timeQueries[QUERY_DEPTH];
+	GLuint sampleQueries[QUERY_DEPTH];
+	unsigned int head = 0;
+	unsigned int pending = 0;
+
+	uint64_t totalNanoseconds = 0;
+	uint64_t totalSamples = 0;
+	uint64_t frames = 0;
+
+	// reads back every finished query, oldest first
+	void collect()
+	{
+		while (pending > 0)
+		{
+			unsigned int oldest = (head + QUERY_DEPTH - pending) % QUERY_DEPTH;
+			GLint available = 0;
+			glGetQueryObjectiv(timeQueries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+			{
+				// the ring is full, the oldest query has to be waited for before it's reused
+				if (pending < QUERY_DEPTH)
+					break;
+			}
+
+			GLuint64 nanoseconds = 0, samples = 0;
+			glGetQueryObjectui64v(timeQueries[oldest], GL_QUERY_RESULT, &nanoseconds);
+			glGetQueryObjectui64v(sampleQueries[oldest], GL_QUERY_RESULT, &samples);
+			totalNanoseconds += nanoseconds;
+			totalSamples += samples;
+			frames++;
+			pending--;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef HIZ_CULLER_H
+#define HIZ_CULLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "GLExtensions.h"
+#include "Shader.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// shader storage binding points of the culling program
+const GLuint HIZ_BOUNDS_BINDING = 7;
+const GLuint HIZ_INSTANCE_BINDING = 8;
+const GLuint HIZ_VISIBILITY_BINDING = 9;
+const GLuint HIZ_DRAW_INSTANCE_BINDING = 10;
+const GLuint HIZ_COMMAND_BINDING = 11;
+
+// the pyramid is sampled from this unit, past the ones the lit pass uses
+const GLuint HIZ_TEXTURE_UNIT = 9;
+
+// what the culling did, summed over the frames read back since the last reset
+struct HiZStats {
+	uint64_t frames = 0;
+	uint64_t objects = 0;
+	uint64_t drawnFirst = 0; // visible last frame, drawn before the pyramid was built
+	uint64_t drawnSecond = 0; // disoccluded, drawn after testing against the new pyramid
+	uint64_t outsideFrustum = 0;
+	uint64_t occluded = 0;
+
+	double culledPercent() const { return objects > 0 ? 100.0 * (objects - drawnFirst - drawnSecond) / objects : 0.0; }
+};
+
+// Occlusion culling on the GPU against a hierarchical depth buffer, with no occlusion
+// queries and nothing read back to decide what to draw. Every object's instance goes up each
+// frame and a compute program picks the ones to draw into indirect draw commands, in two
+// phases:
+// 1. whatever was visible last frame (and is in the frustum) is drawn right away,
+// 2. its depth is reduced into a pyramid, each level keeping the farthest depth of the one
+//    below, and every object's box is tested against it: the ones that show but weren't drawn
+//    in phase 1 are drawn now, and what shows is remembered for the next frame.
+// Phase 2 only culls against depth drawn this frame, so nothing visible is ever left out;
+// last frame's visibility only decides which phase draws an object.
+// The depth comes from the default framebuffer with a blit, so its format has to match the
+// window's depth buffer; when the blit fails the pyramid stays at the far plane and only the
+// frustum culls. Needs compute shaders, images and indirect draws with a base instance, see
+// supported().
+class HiZCuller
+{
+    public:
+	// the programs are hiz_cull.comp and hiz_pyramid.comp without and with FROM_DEPTH; the
+	// culler deletes them. instanceSize is the size of one object's instance attributes
+	HiZCuller(Shader* cullProgram, Shader* pyramidProgram, Shader* pyramidFromDepthProgram, size_t instanceSize)
+		: cullProgram(cullProgram), pyramidProgram(pyramidProgram), pyramidFromDepthProgram(pyramidFromDepthProgram), instanceSize(instanceSize)
+	{
+		cullProgram->bindStorageBlock("HiZBounds", HIZ_BOUNDS_BINDING);
+		cullProgram->bindStorageBlock("HiZInstances", HIZ_INSTANCE_BINDING);
+		cullProgram->bindStorageBlock("HiZVisibility", HIZ_VISIBILITY_BINDING);
+		cullProgram->bindStorageBlock("HiZDrawInstances", HIZ_DRAW_INSTANCE_BINDING);
+		cullProgram->bindStorageBlock("HiZCommands", HIZ_COMMAND_BINDING);
+
+		glGenBuffers(1, &boundsBuffer);
+		glGenBuffers(1, &instanceBuffer);
+		glGenBuffers(1, &visibilityBuffer);
+		glGenBuffers(1, &drawInstanceBuffer);
+		glGenBuffers(1, &commandBuffer);
+		glGenBuffers(STATS_DEPTH, statsBuffers);
+		for (unsigned int i = 0; i < STATS_DEPTH; i++)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, statsBuffers[i]);
+			glBufferData(GL_COPY_WRITE_BUFFER, sizeof(Commands), NULL, GL_STREAM_READ);
+			statsFences[i] = NULL;
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(Commands), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glGenFramebuffers(1, &depthFramebuffer);
+	}
+
+	~HiZCuller()
+	{
+		for (unsigned int i = 0; i < STATS_DEPTH; i++)
+		{
+			if (statsFences[i])
+				glDeleteSync(statsFences[i]);
+		}
+		glDeleteBuffers(STATS_DEPTH, statsBuffers);
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteBuffers(1, &drawInstanceBuffer);
+		glDeleteBuffers(1, &visibilityBuffer);
+		glDeleteBuffers(1, &instanceBuffer);
+		glDeleteBuffers(1, &boundsBuffer);
+		glDeleteFramebuffers(1, &depthFramebuffer);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &pyramid);
+		delete cullProgram;
+		delete pyramidProgram;
+		delete pyramidFromDepthProgram;
+	}
+
+	static bool supported()
+	{
+		const GLCapabilities& caps = glCaps();
+		return caps.computeShader && caps.shaderStorage && caps.imageLoadStore && caps.drawIndirect && caps.baseInstance;
+	}
+
+	// the world boxes of the objects, object i's instance being the i-th of draw()'s; resets
+	// what's remembered as visible, the first frame after draws everything in phase 2
+	void setBounds(const CullBoxes& boxes)
+	{
+		objectCount = boxes.size();
+		std::vector<glm::vec4> bounds;
+		for (size_t i = 0; i < objectCount; i++)
+		{
+			bounds.push_back(glm::vec4(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i], 0.0f));
+			bounds.push_back(glm::vec4(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i], 0.0f));
+		}
+		std::vector<uint32_t> visibility(objectCount, 0);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(glm::vec4), bounds.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, objectCount * instanceSize, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, objectCount * sizeof(uint32_t), visibility.data(), GL_DYNAMIC_DRAW);
+		// room for both phases, the second's instances start at objectCount
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawInstanceBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * objectCount * instanceSize, NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// the instances picked for drawing; the instance attributes of the VAO given to draw() read them
+	unsigned int drawInstances() const { return drawInstanceBuffer; }
+
+	// culls and draws the objects in both phases with the current program, the VAO and its
+	// other state set up by the caller; instances holds one per object, vertexCount vertices
+	// of GL_TRIANGLES are drawn per instance. The framebuffer size is the default framebuffer's
+	void draw(GLsizei vertexCount, const glm::mat4& viewProjection, const void* instances, int framebufferWidth, int framebufferHeight)
+	{
+		collect();
+		if (objectCount == 0)
+			return;
+		resize(framebufferWidth, framebufferHeight);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, objectCount * instanceSize, instances);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		Commands commands = {};
+		commands.draws[0].count = commands.draws[1].count = static_cast<GLuint>(vertexCount);
+		commands.draws[1].baseInstance = static_cast<GLuint>(objectCount);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(Commands), &commands);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HIZ_BOUNDS_BINDING, boundsBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HIZ_INSTANCE_BINDING, instanceBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HIZ_VISIBILITY_BINDING, visibilityBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HIZ_DRAW_INSTANCE_BINDING, drawInstanceBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HIZ_COMMAND_BINDING, commandBuffer);
+
+		GLint drawProgram = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &drawProgram);
+
+		// phase 1: last frame's visible objects
+		cull(false, viewProjection);
+		glUseProgram(drawProgram);
+		glCaps().DrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void*>(offsetof(Commands, draws)));
+
+		// phase 2: the pyramid of what's drawn so far, then whatever it doesn't hide that phase 1 missed
+		buildPyramid();
+		cull(true, viewProjection);
+		glUseProgram(drawProgram);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glCaps().DrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void*>(offsetof(Commands, draws) + sizeof(DrawCommand)));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		// the counts go to the stats a few frames later, once the GPU is done with them
+		glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, statsBuffers[statsHead]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(Commands));
+		statsFences[statsHead] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		statsHead = (statsHead + 1) % STATS_DEPTH;
+		if (statsPending < STATS_DEPTH)
+			statsPending++;
+	}
+
+	const HiZStats& stats() const { return totals; }
+	void resetStats() { totals = HiZStats(); }
+	// the pyramid couldn't be built from the window's depth buffer, only the frustum culls
+	bool pyramidFailed() const { return blitFailed; }
+
+    private:
+	static const unsigned int STATS_DEPTH = 4;
+
+	// the layout of HiZCommands in hiz_cull.comp
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+	struct Commands {
+		DrawCommand draws[2];
+		GLuint outsideFrustum;
+		GLuint occluded;
+	};
+
+	Shader* cullProgram;
+	Shader* pyramidProgram;
+	Shader* pyramidFromDepthProgram;
+	size_t instanceSize;
+	size_t objectCount = 0;
+
+	unsigned int boundsBuffer = 0, instanceBuffer = 0, visibilityBuffer = 0, drawInstanceBuffer = 0, commandBuffer = 0;
+	unsigned int depthTexture = 0, depthFramebuffer = 0, pyramid = 0;
+	int depthWidth = 0, depthHeight = 0;
+	std::vector<glm::ivec2> levelSizes;
+	bool blitFailed = false;
+
+	unsigned int statsBuffers[STATS_DEPTH];
+	GLsync statsFences[STATS_DEPTH];
+	unsigned int statsHead = 0;
+	unsigned int statsPending = 0;
+	HiZStats totals;
+
+	static GLuint groups(int count, int groupSize) { return static_cast<GLuint>((count + groupSize - 1) / groupSize); }
+
+	void cull(bool secondPhase, const glm::mat4& viewProjection)
+	{
+		Frustum frustum = extractFrustum(viewProjection);
+		cullProgram->use();
+		cullProgram->setInt("objectCount", static_cast<int>(objectCount));
+		cullProgram->setBool("secondPhase", secondPhase);
+		cullProgram->setMat4("viewProjection", viewProjection);
+		for (int p = 0; p < 6; p++)
+			cullProgram->setVec4("frustumPlanes[" + std::to_string(p) + "]", frustum.planes[p]);
+		if (secondPhase)
+		{
+			glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_2D, pyramid);
+			glActiveTexture(GL_TEXTURE0);
+			cullProgram->setInt("depthPyramid", HIZ_TEXTURE_UNIT);
+			glUniform2i(glGetUniformLocation(cullProgram->ID, "depthSize"), depthWidth, depthHeight);
+			cullProgram->setInt("pyramidLevels", static_cast<int>(levelSizes.size()));
+		}
+		glCaps().DispatchCompute(groups(static_cast<int>(objectCount), 64), 1, 1);
+		glCaps().MemoryBarrierGL(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
+
+	// (re)creates the depth copy and the pyramid for a framebuffer of this size, levels halving
+	// from half its size down to 1x1
+	void resize(int width, int height)
+	{
+		if (width == depthWidth && height == depthHeight)
+			return;
+		depthWidth = width;
+		depthHeight = height;
+
+		// a depth blit needs the same format on both ends
+		GLint depthBits = 24, stencilBits = 8;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+		GLenum internalFormat = GL_DEPTH_COMPONENT24, format = GL_DEPTH_COMPONENT, type = GL_UNSIGNED_INT;
+		if (stencilBits > 0)
+			internalFormat = GL_DEPTH24_STENCIL8, format = GL_DEPTH_STENCIL, type = GL_UNSIGNED_INT_24_8;
+		else if (depthBits == 16)
+			internalFormat = GL_DEPTH_COMPONENT16, type = GL_UNSIGNED_SHORT;
+		else if (depthBits == 32)
+			internalFormat = GL_DEPTH_COMPONENT32F, type = GL_FLOAT;
+
+		// the textures are set up on the culler's own unit, the lit pass keeps its bindings
+		glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+		glDeleteTextures(1, &depthTexture);
+		glGenTextures(1, &depthTexture);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, depthFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, stencilBits > 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		levelSizes.clear();
+		glm::ivec2 size(std::max(width / 2, 1), std::max(height / 2, 1));
+		for (;;)
+		{
+			levelSizes.push_back(size);
+			if (size.x == 1 && size.y == 1)
+				break;
+			size = glm::max(size / 2, glm::ivec2(1));
+		}
+		glDeleteTextures(1, &pyramid);
+		glGenTextures(1, &pyramid);
+		glBindTexture(GL_TEXTURE_2D, pyramid);
+		for (size_t level = 0; level < levelSizes.size(); level++)
+			glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_R32F, levelSizes[level].x, levelSizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levelSizes.size() - 1));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glActiveTexture(GL_TEXTURE0);
+
+		// one blit to see whether the formats match; a failed one would fail every frame
+		while (glGetError() != GL_NO_ERROR)
+			;
+		blitDepth();
+		blitFailed = glGetError() != GL_NO_ERROR;
+		if (blitFailed)
+			std::cout << "Hi-Z culling: the window's depth buffer can't be copied, only the frustum culls" << std::endl;
+	}
+
+	void blitDepth()
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+		glBlitFramebuffer(0, 0, depthWidth, depthHeight, 0, 0, depthWidth, depthHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void buildPyramid()
+	{
+		if (blitFailed)
+		{
+			// all far plane, nothing is occluded
+			glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+			glBindTexture(GL_TEXTURE_2D, pyramid);
+			for (size_t level = 0; level < levelSizes.size(); level++)
+			{
+				std::vector<float> texels(levelSizes[level].x * levelSizes[level].y, 1.0f);
+				glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0, levelSizes[level].x, levelSizes[level].y, GL_RED, GL_FLOAT, texels.data());
+			}
+			glActiveTexture(GL_TEXTURE0);
+			return;
+		}
+
+		blitDepth();
+		glm::ivec2 sourceSize(depthWidth, depthHeight);
+		for (size_t level = 0; level < levelSizes.size(); level++)
+		{
+			Shader* program = level == 0 ? pyramidFromDepthProgram : pyramidProgram;
+			program->use();
+			if (level == 0)
+			{
+				glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+				glBindTexture(GL_TEXTURE_2D, depthTexture);
+				glActiveTexture(GL_TEXTURE0);
+				program->setInt("depthBuffer", HIZ_TEXTURE_UNIT);
+			}
+			else
+			{
+				glCaps().BindImageTexture(0, pyramid, static_cast<GLint>(level - 1), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+				program->setInt("sourceLevel", 0);
+			}
+			glCaps().BindImageTexture(1, pyramid, static_cast<GLint>(level), GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			program->setInt("targetLevel", 1);
+			glUniform2i(glGetUniformLocation(program->ID, "sourceSize"), sourceSize.x, sourceSize.y);
+			glUniform2i(glGetUniformLocation(program->ID, "targetSize"), levelSizes[level].x, levelSizes[level].y);
+			glCaps().DispatchCompute(groups(levelSizes[level].x, 8), groups(levelSizes[level].y, 8), 1);
+			glCaps().MemoryBarrierGL(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+			sourceSize = levelSizes[level];
+		}
+	}
+
+	// sums up every set of counts the GPU has finished, oldest first
+	void collect()
+	{
+		while (statsPending > 0)
+		{
+			unsigned int oldest = (statsHead + STATS_DEPTH - statsPending) % STATS_DEPTH;
+			// the ring is full, the oldest copy has to be waited for before it's reused
+			bool full = statsPending == STATS_DEPTH;
+			GLenum status = glClientWaitSync(statsFences[oldest], full ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, full ? 1000000000 : 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				break;
+			glDeleteSync(statsFences[oldest]);
+			statsFences[oldest] = NULL;
+
+			Commands commands;
+			glBindBuffer(GL_COPY_READ_BUFFER, statsBuffers[oldest]);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(Commands), &commands);
+			totals.frames++;
+			totals.objects += objectCount;
+			totals.drawnFirst += commands.draws[0].instanceCount;
+			totals.drawnSecond += commands.draws[1].instanceCount;
+			totals.outsideFrustum += commands.outsideFrustum;
+			totals.occluded += commands.occluded;
+			statsPending--;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef IBL_BAKER_H
+#define IBL_BAKER_H
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// Offline precomputation for the PBR shading mode's image based lighting (split sum):
+//  - the BRDF LUT: scale and bias applied to F0, indexed by (NdotV, roughness)
+//  - the prefiltered environment: the environment convolved with GGX lobes of increasing
+//    roughness, one roughness per mip level of a cubemap
+// so the fragment shader pays one fetch of each instead of integrating anything.
+
+const uint32_t BRDF_LUT_MAGIC = 0x54554C42; // "BLUT"
+const uint32_t ENVIRONMENT_MAGIC = 0x45564E45; // "ENVE"
+const uint32_t IBL_VERSION = 1;
+
+// followed by size * size RG floats, rows ordered by roughness
+struct BrdfLutHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+};
+
+// followed by every mip level, largest first, each holding the 6 faces in GL order
+// (+X, -X, +Y, -Y, +Z, -Z) of (faceSize >> mip)^2 RGB floats
+struct EnvironmentHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t faceSize;
+	uint32_t mipCount;
+};
+
+const float IBL_PI = 3.14159265f;
+
+inline float radicalInverse(uint32_t bits)
+{
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return float(bits) * 2.3283064365386963e-10f;
+}
+
+// GGX importance sample of the half vector around normal
+inline glm::vec3 importanceSampleGGX(uint32_t i, uint32_t count, const glm::vec3& normal, float roughness)
+{
+	float a = roughness * roughness;
+	float phi = 2.0f * IBL_PI * (i + 0.5f) / count;
+	float xi = radicalInverse(i);
+	float cosTheta = std::sqrt((1.0f - xi) / (1.0f + (a * a - 1.0f) * xi));
+	float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+	glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 tangent = glm::normalize(glm::cross(up, normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+	return glm::normalize(tangent * (std::cos(phi) * sinTheta) + bitangent * (std::sin(phi) * sinTheta) + normal * cosTheta);
+}
+
+// Smith geometry term with the k used for image based lighting
+inline float geometrySmithIBL(float NdotV, float NdotL, float roughness)
+{
+	float k = roughness * roughness / 2.0f;
+	float ggxV = NdotV / (NdotV * (1.0f - k) + k);
+	float ggxL = NdotL / (NdotL * (1.0f - k) + k);
+	return ggxV * ggxL;
+}
+
+// integrates the split sum BRDF term into a size x size RG table
+inline std::vector<glm::vec2> bakeBrdfLut(uint32_t size, uint32_t sampleCount, unsigned int workerCount)
+{
+	std::vector<glm::vec2> lut(size * size);
+	parallelFor(size, 4, workerCount, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t y = begin; y < end; y++)
+		{
+			float roughness = (y + 0.5f) / size;
+			for (uint32_t x = 0; x < size; x++)
+			{
+				float NdotV = (x + 0.5f) / size;
+				glm::vec3 V(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+				glm::vec3 N(0.0f, 0.0f, 1.0f);
+
+				float scale = 0.0f, bias = 0.0f;
+				for (uint32_t i = 0; i < sampleCount; i++)
+				{
+					glm::vec3 H = importanceSampleGGX(i, sampleCount, N, roughness);
+					glm::vec3 L = 2.0f * glm::dot(V, H) * H - V;
+					float NdotL = std::max(L.z, 0.0f);
+					float NdotH = std::max(H.z, 0.0f);
+					float VdotH = std::max(glm::dot(V, H), 0.0f);
+					if (NdotL <= 0.0f)
+						continue;
+
+					float G = geometrySmithIBL(NdotV, NdotL, roughness);
+					float visibility = G * VdotH / (NdotH * NdotV);
+					float fresnel = std::pow(1.0f - VdotH, 5.0f);
+					scale += (1.0f - fresnel) * visibility;
+					bias += fresnel * visibility;
+				}
+				lut[y * size + x] = glm::vec2(scale, bias) / float(sampleCount);
+			}
+		}
+	});
+	return lut;
+}
+
+// The scene has no environment map, so the environment is a procedural sky matching the
+// clear color, brightened around the direction the dirLight comes from.
+inline glm::vec3 environmentRadiance(const glm::vec3& direction)
+{
+	const glm::vec3 ground(0.08f, 0.08f, 0.08f);
+	const glm::vec3 horizon(0.1f, 0.1f, 0.1f);
+	const glm::vec3 zenith(0.15f, 0.17f, 0.22f);
+
+	glm::vec3 sky = direction.y > 0.0f ? glm::mix(horizon, zenith, direction.y) : glm::mix(horizon, ground, std::min(-direction.y * 4.0f, 1.0f));
+	float sun = std::max(glm::dot(direction, glm::normalize(-DIR_LIGHT_DIRECTION)), 0.0f);
+	return sky + DIR_LIGHT_DIFFUSE * (4.0f * std::pow(sun, 256.0f) + 0.5f * std::pow(sun, 8.0f));
+}
+
+// direction through the center of texel (x, y) of a cubemap face, in GL's face orientation
+inline glm::vec3 cubemapDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t size)
+{
+	float u = 2.0f * (x + 0.5f) / size - 1.0f;
+	float v = 2.0f * (y + 0.5f) / size - 1.0f;
+	glm::vec3 direction;
+	switch (face)
+	{
+	case 0: direction = glm::vec3(1.0f, -v, -u); break;
+	case 1: direction = glm::vec3(-1.0f, -v, u); break;
+	case 2: direction = glm::vec3(u, 1.0f, v); break;
+	case 3: direction = glm::vec3(u, -1.0f, -v); break;
+	case 4: direction = glm::vec3(u, -v, 1.0f); break;
+	default: direction = glm::vec3(-u, -v, -1.0f); break;
+	}
+	return glm::normalize(direction);
+}
+
+// prefilters the environment for mip level roughness = mip / (mipCount - 1)
+inline std::vector<glm::vec3> bakePrefilteredEnvironment(uint32_t faceSize, uint32_t mipCount, uint32_t sampleCount, unsigned int workerCount)
+{
+	std::vector<size_t> mipOffsets(mipCount);
+	size_t total = 0;
+	for (uint32_t mip = 0; mip < mipCount; mip++)
+	{
+		uint32_t size = std::max(faceSize >> mip, 1u);
+		mipOffsets[mip] = total;
+		total += 6 * size * size;
+	}
+	std::vector<glm::vec3> texels(total);
+
+	// one task per (mip, face) pair
+	parallelFor(mipCount * 6, 1, workerCount, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t task = begin; task < end; task++)
+		{
+			uint32_t mip = static_cast<uint32_t>(task / 6);
+			uint32_t face = static_cast<uint32_t>(task % 6);
+			uint32_t size = std::max(faceSize >> mip, 1u);
+			float roughness = mipCount > 1 ? mip / float(mipCount - 1) : 0.0f;
+			glm::vec3* out = &texels[mipOffsets[mip] + face * size * size];
+
+			for (uint32_t y = 0; y < size; y++)
+			{
+				for (uint32_t x = 0; x < size; x++)
+				{
+					// the usual N = V = R assumption of the split sum
+					glm::vec3 N = cubemapDirection(face, x, y, size);
+					if (roughness == 0.0f)
+					{
+						out[y * size + x] = environmentRadiance(N);
+						continue;
+					}
+
+					glm::vec3 color(0.0f);
+					float weight = 0.0f;
+					for (uint32_t i = 0; i < sampleCount; i++)
+					{
+						glm::vec3 H = importanceSampleGGX(i, sampleCount, N, roughness);
+						glm::vec3 L = 2.0f * glm::dot(N, H) * H - N;
+						float NdotL = glm::dot(N, L);
+						if (NdotL > 0.0f)
+						{
+							color += environmentRadiance(L) * NdotL;
+							weight += NdotL;
+						}
+					}
+					out[y * size + x] = weight > 0.0f ? color / weight : glm::vec3(0.0f);
+				}
+			}
+		}
+	});
+	return texels;
+}
+
+inline bool writeBrdfLut(const char* path, uint32_t size, const std::vector<glm::vec2>& lut)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	BrdfLutHeader header = { BRDF_LUT_MAGIC, IBL_VERSION, size };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(lut.data()), lut.size() * sizeof(glm::vec2));
+	return file.good();
+}
+
+inline bool writeEnvironment(const char* path, uint32_t faceSize, uint32_t mipCount, const std::vector<glm::vec3>& texels)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	EnvironmentHeader header = { ENVIRONMENT_MAGIC, IBL_VERSION, faceSize, mipCount };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(texels.data()), texels.size() * sizeof(glm::vec3));
+	return file.good();
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef INPUT_LATENCY_TIMER_H
+#define INPUT_LATENCY_TIMER_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// Measures how long input takes to show: from the moment an event arrives until the GPU has
+// finished the frame built with it. A timestamp query after the frame's swap gives the GPU's
+// end; the GL time read when the input is applied ties it to the CPU's clock, so no clocks
+// need to agree. Queries go through a small ring and are read back a few frames later, like
+// GpuTimer's. What the compositor and the display add after the GPU is done isn't seen.
+class InputLatencyTimer
+{
+    public:
+	InputLatencyTimer()
+	{
+		glGenQueries(QUERY_DEPTH, queries);
+	}
+
+	~InputLatencyTimer()
+	{
+		glDeleteQueries(QUERY_DEPTH, queries);
+	}
+
+	// the input applied to this frame arrived inputAgeSeconds ago; call when it's applied
+	void inputApplied(double inputAgeSeconds)
+	{
+		collect();
+		GLint64 now = 0;
+		glGetInteger64v(GL_TIMESTAMP, &now);
+		applied[head] = now;
+		inputAges[head] = static_cast<int64_t>(inputAgeSeconds * 1e9);
+		armed = true;
+	}
+
+	// after the swap of every frame; only frames that applied input are measured
+	void frameSubmitted()
+	{
+		if (!armed)
+			return;
+		glQueryCounter(queries[head], GL_TIMESTAMP);
+		head = (head + 1) % QUERY_DEPTH;
+		if (pending < QUERY_DEPTH)
+			pending++;
+		armed = false;
+	}
+
+	// averages since the last reset()
+	double averageMilliseconds() const { return inputs > 0 ? totalNanoseconds / 1e6 / inputs : 0.0; }
+	uint64_t measuredInputs() const { return inputs; }
+
+	void reset()
+	{
+		totalNanoseconds = 0;
+		inputs = 0;
+	}
+
+    private:
+	static const unsigned int QUERY_DEPTH = 4;
+
+	GLuint queries[QUERY_DEPTH];
+	GLint64 applied[QUERY_DEPTH] = {}; // GL time when the input went into the frame
+	int64_t inputAges[QUERY_DEPTH] = {}; // how old the input was by then
+	unsigned int head = 0;
+	unsigned int pending = 0;
+	bool armed = false;
+
+	uint64_t totalNanoseconds = 0;
+	uint64_t inputs = 0;
+
+	// reads back every finished query, oldest first
+	void collect()
+	{
+		while (pending > 0)
+		{
+			unsigned int oldest = (head + QUERY_DEPTH - pending) % QUERY_DEPTH;
+			GLint available = 0;
+			glGetQueryObjectiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+			// the ring is full, the oldest query has to be waited for before it's reused
+			if (!available && pending < QUERY_DEPTH)
+				break;
+
+			GLuint64 finished = 0;
+			glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &finished);
+			int64_t nanoseconds = static_cast<int64_t>(finished) - applied[oldest] + inputAges[oldest];
+			if (nanoseconds > 0)
+			{
+				totalNanoseconds += static_cast<uint64_t>(nanoseconds);
+				inputs++;
+			}
+			pending--;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// Minimal KTX2 container support for the block compressed textures written by
+// "AssetTool compress-textures": one 2D image with a mip chain, no supercompression and
+// no key/value data. Just enough of the format for other KTX2 tools to read our files and
+// for the renderer to hand the mips straight to glCompressedTexImage2D.
+
+const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// the Vulkan format numbers KTX2 uses
+const uint32_t KTX2_FORMAT_BC1_RGB_UNORM = 131;
+const uint32_t KTX2_FORMAT_BC1_RGB_SRGB = 132;
+const uint32_t KTX2_FORMAT_BC4_UNORM = 139;
+const uint32_t KTX2_FORMAT_BC5_UNORM = 141;
+const uint32_t KTX2_FORMAT_BC7_UNORM = 145;
+const uint32_t KTX2_FORMAT_BC7_SRGB = 146;
+
+struct Ktx2Header {
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+// one entry per mip level, level 0 first, right after the header
+struct Ktx2LevelIndex {
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+// a whole KTX2 file in memory
+struct Ktx2Image {
+	uint32_t vkFormat = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> data;
+	std::vector<Ktx2LevelIndex> levels; // offsets into data
+};
+
+inline uint32_t ktx2BlockBytes(uint32_t vkFormat)
+{
+	return vkFormat == KTX2_FORMAT_BC5_UNORM || vkFormat == KTX2_FORMAT_BC7_UNORM || vkFormat == KTX2_FORMAT_BC7_SRGB ? 16 : 8;
+}
+
+inline bool ktx2IsSrgb(uint32_t vkFormat)
+{
+	return vkFormat == KTX2_FORMAT_BC1_RGB_SRGB || vkFormat == KTX2_FORMAT_BC7_SRGB;
+}
+
+// the basic data format descriptor of a 4x4 block compressed format
+inline std::vector<uint32_t> ktx2BlockDescriptor(uint32_t vkFormat)
+{
+	uint32_t colorModel = 128; // KHR_DF_MODEL_BC1A
+	uint32_t sampleCount = 1;
+	if (vkFormat == KTX2_FORMAT_BC4_UNORM)
+		colorModel = 131;
+	else if (vkFormat == KTX2_FORMAT_BC5_UNORM)
+	{
+		colorModel = 132;
+		sampleCount = 2;
+	}
+	else if (vkFormat == KTX2_FORMAT_BC7_UNORM || vkFormat == KTX2_FORMAT_BC7_SRGB)
+		colorModel = 134;
+
+	uint32_t blockBytes = ktx2BlockBytes(vkFormat);
+	uint32_t blockSize = 24 + 16 * sampleCount;
+	std::vector<uint32_t> words;
+	words.push_back(4 + blockSize); // dfdTotalSize
+	words.push_back(0); // vendor 0 (Khronos), descriptor type 0 (basic)
+	words.push_back(2 | (blockSize << 16)); // version 2
+	uint32_t transfer = ktx2IsSrgb(vkFormat) ? 2 : 1;
+	words.push_back(colorModel | (1 << 8) | (transfer << 16)); // BT.709 primaries, straight alpha
+	words.push_back(3 | (3 << 8)); // 4x4x1x1 texel blocks, stored minus one
+	words.push_back(blockBytes); // bytesPlane0
+	words.push_back(0); // bytesPlane4..7
+	for (uint32_t sample = 0; sample < sampleCount; sample++)
+	{
+		uint32_t bits = blockBytes * 8 / sampleCount;
+		// bitOffset, bitLength - 1 and the channel (red, then green for BC5)
+		words.push_back((sample * bits) | ((bits - 1) << 16) | (sample << 24));
+		words.push_back(0); // sample position
+		words.push_back(0); // lower
+		words.push_back(0xFFFFFFFFu); // upper
+	}
+	return words;
+}
+
+// levels[0] is the full size image
+inline bool writeKtx2(const char* path, uint32_t vkFormat, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::vector<uint32_t> descriptor = ktx2BlockDescriptor(vkFormat);
+	uint32_t levelCount = static_cast<uint32_t>(levels.size());
+
+	Ktx2Header header = {};
+	std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = vkFormat;
+	header.typeSize = 1;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.faceCount = 1;
+	header.levelCount = levelCount;
+	header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndex));
+	header.dfdByteLength = static_cast<uint32_t>(descriptor.size() * sizeof(uint32_t));
+
+	// the mips go smallest first, each aligned to a block
+	uint64_t alignment = ktx2BlockBytes(vkFormat);
+	uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+	std::vector<Ktx2LevelIndex> index(levelCount);
+	for (uint32_t level = levelCount; level-- > 0;)
+	{
+		offset = (offset + alignment - 1) / alignment * alignment;
+		index[level].byteOffset = offset;
+		index[level].byteLength = levels[level].size();
+		index[level].uncompressedByteLength = levels[level].size();
+		offset += levels[level].size();
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(Ktx2LevelIndex));
+	file.write(reinterpret_cast<const char*>(descriptor.data()), header.dfdByteLength);
+	uint64_t written = header.dfdByteOffset + header.dfdByteLength;
+	for (uint32_t level = levelCount; level-- > 0;)
+	{
+		const char zeros[16] = {};
+		file.write(zeros, index[level].byteOffset - written);
+		file.write(reinterpret_cast<const char*>(levels[level].data()), levels[level].size());
+		written = index[level].byteOffset + levels[level].size();
+	}
+	return file.good();
+}
+
+// the vkFormat of a KTX2 file, 0 if it can't be read
+inline uint32_t readKtx2Format(const char* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	Ktx2Header header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+		return 0;
+	return header.vkFormat;
+}
+
+// reads a file written by writeKtx2 (or anything else without supercompression)
+inline bool readKtx2(const char* path, Ktx2Image& image)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+	std::streamoff size = file.tellg();
+	if (size < static_cast<std::streamoff>(sizeof(Ktx2Header)))
+		return false;
+	image.data.resize(static_cast<size_t>(size));
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(image.data.data()), size))
+		return false;
+
+	Ktx2Header header;
+	std::memcpy(&header, image.data.data(), sizeof(header));
+	if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 || header.supercompressionScheme != 0
+		|| header.levelCount == 0 || header.faceCount != 1 || header.layerCount > 1 || header.pixelDepth > 1)
+		return false;
+	if (sizeof(Ktx2Header) + header.levelCount * sizeof(Ktx2LevelIndex) > image.data.size())
+		return false;
+
+	image.vkFormat = header.vkFormat;
+	image.width = header.pixelWidth;
+	image.height = header.pixelHeight;
+	image.levels.resize(header.levelCount);
+	std::memcpy(image.levels.data(), image.data.data() + sizeof(Ktx2Header), header.levelCount * sizeof(Ktx2LevelIndex));
+	for (const Ktx2LevelIndex& level : image.levels)
+	{
+		if (level.byteOffset + level.byteLength > image.data.size())
+			return false;
+	}
+	return true;
+}
+
+#endif
@@ -6,4 +6,10 @@ struct Light {
   glm::vec3 ambient; // the ambient vec3
   glm::vec3 diffuse; // the diffuse vec3
   glm::vec3 specular; // and the specular vec3
+  glm::vec3 direction; // where directional and spot lights point to
+  float constant; // attenuation terms of point and spot lights
+  float linear;
+  float quadratic;
+  float cutOff; // cosines of the inner and outer spot light cones
+  float outerCutOff;
 };
@@ -0,0 +1,402 @@
+#ifndef LIGHT_MANAGER_H
+#define LIGHT_MANAGER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Light.h"
+#include "LightMode.h"
+#include "Shader.h"
+#include "GLExtensions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Refers to a light owned by a LightManager. The generation is bumped every time a slot is
+// freed, so a handle to a removed light is detected instead of silently hitting its successor.
+struct LightHandle {
+	uint32_t slot;
+	uint32_t generation; // 0 is never handed out
+
+	bool operator==(const LightHandle& other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const LightHandle& other) const { return !(*this == other); }
+};
+
+const LightHandle INVALID_LIGHT = { 0, 0 };
+
+// The layout of one light in the GPU mirror, matching GPULight in 1.colors.fs (std430).
+// The same struct is used for all three types, each type ignores the fields it doesn't need.
+struct GPULight {
+	glm::vec4 positionConstant;
+	glm::vec4 directionLinear;
+	glm::vec4 ambientQuadratic;
+	glm::vec4 diffuseCutOff;
+	glm::vec4 specularOuterCutOff;
+};
+
+// SSBO binding points of the per-type light arrays
+const GLuint DIR_LIGHT_BINDING = 0;
+const GLuint POINT_LIGHT_BINDING = 1;
+const GLuint SPOT_LIGHT_BINDING = 2;
+
+// Owns every light in the scene, stored data-oriented: one set of SoA arrays per LightMode,
+// densely packed so the upload and the shader loop only touch live lights. Add and remove
+// are O(1) (removal swaps the last light into the hole) and nothing is allocated per light
+// once the arrays have grown to their working size.
+//
+// Every write widens a per-type dirty range, and upload() only sends that range. With SSBO
+// support the arrays are mirrored into one shader storage buffer per type; otherwise
+// applyUniforms() falls back to the fixed dirLight/pointLights[]/spotLight uniforms.
+class LightManager
+{
+    public:
+	LightManager(size_t reserveCount = 0)
+	{
+		for (unsigned int mode = 0; mode < LIGHT_MODE_COUNT; mode++)
+			arrays[mode].reserve(reserveCount);
+		slots.reserve(reserveCount);
+	}
+
+	~LightManager()
+	{
+		for (unsigned int mode = 0; mode < LIGHT_MODE_COUNT; mode++)
+		{
+			if (arrays[mode].buffer != 0)
+				glDeleteBuffers(1, &arrays[mode].buffer);
+		}
+	}
+
+	LightHandle add(LightMode mode, const Light& light)
+	{
+		uint32_t slot;
+		if (freeSlot != NO_SLOT)
+		{
+			slot = freeSlot;
+			freeSlot = slots[slot].nextFree;
+		}
+		else
+		{
+			slot = static_cast<uint32_t>(slots.size());
+			slots.push_back(Slot());
+			slots[slot].generation = 1;
+		}
+
+		LightArrays& lights = arrays[mode];
+		uint32_t index = static_cast<uint32_t>(lights.count());
+		lights.push(light, slot);
+		lights.markDirty(index);
+		lights.revision++;
+
+		slots[slot].mode = mode;
+		slots[slot].index = index;
+		slots[slot].nextFree = NO_SLOT;
+		return LightHandle{ slot, slots[slot].generation };
+	}
+
+	void remove(LightHandle handle)
+	{
+		if (!isValid(handle))
+			return;
+
+		Slot& slot = slots[handle.slot];
+		LightArrays& lights = arrays[slot.mode];
+		uint32_t last = static_cast<uint32_t>(lights.count() - 1);
+		if (slot.index != last)
+		{
+			lights.move(last, slot.index);
+			slots[lights.owner[slot.index]].index = slot.index;
+			lights.markDirty(slot.index);
+		}
+		lights.pop();
+		lights.revision++;
+
+		// the shrunken count is uploaded as a uniform, nothing past it needs to be sent
+		lights.dirtyEnd = std::min(lights.dirtyEnd, lights.count());
+
+		slot.generation++;
+		if (slot.generation == 0)
+			slot.generation = 1;
+		slot.nextFree = freeSlot;
+		freeSlot = handle.slot;
+	}
+
+	bool isValid(LightHandle handle) const
+	{
+		return handle.generation != 0 && handle.slot < slots.size() && slots[handle.slot].generation == handle.generation;
+	}
+
+	Light get(LightHandle handle) const
+	{
+		if (!isValid(handle))
+			return Light();
+		return arrays[slots[handle.slot].mode].get(slots[handle.slot].index);
+	}
+
+	void set(LightHandle handle, const Light& light)
+	{
+		if (!isValid(handle))
+			return;
+		LightArrays& lights = arrays[slots[handle.slot].mode];
+		lights.set(slots[handle.slot].index, light);
+		lights.markDirty(slots[handle.slot].index);
+		lights.revision++;
+	}
+
+	void setPosition(LightHandle handle, const glm::vec3& position)
+	{
+		if (!isValid(handle))
+			return;
+		LightArrays& lights = arrays[slots[handle.slot].mode];
+		if (lights.position[slots[handle.slot].index] == position)
+			return;
+		lights.position[slots[handle.slot].index] = position;
+		lights.markDirty(slots[handle.slot].index);
+	}
+
+	void setDirection(LightHandle handle, const glm::vec3& direction)
+	{
+		if (!isValid(handle))
+			return;
+		LightArrays& lights = arrays[slots[handle.slot].mode];
+		if (lights.direction[slots[handle.slot].index] == direction)
+			return;
+		lights.direction[slots[handle.slot].index] = direction;
+		lights.markDirty(slots[handle.slot].index);
+	}
+
+	size_t count(LightMode mode) const { return arrays[mode].count(); }
+
+	// direct access to the packed arrays, e.g. for culling or baking
+	const std::vector<glm::vec3>& positions(LightMode mode) const { return arrays[mode].position; }
+	const std::vector<glm::vec3>& ambientColors(LightMode mode) const { return arrays[mode].ambient; }
+	const std::vector<glm::vec3>& diffuseColors(LightMode mode) const { return arrays[mode].diffuse; }
+	const std::vector<float>& constants(LightMode mode) const { return arrays[mode].constant; }
+
+	// bumped by add, remove and set, i.e. whenever anything but a position or direction changes
+	uint64_t revision(LightMode mode) const { return arrays[mode].revision; }
+
+	// bytes sent to the GPU by the last upload(), to check the dirty tracking
+	size_t lastUploadBytes() const { return uploadedBytes; }
+
+	// pushes the dirty ranges into the storage buffers; needs glCaps().shaderStorage
+	void upload()
+	{
+		uploadedBytes = 0;
+		for (unsigned int mode = 0; mode < LIGHT_MODE_COUNT; mode++)
+		{
+			LightArrays& lights = arrays[mode];
+			if (lights.buffer == 0)
+				glGenBuffers(1, &lights.buffer);
+
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, lights.buffer);
+			if (lights.count() > lights.gpuCapacity || lights.gpuCapacity == 0)
+			{
+				// grow the mirror geometrically and send everything again
+				lights.gpuCapacity = std::max<size_t>(std::max<size_t>(lights.gpuCapacity * 2, lights.count()), 16);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, lights.gpuCapacity * sizeof(GPULight), NULL, GL_DYNAMIC_DRAW);
+				lights.dirtyBegin = 0;
+				lights.dirtyEnd = lights.count();
+			}
+
+			if (lights.dirtyBegin < lights.dirtyEnd)
+			{
+				size_t rangeCount = lights.dirtyEnd - lights.dirtyBegin;
+				staging.resize(std::max(staging.size(), rangeCount));
+				for (size_t i = 0; i < rangeCount; i++)
+					staging[i] = lights.pack(lights.dirtyBegin + i);
+
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, lights.dirtyBegin * sizeof(GPULight), rangeCount * sizeof(GPULight), staging.data());
+				uploadedBytes += rangeCount * sizeof(GPULight);
+			}
+			lights.clearDirty();
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// binds the storage buffers and sets the light counts; the program needs LIGHTS_SSBO
+	void bind(const Shader& shader) const
+	{
+		const GLuint bindings[LIGHT_MODE_COUNT] = { DIR_LIGHT_BINDING, POINT_LIGHT_BINDING, SPOT_LIGHT_BINDING };
+		for (unsigned int mode = 0; mode < LIGHT_MODE_COUNT; mode++)
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bindings[mode], arrays[mode].buffer);
+
+		shader.setInt("dirLightCount", static_cast<int>(arrays[Directional].count()));
+		shader.setInt("pointLightCount", static_cast<int>(arrays[Point].count()));
+		shader.setInt("spotLightCount", static_cast<int>(arrays[Spotlight].count()));
+	}
+
+	// fallback without SSBOs: the first lights of each type go into the fixed uniforms
+	void applyUniforms(const Shader& shader, unsigned int maxPointLights)
+	{
+		if (pointUniformNames.size() < maxPointLights)
+		{
+			// build the names once instead of concatenating strings every frame
+			for (unsigned int i = static_cast<unsigned int>(pointUniformNames.size()); i < maxPointLights; i++)
+				pointUniformNames.push_back(UniformNames("pointLights[" + std::to_string(i) + "]"));
+		}
+
+		if (arrays[Directional].count() > 0)
+			applyLight(shader, dirUniformNames, arrays[Directional].get(0));
+		for (unsigned int i = 0; i < maxPointLights; i++)
+		{
+			// unused entries are zeroed so they don't contribute
+			Light light = i < arrays[Point].count() ? arrays[Point].get(i) : Light();
+			if (i >= arrays[Point].count())
+				light.constant = 1.0f;
+			applyLight(shader, pointUniformNames[i], light);
+		}
+		if (arrays[Spotlight].count() > 0)
+			applyLight(shader, spotUniformNames, arrays[Spotlight].get(0));
+	}
+
+    private:
+	static const uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+	struct Slot {
+		LightMode mode = Point;
+		uint32_t index = 0; // position in the arrays of its mode
+		uint32_t generation = 1;
+		uint32_t nextFree = NO_SLOT; // free list link, NO_SLOT while the slot is in use
+	};
+
+	struct LightArrays {
+		std::vector<glm::vec3> position;
+		std::vector<glm::vec3> direction;
+		std::vector<glm::vec3> ambient;
+		std::vector<glm::vec3> diffuse;
+		std::vector<glm::vec3> specular;
+		std::vector<float> constant;
+		std::vector<float> linear;
+		std::vector<float> quadratic;
+		std::vector<float> cutOff;
+		std::vector<float> outerCutOff;
+		std::vector<uint32_t> owner; // slot of every light, to patch it when lights move
+
+		size_t dirtyBegin = 0;
+		size_t dirtyEnd = 0;
+		GLuint buffer = 0;
+		size_t gpuCapacity = 0;
+		uint64_t revision = 0;
+
+		size_t count() const { return owner.size(); }
+
+		void reserve(size_t n)
+		{
+			position.reserve(n); direction.reserve(n); ambient.reserve(n); diffuse.reserve(n); specular.reserve(n);
+			constant.reserve(n); linear.reserve(n); quadratic.reserve(n); cutOff.reserve(n); outerCutOff.reserve(n);
+			owner.reserve(n);
+		}
+
+		void push(const Light& light, uint32_t slot)
+		{
+			position.push_back(light.position); direction.push_back(light.direction);
+			ambient.push_back(light.ambient); diffuse.push_back(light.diffuse); specular.push_back(light.specular);
+			constant.push_back(light.constant); linear.push_back(light.linear); quadratic.push_back(light.quadratic);
+			cutOff.push_back(light.cutOff); outerCutOff.push_back(light.outerCutOff);
+			owner.push_back(slot);
+		}
+
+		void pop()
+		{
+			position.pop_back(); direction.pop_back(); ambient.pop_back(); diffuse.pop_back(); specular.pop_back();
+			constant.pop_back(); linear.pop_back(); quadratic.pop_back(); cutOff.pop_back(); outerCutOff.pop_back();
+			owner.pop_back();
+		}
+
+		void move(size_t from, size_t to)
+		{
+			set(to, get(from));
+			owner[to] = owner[from];
+		}
+
+		Light get(size_t i) const
+		{
+			Light light;
+			light.position = position[i]; light.direction = direction[i];
+			light.ambient = ambient[i]; light.diffuse = diffuse[i]; light.specular = specular[i];
+			light.constant = constant[i]; light.linear = linear[i]; light.quadratic = quadratic[i];
+			light.cutOff = cutOff[i]; light.outerCutOff = outerCutOff[i];
+			return light;
+		}
+
+		void set(size_t i, const Light& light)
+		{
+			position[i] = light.position; direction[i] = light.direction;
+			ambient[i] = light.ambient; diffuse[i] = light.diffuse; specular[i] = light.specular;
+			constant[i] = light.constant; linear[i] = light.linear; quadratic[i] = light.quadratic;
+			cutOff[i] = light.cutOff; outerCutOff[i] = light.outerCutOff;
+		}
+
+		GPULight pack(size_t i) const
+		{
+			GPULight light;
+			light.positionConstant = glm::vec4(position[i], constant[i]);
+			light.directionLinear = glm::vec4(direction[i], linear[i]);
+			light.ambientQuadratic = glm::vec4(ambient[i], quadratic[i]);
+			light.diffuseCutOff = glm::vec4(diffuse[i], cutOff[i]);
+			light.specularOuterCutOff = glm::vec4(specular[i], outerCutOff[i]);
+			return light;
+		}
+
+		void markDirty(size_t i)
+		{
+			if (dirtyBegin >= dirtyEnd)
+			{
+				dirtyBegin = i;
+				dirtyEnd = i + 1;
+			}
+			else
+			{
+				dirtyBegin = std::min(dirtyBegin, i);
+				dirtyEnd = std::max(dirtyEnd, i + 1);
+			}
+		}
+
+		void clearDirty()
+		{
+			dirtyBegin = 0;
+			dirtyEnd = 0;
+		}
+	};
+
+	// the uniform names of one light in the fallback path
+	struct UniformNames {
+		std::string position, direction, ambient, diffuse, specular, constant, linear, quadratic, cutOff, outerCutOff;
+
+		UniformNames(const std::string& prefix)
+			: position(prefix + ".position"), direction(prefix + ".direction"), ambient(prefix + ".ambient"),
+			diffuse(prefix + ".diffuse"), specular(prefix + ".specular"), constant(prefix + ".constant"),
+			linear(prefix + ".linear"), quadratic(prefix + ".quadratic"), cutOff(prefix + ".cutOff"),
+			outerCutOff(prefix + ".outerCutOff")
+		{
+		}
+	};
+
+	LightArrays arrays[LIGHT_MODE_COUNT];
+	std::vector<Slot> slots;
+	uint32_t freeSlot = NO_SLOT;
+	std::vector<GPULight> staging;
+	size_t uploadedBytes = 0;
+
+	UniformNames dirUniformNames = UniformNames("dirLight");
+	UniformNames spotUniformNames = UniformNames("spotLight");
+	std::vector<UniformNames> pointUniformNames;
+
+	static void applyLight(const Shader& shader, const UniformNames& names, const Light& light)
+	{
+		shader.setVec3(names.position, light.position);
+		shader.setVec3(names.direction, light.direction);
+		shader.setVec3(names.ambient, light.ambient);
+		shader.setVec3(names.diffuse, light.diffuse);
+		shader.setVec3(names.specular, light.specular);
+		shader.setFloat(names.constant, light.constant);
+		shader.setFloat(names.linear, light.linear);
+		shader.setFloat(names.quadratic, light.quadratic);
+		shader.setFloat(names.cutOff, light.cutOff);
+		shader.setFloat(names.outerCutOff, light.outerCutOff);
+	}
+};
+
+#endif
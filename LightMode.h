@@ -1,5 +1,7 @@
 #pragma once
 enum LightMode {
+	Directional = 0,
 	Point = 1,
 	Spotlight = 2
-};
\ No newline at end of file
+};
+const unsigned int LIGHT_MODE_COUNT = 3;
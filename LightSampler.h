@@ -0,0 +1,223 @@
+#ifndef LIGHT_SAMPLER_H
+#define LIGHT_SAMPLER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "LightManager.h"
+#include "Shader.h"
+#include "GLExtensions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// One bin of the alias table, matching AliasEntry in 1.colors.fs (std430)
+struct AliasEntry {
+	float probability; // of keeping this bin's own light instead of its alias
+	uint32_t alias;
+	float pdf; // of the whole table picking this bin's light
+	float padding;
+};
+
+// bytes per pixel of a Reservoir in 1.colors.fs: three vec4s
+const size_t RESERVOIR_SIZE = 3 * 4 * sizeof(float);
+
+// SSBO binding points, after the LightManager's ones
+const GLuint LIGHT_ALIAS_BINDING = 3;
+const GLuint PREVIOUS_RESERVOIR_BINDING = 4;
+const GLuint CURRENT_RESERVOIR_BINDING = 5;
+
+struct LightSamplerSettings {
+	int lightSampleCount = 8; // alias table candidates per pixel
+	int spatialSampleCount = 2; // neighbour reservoirs reused per pixel
+	float spatialRadius = 16.0f; // in pixels
+	int maxConfidence = 20 * 8; // cap on a reservoir's candidate count, 20 frames' worth
+};
+
+// Drives the MANY_LIGHTS variant of the lighting shader: instead of looping over every point
+// light, each pixel draws a few candidates from an alias table (built here, weighted by each
+// light's brightness), keeps one by weighted reservoir sampling against its actual
+// contribution, merges in last frame's reservoirs of the same and nearby pixels, and shades
+// only the survivor. The cost per pixel is fixed by the settings, not by the light count.
+//
+// The reservoirs live in two per-pixel storage buffers that swap every frame, written by the
+// fragment shader itself, so the pass has to run over a depth prepass with GL_EQUAL to leave
+// one writer per pixel; needs glCaps().shaderStorage and glCaps().imageLoadStore.
+class LightSampler
+{
+    public:
+	LightSampler(const LightSamplerSettings& settings = LightSamplerSettings()) : settings(settings)
+	{
+	}
+
+	~LightSampler()
+	{
+		if (aliasBuffer != 0)
+			glDeleteBuffers(1, &aliasBuffer);
+		if (reservoirBuffers[0] != 0)
+			glDeleteBuffers(2, reservoirBuffers);
+	}
+
+	// rebuilds the alias table when the point lights were added, removed or changed
+	void update(const LightManager& lights)
+	{
+		if (aliasBuffer != 0 && lights.revision(Point) == builtRevision)
+			return;
+		// a removal moves the last light into the freed index, so the reservoirs' light indices
+		// may name other lights now
+		if (aliasBuffer != 0)
+			invalidateHistory();
+
+		const std::vector<glm::vec3>& ambient = lights.ambientColors(Point);
+		const std::vector<glm::vec3>& diffuse = lights.diffuseColors(Point);
+		const std::vector<float>& constant = lights.constants(Point);
+		weights.resize(lights.count(Point));
+		for (size_t i = 0; i < weights.size(); i++)
+			weights[i] = luminance(ambient[i] + diffuse[i]) / std::max(constant[i], 1e-4f);
+		buildAliasTable(weights, table);
+
+		if (aliasBuffer == 0)
+			glGenBuffers(1, &aliasBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, aliasBuffer);
+		// never empty, so there's always something to bind
+		AliasEntry empty = {};
+		glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(table.size(), 1) * sizeof(AliasEntry), table.empty() ? &empty : table.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		builtRevision = lights.revision(Point);
+	}
+
+	// (re)allocates the reservoirs for the framebuffer size, dropping the history on a change
+	void resize(int width, int height)
+	{
+		if (width == screenWidth && height == screenHeight)
+			return;
+		screenWidth = width;
+		screenHeight = height;
+
+		if (reservoirBuffers[0] == 0)
+			glGenBuffers(2, reservoirBuffers);
+
+		// zeroed, so pixels nothing was drawn to yet hold no reusable reservoir
+		std::vector<float> zeros(static_cast<size_t>(width) * height * RESERVOIR_SIZE / sizeof(float), 0.0f);
+		for (int i = 0; i < 2; i++)
+		{
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, reservoirBuffers[i]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, zeros.size() * sizeof(float), zeros.data(), GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		frameIndex = 0;
+	}
+
+	// call once per frame before drawing with the MANY_LIGHTS shader, after resize()
+	void bind(const Shader& shader, const glm::mat4& viewProjection)
+	{
+		// last frame's fragment shader writes have to land before they're read back
+		glCaps().MemoryBarrierGL(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		current = 1 - current;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_ALIAS_BINDING, aliasBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PREVIOUS_RESERVOIR_BINDING, reservoirBuffers[1 - current]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CURRENT_RESERVOIR_BINDING, reservoirBuffers[current]);
+
+		shader.setInt("lightSampleCount", settings.lightSampleCount);
+		shader.setInt("spatialSampleCount", settings.spatialSampleCount);
+		shader.setFloat("spatialRadius", settings.spatialRadius);
+		shader.setInt("maxConfidence", settings.maxConfidence);
+		shader.setBool("reuseReservoirs", frameIndex > 0);
+		shader.setInt("frameIndex", static_cast<int>(frameIndex));
+		shader.setInt("screenWidth", screenWidth);
+		shader.setInt("screenHeight", screenHeight);
+		shader.setMat4("previousViewProjection", previousViewProjection);
+
+		previousViewProjection = viewProjection;
+		frameIndex++;
+	}
+
+	// the history is only valid while the sampler is used every frame
+	void invalidateHistory() { frameIndex = 0; }
+
+	// Vose's alias method: O(n) to build, O(1) per sample
+	static void buildAliasTable(const std::vector<float>& weights, std::vector<AliasEntry>& table)
+	{
+		size_t count = weights.size();
+		table.resize(count);
+		if (count == 0)
+			return;
+
+		double total = 0.0;
+		for (size_t i = 0; i < count; i++)
+			total += weights[i];
+
+		std::vector<double> scaled(count);
+		std::vector<uint32_t> underfull, overfull;
+		underfull.reserve(count);
+		overfull.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			// all black lights are still picked uniformly rather than dividing by zero
+			double pdf = total > 0.0 ? weights[i] / total : 1.0 / count;
+			table[i].pdf = static_cast<float>(pdf);
+			table[i].padding = 0.0f;
+			scaled[i] = pdf * count;
+			if (scaled[i] < 1.0)
+				underfull.push_back(static_cast<uint32_t>(i));
+			else
+				overfull.push_back(static_cast<uint32_t>(i));
+		}
+
+		while (!underfull.empty() && !overfull.empty())
+		{
+			uint32_t less = underfull.back();
+			underfull.pop_back();
+			uint32_t more = overfull.back();
+
+			table[less].probability = static_cast<float>(scaled[less]);
+			table[less].alias = more;
+			scaled[more] -= 1.0 - scaled[less];
+			if (scaled[more] < 1.0)
+			{
+				overfull.pop_back();
+				underfull.push_back(more);
+			}
+		}
+
+		// whatever is left is 1 up to rounding, except a black light the rounding left behind:
+		// it must never be picked, its pdf is 0, so its bin goes to the brightest light
+		uint32_t brightest = static_cast<uint32_t>(std::max_element(weights.begin(), weights.end()) - weights.begin());
+		for (uint32_t i : overfull)
+		{
+			table[i].probability = 1.0f;
+			table[i].alias = i;
+		}
+		for (uint32_t i : underfull)
+		{
+			bool black = table[i].pdf <= 0.0f;
+			table[i].probability = black ? 0.0f : 1.0f;
+			table[i].alias = black ? brightest : i;
+		}
+	}
+
+    private:
+	LightSamplerSettings settings;
+
+	GLuint aliasBuffer = 0;
+	GLuint reservoirBuffers[2] = { 0, 0 };
+	unsigned int current = 0;
+	int screenWidth = 0;
+	int screenHeight = 0;
+	uint32_t frameIndex = 0;
+	glm::mat4 previousViewProjection = glm::mat4(1.0f);
+
+	uint64_t builtRevision = 0;
+	std::vector<float> weights;
+	std::vector<AliasEntry> table;
+
+	static float luminance(const glm::vec3& color)
+	{
+		return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+};
+
+#endif
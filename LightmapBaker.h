@@ -0,0 +1,214 @@
+#ifndef LIGHTMAP_BAKER_H
+#define LIGHTMAP_BAKER_H
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "BakeScene.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// Lightmap file layout: a LightmapHeader followed by width * height RGB floats,
+// rows bottom to top (the order glTexImage2D expects).
+const uint32_t LIGHTMAP_MAGIC = 0x50414D4C; // "LMAP"
+const uint32_t LIGHTMAP_VERSION = 1;
+
+struct LightmapHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t tileSize; // texels per side of one cube face
+	uint32_t tilesPerRow; // the atlas is tilesPerRow * tilesPerRow tiles
+};
+
+// Every face of every cube gets its own square tile in the atlas. The tile of face f
+// of cube i is i * CUBE_FACE_COUNT + f, which the vertex shader recovers from gl_VertexID.
+const uint32_t LIGHTMAP_TILE_COUNT = NR_CUBES * CUBE_FACE_COUNT;
+
+inline uint32_t lightmapTilesPerRow()
+{
+	uint32_t tilesPerRow = 1;
+	while (tilesPerRow * tilesPerRow < LIGHTMAP_TILE_COUNT)
+		tilesPerRow++;
+	return tilesPerRow;
+}
+
+struct LightmapSettings {
+	uint32_t tileSize = 16;
+	uint32_t samplesPerTexel = 256; // indirect paths per texel
+	uint32_t maxBounces = 3;
+	float albedo = 0.5f; // grey stand-in for the diffuse map when light bounces
+	unsigned int workerCount = 0; // 0 = one per core
+};
+
+struct LightmapStats {
+	uint64_t rays = 0; // closest-hit and shadow rays
+	double seconds = 0.0;
+	unsigned int workerCount = 0;
+
+	double raysPerSecondPerCore() const
+	{
+		return seconds > 0.0 ? rays / seconds / workerCount : 0.0;
+	}
+};
+
+// Path traces the static lights (dirLight and the point lights) into a lightmap atlas.
+// The baked value is the diffuse irradiance, ambient terms included, so the fragment shader
+// only has to multiply it with the diffuse map. Specular is view dependent and isn't baked.
+class LightmapBaker
+{
+    public:
+	LightmapBaker(const LightmapSettings& settings = LightmapSettings()) : settings(settings)
+	{
+	}
+
+	void bake()
+	{
+		scene.build();
+		buildFaces();
+
+		tilesPerRow = lightmapTilesPerRow();
+		atlasSize = tilesPerRow * settings.tileSize;
+		texels.assign(atlasSize * atlasSize, glm::vec3(0.0f));
+
+		unsigned int workerCount = settings.workerCount > 0 ? settings.workerCount : defaultWorkerCount();
+		std::atomic<uint64_t> rays(0);
+
+		auto start = std::chrono::steady_clock::now();
+		parallelFor(LIGHTMAP_TILE_COUNT, 1, workerCount, [&](size_t begin, size_t end, unsigned int) {
+			uint64_t tileRays = 0;
+			for (size_t tile = begin; tile < end; tile++)
+				tileRays += bakeTile(static_cast<uint32_t>(tile));
+			rays += tileRays;
+		});
+		auto finish = std::chrono::steady_clock::now();
+
+		stats.rays = rays;
+		stats.seconds = std::chrono::duration<double>(finish - start).count();
+		stats.workerCount = workerCount;
+	}
+
+	bool write(const char* path) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		LightmapHeader header = { LIGHTMAP_MAGIC, LIGHTMAP_VERSION, settings.tileSize, tilesPerRow };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(texels.data()), texels.size() * sizeof(glm::vec3));
+		return file.good();
+	}
+
+	const LightmapStats& getStats() const { return stats; }
+	uint32_t getAtlasSize() const { return atlasSize; }
+
+    private:
+	LightmapSettings settings;
+	LightmapStats stats;
+	uint32_t tilesPerRow = 0;
+	uint32_t atlasSize = 0;
+	std::vector<glm::vec3> texels;
+
+	BakeScene scene;
+
+	// a cube face in world space: position = origin + u * axisU + v * axisV for u, v in [0, 1]
+	struct Face {
+		glm::vec3 origin;
+		glm::vec3 axisU;
+		glm::vec3 axisV;
+		glm::vec3 normal;
+	};
+	std::vector<Face> faces;
+
+	void buildFaces()
+	{
+		faces.clear();
+
+		for (unsigned int cube = 0; cube < NR_CUBES; cube++)
+		{
+			glm::mat4 model = cubeModelMatrix(cube);
+			glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(model)));
+
+			for (unsigned int face = 0; face < CUBE_FACE_COUNT; face++)
+			{
+				// solve the affine texture coordinate -> position mapping from the face's first triangle
+				const float* v0 = &cubeVertices[(face * 6) * CUBE_VERTEX_STRIDE];
+				const float* v1 = &cubeVertices[(face * 6 + 1) * CUBE_VERTEX_STRIDE];
+				const float* v2 = &cubeVertices[(face * 6 + 2) * CUBE_VERTEX_STRIDE];
+				glm::vec3 p0(v0[0], v0[1], v0[2]), p1(v1[0], v1[1], v1[2]), p2(v2[0], v2[1], v2[2]);
+				glm::vec2 t0(v0[6], v0[7]), t1(v1[6], v1[7]), t2(v2[6], v2[7]);
+
+				glm::mat2 uvToBarycentric = glm::inverse(glm::mat2(t1 - t0, t2 - t0));
+				glm::vec2 a = uvToBarycentric * glm::vec2(1.0f, 0.0f);
+				glm::vec2 b = uvToBarycentric * glm::vec2(0.0f, 1.0f);
+				glm::vec2 c = uvToBarycentric * -t0;
+				glm::vec3 axisU = (p1 - p0) * a.x + (p2 - p0) * a.y;
+				glm::vec3 axisV = (p1 - p0) * b.x + (p2 - p0) * b.y;
+				glm::vec3 origin = p0 + (p1 - p0) * c.x + (p2 - p0) * c.y;
+
+				Face worldFace;
+				worldFace.origin = glm::vec3(model * glm::vec4(origin, 1.0f));
+				worldFace.axisU = glm::mat3(model) * axisU;
+				worldFace.axisV = glm::mat3(model) * axisV;
+				worldFace.normal = glm::normalize(normalMatrix * glm::vec3(v0[3], v0[4], v0[5]));
+				faces.push_back(worldFace);
+			}
+		}
+	}
+
+	// irradiance arriving through diffuse interreflection, one path per call
+	glm::vec3 indirectLight(glm::vec3 position, glm::vec3 normal, BakeRandom& random, uint64_t& rays) const
+	{
+		glm::vec3 result(0.0f);
+		glm::vec3 throughput(1.0f);
+		for (uint32_t bounce = 0; bounce < settings.maxBounces; bounce++)
+		{
+			glm::vec3 direction = cosineSampleHemisphere(normal, random.next(), random.next());
+			if (!scene.trace(position + normal * 1e-3f, direction, position, normal, rays))
+				break;
+
+			// cosine sampling cancels the Lambert cos / pdf, leaving only the albedo
+			throughput *= settings.albedo;
+			result += throughput * scene.directLight(position, normal, false, rays);
+		}
+		return result;
+	}
+
+	uint64_t bakeTile(uint32_t tile)
+	{
+		const Face& face = faces[tile];
+		uint32_t tileX = (tile % tilesPerRow) * settings.tileSize;
+		uint32_t tileY = (tile / tilesPerRow) * settings.tileSize;
+		BakeRandom random = { 0x9E3779B9u * (tile + 1) };
+		uint64_t rays = 0;
+
+		for (uint32_t y = 0; y < settings.tileSize; y++)
+		{
+			for (uint32_t x = 0; x < settings.tileSize; x++)
+			{
+				// texels sit on the face edges too, so bilinear filtering never leaves the tile
+				float u = settings.tileSize > 1 ? x / float(settings.tileSize - 1) : 0.5f;
+				float v = settings.tileSize > 1 ? y / float(settings.tileSize - 1) : 0.5f;
+				glm::vec3 position = face.origin + face.axisU * u + face.axisV * v;
+
+				glm::vec3 irradiance = scene.directLight(position, face.normal, true, rays);
+				glm::vec3 indirect(0.0f);
+				for (uint32_t sample = 0; sample < settings.samplesPerTexel; sample++)
+					indirect += indirectLight(position, face.normal, random, rays);
+				if (settings.samplesPerTexel > 0)
+					irradiance += indirect / float(settings.samplesPerTexel);
+
+				texels[(tileY + y) * atlasSize + tileX + x] = irradiance;
+			}
+		}
+		return rays;
+	}
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef LOCK_FREE_QUEUE_H
+#define LOCK_FREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bounded multi-producer multi-consumer queue (Dmitry Vyukov's design): every cell carries a
+// sequence number that tells producers and consumers whether it's their turn, so pushing and
+// popping are a single compare-and-swap on the shared position and never take a lock.
+// The capacity is rounded up to a power of two; tryPush fails when the queue is full.
+template <typename T>
+class LockFreeQueue
+{
+    public:
+	LockFreeQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		cells = std::vector<Cell>(size);
+		mask = size - 1;
+		for (size_t i = 0; i < size; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	LockFreeQueue(const LockFreeQueue&) = delete;
+	LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+	bool tryPush(const T& value)
+	{
+		size_t position = pushPosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (difference == 0)
+			{
+				if (pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					cell.value = value;
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false; // full
+			}
+			else
+			{
+				position = pushPosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool tryPop(T& value)
+	{
+		size_t position = popPosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+			if (difference == 0)
+			{
+				if (popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					value = cell.value;
+					cell.sequence.store(position + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false; // empty
+			}
+			else
+			{
+				position = popPosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+    private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+
+		Cell() : sequence(0), value() {}
+		Cell(const Cell& other) : sequence(other.sequence.load(std::memory_order_relaxed)), value(other.value) {}
+	};
+
+	std::vector<Cell> cells;
+	size_t mask;
+	// padded apart so producers and consumers don't false share a cache line (padding rather
+	// than alignas, which would need C++17 aligned new for heap allocated queues)
+	char padding0[64];
+	std::atomic<size_t> pushPosition{ 0 };
+	char padding1[64];
+	std::atomic<size_t> popPosition{ 0 };
+};
+
+#endif
@@ -7,10 +7,39 @@
 
 #include "Shader.h"
 #include "Camera.h"
+#include "CameraBuffer.h"
 #include "Material.h"
 #include "Light.h"
-
+#include "LightManager.h"
+#include "LightSampler.h"
+#include "GLExtensions.h"
+#include "Scene.h"
+#include "LightmapBaker.h"
+#include "ProbeGridBaker.h"
+#include "IBLBaker.h"
+#include "GpuTimer.h"
+#include "InputLatencyTimer.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "TextureArrayPool.h"
+#include "BindlessTextures.h"
+#include "MaterialTable.h"
+#include "AssetPack.h"
+#include "FrustumCuller.h"
+#include "SceneBVH.h"
+#include "OcclusionCuller.h"
+#include "HiZCuller.h"
+#include "SceneView.h"
+#include "RayPicker.h"
+#include "MeshLod.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <random>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -19,8 +48,23 @@
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void processInput(GLFWwindow* window, int key, int scancode, int action, int mods);
-unsigned int loadTexture(const char* resourcePath);
+double updateCamera(GLFWwindow* window);
+unsigned int loadLightmap(const char* resourcePath, LightmapHeader& header);
+unsigned int loadProbeGrid(const char* resourcePath, ProbeGridHeader& header);
+unsigned int loadBrdfLut(const char* resourcePath);
+unsigned int loadEnvironment(const char* resourcePath, EnvironmentHeader& header);
+void addManyLights();
+void removeManyLights();
+std::string compressedTexturePath(const std::string& imagePath);
+uint32_t textureFormat(const char* ktx2Path);
+Shader* loadShader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "");
+Shader* loadComputeShader(const char* computePath, const std::string& defines = "");
+void setupCubeBatchVAO(unsigned int vao, unsigned int vertexBuffer, unsigned int instanceBuffer, unsigned int firstInstance = 0);
+void runCullBenchmark();
+void runBvhBenchmark();
+void runPickBenchmark();
 
 // settings
 const unsigned int SCR_WIDTH = 800;
@@ -28,31 +72,150 @@ const unsigned int SCR_HEIGHT = 600;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+CameraBuffer* cameraBuffer = NULL; // its matrices for every program, see loadShader
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+// the callbacks only gather input, updateCamera() applies it once a frame
+float mouseDeltaX = 0.0f;
+float mouseDeltaY = 0.0f;
+float scrollDelta = 0.0f;
+double pendingInputTime = -1.0; // when the oldest input not yet applied arrived
+bool pickRequested = false; // a left click picks what's under the crosshair in the next frame
 
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// textures are decoded in the background and uploaded at most this many bytes per frame
+const size_t TEXTURE_UPLOAD_BUDGET = 1 << 20;
+
 // lighting
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f); // the initial light cube position
 
 // Shaders
-Shader* lightingShader;
+Shader* lightingShader; // the active one of the variants below
+Shader* lightingShaders[2][2][2] = {}; // [PBR][many lights][bindless], the many light and bindless ones need SSBOs
 Shader* lightCubeShader;
 
+// Every light in the scene
+LightManager* lightManager;
+
+// Background texture decoding and uploads
+AsyncTextureLoader* textureLoader;
+// Every texture, shared between the materials that use it
+TextureCache* textureCache;
+// Same sized material textures as layers of texture arrays, NULL without glCopyImageSubData
+TextureArrayPool* textureArrays = NULL;
+// Material maps as bindless handles in a storage buffer, NULL without ARB_bindless_texture
+BindlessTextures* bindlessTextures = NULL;
+MaterialTable* materialTable = NULL;
+// Shaders, textures and the cube mesh from one mapped file, written by "AssetTool pack-assets";
+// NULL when it's missing or with --loose, everything then comes from the loose files
+AssetPack* assetPack = NULL;
+
+// Per instance attributes of the batched cube draw (locations 3 to 9 of 1.colors.vs)
+struct CubeInstance {
+	glm::mat4 model;
+	GLint materialLayers[2]; // diffuse and specular layer
+	GLint lightmapTileBase;
+	GLint materialIndex; // into the MaterialTable
+};
+
+// Many-light mode: a crowd of extra point lights, shaded by stochastic sampling
+const unsigned int MANY_LIGHT_COUNT = 100000;
+LightSampler* lightSampler = NULL;
+std::vector<LightHandle> manyLights;
+bool manyLightsToggle = false;
+
 // Wireframe toggle
 bool wireframeToggle = false;
 
-// Point light intensity configuration
-const float constant = 1.0f;
-const float linear = 0.7f;
-const float quadratic = 1.8f;
-
-int main()
+// Baked lighting toggle
+bool lightmapToggle = false;
+bool lightmapLoaded = false;
+bool probesToggle = false;
+bool probesLoaded = false;
+
+// Physically based shading toggle
+bool pbrToggle = false;
+bool shadingChanged = false;
+
+// Bindless material textures toggle, instead of binding texture units or arrays
+bool bindlessToggle = false;
+
+// Frustum culling toggle; off, every cube and light marker is submitted
+bool cullingToggle = true;
+
+// Occlusion culling toggle, on top of frustum culling: the nearest cubes are rasterized on the
+// CPU and whatever they hide isn't submitted
+bool occlusionToggle = true;
+const int OCCLUSION_WIDTH = 256;
+const int OCCLUSION_HEIGHT = 192;
+const double OCCLUSION_BUDGET_MS = 1.0;
+
+// Depth prepass toggle: the visible cubes' depth goes down first with a position only program,
+// then the lit pass shades only the fragments matching it (GL_EQUAL, no depth writes)
+bool depthPrepassToggle = false;
+Shader* depthPrepassShader;
+
+// Hi-Z culling toggle: the instanced draws cull the cubes on the GPU against a depth pyramid
+// instead, see HiZCuller.h; needs compute shaders
+bool hizToggle = false;
+HiZCuller* hizCuller = NULL;
+
+// The light markers' levels of detail, NULL without "AssetTool bake-lods" (the markers are then
+// cubes): a marker gets the coarsest level that's off by at most MARKER_LOD_PIXEL_ERROR pixels,
+// and with the fade toggle the next one dithers in over the last MARKER_LOD_FADE_BAND of the way
+MeshLodChain* markerLods = NULL;
+bool lodFadeToggle = true;
+const float MARKER_LOD_PIXEL_ERROR = 0.5f;
+const float MARKER_LOD_FADE_BAND = 0.5f;
+
+// Secondary view toggle: a side view in the top right corner, at half its resolution and
+// every other frame; its objects are culled in the same walk of the BVH as the main view's.
+// Not drawn in many-light mode, the light reservoirs are per pixel of the main view
+bool secondaryViewToggle = false;
+SceneView* secondaryView = NULL;
+const float SECONDARY_VIEW_SIZE = 0.3f; // of the window
+const float SECONDARY_VIEW_RESOLUTION = 0.5f;
+const unsigned int SECONDARY_VIEW_INTERVAL = 2;
+
+// command line switches to compare texture paths: --png skips the block compressed textures,
+// --driver-mips leaves the mips to glGenerateMipmap instead of the CPU filter, and
+// --texture-budget <MB> streams the mip levels within that much GPU memory, and --loose
+// reads the loose asset files instead of the asset pack; --cull-benchmark times culling a
+// million boxes and --bvh-benchmark building, refitting and querying a BVH before starting,
+// --pick-benchmark picking among a million boxes with and without the BVH;
+// --prepass-benchmark switches the depth prepass on and off at every report, so both are
+// measured on the same view
+bool pngTextures = false;
+bool driverMips = false;
+size_t textureBudget = 0;
+bool looseAssets = false;
+bool prepassBenchmark = false;
+
+int main(int argc, char** argv)
 {
+	camera.SetPerspective((float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+	for (int i = 1; i < argc; i++) {
+		pngTextures = pngTextures || std::strcmp(argv[i], "--png") == 0;
+		driverMips = driverMips || std::strcmp(argv[i], "--driver-mips") == 0;
+		looseAssets = looseAssets || std::strcmp(argv[i], "--loose") == 0;
+		prepassBenchmark = prepassBenchmark || std::strcmp(argv[i], "--prepass-benchmark") == 0;
+		if (std::strcmp(argv[i], "--cull-benchmark") == 0)
+			runCullBenchmark();
+		if (std::strcmp(argv[i], "--bvh-benchmark") == 0)
+			runBvhBenchmark();
+		if (std::strcmp(argv[i], "--pick-benchmark") == 0)
+			runPickBenchmark();
+		if (std::strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+			textureBudget = static_cast<size_t>(std::atof(argv[++i]) * 1024 * 1024);
+	}
+
+	std::chrono::steady_clock::time_point startupBegin = std::chrono::steady_clock::now();
+
 	// glfw: initialize and configure
 	// ------------------------------
 	glfwInit();
@@ -83,6 +246,8 @@ int main()
 	glfwSetCursorPosCallback(window, mouse_callback);
 	// Scroll movement
 	glfwSetScrollCallback(window, scroll_callback);
+	// Mouse buttons
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	// Key press and release
 	glfwSetKeyCallback(window, processInput);
 
@@ -96,14 +261,67 @@ int main()
 		return -1;
 	}
 
+	// pick up what the driver offers beyond GL 3.3
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
 	// configure global opengl state
 	// -----------------------------
 	glEnable(GL_DEPTH_TEST);
 
+	// map the asset pack before anything is loaded, it's checked first for every asset
+	if (!looseAssets) {
+		assetPack = new AssetPack();
+		if (!assetPack->open("Assets\\assets.pack")) {
+			std::cout << "No asset pack, loading the loose asset files" << std::endl;
+			delete assetPack;
+			assetPack = NULL;
+		}
+	}
+
+	// every program reads the camera from this one buffer
+	cameraBuffer = new CameraBuffer();
+	// looking at the cubes from their right
+	secondaryView = new SceneView(Camera(glm::vec3(12.0f, 2.0f, -6.0f), glm::vec3(0.0f, 1.0f, 0.0f), 180.0f, -8.0f),
+		1.0f - SECONDARY_VIEW_SIZE, 1.0f - SECONDARY_VIEW_SIZE, SECONDARY_VIEW_SIZE, SECONDARY_VIEW_SIZE, SECONDARY_VIEW_RESOLUTION, SECONDARY_VIEW_INTERVAL);
+
 	// build and compile our shader program
 	// ------------------------------------
-	lightingShader = new Shader("Assets\\Shaders\\1.colors.vs", "Assets\\Shaders\\1.colors.fs");
-	lightCubeShader = new Shader("Assets\\Shaders\\1.light_cube.vs", "Assets\\Shaders\\1.light_cube.fs");
+	// with SSBOs the lights come from the LightManager's buffers, otherwise from plain uniforms
+	std::string lightingDefines = glCaps().shaderStorage ? "#define LIGHTS_SSBO\n" : "";
+	bool manyLightsSupported = glCaps().shaderStorage && glCaps().imageLoadStore;
+	bool bindlessSupported = glCaps().shaderStorage && glCaps().bindlessTexture;
+	for (int pbr = 0; pbr < 2; pbr++) {
+		for (int many = 0; many < 2; many++) {
+			for (int bindless = 0; bindless < 2; bindless++) {
+				if ((many && !manyLightsSupported) || (bindless && !bindlessSupported))
+					continue;
+				std::string defines = lightingDefines + (pbr ? "#define PBR\n" : "") + (many ? "#define MANY_LIGHTS\n" : "")
+					+ (bindless ? "#define BINDLESS\n" : "");
+				Shader* shader = loadShader("Assets\\Shaders\\1.colors.vs", "Assets\\Shaders\\1.colors.fs", defines);
+				if (glCaps().shaderStorage) {
+					shader->bindStorageBlock("DirLights", DIR_LIGHT_BINDING);
+					shader->bindStorageBlock("PointLights", POINT_LIGHT_BINDING);
+					shader->bindStorageBlock("SpotLights", SPOT_LIGHT_BINDING);
+				}
+				if (many) {
+					shader->bindStorageBlock("LightAliasTable", LIGHT_ALIAS_BINDING);
+					shader->bindStorageBlock("PreviousReservoirs", PREVIOUS_RESERVOIR_BINDING);
+					shader->bindStorageBlock("CurrentReservoirs", CURRENT_RESERVOIR_BINDING);
+				}
+				if (bindless)
+					shader->bindStorageBlock("MaterialTable", MATERIAL_TABLE_BINDING);
+				lightingShaders[pbr][many][bindless] = shader;
+			}
+		}
+	}
+	lightingShader = lightingShaders[0][0][0];
+	if (manyLightsSupported)
+		lightSampler = new LightSampler();
+	else {
+		std::cout << "No shader storage buffer support, lights are limited to " << NR_POINT_LIGHTS << " point lights" << std::endl;
+	}
+	lightCubeShader = loadShader("Assets\\Shaders\\1.light_cube.vs", "Assets\\Shaders\\1.light_cube.fs");
+	depthPrepassShader = loadShader("Assets\\Shaders\\depth_prepass.vs", "Assets\\Shaders\\depth_prepass.fs");
 
 	// Material settings
 	Material material = {};
@@ -114,94 +332,52 @@ int main()
 	material.shininess = 32.0f;
 
 	// Light settings
-	Light pointLight = {};
-	Light spotLight = {};
-	Light dirLight = {};
-
-	pointLight.ambient = { 0.2f, 0.2f, 0.2f };
-	pointLight.diffuse = { 0.5f, 0.5f, 0.5f };
-	pointLight.specular = { 1.0f, 1.0f, 1.0f };
-
-	spotLight.ambient = { 0.1f, 0.1f, 0.1f };
-	spotLight.diffuse = { 0.8f, 0.8f, 0.8f };
-	spotLight.specular = { 1.0f, 1.0f, 1.0f };
+	lightManager = new LightManager(NR_POINT_LIGHTS + 2);
 
-	dirLight.ambient = { 0.2f, 0.2f, 0.2f };
-	dirLight.diffuse = { 0.5f, 0.5f, 0.5f };
-	dirLight.specular = { 1.0f, 1.0f, 1.0f };
-
-	glm::vec3 pointLightPositions[] = {
-		glm::vec3(0.7f,  0.2f,  2.0f),
-		glm::vec3(2.3f, -3.3f, -4.0f),
-		glm::vec3(-4.0f,  2.0f, -12.0f),
-		glm::vec3(0.0f,  0.0f, -3.0f)
-	};
-
-	float vertices[] = {
-		// positions          // normals           // texture coords
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-		0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
-
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
-		0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
-
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-		0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-		0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
-		0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
-		0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
-
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-		0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,
-		0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-		0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
-
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f
-	};
+	Light dirLight = {};
+	dirLight.direction = DIR_LIGHT_DIRECTION;
+	dirLight.ambient = DIR_LIGHT_AMBIENT;
+	dirLight.diffuse = DIR_LIGHT_DIFFUSE;
+	dirLight.specular = DIR_LIGHT_SPECULAR;
+	lightManager->add(Directional, dirLight);
+
+	for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++) {
+		Light pointLight = {};
+		pointLight.position = pointLightPositions[i];
+		pointLight.ambient = POINT_LIGHT_AMBIENT;
+		pointLight.diffuse = POINT_LIGHT_DIFFUSE;
+		pointLight.specular = POINT_LIGHT_SPECULAR;
+		pointLight.constant = POINT_LIGHT_CONSTANT;
+		pointLight.linear = POINT_LIGHT_LINEAR;
+		pointLight.quadratic = POINT_LIGHT_QUADRATIC;
+		lightManager->add(Point, pointLight);
+	}
 
-	glm::vec3 cubePositions[] = {
-		glm::vec3(0.0f,  0.0f,  0.0f),
-		glm::vec3(2.0f,  5.0f, -15.0f),
-		glm::vec3(-1.5f, -2.2f, -2.5f),
-		glm::vec3(-3.8f, -2.0f, -12.3f),
-		glm::vec3(2.4f, -0.4f, -3.5f),
-		glm::vec3(-1.7f,  3.0f, -7.5f),
-		glm::vec3(1.3f, -2.0f, -2.5f),
-		glm::vec3(1.5f,  2.0f, -2.5f),
-		glm::vec3(1.5f,  0.2f, -1.5f),
-		glm::vec3(-1.3f,  1.0f, -1.5f)
-	};
+	Light spotLight = {};
+	spotLight.position = camera.Position;
+	spotLight.direction = camera.Front;
+	spotLight.ambient = SPOT_LIGHT_AMBIENT;
+	spotLight.diffuse = SPOT_LIGHT_DIFFUSE;
+	spotLight.specular = SPOT_LIGHT_SPECULAR;
+	spotLight.constant = SPOT_LIGHT_CONSTANT;
+	spotLight.linear = SPOT_LIGHT_LINEAR;
+	spotLight.quadratic = SPOT_LIGHT_QUADRATIC;
+	spotLight.cutOff = glm::cos(glm::radians(SPOT_LIGHT_CUTOFF_DEGREES));
+	spotLight.outerCutOff = glm::cos(glm::radians(SPOT_LIGHT_OUTER_CUTOFF_DEGREES));
+	LightHandle flashlight = lightManager->add(Spotlight, spotLight);
 
 	// first, configure the cube's VAO (and VBO)
 	unsigned int VBO, cubeVAO;
 	glGenVertexArrays(1, &cubeVAO);
 	glGenBuffers(1, &VBO);
 
+	// the packed mesh goes straight from the mapped file into the buffer
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	const AssetPackEntry* cubeMesh = assetPack ? assetPack->find("Assets\\Meshes\\cube", ASSET_MESH) : NULL;
+	if (cubeMesh && cubeMesh->width == 36 && cubeMesh->height == 8)
+		glBufferData(GL_ARRAY_BUFFER, cubeMesh->size, assetPack->data(*cubeMesh), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
 
 	glBindVertexArray(cubeVAO);
 
@@ -217,11 +393,144 @@ int main()
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(sizeof(float) * 6));
 	glEnableVertexAttribArray(2);
 
-	// Load diffuse map image.
-	unsigned int diffuseMap = loadTexture("Assets\\Images\\container2.png");
+	// the same cube with per instance attributes, to draw every cube at once when their
+	// materials only differ in array layers; a range of instances and a VAO reading it for
+	// the main view and the side view each
+	unsigned int cubeBatchVAOs[2], instanceVBO;
+	glGenVertexArrays(2, cubeBatchVAOs);
+	glGenBuffers(1, &instanceVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, 2 * NR_CUBES * sizeof(CubeInstance), NULL, GL_DYNAMIC_DRAW);
+	setupCubeBatchVAO(cubeBatchVAOs[0], VBO, instanceVBO);
+	setupCubeBatchVAO(cubeBatchVAOs[1], VBO, instanceVBO, NR_CUBES);
+
+	// Textures decode on worker threads; they show a placeholder until they're uploaded
+	textureLoader = new AsyncTextureLoader(0, !driverMips, textureBudget);
+	// packed textures skip the workers, they're uploaded from the mapping when requested
+	if (assetPack)
+		textureLoader->usePack(assetPack);
+	if (textureBudget > 0 && driverMips)
+		std::cout << "Texture streaming reads the CPU mips back from their cache, it's off with --driver-mips" << std::endl;
+	if (glCaps().copyImage)
+		textureArrays = new TextureArrayPool();
+	textureCache = new TextureCache(*textureLoader, textureArrays);
+	// a bindless handle freezes the texture, streamed ones keep changing their levels
+	if (bindlessSupported && textureLoader->streamingBudgetBytes() == 0) {
+		bindlessTextures = new BindlessTextures();
+		textureCache->setBindless(bindlessTextures);
+		if (textureArrays)
+			textureArrays->setBindless(bindlessTextures);
+		materialTable = new MaterialTable(*bindlessTextures);
+	}
+
+	// the container maps as one texture with the specular mask in the diffuse alpha, written by
+	// "AssetTool pack-material"; one sampler less per fragment when the driver can sample it
+	const char* packedMaterialPath = "Assets\\Baked\\Textures\\container2_packed.ktx2";
+	uint32_t packedMaterialFormat = textureFormat(packedMaterialPath);
+	bool packedMaterial = !pngTextures && packedMaterialFormat != 0 && AsyncTextureLoader::supportsCompressedFormat(packedMaterialFormat);
+
+	// every cube gets its own material, but they all share the container maps
+	std::vector<Material> cubeMaterials(NR_CUBES, material);
+	for (Material& cubeMaterial : cubeMaterials) {
+		if (packedMaterial) {
+			cubeMaterial.diffuseMap = textureCache->acquire(packedMaterialPath);
+			cubeMaterial.specularMap = INVALID_TEXTURE;
+			cubeMaterial.specularInDiffuseAlpha = true;
+		}
+		else {
+			cubeMaterial.diffuseMap = textureCache->acquire(compressedTexturePath("Assets\\Images\\container2.png").c_str());
+			cubeMaterial.specularMap = textureCache->acquire(compressedTexturePath("Assets\\Images\\container2_specular.png").c_str());
+		}
+	}
+
+	// load the baked static lighting, written by "AssetTool bake-lightmap"
+	LightmapHeader lightmapHeader = {};
+	unsigned int lightmap = loadLightmap("Assets\\Baked\\scene.lightmap", lightmapHeader);
+	lightmapLoaded = lightmap != 0;
+
+	// load the ambient probe grid, written by "AssetTool bake-probes"
+	ProbeGridHeader probeGridHeader = {};
+	unsigned int probeGrid = loadProbeGrid("Assets\\Baked\\scene.probes", probeGridHeader);
+	probesLoaded = probeGrid != 0;
+
+	// load the image based lighting of the PBR mode, written by "AssetTool bake-ibl"
+	unsigned int brdfLut = loadBrdfLut("Assets\\Baked\\brdf.lut");
+	EnvironmentHeader environmentHeader = {};
+	unsigned int environment = loadEnvironment("Assets\\Baked\\environment.cube", environmentHeader);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	// load the light marker's levels of detail, written by "AssetTool bake-lods"
+	std::vector<LodMesh> markerChain;
+	if (readLodChain("Assets\\Baked\\marker.lods", markerChain))
+		markerLods = new MeshLodChain(markerChain);
+	else
+		std::cout << "No marker LODs loaded, run AssetTool bake-lods first" << std::endl;
+
+	// the baked lighting keeps its units for good: the render loop only ever activates the
+	// material units, so neither it nor the texture uploads in between disturb these
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, lightmap);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_3D, probeGrid);
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, brdfLut);
+	glActiveTexture(GL_TEXTURE6);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, environment);
+	glActiveTexture(GL_TEXTURE0);
+
+	// the cubes and the light markers in one BVH: objects below NR_CUBES are cubes, the rest
+	// markers. The cubes never move, the markers follow their lights and are refit every frame
+	SceneBVH sceneBVH;
+	CullBoxes cubeBounds;
+	for (unsigned int i = 0; i < NR_CUBES; i++)
+		cubeBounds.add(cubeModelMatrix(i), glm::vec3(0.5f));
+	for (unsigned int i = 0; i < NR_CUBES; i++) {
+		glm::vec3 center(cubeBounds.centerX[i], cubeBounds.centerY[i], cubeBounds.centerZ[i]);
+		glm::vec3 extent(cubeBounds.extentX[i], cubeBounds.extentY[i], cubeBounds.extentZ[i]);
+		sceneBVH.insert(center - extent, center + extent, i);
+	}
+	const glm::vec3 MARKER_EXTENT(0.1f); // the light cube is scaled to 0.2
+	uint32_t markerProxies[NR_POINT_LIGHTS];
+	for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+		markerProxies[i] = sceneBVH.insert(pointLightPositions[i] - MARKER_EXTENT, pointLightPositions[i] + MARKER_EXTENT, NR_CUBES + i);
+	sceneBVH.rebuild();
+	std::vector<uint32_t> visibleObjects[2], visibleCubes, visibleLights; // objects of the main and the secondary view
+	double cullMilliseconds = 0.0;
+	unsigned int culledFrames = 0;
+	OcclusionCuller* occlusionCuller = new OcclusionCuller(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+	std::vector<std::pair<float, uint32_t>> occluderOrder;
+
+	// the GPU culling path over the same cube boxes; its VAO reads the instances it picks
+	unsigned int hizBatchVAO = 0;
+	if (HiZCuller::supported()) {
+		hizCuller = new HiZCuller(loadComputeShader("Assets\\Shaders\\hiz_cull.comp"), loadComputeShader("Assets\\Shaders\\hiz_pyramid.comp"),
+			loadComputeShader("Assets\\Shaders\\hiz_pyramid.comp", "#define FROM_DEPTH\n"), sizeof(CubeInstance));
+		hizCuller->setBounds(cubeBounds);
+		glGenVertexArrays(1, &hizBatchVAO);
+		setupCubeBatchVAO(hizBatchVAO, VBO, hizCuller->drawInstances());
+	}
 
-	// load the specular map image.
-	unsigned int specularMap = loadTexture("Assets\\Images\\container2_specular.png");
+	// measures the lit cubes, to compare the per pixel cost of the two shading modes
+	GpuTimer* litPassTimer = new GpuTimer();
+	// and the depth prepass; the last report of each mode tells whether the prepass pays off
+	GpuTimer* prepassTimer = new GpuTimer();
+	double litMilliseconds[2] = { -1.0, -1.0 }; // without, with the prepass
+	double litFragments[2] = { 0.0, 0.0 };
+	double prepassMilliseconds = 0.0;
+	// and the side view, whenever it's drawn; the report spreads it over every frame
+	GpuTimer* secondaryTimer = new GpuTimer();
+	unsigned int secondaryFrames = 0;
+	// how long the camera takes to follow the mouse and keys, up to the GPU finishing the frame
+	InputLatencyTimer* inputLatencyTimer = new InputLatencyTimer();
+	float lastReport = 0.0f;
+	unsigned int reportFrames = 0;
+	uint64_t frameNumber = 0;
+	// the marker vertices drawn through the LODs, against all of them at full detail
+	uint64_t markerVertices = 0;
+	uint64_t markerFullVertices = 0;
+
+	bool firstFrame = true;
+	bool texturesReported = false;
 
 	unsigned int lightCubeVAO;
 	glGenVertexArrays(1, &lightCubeVAO);
@@ -242,131 +551,560 @@ int main()
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
+		// upload whatever the workers finished decoding, within this frame's budget
+		textureLoader->update(TEXTURE_UPLOAD_BUDGET);
+		textureCache->update();
+
 		// render
 		// ------
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// input is sampled as late as it can be, just before the camera is first read
+		double inputTime = updateCamera(window);
+		if (inputTime >= 0.0)
+			inputLatencyTimer->inputApplied(glfwGetTime() - inputTime);
+		reportFrames++;
+		frameNumber++;
+
 		// be sure to activate shader when setting uniforms/drawing objects
 		lightingShader->use();
 		lightingShader->setVec3("objectColor", 1.0f, 0.5f, 0.31f);
 		lightingShader->setVec3("lightColor", 1.0f, 1.0f, 1.0f);
-		lightingShader->setVec3("viewPos", camera.Position);
 
-		// Activate the first texture
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap);
-
-		// The second one, where the shininess is present
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularMap);
+		// The baked static lighting
+		lightingShader->setInt("lightmap", 3);
+		lightingShader->setBool("useLightmap", lightmapToggle && lightmapLoaded);
+		lightingShader->setInt("lightmapTilesPerRow", lightmapHeader.tilesPerRow);
+		lightingShader->setFloat("lightmapTileSize", static_cast<float>(lightmapHeader.tileSize));
+
+		// The baked ambient probes
+		lightingShader->setInt("probeGrid", 4);
+		lightingShader->setBool("useProbes", probesToggle && probesLoaded);
+		lightingShader->setVec3("probeGridMin", glm::vec3(probeGridHeader.boundsMin[0], probeGridHeader.boundsMin[1], probeGridHeader.boundsMin[2]));
+		lightingShader->setVec3("probeGridMax", glm::vec3(probeGridHeader.boundsMax[0], probeGridHeader.boundsMax[1], probeGridHeader.boundsMax[2]));
+		lightingShader->setVec3("probeGridSize", glm::vec3(probeGridHeader.size[0], probeGridHeader.size[1], probeGridHeader.size[2]));
+
+		// The precomputed image based lighting, only read by the PBR mode
+		if (pbrToggle) {
+			lightingShader->setInt("brdfLUT", 5);
+			lightingShader->setInt("prefilterMap", 6);
+			lightingShader->setFloat("prefilterMaxLod", static_cast<float>(environmentHeader.mipCount - 1));
+			lightingShader->setVec3("pbrAmbient", DIR_LIGHT_AMBIENT);
+		}
 		
 		// Set the material
 		lightingShader->setInt("material.diffuse", 0);
 		lightingShader->setInt("material.specular", 1);
 		lightingShader->setInt("material.emission", 2);
+		lightingShader->setInt("material.diffuseArray", 7);
+		lightingShader->setInt("material.specularArray", 8);
 		lightingShader->setFloat("material.shininess", material.shininess);
 
-		// directional light
-		lightingShader->setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-		//lightingShader->setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-		//lightingShader->setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-
-		lightingShader->setVec3("dirLight.ambient", 0.01f, 0.2f, 0.01f);
-		lightingShader->setVec3("dirLight.diffuse", 0.01f, 0.2f, 0.01f);
-		lightingShader->setVec3("dirLight.specular", 0.5f, 0.2f, 0.5f);
-		// point light 1
-		lightingShader->setVec3("pointLights[0].position", pointLightPositions[0]);
-		lightingShader->setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader->setVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader->setVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader->setFloat("pointLights[0].constant", constant);
-		lightingShader->setFloat("pointLights[0].linear", linear);
-		lightingShader->setFloat("pointLights[0].quadratic", quadratic);
-		// point light 2
-		lightingShader->setVec3("pointLights[1].position", pointLightPositions[1]);
-		lightingShader->setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader->setVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader->setVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader->setFloat("pointLights[1].constant", constant);
-		lightingShader->setFloat("pointLights[1].linear", linear);
-		lightingShader->setFloat("pointLights[1].quadratic", quadratic);
-		// point light 3
-		lightingShader->setVec3("pointLights[2].position", pointLightPositions[2]);
-		lightingShader->setVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader->setVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader->setVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader->setFloat("pointLights[2].constant", constant);
-		lightingShader->setFloat("pointLights[2].linear", linear);
-		lightingShader->setFloat("pointLights[2].quadratic", quadratic);
-		// point light 4
-		lightingShader->setVec3("pointLights[3].position", pointLightPositions[3]);
-		lightingShader->setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-		lightingShader->setVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-		lightingShader->setVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-		lightingShader->setFloat("pointLights[3].constant", constant);
-		lightingShader->setFloat("pointLights[3].linear", linear);
-		lightingShader->setFloat("pointLights[3].quadratic", quadratic);
-		// spotLight
-		lightingShader->setVec3("spotLight.position", camera.Position);
-		lightingShader->setVec3("spotLight.direction", camera.Front);
-		lightingShader->setVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-		lightingShader->setVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-		lightingShader->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-		lightingShader->setFloat("spotLight.constant", 1.0f);
-		lightingShader->setFloat("spotLight.linear", 0.09f);
-		lightingShader->setFloat("spotLight.quadratic", 0.032f);
-		lightingShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(7.5f)));
-		lightingShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(12.5f)));
-
-		// view/projection transformations
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-		lightingShader->setMat4("projection", projection);
-		lightingShader->setMat4("view", view);
-
-		// world transformation
-		glm::mat4 model = glm::mat4(1.0f);
-		lightingShader->setMat4("model", model);
-
-		for (unsigned int i = 0; i < 10; i++)
+		// lights; only the flashlight moves, so only its entry is re-uploaded
+		lightManager->setPosition(flashlight, camera.Position);
+		lightManager->setDirection(flashlight, camera.Front);
+		if (glCaps().shaderStorage) {
+			lightManager->upload();
+			lightManager->bind(*lightingShader);
+		}
+		else {
+			lightManager->applyUniforms(*lightingShader, NR_POINT_LIGHTS);
+		}
+
+		// view/projection transformations, published once for every program
+		cameraBuffer->publish(camera);
+		const glm::mat4& viewProjection = camera.GetViewProjectionMatrix();
+
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		bool secondaryDue = secondaryViewToggle && !manyLightsToggle && secondaryView->due(frameNumber);
+		if (secondaryDue)
+			secondaryView->fit(framebufferWidth, framebufferHeight);
+
+		// only what's in the view frustum is drawn; without culling the lists hold everything
+		std::chrono::steady_clock::time_point cullBegin = std::chrono::steady_clock::now();
+		const std::vector<glm::vec3>& lightPositions = lightManager->positions(Point);
+		unsigned int markerCount = static_cast<unsigned int>(std::min<size_t>(lightPositions.size(), NR_POINT_LIGHTS));
+		for (unsigned int i = 0; i < markerCount; i++)
+			sceneBVH.update(markerProxies[i], lightPositions[i] - MARKER_EXTENT, lightPositions[i] + MARKER_EXTENT);
+		sceneBVH.refit();
+		visibleCubes.clear();
+		visibleLights.clear();
+		auto splitObjects = [&](const std::vector<uint32_t>& objects, std::vector<uint32_t>& cubes, std::vector<uint32_t>& lights) {
+			cubes.clear();
+			lights.clear();
+			for (uint32_t object : objects) {
+				if (object < NR_CUBES)
+					cubes.push_back(object);
+				else if (object - NR_CUBES < markerCount)
+					lights.push_back(object - NR_CUBES);
+			}
+			// in cube order, so cubes sharing textures keep following each other
+			std::sort(cubes.begin(), cubes.end());
+		};
+		if (cullingToggle) {
+			// both views in one walk of the tree when the secondary one is drawn this frame
+			Frustum frusta[2] = { extractFrustum(viewProjection) };
+			unsigned int viewCount = 1;
+			if (secondaryDue)
+				frusta[viewCount++] = extractFrustum(secondaryView->camera.GetViewProjectionMatrix());
+			sceneBVH.cull(frusta, viewCount, visibleObjects);
+			splitObjects(visibleObjects[0], visibleCubes, visibleLights);
+			if (secondaryDue)
+				splitObjects(visibleObjects[1], secondaryView->visibleCubes, secondaryView->visibleLights);
+		}
+		else {
+			for (unsigned int i = 0; i < NR_CUBES; i++)
+				visibleCubes.push_back(i);
+			for (unsigned int i = 0; i < markerCount; i++)
+				visibleLights.push_back(i);
+			secondaryView->visibleCubes = visibleCubes;
+			secondaryView->visibleLights = visibleLights;
+		}
+		if (cullingToggle && occlusionToggle) {
+			// the visible cubes are the occluders, nearest first, so the ones that hide the most
+			// get drawn if the budget runs out
+			occluderOrder.clear();
+			for (uint32_t i : visibleCubes)
+				occluderOrder.push_back(std::make_pair(glm::length(cubePositions[i] - camera.Position), i));
+			std::sort(occluderOrder.begin(), occluderOrder.end());
+			occlusionCuller->begin(OCCLUSION_BUDGET_MS);
+			for (const std::pair<float, uint32_t>& occluder : occluderOrder) {
+				if (!occlusionCuller->addOccluder(viewProjection * cubeModelMatrix(occluder.second), cubeVertices, CUBE_VERTEX_COUNT, CUBE_VERTEX_STRIDE))
+					break;
+			}
+			occlusionCuller->rasterize();
+
+			// a cube's own box is never behind its surface, so the occluders stay visible
+			size_t kept = 0;
+			for (uint32_t i : visibleCubes) {
+				glm::vec3 center(cubeBounds.centerX[i], cubeBounds.centerY[i], cubeBounds.centerZ[i]);
+				glm::vec3 extent(cubeBounds.extentX[i], cubeBounds.extentY[i], cubeBounds.extentZ[i]);
+				if (occlusionCuller->testBox(viewProjection, center - extent, center + extent))
+					visibleCubes[kept++] = i;
+			}
+			visibleCubes.resize(kept);
+			kept = 0;
+			for (uint32_t i : visibleLights) {
+				if (occlusionCuller->testBox(viewProjection, lightPositions[i] - MARKER_EXTENT, lightPositions[i] + MARKER_EXTENT))
+					visibleLights[kept++] = i;
+			}
+			visibleLights.resize(kept);
+		}
+		size_t visibleCubeCount = visibleCubes.size();
+		size_t visibleLightCount = visibleLights.size();
+		cullMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullBegin).count();
+		culledFrames++;
+
+		// what's under the crosshair, on the CPU against the boxes just refitted for culling, so
+		// nothing waits for the GPU; a cube's leaf holds the world box around it, the ray is
+		// then tested against the turned cube itself
+		if (pickRequested) {
+			pickRequested = false;
+			std::chrono::steady_clock::time_point pickBegin = std::chrono::steady_clock::now();
+			glm::vec3 origin, direction;
+			camera.GetRay(0.0f, 0.0f, origin, direction);
+			SceneRayHit hit;
+			bool picked = sceneBVH.raycast(origin, direction, FAR_PLANE, [&](uint32_t object, float boxT, float& t) {
+				if (object < NR_CUBES)
+					return rayEntersModelBox(origin, direction, cubeModelMatrix(object), glm::vec3(0.5f), FAR_PLANE, t);
+				t = boxT;
+				return object - NR_CUBES < markerCount;
+			}, hit);
+			double pickMicroseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pickBegin).count();
+			if (picked) {
+				glm::vec3 position = origin + direction * hit.t;
+				std::cout << "Picked " << (hit.object < NR_CUBES ? "cube " : "light ") << (hit.object < NR_CUBES ? hit.object : hit.object - NR_CUBES)
+					<< " at (" << position.x << ", " << position.y << ", " << position.z << "), " << glm::length(position - camera.Position)
+					<< " away, in " << pickMicroseconds << " us" << std::endl;
+			}
+			else {
+				std::cout << "Picked nothing, in " << pickMicroseconds << " us" << std::endl;
+			}
+		}
+
+		// the crowd of point lights is sampled, a fixed number of them per pixel
+		if (manyLightsToggle) {
+			lightSampler->resize(framebufferWidth, framebufferHeight);
+			lightSampler->update(*lightManager);
+			lightSampler->bind(*lightingShader, viewProjection);
+		}
+
+		// how big every cube shows on screen (they're unit cubes), for the levels their maps need
+		if (textureLoader->streamingBudgetBytes() > 0) {
+			float pixelsPerUnit = framebufferHeight / (2.0f * glm::tan(glm::radians(camera.Zoom) * 0.5f));
+			for (unsigned int i = 0; i < NR_CUBES; i++) {
+				float distance = std::max(glm::length(cubePositions[i] - camera.Position), 0.1f);
+				float pixels = pixelsPerUnit / distance;
+				textureLoader->requestResolution(textureCache->texture(cubeMaterials[i].diffuseMap), pixels);
+				textureLoader->requestResolution(textureCache->texture(cubeMaterials[i].specularMap), pixels);
+			}
+		}
+
+		if (shadingChanged) {
+			litPassTimer->reset();
+			prepassTimer->reset();
+			shadingChanged = false;
+		}
+
+		// every cube in one draw once all of their maps are layers of the same arrays
+		TextureLayer firstDiffuse = textureCache->layer(cubeMaterials[0].diffuseMap);
+		TextureLayer firstSpecular = textureCache->layer(cubeMaterials[0].specularMap);
+		bool packed = cubeMaterials[0].specularInDiffuseAlpha;
+		bool batched = textureArrays != NULL && !bindlessToggle;
+		for (unsigned int i = 0; i < NR_CUBES && batched; i++)
 		{
-			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[i]);
-			float angle = 20.0f * i;
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			lightingShader->setMat4("model", model);
+			TextureLayer diffuse = textureCache->layer(cubeMaterials[i].diffuseMap);
+			TextureLayer specular = textureCache->layer(cubeMaterials[i].specularMap);
+			batched = diffuse.layer >= 0 && diffuse.array == firstDiffuse.array && cubeMaterials[i].specularInDiffuseAlpha == packed
+				&& (packed || (specular.layer >= 0 && specular.array == firstSpecular.array));
+		}
 
-			glBindVertexArray(cubeVAO);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+		// the instances of every view drawn this frame, each view in its own range of instanceVBO
+		// and all of them uploaded at once: the main view's prepass and lit pass read the same
+		// range, and the side view doesn't overwrite one that's still being drawn from. With Hi-Z
+		// culling the main view's instances are every cube and the GPU picks
+		bool hizActive = hizToggle && hizCuller;
+		CubeInstance instances[2][NR_CUBES];
+		size_t instanceCounts[2] = { 0, 0 };
+		auto fillInstances = [&](const std::vector<uint32_t>& cubes, bool allCubes, CubeInstance* viewInstances) {
+			size_t count = allCubes ? NR_CUBES : cubes.size();
+			for (size_t v = 0; v < count; v++)
+			{
+				unsigned int i = allCubes ? static_cast<unsigned int>(v) : cubes[v];
+				viewInstances[v].model = cubeModelMatrix(i);
+				// bindless materials find their maps through materialIndex instead
+				viewInstances[v].materialLayers[0] = batched ? textureCache->layer(cubeMaterials[i].diffuseMap).layer : -1;
+				viewInstances[v].materialLayers[1] = batched && !packed ? textureCache->layer(cubeMaterials[i].specularMap).layer : -1;
+				viewInstances[v].lightmapTileBase = i * CUBE_FACE_COUNT;
+				viewInstances[v].materialIndex = i;
+			}
+			return count;
+		};
+		instanceCounts[0] = fillInstances(visibleCubes, hizActive, instances[0]);
+		if (secondaryDue)
+			instanceCounts[1] = fillInstances(secondaryView->visibleCubes, false, instances[1]);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, (secondaryDue ? NR_CUBES + instanceCounts[1] : instanceCounts[0]) * sizeof(CubeInstance), instances);
+
+		// the lit cubes of a view (0 the main one, 1 the side view), with whichever program and
+		// state is current; Hi-Z culling is only for the main view, the pyramid is built from
+		// the window's depth
+		auto drawLitCubes = [&](int view, const std::vector<uint32_t>& cubes, bool viewHiz, unsigned int& cubeDraws, unsigned int& textureBinds) {
+			auto drawInstances = [&]() {
+				if (viewHiz) {
+					glBindVertexArray(hizBatchVAO);
+					hizCuller->draw(36, viewProjection, instances[0], framebufferWidth, framebufferHeight);
+					cubeDraws += 2;
+				}
+				else if (instanceCounts[view] > 0) {
+					glBindVertexArray(cubeBatchVAOs[view]);
+					glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(instanceCounts[view]));
+					cubeDraws++;
+				}
+			};
+
+			// bindless: the materials are a table of texture handles, every cube goes into one draw
+			// and no texture unit is touched; the placeholder stands in for maps still loading
+			if (bindlessToggle) {
+				materialTable->bind();
+				drawInstances();
+			}
+
+			if (batched && instanceCounts[view] > 0) {
+				glActiveTexture(GL_TEXTURE7);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrays->texture(firstDiffuse));
+				textureBinds++;
+				if (!packed) {
+					glActiveTexture(GL_TEXTURE8);
+					glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrays->texture(firstSpecular));
+					textureBinds++;
+				}
+				lightingShader->setBool("material.specularInDiffuseAlpha", packed);
+				drawInstances();
+			}
+
+			// one draw per cube; materials sharing textures share the bindings too. A map may
+			// already be an array layer while the other one is still loading
+			unsigned int bound[4] = {}; // diffuse, specular, diffuse array, specular array
+			int boundPacking = -1;
+			for (size_t v = 0; v < cubes.size() && !batched && !bindlessToggle; v++)
+			{
+				unsigned int i = cubes[v];
+				TextureLayer layers[2] = { textureCache->layer(cubeMaterials[i].diffuseMap), textureCache->layer(cubeMaterials[i].specularMap) };
+				unsigned int maps[2] = { textureCache->texture(cubeMaterials[i].diffuseMap), textureCache->texture(cubeMaterials[i].specularMap) };
+				for (int map = 0; map < 2; map++) {
+					bool inArray = layers[map].layer >= 0;
+					unsigned int texture = inArray ? textureArrays->texture(layers[map]) : maps[map];
+					int slot = inArray ? map + 2 : map;
+					if (texture != 0 && texture != bound[slot]) {
+						glActiveTexture(inArray ? GL_TEXTURE7 + map : GL_TEXTURE0 + map);
+						glBindTexture(inArray ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, texture);
+						bound[slot] = texture;
+						textureBinds++;
+					}
+				}
+				if (static_cast<int>(cubeMaterials[i].specularInDiffuseAlpha) != boundPacking) {
+					boundPacking = cubeMaterials[i].specularInDiffuseAlpha;
+					lightingShader->setBool("material.specularInDiffuseAlpha", cubeMaterials[i].specularInDiffuseAlpha);
+				}
+
+				// cubeVAO has no instance arrays, the attributes hold these values for the draw
+				glm::mat4 model = cubeModelMatrix(i);
+				for (int column = 0; column < 4; column++)
+					glVertexAttrib4fv(3 + column, glm::value_ptr(model[column]));
+				glVertexAttribI2i(7, layers[0].layer, layers[1].layer);
+				glVertexAttribI1i(8, i * CUBE_FACE_COUNT);
+				glVertexAttribI1i(9, i);
+
+				glBindVertexArray(cubeVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 36);
+				cubeDraws++;
+			}
+		};
+
+		// the material table goes up once for every view
+		if (bindlessToggle)
+			materialTable->update(cubeMaterials, *textureCache, textureArrays);
+
+		// the depth of the main view's cubes first, in one instanced draw whichever path shades
+		// them; always in many-light mode, whose reservoirs are only written by the visible fragment
+		bool depthPrepassActive = depthPrepassToggle || manyLightsToggle;
+		if (depthPrepassActive && instanceCounts[0] > 0) {
+			prepassTimer->begin();
+			depthPrepassShader->use();
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			glBindVertexArray(cubeBatchVAOs[0]);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(instanceCounts[0]));
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			prepassTimer->end();
+
+			lightingShader->use();
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
+
+		litPassTimer->begin();
+		unsigned int cubeDraws = 0;
+		unsigned int textureBinds = 0;
+		drawLitCubes(0, visibleCubes, hizActive, cubeDraws, textureBinds);
+		litPassTimer->end();
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+
+		if (currentFrame - lastReport > 2.0f && litPassTimer->measuredFrames() > 0) {
+			std::cout << (pbrToggle ? "PBR" : "Phong") << (manyLightsToggle ? " + many lights" : "") << (bindlessToggle ? " + bindless" : "")
+				<< (depthPrepassActive ? " + depth prepass" : "") << " lit pass: " << litPassTimer->averageMilliseconds() << " ms, "
+				<< static_cast<uint64_t>(litPassTimer->averageFragments()) << " fragments, "
+				<< litPassTimer->nanosecondsPerFragment() << " ns/fragment, " << cubeDraws << (cubeDraws == 1 ? " draw, " : " draws, ") << textureBinds << " texture binds" << std::endl;
+			// overdraw: how many more fragments pass the depth test without the prepass than with it
+			int prepassMode = depthPrepassActive ? 1 : 0;
+			litMilliseconds[prepassMode] = litPassTimer->averageMilliseconds();
+			litFragments[prepassMode] = litPassTimer->averageFragments();
+			if (depthPrepassActive)
+				prepassMilliseconds = prepassTimer->averageMilliseconds();
+			if (litMilliseconds[0] >= 0.0 && litMilliseconds[1] >= 0.0) {
+				double overdraw = litFragments[1] > 0.0 ? litFragments[0] / litFragments[1] : 0.0;
+				double withPrepass = prepassMilliseconds + litMilliseconds[1];
+				std::cout << "Depth prepass: " << prepassMilliseconds << " ms + " << litMilliseconds[1] << " ms lit, against " << litMilliseconds[0]
+					<< " ms without at " << overdraw << "x overdraw; the prepass " << (withPrepass < litMilliseconds[0] ? "wins" : "loses") << std::endl;
+			}
+			litPassTimer->reset();
+			prepassTimer->reset();
+
+			double frameMilliseconds = (currentFrame - lastReport) * 1000.0 / reportFrames;
+			if (inputLatencyTimer->measuredInputs() > 0) {
+				double latency = inputLatencyTimer->averageMilliseconds();
+				std::cout << "Input latency: " << latency << " ms, " << latency / frameMilliseconds << " frames at " << frameMilliseconds << " ms per frame" << std::endl;
+				inputLatencyTimer->reset();
+			}
+			if (markerFullVertices > 0) {
+				std::cout << "Marker LOD" << (lodFadeToggle ? " with cross-fade" : "") << ": " << markerVertices / reportFrames
+					<< " vertices per frame, " << 100.0 * markerVertices / markerFullVertices << "% of full detail" << std::endl;
+				markerVertices = 0;
+				markerFullVertices = 0;
+			}
+			if (secondaryFrames > 0 && secondaryTimer->measuredFrames() > 0) {
+				double perFrame = secondaryTimer->averageMilliseconds() * secondaryFrames / reportFrames;
+				std::cout << "Secondary view: " << secondaryTimer->averageMilliseconds() << " ms when drawn, " << secondaryFrames << " of " << reportFrames
+					<< " frames, " << perFrame << " ms per frame against " << litMilliseconds[prepassMode] << " ms for the main lit pass" << std::endl;
+			}
+			secondaryTimer->reset();
+			secondaryFrames = 0;
+			lastReport = currentFrame;
+			reportFrames = 0;
+			if (prepassBenchmark) {
+				depthPrepassToggle = !depthPrepassToggle;
+				shadingChanged = true;
+			}
+
+			std::cout << "Culling " << (cullingToggle ? "on" : "off") << ": " << visibleCubeCount << " of " << NR_CUBES << " cubes and "
+				<< visibleLightCount << " of " << markerCount << " light markers visible, " << cullMilliseconds / culledFrames << " ms" << std::endl;
+			cullMilliseconds = 0.0;
+			culledFrames = 0;
+			if (cullingToggle && occlusionToggle) {
+				const OcclusionStats& occlusion = occlusionCuller->stats();
+				std::cout << "Occlusion culling: " << occlusion.occludedBoxes << " of " << occlusion.testedBoxes << " boxes hidden by "
+					<< occlusion.occluderTriangles << " occluder triangles, " << occlusion.milliseconds << " ms to rasterize"
+					<< (occlusion.overBudget ? ", over budget" : "") << std::endl;
+			}
+			if (hizToggle && hizCuller && hizCuller->stats().frames > 0) {
+				const HiZStats& hiz = hizCuller->stats();
+				double frames = static_cast<double>(hiz.frames);
+				std::cout << "Hi-Z culling: " << hiz.culledPercent() << "% of the cubes culled per frame, " << hiz.outsideFrustum / frames
+					<< " outside the frustum and " << hiz.occluded / frames << " occluded; " << hiz.drawnFirst / frames << " drawn before the pyramid, "
+					<< hiz.drawnSecond / frames << " after" << std::endl;
+				hizCuller->resetStats();
+			}
+
+			if (textureLoader->streamingBudgetBytes() > 0) {
+				std::cout << "Texture streaming: " << textureLoader->streamedResidentBytes() / 1024 << " of " << textureLoader->streamingBudgetBytes() / 1024
+					<< " KB, " << textureLoader->streamedLevelCount() << " levels streamed in, " << textureLoader->evictedLevelCount() << " evicted" << std::endl;
+				TextureHandle maps[2] = { cubeMaterials[0].diffuseMap, cubeMaterials[0].specularMap };
+				const char* names[2] = { "diffuse", "specular" };
+				for (int map = 0; map < 2; map++) {
+					TextureStreamStats stats;
+					if (textureLoader->streamStats(textureCache->texture(maps[map]), stats)) {
+						std::cout << "  " << names[map] << " map: level " << stats.residentLevel << " of " << stats.levelCount << " resident, "
+							<< stats.wantedLevel << " wanted, " << stats.bytes / 1024 << " KB" << std::endl;
+					}
+				}
+			}
 		}
 
 		// point light
 		lightCubeShader->use();
-		lightCubeShader->setMat4("projection", projection);
-		lightCubeShader->setMat4("view", view);
 
-		for (unsigned int i = 0; i < 4; i++)
-		{
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, pointLightPositions[i]);
-			model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-			lightCubeShader->setMat4("model", model);
+		lightCubeShader->setVec2("ditherRange", 0.0f, 1.0f);
 
-			glBindVertexArray(lightCubeVAO);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+		// only the scene's own lights get a marker, not the sampled crowd added after them; the
+		// LODs are picked for the view's own camera and size, only the main view is counted
+		auto drawMarkers = [&](const Camera& viewCamera, const std::vector<uint32_t>& lights, float viewportHeight, bool counted)
+		{
+			float markerPixelsPerUnit = lodPixelsPerUnit(glm::radians(viewCamera.Zoom), viewportHeight);
+			for (size_t v = 0; v < lights.size(); v++)
+			{
+				glm::mat4 model = glm::mat4(1.0f);
+				model = glm::translate(model, lightPositions[lights[v]]);
+				if (!markerLods) {
+					model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
+					lightCubeShader->setMat4("model", model);
+
+					glBindVertexArray(lightCubeVAO);
+					glDrawArrays(GL_TRIANGLES, 0, 36);
+					continue;
+				}
+
+				lightCubeShader->setMat4("model", model);
+				float distance = glm::length(lightPositions[lights[v]] - viewCamera.Position);
+				LodSelection lod = markerLods->select(distance, 1.0f, markerPixelsPerUnit, MARKER_LOD_PIXEL_ERROR, lodFadeToggle ? MARKER_LOD_FADE_BAND : 0.0f);
+				if (lod.fadeLevel >= 0) {
+					// complementary halves of the dither, every pixel gets exactly one of the two levels
+					lightCubeShader->setVec2("ditherRange", lod.fade, 1.0f);
+					markerLods->draw(lod.level);
+					lightCubeShader->setVec2("ditherRange", 0.0f, lod.fade);
+					markerLods->draw(lod.fadeLevel);
+					lightCubeShader->setVec2("ditherRange", 0.0f, 1.0f);
+					if (counted)
+						markerVertices += markerLods->vertexCount(lod.fadeLevel);
+				}
+				else {
+					markerLods->draw(lod.level);
+				}
+				if (counted) {
+					markerVertices += markerLods->vertexCount(lod.level);
+					markerFullVertices += markerLods->vertexCount(0);
+				}
+			}
+		};
+		drawMarkers(camera, visibleLights, static_cast<float>(framebufferHeight), true);
+
+		// the side view reuses this frame's uploads and its own share of the culling, only its
+		// camera buffer is swapped in, and back for next frame's input
+		if (secondaryDue) {
+			secondaryTimer->begin();
+			secondaryView->begin(frameNumber);
+			lightingShader->use();
+			unsigned int secondaryDraws = 0, secondaryBinds = 0;
+			drawLitCubes(1, secondaryView->visibleCubes, false, secondaryDraws, secondaryBinds);
+			lightCubeShader->use();
+			lightCubeShader->setVec2("ditherRange", 0.0f, 1.0f);
+			drawMarkers(secondaryView->camera, secondaryView->visibleLights, static_cast<float>(secondaryView->pixelHeight()), false);
+			secondaryView->end(framebufferWidth, framebufferHeight);
+			secondaryTimer->end();
+			secondaryFrames++;
+			cameraBuffer->publish(camera);
 		}
+		if (secondaryViewToggle && !manyLightsToggle)
+			secondaryView->present(framebufferWidth, framebufferHeight);
 
 		glfwSwapBuffers(window);
-		glfwPollEvents();
+		inputLatencyTimer->frameSubmitted();
+
+		if (firstFrame || (!texturesReported && textureLoader->idle())) {
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count();
+			if (firstFrame)
+				std::cout << "First frame after " << milliseconds << " ms" << std::endl;
+			if (!texturesReported && textureLoader->idle()) {
+				std::cout << "All textures resident after " << milliseconds << " ms" << std::endl;
+				std::cout << "Texture cache: " << textureCache->residentCount() << " textures for " << textureCache->referenceCount()
+					<< " references, " << textureCache->residentBytes() / 1024 << " KB" << std::endl;
+				std::cout << "Mip generation: " << textureLoader->mipGenerationSeconds() * 1000.0 << " ms "
+					<< (driverMips ? "in glGenerateMipmap" : "on the CPU") << ", " << textureLoader->mipCacheHits() << " chains cached" << std::endl;
+				if (assetPack)
+					std::cout << "Asset pack: " << assetPack->entryCount() << " assets, " << textureLoader->packedCount() << " textures uploaded from it" << std::endl;
+				else
+					std::cout << "Assets loaded from the loose files" << std::endl;
+				texturesReported = true;
+			}
+			firstFrame = false;
+		}
 	}
 
 	glDeleteVertexArrays(1, &cubeVAO);
+	glDeleteVertexArrays(2, cubeBatchVAOs);
+	glDeleteBuffers(1, &instanceVBO);
 	glDeleteVertexArrays(1, &lightCubeVAO);
 	glDeleteBuffers(1, &VBO);
+	glDeleteTextures(1, &lightmap);
+	glDeleteTextures(1, &probeGrid);
+	glDeleteTextures(1, &brdfLut);
+	glDeleteTextures(1, &environment);
+	for (Material& cubeMaterial : cubeMaterials) {
+		textureCache->release(cubeMaterial.diffuseMap);
+		textureCache->release(cubeMaterial.specularMap);
+	}
 
-	delete lightingShader;
+	for (int pbr = 0; pbr < 2; pbr++) {
+		for (int many = 0; many < 2; many++) {
+			for (int bindless = 0; bindless < 2; bindless++)
+				delete lightingShaders[pbr][many][bindless];
+		}
+	}
+	delete lightSampler;
+	// every handle goes non-resident before the textures behind them are deleted
+	delete materialTable;
+	delete bindlessTextures;
+	textureCache->setBindless(NULL);
+	if (textureArrays)
+		textureArrays->setBindless(NULL);
+	delete textureCache;
+	delete textureArrays;
+	delete textureLoader;
+	delete litPassTimer;
+	delete prepassTimer;
+	delete inputLatencyTimer;
+	delete secondaryTimer;
+	delete depthPrepassShader;
+	delete occlusionCuller;
+	delete hizCuller;
+	delete markerLods;
 	delete lightCubeShader;
+	delete secondaryView;
+	delete cameraBuffer;
+	delete lightManager;
+	delete assetPack;
 
 	glfwTerminate();
 	return 0;
@@ -377,14 +1115,98 @@ void processInput(GLFWwindow* window, int key, int scancode, int action, int mod
 	if (key == GLFW_KEY_ESCAPE)
 		glfwSetWindowShouldClose(window, true);
 
-	if (key == GLFW_KEY_W)
-		camera.ProcessKeyboard(FORWARD, deltaTime);
-	if (key == GLFW_KEY_S)
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
-	if (key == GLFW_KEY_A)
-		camera.ProcessKeyboard(LEFT, deltaTime);
-	if (key == GLFW_KEY_D)
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+	// movement keys are polled by updateCamera(), a press only starts the latency clock
+	if ((key == GLFW_KEY_W || key == GLFW_KEY_S || key == GLFW_KEY_A || key == GLFW_KEY_D) && action == GLFW_PRESS && pendingInputTime < 0.0)
+		pendingInputTime = glfwGetTime();
+
+	if (key == GLFW_KEY_L && action == GLFW_RELEASE) {
+		lightmapToggle = !lightmapToggle;
+		if (lightmapToggle && !lightmapLoaded)
+			std::cout << "No baked lightmap loaded, run AssetTool bake-lightmap first" << std::endl;
+		// the point lights aren't sampled under the lightmap, the reservoirs stop being written
+		if (lightSampler)
+			lightSampler->invalidateHistory();
+	}
+
+	if (key == GLFW_KEY_P && action == GLFW_RELEASE) {
+		probesToggle = !probesToggle;
+		if (probesToggle && !probesLoaded)
+			std::cout << "No baked probe grid loaded, run AssetTool bake-probes first" << std::endl;
+	}
+
+	if (key == GLFW_KEY_M && action == GLFW_RELEASE) {
+		pbrToggle = !pbrToggle;
+		lightingShader = lightingShaders[pbrToggle][manyLightsToggle][bindlessToggle];
+		shadingChanged = true;
+		std::cout << "Shading: " << (pbrToggle ? "PBR" : "Phong") << std::endl;
+	}
+
+	if (key == GLFW_KEY_N && action == GLFW_RELEASE) {
+		if (!lightSampler) {
+			std::cout << "Many-light mode needs GL 4.3 (shader storage buffers and early fragment tests)" << std::endl;
+		}
+		else {
+			manyLightsToggle = !manyLightsToggle;
+			if (manyLightsToggle) {
+				addManyLights();
+				lightSampler->invalidateHistory();
+			}
+			else {
+				removeManyLights();
+			}
+			lightingShader = lightingShaders[pbrToggle][manyLightsToggle][bindlessToggle];
+			shadingChanged = true;
+			std::cout << "Point lights: " << lightManager->count(Point) << (manyLightsToggle ? ", sampled" : "") << std::endl;
+		}
+	}
+
+	if (key == GLFW_KEY_B && action == GLFW_RELEASE) {
+		if (!materialTable) {
+			std::cout << "Bindless textures need ARB_bindless_texture and shader storage buffers, and no --texture-budget" << std::endl;
+		}
+		else {
+			bindlessToggle = !bindlessToggle;
+			lightingShader = lightingShaders[pbrToggle][manyLightsToggle][bindlessToggle];
+			shadingChanged = true;
+			std::cout << "Material textures: " << (bindlessToggle ? "bindless handles" : (textureArrays ? "texture arrays" : "texture units")) << std::endl;
+		}
+	}
+
+	if (key == GLFW_KEY_C && action == GLFW_RELEASE) {
+		cullingToggle = !cullingToggle;
+		std::cout << "Frustum culling: " << (cullingToggle ? "on" : "off") << std::endl;
+	}
+
+	if (key == GLFW_KEY_O && action == GLFW_RELEASE) {
+		occlusionToggle = !occlusionToggle;
+		std::cout << "Occlusion culling: " << (occlusionToggle ? "on" : "off") << (cullingToggle ? "" : ", once frustum culling is back on") << std::endl;
+	}
+
+	if (key == GLFW_KEY_Z && action == GLFW_RELEASE) {
+		depthPrepassToggle = !depthPrepassToggle;
+		shadingChanged = true;
+		std::cout << "Depth prepass: " << (depthPrepassToggle ? "on" : "off") << (manyLightsToggle ? ", always on in many-light mode" : "") << std::endl;
+	}
+
+	if (key == GLFW_KEY_H && action == GLFW_RELEASE) {
+		if (!hizCuller) {
+			std::cout << "Hi-Z culling needs compute shaders, shader storage buffers and indirect draws" << std::endl;
+		}
+		else {
+			hizToggle = !hizToggle;
+			std::cout << "Hi-Z culling: " << (hizToggle ? "on, for the instanced draws" : "off") << std::endl;
+		}
+	}
+
+	if (key == GLFW_KEY_X && action == GLFW_RELEASE) {
+		lodFadeToggle = !lodFadeToggle;
+		std::cout << "LOD cross-fade: " << (lodFadeToggle ? "on" : "off") << (markerLods ? "" : ", no marker LODs loaded") << std::endl;
+	}
+
+	if (key == GLFW_KEY_V && action == GLFW_RELEASE) {
+		secondaryViewToggle = !secondaryViewToggle;
+		std::cout << "Secondary view: " << (secondaryViewToggle ? "on" : "off") << (secondaryViewToggle && manyLightsToggle ? ", hidden in many-light mode" : "") << std::endl;
+	}
 
 	if (key == GLFW_KEY_F && action == GLFW_RELEASE) {
 		if (!wireframeToggle) {
@@ -398,6 +1220,32 @@ void processInput(GLFWwindow* window, int key, int scancode, int action, int mod
 	}
 }
 
+void addManyLights()
+{
+	// dim lights of random colors scattered through the volume around the cubes
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	manyLights.reserve(MANY_LIGHT_COUNT);
+	for (unsigned int i = 0; i < MANY_LIGHT_COUNT; i++) {
+		Light light = {};
+		light.position = glm::vec3(-5.0f + 10.0f * unit(random), -4.0f + 8.0f * unit(random), -14.0f + 16.0f * unit(random));
+		light.diffuse = glm::vec3(unit(random), unit(random), unit(random)) * 0.5f;
+		light.specular = light.diffuse;
+		light.constant = POINT_LIGHT_CONSTANT;
+		light.linear = POINT_LIGHT_LINEAR;
+		light.quadratic = POINT_LIGHT_QUADRATIC;
+		manyLights.push_back(lightManager->add(Point, light));
+	}
+}
+
+void removeManyLights()
+{
+	// newest first, so every removal takes the last slot and nothing gets swapped around
+	for (size_t i = manyLights.size(); i > 0; i--)
+		lightManager->remove(manyLights[i - 1]);
+	manyLights.clear();
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	// make sure the viewport matches the new window dimensions; note that width and 
@@ -422,50 +1270,434 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 	lastX = xpos;
 	lastY = ypos;
 
-	camera.ProcessMouseMovement(xoffset, yoffset);
+	mouseDeltaX += xoffset;
+	mouseDeltaY += yoffset;
+	if (pendingInputTime < 0.0)
+		pendingInputTime = glfwGetTime();
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-	camera.ProcessMouseScroll(static_cast<float>(yoffset));
+	scrollDelta += static_cast<float>(yoffset);
+	if (pendingInputTime < 0.0)
+		pendingInputTime = glfwGetTime();
 }
 
-unsigned int loadTexture(const char* resourcePath) {
-	unsigned int textureID = -1;
-	int width, height, nrChannels;
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+		pickRequested = true;
+}
 
-	unsigned char* data = stbi_load(resourcePath, &width, &height, &nrChannels, 0);
+// drains the window's events and moves the camera once with all of them: the held movement
+// keys for this frame's deltaTime, and the mouse and scroll summed over every event since
+// the last frame. Returns when the oldest of that input arrived, or a negative time if none did.
+double updateCamera(GLFWwindow* window)
+{
+	glfwPollEvents();
 
-	if (data) {
-		GLuint format = 0;
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+		camera.ProcessKeyboard(FORWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+		camera.ProcessKeyboard(BACKWARD, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+		camera.ProcessKeyboard(LEFT, deltaTime);
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+		camera.ProcessKeyboard(RIGHT, deltaTime);
+
+	if (mouseDeltaX != 0.0f || mouseDeltaY != 0.0f)
+		camera.ProcessMouseMovement(mouseDeltaX, mouseDeltaY);
+	if (scrollDelta != 0.0f)
+		camera.ProcessMouseScroll(scrollDelta);
+	mouseDeltaX = mouseDeltaY = scrollDelta = 0.0f;
+
+	double inputTime = pendingInputTime;
+	pendingInputTime = -1.0;
+	return inputTime;
+}
+
+unsigned int loadLightmap(const char* resourcePath, LightmapHeader& header) {
+	unsigned int textureID = 0;
+	std::ifstream file(resourcePath, std::ios::binary);
+
+	if (file && file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		&& header.magic == LIGHTMAP_MAGIC && header.version == LIGHTMAP_VERSION) {
+		unsigned int size = header.tileSize * header.tilesPerRow;
+		std::vector<float> texels(size * size * 3);
 
-		if (nrChannels == 1) {
-			format = GL_RED;
+		if (file.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(float))) {
+			glGenTextures(1, &textureID);
+
+			glBindTexture(GL_TEXTURE_2D, textureID);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, texels.data());
+
+			// tiles are laid out edge to edge, so no mipmaps and no wrapping
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		}
-		else if (nrChannels == 3) {
-			format = GL_RGB;
+	}
+
+	if (textureID == 0)
+	{
+		// keep the atlas layout uniforms sane even though nothing gets sampled
+		header = LightmapHeader();
+		header.tileSize = 1;
+		header.tilesPerRow = 1;
+		std::cout << "Unable to load lightmap. Path: " << resourcePath << std::endl;
+	}
+
+	return textureID;
+}
+
+unsigned int loadProbeGrid(const char* resourcePath, ProbeGridHeader& header) {
+	unsigned int textureID = 0;
+	std::ifstream file(resourcePath, std::ios::binary);
+
+	if (file && file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		&& header.magic == PROBE_GRID_MAGIC && header.version == PROBE_GRID_VERSION) {
+		size_t probeCount = static_cast<size_t>(header.size[0]) * header.size[1] * header.size[2];
+		std::vector<float> texels(probeCount * SH_TEXELS_PER_PROBE * 4);
+
+		if (file.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(float))) {
+			// each block is a full x/y/z grid, so stack them along x by uploading block by block
+			glGenTextures(1, &textureID);
+
+			glBindTexture(GL_TEXTURE_3D, textureID);
+			glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, header.size[0] * SH_TEXELS_PER_PROBE, header.size[1], header.size[2], 0, GL_RGBA, GL_FLOAT, NULL);
+			for (unsigned int block = 0; block < SH_TEXELS_PER_PROBE; block++)
+				glTexSubImage3D(GL_TEXTURE_3D, 0, block * header.size[0], 0, 0, header.size[0], header.size[1], header.size[2], GL_RGBA, GL_FLOAT, &texels[block * probeCount * 4]);
+
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		}
-		else if (nrChannels == 4) {
-			format = GL_RGBA;
+	}
+
+	if (textureID == 0)
+	{
+		header = ProbeGridHeader();
+		header.size[0] = header.size[1] = header.size[2] = 2;
+		header.boundsMax[0] = header.boundsMax[1] = header.boundsMax[2] = 1.0f;
+		std::cout << "Unable to load probe grid. Path: " << resourcePath << std::endl;
+	}
+
+	return textureID;
+}
+
+unsigned int loadBrdfLut(const char* resourcePath) {
+	unsigned int textureID = 0;
+	std::ifstream file(resourcePath, std::ios::binary);
+	BrdfLutHeader header = {};
+
+	if (file && file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		&& header.magic == BRDF_LUT_MAGIC && header.version == IBL_VERSION) {
+		std::vector<float> texels(header.size * header.size * 2);
+
+		if (file.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(float))) {
+			glGenTextures(1, &textureID);
+
+			glBindTexture(GL_TEXTURE_2D, textureID);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, header.size, header.size, 0, GL_RG, GL_FLOAT, texels.data());
+
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		}
+	}
 
-		glGenTextures(1, &textureID);
+	if (textureID == 0)
+		std::cout << "Unable to load BRDF LUT. Path: " << resourcePath << std::endl;
+
+	return textureID;
+}
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+unsigned int loadEnvironment(const char* resourcePath, EnvironmentHeader& header) {
+	unsigned int textureID = 0;
+	std::ifstream file(resourcePath, std::ios::binary);
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (file && file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		&& header.magic == ENVIRONMENT_MAGIC && header.version == IBL_VERSION && header.mipCount > 0) {
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+		// every mip holds a prefiltered roughness level, so they're all uploaded, never generated
+		std::vector<float> texels;
+		for (unsigned int mip = 0; mip < header.mipCount && textureID != 0; mip++) {
+			unsigned int size = std::max(header.faceSize >> mip, 1u);
+			texels.resize(size * size * 3);
+			for (unsigned int face = 0; face < 6; face++) {
+				if (!file.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(float))) {
+					glDeleteTextures(1, &textureID);
+					textureID = 0;
+					break;
+				}
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT, texels.data());
+			}
+		}
 
-		// free the loaded container image.
-		stbi_image_free(data);
+		if (textureID != 0) {
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, header.mipCount - 1);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
 	}
-	else
+
+	if (textureID == 0)
 	{
-		std::cout << "Unable to load image data. Path: " << resourcePath << std::endl;
+		header = EnvironmentHeader();
+		header.mipCount = 1;
+		std::cout << "Unable to load environment. Path: " << resourcePath << std::endl;
 	}
 
 	return textureID;
 }
+
+// the block compressed version of an image, written by "AssetTool compress-textures", when
+// there is one the driver can sample; the image itself otherwise
+std::string compressedTexturePath(const std::string& imagePath)
+{
+	if (pngTextures)
+		return imagePath;
+
+	size_t nameStart = imagePath.find_last_of("\\/") + 1;
+	size_t extension = imagePath.find_last_of('.');
+	if (extension == std::string::npos || extension < nameStart)
+		extension = imagePath.size();
+
+	std::string compressedPath = "Assets\\Baked\\Textures\\" + imagePath.substr(nameStart, extension - nameStart) + ".ktx2";
+	uint32_t format = textureFormat(compressedPath.c_str());
+	return format != 0 && AsyncTextureLoader::supportsCompressedFormat(format) ? compressedPath : imagePath;
+}
+
+// the format of a KTX2 texture, from the asset pack if it has it, 0 when there's none
+uint32_t textureFormat(const char* ktx2Path)
+{
+	const AssetPackEntry* entry = assetPack ? assetPack->find(ktx2Path, ASSET_TEXTURE) : NULL;
+	return entry && entry->vkFormat != 0 ? entry->vkFormat : readKtx2Format(ktx2Path);
+}
+
+// compiles the shader sources right out of the asset pack, or from the files without one
+Shader* loadShader(const char* vertexPath, const char* fragmentPath, const std::string& defines)
+{
+	const AssetPackEntry* vertex = assetPack ? assetPack->find(vertexPath, ASSET_SHADER_SOURCE) : NULL;
+	const AssetPackEntry* fragment = assetPack ? assetPack->find(fragmentPath, ASSET_SHADER_SOURCE) : NULL;
+	Shader* shader;
+	if (!vertex || !fragment)
+		shader = new Shader(vertexPath, fragmentPath, defines);
+	else
+		shader = new Shader(reinterpret_cast<const char*>(assetPack->data(*vertex)), vertex->size,
+			reinterpret_cast<const char*>(assetPack->data(*fragment)), fragment->size, defines);
+	// the ones that use the camera all read it from the CameraBuffer
+	shader->bindUniformBlock("CameraBlock", CAMERA_BLOCK_BINDING);
+	return shader;
+}
+
+// the same for a compute program
+Shader* loadComputeShader(const char* computePath, const std::string& defines)
+{
+	const AssetPackEntry* compute = assetPack ? assetPack->find(computePath, ASSET_SHADER_SOURCE) : NULL;
+	if (!compute)
+		return new Shader(computePath, defines);
+	return new Shader(reinterpret_cast<const char*>(assetPack->data(*compute)), compute->size, defines);
+}
+
+// the cube's vertex attributes and the per instance ones of CubeInstance, read from the two buffers
+void setupCubeBatchVAO(unsigned int vao, unsigned int vertexBuffer, unsigned int instanceBuffer, unsigned int firstInstance)
+{
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(sizeof(float) * 3));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(sizeof(float) * 6));
+	glEnableVertexAttribArray(2);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	// GL 3.3 has no base instance, a VAO reading a later range starts its attributes there
+	size_t base = firstInstance * sizeof(CubeInstance);
+	// a mat4 takes four attribute locations, a column each
+	for (int column = 0; column < 4; column++) {
+		glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (void*)(base + sizeof(glm::vec4) * column));
+		glEnableVertexAttribArray(3 + column);
+		glVertexAttribDivisor(3 + column, 1);
+	}
+	glVertexAttribIPointer(7, 2, GL_INT, sizeof(CubeInstance), (void*)(base + offsetof(CubeInstance, materialLayers)));
+	glEnableVertexAttribArray(7);
+	glVertexAttribDivisor(7, 1);
+	glVertexAttribIPointer(8, 1, GL_INT, sizeof(CubeInstance), (void*)(base + offsetof(CubeInstance, lightmapTileBase)));
+	glEnableVertexAttribArray(8);
+	glVertexAttribDivisor(8, 1);
+	glVertexAttribIPointer(9, 1, GL_INT, sizeof(CubeInstance), (void*)(base + offsetof(CubeInstance, materialIndex)));
+	glEnableVertexAttribArray(9);
+	glVertexAttribDivisor(9, 1);
+}
+
+// culls a million boxes scattered around the starting camera against its frustum, the way
+// the cubes are culled every frame, and prints the median time of a few runs
+void runCullBenchmark()
+{
+	const size_t BOX_COUNT = 1000000;
+	const int RUNS = 21;
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> extent(0.1f, 2.0f);
+	CullBoxes boxes;
+	for (size_t i = 0; i < BOX_COUNT; i++)
+		boxes.add(glm::vec3(position(random), position(random), position(random)), glm::vec3(extent(random), extent(random), extent(random)));
+
+	Frustum frustum = extractFrustum(camera.GetViewProjectionMatrix());
+	std::vector<uint32_t> visible;
+	std::vector<double> milliseconds;
+	size_t visibleCount = 0;
+	for (int run = 0; run < RUNS; run++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		visibleCount = cullBoxes(frustum, boxes, visible);
+		milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(milliseconds.begin(), milliseconds.end());
+	std::cout << "Culled " << BOX_COUNT << " boxes " << CULL_LANES << " at a time: " << visibleCount << " visible, median "
+		<< milliseconds[RUNS / 2] << " ms, best " << milliseconds[0] << " ms" << std::endl;
+}
+
+// builds, refits and queries a BVH over a quarter million boxes scattered around the starting
+// camera, and compares its culling with the flat kernel over the same boxes
+void runBvhBenchmark()
+{
+	const uint32_t BOX_COUNT = 250000;
+	const int RAY_COUNT = 100000;
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> extent(0.1f, 2.0f);
+	std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+	std::vector<glm::vec3> centers(BOX_COUNT), extents(BOX_COUNT);
+	CullBoxes boxes;
+	for (uint32_t i = 0; i < BOX_COUNT; i++) {
+		centers[i] = glm::vec3(position(random), position(random), position(random));
+		extents[i] = glm::vec3(extent(random), extent(random), extent(random));
+		boxes.add(centers[i], extents[i]);
+	}
+	auto millisecondsSince = [](std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+	auto perSecond = [](double count, double milliseconds) { return count / (milliseconds / 1000.0) / 1e6; };
+
+	SceneBVH bvh;
+	std::vector<uint32_t> proxies(BOX_COUNT);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BOX_COUNT; i++)
+		proxies[i] = bvh.insert(centers[i] - extents[i], centers[i] + extents[i], i);
+	double insertTime = millisecondsSince(start);
+	float insertedRatio = bvh.surfaceAreaRatio();
+
+	start = std::chrono::steady_clock::now();
+	bvh.rebuild();
+	double rebuildTime = millisecondsSince(start);
+	float rebuiltRatio = bvh.surfaceAreaRatio();
+
+	for (uint32_t i = 0; i < BOX_COUNT; i++)
+		centers[i] += glm::vec3(step(random), step(random), step(random));
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BOX_COUNT; i++)
+		bvh.update(proxies[i], centers[i] - extents[i], centers[i] + extents[i]);
+	bvh.refit();
+	double refitTime = millisecondsSince(start);
+
+	// boxes move ten times their margin, so every one of them is reinserted
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BOX_COUNT; i++) {
+		centers[i] += glm::vec3(step(random), step(random), step(random)) * 10.0f;
+		bvh.move(proxies[i], centers[i] - extents[i], centers[i] + extents[i], 0.25f);
+	}
+	double moveTime = millisecondsSince(start);
+	bvh.rebuild();
+
+	Frustum frustum = extractFrustum(camera.GetViewProjectionMatrix());
+	std::vector<uint32_t> visible;
+	start = std::chrono::steady_clock::now();
+	size_t visibleCount = bvh.cull(frustum, visible);
+	double bvhCullTime = millisecondsSince(start);
+	boxes.clear();
+	for (uint32_t i = 0; i < BOX_COUNT; i++)
+		boxes.add(centers[i], extents[i] + glm::vec3(0.25f)); // the margins the leaves were moved with
+	start = std::chrono::steady_clock::now();
+	size_t flatVisibleCount = cullBoxes(frustum, boxes, visible);
+	double flatCullTime = millisecondsSince(start);
+
+	size_t hits = 0;
+	start = std::chrono::steady_clock::now();
+	for (int ray = 0; ray < RAY_COUNT; ray++) {
+		glm::vec3 origin(position(random), position(random), position(random));
+		glm::vec3 direction = glm::normalize(glm::vec3(step(random), step(random), step(random)) + glm::vec3(1e-4f));
+		SceneRayHit hit;
+		hits += bvh.raycast(origin, direction, 1000.0f, hit);
+	}
+	double rayTime = millisecondsSince(start);
+
+	std::cout << "BVH over " << BOX_COUNT << " boxes:" << std::endl
+		<< "  insert " << insertTime << " ms (" << perSecond(BOX_COUNT, insertTime) << " M/s), SAH ratio " << insertedRatio << std::endl
+		<< "  SAH rebuild " << rebuildTime << " ms (" << perSecond(BOX_COUNT, rebuildTime) << " M/s), SAH ratio " << rebuiltRatio << std::endl
+		<< "  update and refit " << refitTime << " ms (" << perSecond(BOX_COUNT, refitTime) << " M/s)" << std::endl
+		<< "  move and reinsert " << moveTime << " ms (" << perSecond(BOX_COUNT, moveTime) << " M/s)" << std::endl
+		<< "  frustum cull " << bvhCullTime << " ms, " << visibleCount << " visible; flat SIMD cull " << flatCullTime << " ms, "
+		<< flatVisibleCount << " visible" << std::endl
+		<< "  " << RAY_COUNT << " rays " << rayTime << " ms (" << perSecond(RAY_COUNT, rayTime) << " M/s), " << hits << " hit" << std::endl;
+}
+
+// picks among a million boxes scattered around the starting camera, through random points of
+// its screen: with the flat SIMD slab test over every box, and down the BVH, which has to be
+// built first; prints the median time of a pick each way and whether they agree
+void runPickBenchmark()
+{
+	const uint32_t BOX_COUNT = 1000000;
+	const int RAY_COUNT = 101;
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> extent(0.1f, 2.0f);
+	std::uniform_real_distribution<float> screen(-1.0f, 1.0f);
+	CullBoxes boxes;
+	for (uint32_t i = 0; i < BOX_COUNT; i++)
+		boxes.add(glm::vec3(position(random), position(random), position(random)), glm::vec3(extent(random), extent(random), extent(random)));
+	auto millisecondsSince = [](std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	SceneBVH bvh;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BOX_COUNT; i++) {
+		glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+		glm::vec3 halfExtent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+		bvh.insert(center - halfExtent, center + halfExtent, i);
+	}
+	bvh.rebuild();
+	double buildTime = millisecondsSince(start);
+
+	std::vector<double> flatMilliseconds, bvhMilliseconds;
+	int hits = 0, disagreements = 0;
+	for (int ray = 0; ray < RAY_COUNT; ray++) {
+		glm::vec3 origin, direction;
+		camera.GetRay(screen(random), screen(random), origin, direction);
+		SceneRayHit flatHit, bvhHit;
+		start = std::chrono::steady_clock::now();
+		bool flatPicked = raycastBoxes(origin, direction, FAR_PLANE, boxes, flatHit);
+		flatMilliseconds.push_back(millisecondsSince(start));
+		start = std::chrono::steady_clock::now();
+		bool bvhPicked = bvh.raycast(origin, direction, FAR_PLANE, bvhHit);
+		bvhMilliseconds.push_back(millisecondsSince(start));
+		hits += flatPicked;
+		disagreements += flatPicked != bvhPicked || (flatPicked && flatHit.object != bvhHit.object);
+	}
+	std::sort(flatMilliseconds.begin(), flatMilliseconds.end());
+	std::sort(bvhMilliseconds.begin(), bvhMilliseconds.end());
+	std::cout << "Picking among " << BOX_COUNT << " boxes, " << RAY_COUNT << " rays, " << hits << " hit:" << std::endl
+		<< "  flat SIMD slab test " << CULL_LANES << " at a time, median " << flatMilliseconds[RAY_COUNT / 2] << " ms" << std::endl
+		<< "  BVH, median " << bvhMilliseconds[RAY_COUNT / 2] << " ms after " << buildTime << " ms to build; "
+		<< disagreements << (disagreements == 1 ? " ray disagrees" : " rays disagree") << std::endl;
+}
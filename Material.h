@@ -1,8 +1,13 @@
 #pragma once
 #include <glm/glm.hpp>
 
+#include "TextureCache.h"
+
 struct Material {
   glm::vec3 diffuse; // the diffuse vec3
   glm::vec3 specular; // the specular vec3
   float shininess; // the shininess of the material (how much of the light source will be reflected on the material)
+  TextureHandle diffuseMap; // shared through the TextureCache
+  TextureHandle specularMap; // INVALID_TEXTURE when specularInDiffuseAlpha
+  bool specularInDiffuseAlpha; // a texture packed by "AssetTool pack-material"
 };
@@ -0,0 +1,106 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <glad/glad.h>
+
+#include "BindlessTextures.h"
+#include "GLExtensions.h"
+#include "Material.h"
+#include "TextureArrayPool.h"
+#include "TextureCache.h"
+
+#include <cstring>
+#include <vector>
+
+// shader storage binding point of the material table, after the LightSampler's buffers
+const GLuint MATERIAL_TABLE_BINDING = 6;
+
+// One material of the table; matches GPUMaterial in 1.colors.fs (std430)
+struct GPUMaterial {
+	GLuint64 diffuse; // bindless texture handles, uvec2 on the shader side
+	GLuint64 specular;
+	GLint diffuseLayer; // the layer when the handle is of an array, -1 for a 2D texture
+	GLint specularLayer;
+	GLuint specularInDiffuseAlpha;
+	GLuint padding;
+};
+
+// The materials in a shader storage buffer with their maps as bindless texture handles, so
+// the BINDLESS shader variant finds its textures by material index and drawing any number
+// of materials needs no texture units (needs ARB_bindless_texture and SSBOs). A map only
+// gets a handle once it's resident, or a layer of the TextureArrayPool, since a handle
+// freezes the texture the loader is still going to fill; until then it's a grey placeholder.
+class MaterialTable
+{
+    public:
+	MaterialTable(BindlessTextures& handles) : handles(handles)
+	{
+		const unsigned char grey[4] = { 128, 128, 128, 255 };
+		glGenTextures(1, &placeholder);
+		glBindTexture(GL_TEXTURE_2D, placeholder);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glGenBuffers(1, &buffer);
+	}
+
+	~MaterialTable()
+	{
+		handles.retire(placeholder);
+		glDeleteTextures(1, &placeholder);
+		glDeleteBuffers(1, &buffer);
+	}
+
+	MaterialTable(const MaterialTable&) = delete;
+	MaterialTable& operator=(const MaterialTable&) = delete;
+
+	// rebuilds the table from the materials, in their order; only uploaded when it changed
+	void update(const std::vector<Material>& materials, const TextureCache& cache, const TextureArrayPool* arrays)
+	{
+		table.resize(materials.size());
+		for (size_t i = 0; i < materials.size(); i++)
+		{
+			GPUMaterial& entry = table[i];
+			resolve(materials[i].diffuseMap, cache, arrays, entry.diffuse, entry.diffuseLayer);
+			resolve(materials[i].specularMap, cache, arrays, entry.specular, entry.specularLayer);
+			entry.specularInDiffuseAlpha = materials[i].specularInDiffuseAlpha;
+			entry.padding = 0;
+		}
+
+		if (table.size() == uploaded.size() && std::memcmp(table.data(), uploaded.data(), table.size() * sizeof(GPUMaterial)) == 0)
+			return;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, table.size() * sizeof(GPUMaterial), table.data(), GL_DYNAMIC_DRAW);
+		uploaded = table;
+	}
+
+	void bind() const
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_TABLE_BINDING, buffer);
+	}
+
+    private:
+	BindlessTextures& handles;
+	unsigned int placeholder = 0;
+	unsigned int buffer = 0;
+	std::vector<GPUMaterial> table;
+	std::vector<GPUMaterial> uploaded;
+
+	void resolve(TextureHandle map, const TextureCache& cache, const TextureArrayPool* arrays, GLuint64& handle, GLint& layer)
+	{
+		TextureLayer arrayLayer = cache.layer(map);
+		if (arrays && arrayLayer.layer >= 0)
+		{
+			handle = handles.handle(arrays->texture(arrayLayer));
+			layer = arrayLayer.layer;
+		}
+		else
+		{
+			handle = handles.handle(cache.isResident(map) ? cache.texture(map) : placeholder);
+			layer = -1;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A LOD chain built by "AssetTool bake-lods", in one vertex and one index buffer, and the
+// choice of level: the coarsest one whose error, projected to the screen at the object's
+// distance, stays under a pixel budget. Near a switch the next coarser level can be faded in
+// with complementary dither patterns (the fragment shader discards outside its ditherRange),
+// so the two levels cover every pixel once between them and the switch doesn't pop.
+
+struct LodSelection {
+	int level; // drawn over the fragments whose dither value is at least fade
+	int fadeLevel; // the next coarser level fading in over the rest, -1 when there's no fade
+	float fade;
+};
+
+// how many pixels an object space length of 1 covers at a distance of 1
+inline float lodPixelsPerUnit(float fovyRadians, float viewportHeight)
+{
+	return viewportHeight / (2.0f * std::tan(fovyRadians * 0.5f));
+}
+
+class MeshLodChain
+{
+    public:
+	// the positions go to attribute 0
+	explicit MeshLodChain(const std::vector<LodMesh>& chain)
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		for (const LodMesh& mesh : chain)
+		{
+			// every level's indices start at its own first vertex, so one plain draw call each
+			Level level = { static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(mesh.indices.size()),
+				static_cast<uint32_t>(mesh.positions.size()), mesh.error };
+			uint32_t base = static_cast<uint32_t>(positions.size());
+			for (uint32_t index : mesh.indices)
+				indices.push_back(base + index);
+			positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
+			levels.push_back(level);
+		}
+
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vertexBuffer);
+		glGenBuffers(1, &indexBuffer);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glEnableVertexAttribArray(0);
+		glBindVertexArray(0);
+	}
+
+	~MeshLodChain()
+	{
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vertexBuffer);
+		glDeleteBuffers(1, &indexBuffer);
+	}
+
+	int levelCount() const { return static_cast<int>(levels.size()); }
+	uint32_t vertexCount(int level) const { return levels[level].vertexCount; }
+	uint32_t triangleCount(int level) const { return levels[level].indexCount / 3; }
+	float error(int level) const { return levels[level].error; }
+
+	// for an object scaled by scale at distance from the camera; fadeBand is how far past the
+	// budget, as a fraction of it, the next level's projected error starts fading in (0 for none)
+	LodSelection select(float distance, float scale, float pixelsPerUnit, float maxPixelError, float fadeBand) const
+	{
+		float pixelsPerError = scale * pixelsPerUnit / std::max(distance, 1e-4f);
+		LodSelection selection = { 0, -1, 0.0f };
+		// errors only grow along the chain
+		while (selection.level + 1 < levelCount() && levels[selection.level + 1].error * pixelsPerError <= maxPixelError)
+			selection.level++;
+		if (fadeBand > 0.0f && selection.level + 1 < levelCount())
+		{
+			float next = levels[selection.level + 1].error * pixelsPerError;
+			float fadeStart = maxPixelError * (1.0f + fadeBand);
+			if (next < fadeStart)
+			{
+				selection.fadeLevel = selection.level + 1;
+				selection.fade = (fadeStart - next) / (fadeStart - maxPixelError);
+			}
+		}
+		return selection;
+	}
+
+	// leaves the chain's vertex array bound
+	void draw(int level) const
+	{
+		glBindVertexArray(vao);
+		glDrawElements(GL_TRIANGLES, levels[level].indexCount, GL_UNSIGNED_INT, (void*)(levels[level].firstIndex * sizeof(uint32_t)));
+	}
+
+    private:
+	struct Level {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t vertexCount;
+		float error;
+	};
+
+	std::vector<Level> levels;
+	unsigned int vao = 0;
+	unsigned int vertexBuffer = 0;
+	unsigned int indexBuffer = 0;
+};
+
+#endif
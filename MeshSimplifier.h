@@ -0,0 +1,535 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// Offline mesh simplification for level of detail. Edges are collapsed cheapest first, the cost
+// of a collapse being its quadric error (Garland and Heckbert): every vertex carries the sum of
+// the squared distance functions to the planes of the triangles around it in the original mesh,
+// and a merged vertex is placed where the sum of its two quadrics is smallest.
+//
+// A LOD chain is one run of collapses snapshotted at halving triangle counts, so every level is
+// simplified from the one before it. The quadric costs only order the collapses, summed over
+// many planes they overstate the damage several times; the error of a level is measured after
+// the fact instead, as the farthest a vertex of either mesh is from the surface of the other.
+
+const uint32_t MESH_LOD_MAGIC = 0x444F4C4D; // "MLOD"
+const uint32_t MESH_LOD_VERSION = 1;
+const uint32_t MESH_LOD_MAX_LEVELS = 8;
+
+// followed by every level's positions (3 floats a vertex) and indices (uint32), level 0 first
+struct MeshLodHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t levelCount;
+	uint32_t reserved;
+	// then levelCount of these
+};
+
+struct MeshLodLevel {
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	float error; // in object space units, 0 for the full detail level
+	uint32_t reserved;
+};
+
+struct LodMesh {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices; // triangles
+	float error = 0.0f;
+};
+
+// a symmetric 4x4 matrix Q, the error of a point p being (p, 1) Q (p, 1)
+struct Quadric {
+	double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+	double yy = 0.0, yz = 0.0, yw = 0.0;
+	double zz = 0.0, zw = 0.0;
+	double ww = 0.0;
+
+	// the squared distance to the plane dot(normal, p) + distance = 0, normal unit length, times weight
+	static Quadric plane(const glm::dvec3& normal, double distance, double weight = 1.0)
+	{
+		Quadric q;
+		q.xx = normal.x * normal.x * weight, q.xy = normal.x * normal.y * weight, q.xz = normal.x * normal.z * weight, q.xw = normal.x * distance * weight;
+		q.yy = normal.y * normal.y * weight, q.yz = normal.y * normal.z * weight, q.yw = normal.y * distance * weight;
+		q.zz = normal.z * normal.z * weight, q.zw = normal.z * distance * weight;
+		q.ww = distance * distance * weight;
+		return q;
+	}
+
+	void add(const Quadric& q)
+	{
+		xx += q.xx, xy += q.xy, xz += q.xz, xw += q.xw;
+		yy += q.yy, yz += q.yz, yw += q.yw;
+		zz += q.zz, zw += q.zw;
+		ww += q.ww;
+	}
+
+	double error(const glm::dvec3& p) const
+	{
+		double e = xx * p.x * p.x + 2.0 * xy * p.x * p.y + 2.0 * xz * p.x * p.z + 2.0 * xw * p.x
+			+ yy * p.y * p.y + 2.0 * yz * p.y * p.z + 2.0 * yw * p.y
+			+ zz * p.z * p.z + 2.0 * zw * p.z + ww;
+		return std::max(e, 0.0);
+	}
+
+	// the point of least error, when there's a single one (the planes aren't all parallel to a line)
+	bool minimum(glm::dvec3& p) const
+	{
+		double c00 = yy * zz - yz * yz, c01 = xz * yz - xy * zz, c02 = xy * yz - xz * yy;
+		double det = xx * c00 + xy * c01 + xz * c02;
+		if (std::fabs(det) < 1e-12)
+			return false;
+		double c11 = xx * zz - xz * xz, c12 = xy * xz - xx * yz, c22 = xx * yy - xy * xy;
+		// solves A p = -b with the inverse of A from its cofactors (A is symmetric)
+		p.x = -(c00 * xw + c01 * yw + c02 * zw) / det;
+		p.y = -(c01 * xw + c11 * yw + c12 * zw) / det;
+		p.z = -(c02 * xw + c12 * yw + c22 * zw) / det;
+		return true;
+	}
+};
+
+// Simplifies an indexed triangle mesh whose triangles share their vertices. Open edges are kept
+// in place by planes through them at right angles to their triangle, weighted heavily. A
+// collapse is refused when it would flip a triangle or pinch the surface (the two vertices share
+// neighbours other than the ones across their edge).
+class MeshSimplifier
+{
+    public:
+	MeshSimplifier(const std::vector<glm::vec3>& meshPositions, const std::vector<uint32_t>& meshIndices)
+		: positions(meshPositions.begin(), meshPositions.end()), indices(meshIndices), quadrics(meshPositions.size()),
+		vertexTriangles(meshPositions.size()), vertexAlive(meshPositions.size(), true), vertexVersion(meshPositions.size(), 0),
+		triangleAlive(meshIndices.size() / 3, true), liveTriangles(meshIndices.size() / 3)
+	{
+		std::map<std::pair<uint32_t, uint32_t>, int> edgeUses;
+		for (uint32_t t = 0; t < triangleAlive.size(); t++)
+		{
+			glm::dvec3 normal;
+			if (!triangleNormal(t, normal))
+				normal = glm::dvec3(0.0);
+			Quadric q = Quadric::plane(normal, -glm::dot(normal, positions[indices[t * 3]]));
+			for (int corner = 0; corner < 3; corner++)
+			{
+				uint32_t v = indices[t * 3 + corner];
+				uint32_t next = indices[t * 3 + (corner + 1) % 3];
+				quadrics[v].add(q);
+				vertexTriangles[v].push_back(t);
+				edgeUses[std::make_pair(std::min(v, next), std::max(v, next))]++;
+			}
+		}
+
+		for (uint32_t t = 0; t < triangleAlive.size(); t++)
+		{
+			glm::dvec3 normal;
+			if (!triangleNormal(t, normal))
+				continue;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				uint32_t a = indices[t * 3 + corner];
+				uint32_t b = indices[t * 3 + (corner + 1) % 3];
+				if (edgeUses[std::make_pair(std::min(a, b), std::max(a, b))] != 1)
+					continue;
+				glm::dvec3 edge = positions[b] - positions[a];
+				glm::dvec3 side = glm::cross(edge, normal);
+				double length = glm::length(side);
+				if (length <= 0.0)
+					continue;
+				side /= length;
+				Quadric q = Quadric::plane(side, -glm::dot(side, positions[a]), BOUNDARY_WEIGHT);
+				quadrics[a].add(q);
+				quadrics[b].add(q);
+			}
+		}
+
+		for (const auto& edge : edgeUses)
+			queueCollapse(edge.first.first, edge.first.second);
+	}
+
+	// collapses edges until no more than targetTriangles are left or no collapse is allowed;
+	// returns how many triangles are left
+	size_t simplify(size_t targetTriangles)
+	{
+		while (liveTriangles > targetTriangles && !collapses.empty())
+		{
+			Collapse collapse = collapses.top();
+			collapses.pop();
+			if (!vertexAlive[collapse.from] || !vertexAlive[collapse.to]
+				|| vertexVersion[collapse.from] != collapse.fromVersion || vertexVersion[collapse.to] != collapse.toVersion)
+				continue;
+			if (!collapseAllowed(collapse.from, collapse.to, collapse.position))
+				continue;
+			apply(collapse);
+		}
+		return liveTriangles;
+	}
+
+	size_t triangleCount() const { return liveTriangles; }
+
+	// the current mesh with its unused vertices dropped
+	LodMesh mesh() const
+	{
+		LodMesh result;
+		std::vector<uint32_t> remap(positions.size(), UINT32_MAX);
+		for (uint32_t t = 0; t < triangleAlive.size(); t++)
+		{
+			if (!triangleAlive[t])
+				continue;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				uint32_t v = indices[t * 3 + corner];
+				if (remap[v] == UINT32_MAX)
+				{
+					remap[v] = static_cast<uint32_t>(result.positions.size());
+					result.positions.push_back(glm::vec3(positions[v]));
+				}
+				result.indices.push_back(remap[v]);
+			}
+		}
+		return result;
+	}
+
+    private:
+	static constexpr double BOUNDARY_WEIGHT = 1000.0;
+	// a collapse may turn a triangle this far at most (cosine of the angle)
+	static constexpr double MIN_NORMAL_COSINE = 0.2;
+
+	struct Collapse {
+		double cost;
+		uint32_t from, to;
+		uint32_t fromVersion, toVersion; // the collapse is stale once either vertex changes
+		glm::dvec3 position;
+
+		// the cheapest on top of the queue
+		bool operator<(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	std::vector<glm::dvec3> positions;
+	std::vector<uint32_t> indices;
+	std::vector<Quadric> quadrics;
+	std::vector<std::vector<uint32_t>> vertexTriangles; // the live ones, and some dead ones not yet removed
+	std::vector<bool> vertexAlive;
+	std::vector<uint32_t> vertexVersion;
+	std::vector<bool> triangleAlive;
+	size_t liveTriangles;
+	std::priority_queue<Collapse> collapses;
+
+	bool triangleNormal(uint32_t t, glm::dvec3& normal) const
+	{
+		return triangleNormal(positions[indices[t * 3]], positions[indices[t * 3 + 1]], positions[indices[t * 3 + 2]], normal);
+	}
+
+	static bool triangleNormal(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c, glm::dvec3& normal)
+	{
+		normal = glm::cross(b - a, c - a);
+		double length = glm::length(normal);
+		if (length <= 1e-20)
+			return false;
+		normal /= length;
+		return true;
+	}
+
+	bool hasVertex(uint32_t t, uint32_t v) const
+	{
+		return indices[t * 3] == v || indices[t * 3 + 1] == v || indices[t * 3 + 2] == v;
+	}
+
+	// the merged vertex goes to the minimum of the quadric, or the best of the two ends and
+	// their midpoint when the minimum isn't unique (a flat or cylindrical neighbourhood)
+	void queueCollapse(uint32_t a, uint32_t b)
+	{
+		Quadric q = quadrics[a];
+		q.add(quadrics[b]);
+		glm::dvec3 position;
+		double cost;
+		if (q.minimum(position))
+		{
+			cost = q.error(position);
+		}
+		else
+		{
+			glm::dvec3 candidates[3] = { positions[a], positions[b], (positions[a] + positions[b]) * 0.5 };
+			position = candidates[0];
+			cost = q.error(position);
+			for (int i = 1; i < 3; i++)
+			{
+				double candidateCost = q.error(candidates[i]);
+				if (candidateCost < cost)
+					cost = candidateCost, position = candidates[i];
+			}
+		}
+		Collapse collapse = { cost, a, b, vertexVersion[a], vertexVersion[b], position };
+		collapses.push(collapse);
+	}
+
+	void neighbours(uint32_t v, std::vector<uint32_t>& result) const
+	{
+		result.clear();
+		for (uint32_t t : vertexTriangles[v])
+		{
+			if (!triangleAlive[t])
+				continue;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				if (indices[t * 3 + corner] != v)
+					result.push_back(indices[t * 3 + corner]);
+			}
+		}
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+	}
+
+	bool collapseAllowed(uint32_t from, uint32_t to, const glm::dvec3& position)
+	{
+		// the link condition: the only vertices next to both are the ones opposite the edge
+		size_t sharedTriangles = 0;
+		for (uint32_t t : vertexTriangles[from])
+		{
+			if (triangleAlive[t] && hasVertex(t, to))
+				sharedTriangles++;
+		}
+		std::vector<uint32_t> fromNeighbours, toNeighbours, shared;
+		neighbours(from, fromNeighbours);
+		neighbours(to, toNeighbours);
+		std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(), std::back_inserter(shared));
+		if (shared.size() != sharedTriangles)
+			return false;
+
+		// every triangle that survives has to keep facing the way it did
+		for (uint32_t v : { from, to })
+		{
+			uint32_t other = v == from ? to : from;
+			for (uint32_t t : vertexTriangles[v])
+			{
+				if (!triangleAlive[t] || hasVertex(t, other))
+					continue;
+				glm::dvec3 corners[3];
+				for (int corner = 0; corner < 3; corner++)
+				{
+					uint32_t index = indices[t * 3 + corner];
+					corners[corner] = index == v ? position : positions[index];
+				}
+				glm::dvec3 before, after;
+				if (!triangleNormal(t, before))
+					continue;
+				if (!triangleNormal(corners[0], corners[1], corners[2], after) || glm::dot(before, after) < MIN_NORMAL_COSINE)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void apply(const Collapse& collapse)
+	{
+		uint32_t from = collapse.from, to = collapse.to;
+		for (uint32_t t : vertexTriangles[from])
+		{
+			if (!triangleAlive[t])
+				continue;
+			if (hasVertex(t, to))
+			{
+				triangleAlive[t] = false;
+				liveTriangles--;
+				continue;
+			}
+			for (int corner = 0; corner < 3; corner++)
+			{
+				if (indices[t * 3 + corner] == from)
+					indices[t * 3 + corner] = to;
+			}
+			vertexTriangles[to].push_back(t);
+		}
+		std::vector<uint32_t>& triangles = vertexTriangles[to];
+		triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [this](uint32_t t) { return !triangleAlive[t]; }), triangles.end());
+		vertexTriangles[from].clear();
+		vertexAlive[from] = false;
+
+		positions[to] = collapse.position;
+		quadrics[to].add(quadrics[from]);
+		vertexVersion[to]++;
+
+		std::vector<uint32_t> around;
+		neighbours(to, around);
+		for (uint32_t n : around)
+			queueCollapse(to, n);
+	}
+};
+
+inline glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	// the Voronoi regions of the corners, then of the edges, then the face (Ericson)
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return a;
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3)
+		return b;
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + ab * (d1 / (d1 - d3));
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6)
+		return c;
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + ac * (d2 / (d2 - d6));
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denominator = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// the farthest any vertex of from is from the surface of to; every vertex against every
+// triangle, fine for the offline tool and the meshes it simplifies
+inline float vertexToSurfaceDistance(const LodMesh& from, const LodMesh& to)
+{
+	float farthest = 0.0f;
+	for (const glm::vec3& p : from.positions)
+	{
+		// a vertex already nearer than the farthest so far can't change the answer
+		float nearest = FLT_MAX;
+		for (size_t i = 0; i < to.indices.size() && nearest > farthest; i += 3)
+		{
+			glm::vec3 closest = closestPointOnTriangle(p, to.positions[to.indices[i]], to.positions[to.indices[i + 1]], to.positions[to.indices[i + 2]]);
+			glm::vec3 offset = p - closest;
+			nearest = std::min(nearest, glm::dot(offset, offset));
+		}
+		farthest = std::max(farthest, nearest);
+	}
+	return std::sqrt(farthest);
+}
+
+// the chain from the full mesh down, each level at most half the triangles of the one before,
+// until minTriangles or until nothing more can be collapsed
+inline std::vector<LodMesh> buildLodChain(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, size_t minTriangles)
+{
+	std::vector<LodMesh> chain;
+	MeshSimplifier simplifier(positions, indices);
+	chain.push_back(simplifier.mesh());
+	while (chain.size() < MESH_LOD_MAX_LEVELS)
+	{
+		size_t triangles = simplifier.triangleCount();
+		size_t target = std::max(triangles / 2, minTriangles);
+		if (target >= triangles || simplifier.simplify(target) >= triangles)
+			break;
+		LodMesh level = simplifier.mesh();
+		// both ways: the coarse surface can cut inside the original as well as stand off it;
+		// never less than the level before, so coarser levels are never picked nearer
+		level.error = std::max({ vertexToSurfaceDistance(chain[0], level), vertexToSurfaceDistance(level, chain[0]), chain.back().error });
+		chain.push_back(level);
+	}
+	return chain;
+}
+
+// a unit icosahedron with every triangle split in four subdivisions times, pushed out to radius
+inline void buildIcosphere(unsigned int subdivisions, float radius, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+	const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+	positions = {
+		glm::vec3(-1, t, 0), glm::vec3(1, t, 0), glm::vec3(-1, -t, 0), glm::vec3(1, -t, 0),
+		glm::vec3(0, -1, t), glm::vec3(0, 1, t), glm::vec3(0, -1, -t), glm::vec3(0, 1, -t),
+		glm::vec3(t, 0, -1), glm::vec3(t, 0, 1), glm::vec3(-t, 0, -1), glm::vec3(-t, 0, 1)
+	};
+	indices = {
+		0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+		1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+		3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+		4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+	};
+	for (glm::vec3& position : positions)
+		position = glm::normalize(position);
+
+	for (unsigned int level = 0; level < subdivisions; level++)
+	{
+		// the midpoint of every edge is shared by the two triangles on it
+		std::map<std::pair<uint32_t, uint32_t>, uint32_t> midpoints;
+		auto midpoint = [&](uint32_t a, uint32_t b) {
+			std::pair<uint32_t, uint32_t> edge(std::min(a, b), std::max(a, b));
+			auto found = midpoints.find(edge);
+			if (found != midpoints.end())
+				return found->second;
+			uint32_t index = static_cast<uint32_t>(positions.size());
+			positions.push_back(glm::normalize(positions[a] + positions[b]));
+			midpoints[edge] = index;
+			return index;
+		};
+		std::vector<uint32_t> split;
+		split.reserve(indices.size() * 4);
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+			uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+			uint32_t triangles[12] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+			split.insert(split.end(), triangles, triangles + 12);
+		}
+		indices.swap(split);
+	}
+
+	for (glm::vec3& position : positions)
+		position *= radius;
+}
+
+inline bool writeLodChain(const char* path, const std::vector<LodMesh>& chain)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file || chain.empty() || chain.size() > MESH_LOD_MAX_LEVELS)
+		return false;
+	MeshLodHeader header = { MESH_LOD_MAGIC, MESH_LOD_VERSION, static_cast<uint32_t>(chain.size()), 0 };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const LodMesh& mesh : chain)
+	{
+		MeshLodLevel level = { static_cast<uint32_t>(mesh.positions.size()), static_cast<uint32_t>(mesh.indices.size()), mesh.error, 0 };
+		file.write(reinterpret_cast<const char*>(&level), sizeof(level));
+	}
+	for (const LodMesh& mesh : chain)
+	{
+		file.write(reinterpret_cast<const char*>(mesh.positions.data()), mesh.positions.size() * sizeof(glm::vec3));
+		file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+	}
+	return file.good();
+}
+
+inline bool readLodChain(const char* path, std::vector<LodMesh>& chain)
+{
+	std::ifstream file(path, std::ios::binary);
+	MeshLodHeader header;
+	if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != MESH_LOD_MAGIC
+		|| header.version != MESH_LOD_VERSION || header.levelCount == 0 || header.levelCount > MESH_LOD_MAX_LEVELS)
+		return false;
+	std::vector<MeshLodLevel> levels(header.levelCount);
+	if (!file.read(reinterpret_cast<char*>(levels.data()), levels.size() * sizeof(MeshLodLevel)))
+		return false;
+	chain.assign(levels.size(), LodMesh());
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		LodMesh& mesh = chain[i];
+		mesh.positions.resize(levels[i].vertexCount);
+		mesh.indices.resize(levels[i].indexCount);
+		mesh.error = levels[i].error;
+		if (!file.read(reinterpret_cast<char*>(mesh.positions.data()), mesh.positions.size() * sizeof(glm::vec3))
+			|| !file.read(reinterpret_cast<char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t)))
+			return false;
+		for (uint32_t index : mesh.indices)
+		{
+			if (index >= levels[i].vertexCount)
+				return false;
+		}
+	}
+	return true;
+}
+
+#endif
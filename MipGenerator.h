@@ -0,0 +1,327 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// CPU mipmap generation to replace glGenerateMipmap, which box filters whatever it's given:
+// here the color channels of sRGB encoded images are decoded and filtered as linear light,
+// whether or not the texture is sampled as sRGB (data like normals is filtered as stored, see
+// TextureOptions::srgbEncoded), and every level is resampled from the one above with a
+// separable Kaiser windowed sinc, which keeps detail a box filter blurs away without its
+// aliasing. A texel is four floats, so each filter tap is one SSE
+// multiply-add; rows are spread across threads (levels depend on each other, so they can't be).
+// The chains are cached next to the source image ("container2.png.mips"), keyed on a hash of
+// the source file, so the filter runs once per image edit instead of once per launch.
+
+// all levels of an image, level 0 first, tightly packed
+struct MipChain {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t channels = 0;
+	std::vector<uint8_t> data;
+	std::vector<size_t> levelOffsets;
+
+	uint32_t levelCount() const { return static_cast<uint32_t>(levelOffsets.size()); }
+	uint32_t levelWidth(uint32_t level) const { return std::max(width >> level, 1u); }
+	uint32_t levelHeight(uint32_t level) const { return std::max(height >> level, 1u); }
+	size_t levelBytes(uint32_t level) const { return static_cast<size_t>(levelWidth(level)) * levelHeight(level) * channels; }
+};
+
+const float MIP_KAISER_RADIUS = 3.0f; // lobes of the sinc, in destination texels
+const float MIP_KAISER_BETA = 4.0f;
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+inline float besselI0(float x)
+{
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 16; k++)
+	{
+		term *= (x / (2.0f * k)) * (x / (2.0f * k));
+		sum += term;
+	}
+	return sum;
+}
+
+inline float kaiserSinc(float x)
+{
+	if (std::fabs(x) >= MIP_KAISER_RADIUS)
+		return 0.0f;
+	float t = x / MIP_KAISER_RADIUS;
+	float window = besselI0(MIP_KAISER_BETA * std::sqrt(1.0f - t * t)) / besselI0(MIP_KAISER_BETA);
+	float sinc = x == 0.0f ? 1.0f : std::sin(3.14159265f * x) / (3.14159265f * x);
+	return sinc * window;
+}
+
+// the taps of one destination texel along an axis, source indices clamped to the edge
+struct MipFilterAxis {
+	std::vector<uint32_t> first; // per destination texel, into indices/weights
+	std::vector<uint32_t> indices;
+	std::vector<float> weights;
+
+	MipFilterAxis(uint32_t sourceSize, uint32_t destinationSize)
+	{
+		float scale = static_cast<float>(sourceSize) / destinationSize;
+		float support = MIP_KAISER_RADIUS * scale;
+		for (uint32_t d = 0; d <= destinationSize; d++)
+		{
+			first.push_back(static_cast<uint32_t>(indices.size()));
+			if (d == destinationSize)
+				break;
+			float center = (d + 0.5f) * scale;
+			int begin = static_cast<int>(std::floor(center - support));
+			int end = static_cast<int>(std::ceil(center + support));
+			float total = 0.0f;
+			size_t start = weights.size();
+			for (int s = begin; s <= end; s++)
+			{
+				float weight = kaiserSinc((s + 0.5f - center) / scale);
+				if (weight == 0.0f)
+					continue;
+				indices.push_back(static_cast<uint32_t>(std::min(std::max(s, 0), static_cast<int>(sourceSize) - 1)));
+				weights.push_back(weight);
+				total += weight;
+			}
+			for (size_t i = start; i < weights.size(); i++)
+				weights[i] /= total;
+		}
+	}
+};
+
+// out[x] = sum of weight * in[index * stride] over the taps of x, four floats a texel
+inline void filterTexels(const float* in, size_t stride, const MipFilterAxis& axis, uint32_t x, float* out)
+{
+#ifdef MIP_GENERATOR_SSE2
+	__m128 sum = _mm_setzero_ps();
+	for (uint32_t tap = axis.first[x]; tap < axis.first[x + 1]; tap++)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(axis.weights[tap]), _mm_loadu_ps(in + axis.indices[tap] * stride)));
+	_mm_storeu_ps(out, sum);
+#else
+	float sum[4] = {};
+	for (uint32_t tap = axis.first[x]; tap < axis.first[x + 1]; tap++)
+	{
+		const float* texel = in + axis.indices[tap] * stride;
+		for (int c = 0; c < 4; c++)
+			sum[c] += axis.weights[tap] * texel[c];
+	}
+	std::memcpy(out, sum, sizeof(sum));
+#endif
+}
+
+inline const float* srgbDecodeTable()
+{
+	static std::vector<float> table = [] {
+		std::vector<float> values(256);
+		for (int i = 0; i < 256; i++)
+		{
+			float v = i / 255.0f;
+			values[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+		}
+		return values;
+	}();
+	return table.data();
+}
+
+// linear [0, 1] in 1/16383 steps to 8 bit sRGB, well under one output step everywhere
+inline const uint8_t* srgbEncodeTable()
+{
+	static std::vector<uint8_t> table = [] {
+		std::vector<uint8_t> values(16384);
+		for (int i = 0; i < 16384; i++)
+		{
+			float v = i / 16383.0f;
+			float encoded = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+			values[i] = static_cast<uint8_t>(std::min(std::max(encoded * 255.0f + 0.5f, 0.0f), 255.0f));
+		}
+		return values;
+	}();
+	return table.data();
+}
+
+// Saved images often carry more channels than they use: an alpha that is opaque
+// everywhere, or RGB that is the same gray three times (the specular maps). Packs the
+// pixels down in place so the texture gets the smallest format that keeps everything.
+inline void dropUnusedChannels(unsigned char* pixels, size_t texels, int& channels, bool srgb)
+{
+	bool hasAlpha = channels == 2 || channels == 4;
+	bool colored = channels >= 3;
+	bool opaque = true;
+	bool gray = true;
+	for (size_t i = 0; i < texels && (opaque || gray); i++)
+	{
+		const unsigned char* texel = pixels + i * channels;
+		if (hasAlpha)
+			opaque = opaque && texel[channels - 1] == 255;
+		if (colored)
+			gray = gray && texel[0] == texel[1] && texel[1] == texel[2];
+	}
+
+	// GL 3.3 has no single channel sRGB format, so sRGB images keep their color channels
+	int colorChannels = colored && (!gray || srgb) ? 3 : 1;
+	int kept = colorChannels + (hasAlpha && !opaque ? 1 : 0);
+	if (kept == channels)
+		return;
+	for (size_t i = 0; i < texels; i++)
+	{
+		const unsigned char* source = pixels + i * channels;
+		unsigned char* destination = pixels + i * kept;
+		for (int c = 0; c < colorChannels; c++)
+			destination[c] = source[c];
+		if (kept > colorChannels)
+			destination[colorChannels] = source[channels - 1];
+	}
+	channels = kept;
+}
+
+// builds the whole chain down to 1x1; srgb says the first three channels are sRGB encoded
+// color, filtered in linear light (the alpha and gray images' single channel are always
+// filtered as stored, the same as the BC4 KTX2 textures the gray images compress to)
+inline MipChain generateMipChain(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t channels, bool srgb, unsigned int workerCount)
+{
+	MipChain chain;
+	chain.width = width;
+	chain.height = height;
+	chain.channels = channels;
+	chain.levelOffsets.push_back(0);
+	chain.data.assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+
+	const float* decode = srgbDecodeTable();
+	const uint8_t* encode = srgbEncodeTable();
+	uint32_t colorChannels = srgb && channels >= 3 ? 3 : 0;
+
+	// the current level as four floats a texel, linear
+	std::vector<float> source(static_cast<size_t>(width) * height * 4, 0.0f);
+	for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+	{
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			uint8_t value = pixels[i * channels + c];
+			source[i * 4 + c] = c < colorChannels ? decode[value] : value / 255.0f;
+		}
+	}
+
+	while (width > 1 || height > 1)
+	{
+		uint32_t nextWidth = std::max(width / 2, 1u);
+		uint32_t nextHeight = std::max(height / 2, 1u);
+		MipFilterAxis horizontal(width, nextWidth);
+		MipFilterAxis vertical(height, nextHeight);
+
+		// rows first, then columns of the narrowed rows
+		std::vector<float> narrowed(static_cast<size_t>(nextWidth) * height * 4);
+		parallelFor(height, 16, workerCount, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t y = begin; y < end; y++)
+			{
+				for (uint32_t x = 0; x < nextWidth; x++)
+					filterTexels(&source[y * width * 4], 4, horizontal, x, &narrowed[(y * nextWidth + x) * 4]);
+			}
+		});
+		std::vector<float> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+		parallelFor(nextHeight, 16, workerCount, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t y = begin; y < end; y++)
+			{
+				for (uint32_t x = 0; x < nextWidth; x++)
+					filterTexels(&narrowed[x * 4], static_cast<size_t>(nextWidth) * 4, vertical, static_cast<uint32_t>(y), &next[(y * nextWidth + x) * 4]);
+			}
+		});
+
+		// the negative lobes can ring past the representable range
+		size_t offset = chain.data.size();
+		chain.levelOffsets.push_back(offset);
+		chain.data.resize(offset + static_cast<size_t>(nextWidth) * nextHeight * channels);
+		for (size_t i = 0; i < static_cast<size_t>(nextWidth) * nextHeight; i++)
+		{
+			for (uint32_t c = 0; c < channels; c++)
+			{
+				float value = std::min(std::max(next[i * 4 + c], 0.0f), 1.0f);
+				chain.data[offset + i * channels + c] = c < colorChannels ? encode[static_cast<int>(value * 16383.0f + 0.5f)]
+					: static_cast<uint8_t>(value * 255.0f + 0.5f);
+			}
+		}
+
+		source.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return chain;
+}
+
+// FNV-1a, to tell whether a cached chain still belongs to its source file
+inline uint64_t hashBytes(const uint8_t* bytes, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+// 2: ".mips" chains of color images are no longer filtered as sRGB
+// 3: they are again, in linear light; data images have ".linear.mips" chains filtered as stored
+const uint32_t MIP_CACHE_VERSION = 3;
+
+// the cache file next to an image, per color space: sRGB textures keep gray images' three
+// channels (see dropUnusedChannels), and only color images are filtered in linear light
+inline const char* mipCacheSuffix(bool srgb, bool srgbEncoded)
+{
+	return srgb ? ".srgb.mips" : srgbEncoded ? ".mips" : ".linear.mips";
+}
+
+struct MipCacheHeader {
+	char magic[4]; // "MIPS"
+	uint32_t version;
+	uint64_t sourceSize;
+	uint64_t sourceHash;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t levelCount;
+};
+
+inline bool writeMipCache(const char* path, uint64_t sourceSize, uint64_t sourceHash, const MipChain& chain)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	MipCacheHeader header = { { 'M', 'I', 'P', 'S' }, MIP_CACHE_VERSION, sourceSize, sourceHash, chain.width, chain.height, chain.channels, chain.levelCount() };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(chain.data.data()), chain.data.size());
+	return file.good();
+}
+
+// fails when there's no cache or it was made from a different version of the source
+inline bool readMipCache(const char* path, uint64_t sourceSize, uint64_t sourceHash, MipChain& chain)
+{
+	std::ifstream file(path, std::ios::binary);
+	MipCacheHeader header;
+	if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	if (std::memcmp(header.magic, "MIPS", 4) != 0 || header.version != MIP_CACHE_VERSION || header.sourceSize != sourceSize
+		|| header.sourceHash != sourceHash || header.channels == 0 || header.channels > 4)
+		return false;
+
+	chain = MipChain();
+	chain.width = header.width;
+	chain.height = header.height;
+	chain.channels = header.channels;
+	size_t size = 0;
+	for (uint32_t level = 0; level < header.levelCount; level++)
+	{
+		chain.levelOffsets.push_back(size);
+		size += chain.levelBytes(level);
+	}
+	chain.data.resize(size);
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(chain.data.data()), size));
+}
+
+#endif
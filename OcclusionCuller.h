@@ -0,0 +1,436 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE2
+#include <emmintrin.h>
+#endif
+
+struct OcclusionStats {
+	size_t occluderTriangles = 0; // set up and binned by addOccluder()
+	size_t rasterizedTriangles = 0; // drawn into a band before the deadline, once for every band a triangle covers
+	size_t testedBoxes = 0;
+	size_t occludedBoxes = 0;
+	double milliseconds = 0.0; // from begin() to the end of rasterize()
+	bool overBudget = false;
+};
+
+// Software occlusion culling on the CPU, so the GPU never has to be read back. The nearest,
+// biggest objects are rasterized as occluders into a small depth buffer, then the bounding
+// boxes of everything else are tested against it before their draws are submitted.
+// The buffer is split into bands of BAND_HEIGHT rows; addOccluder() bins every triangle to
+// the bands it covers and rasterize() hands the bands out to persistent workers (the calling
+// thread joins in), so no two threads ever write the same pixels. A band's triangles are drawn
+// four pixels at a time with SSE2, keeping the nearer depth per pixel, and each 8x8 tile keeps
+// the farthest depth in it; testBox() skips every tile that's wholly nearer than the box and
+// only looks at the pixels of the others.
+// The work stops at the deadline given to begin(). Whatever isn't drawn by then stays at the
+// far plane, which hides less but never hides anything that's visible.
+class OcclusionCuller
+{
+    public:
+	static const int BAND_HEIGHT = 16;
+	static const int TILE_SIZE = 8;
+
+	// the buffer is rounded up to whole tiles and bands; the projection stretches over it as it
+	// does over the window, so its aspect doesn't have to match
+	OcclusionCuller(int width, int height, unsigned int workerCount = 0)
+		: width((width + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE), height((height + BAND_HEIGHT - 1) / BAND_HEIGHT * BAND_HEIGHT),
+		  tilesX(this->width / TILE_SIZE), bandCount(this->height / BAND_HEIGHT),
+		  depth(this->width * this->height, 1.0f), tileMaxDepth(tilesX * (this->height / TILE_SIZE), 1.0f), bins(bandCount)
+	{
+		// the calling thread rasterizes too
+		if (workerCount == 0)
+			workerCount = defaultWorkerCount() - 1;
+		for (unsigned int i = 0; i < workerCount; i++)
+			workers.emplace_back(&OcclusionCuller::workerLoop, this);
+	}
+
+	~OcclusionCuller()
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			stopping = true;
+		}
+		jobReady.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	// starts a frame: drops the last frame's occluders and gives this one budgetMilliseconds
+	// to set up and rasterize the new ones
+	void begin(double budgetMilliseconds)
+	{
+		start = Clock::now();
+		deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(budgetMilliseconds));
+		triangles.clear();
+		for (std::vector<uint32_t>& bin : bins)
+			bin.clear();
+		frameStats = OcclusionStats();
+		rasterized = 0;
+		bandsOverBudget = false;
+	}
+
+	// adds the triangles (every three vertices) of a mesh, positions being the first three of
+	// every strideFloats floats. Both windings are drawn, so the mesh doesn't need a consistent
+	// one; triangles reaching in front of the near plane are left out, the GPU clips them and
+	// they'd hide what shows through. False once the budget is spent, add nothing more
+	bool addOccluder(const glm::mat4& modelViewProjection, const float* positions, size_t vertexCount, size_t strideFloats)
+	{
+		if (Clock::now() > deadline)
+		{
+			frameStats.overBudget = true;
+			return false;
+		}
+		for (size_t v = 0; v + 3 <= vertexCount; v += 3)
+		{
+			Triangle triangle;
+			bool clipped = false;
+			for (int k = 0; k < 3; k++)
+			{
+				const float* position = positions + (v + k) * strideFloats;
+				glm::vec4 clip = modelViewProjection * glm::vec4(position[0], position[1], position[2], 1.0f);
+				if (clip.w <= MIN_W || clip.z < -clip.w)
+				{
+					clipped = true;
+					break;
+				}
+				float inverseW = 1.0f / clip.w;
+				triangle.x[k] = (clip.x * inverseW * 0.5f + 0.5f) * width;
+				triangle.y[k] = (clip.y * inverseW * 0.5f + 0.5f) * height;
+				triangle.depth[k] = clip.z * inverseW * 0.5f + 0.5f;
+			}
+			if (clipped || !setup(triangle))
+				continue;
+
+			uint32_t index = static_cast<uint32_t>(triangles.size());
+			triangles.push_back(triangle);
+			for (int band = triangle.minY / BAND_HEIGHT; band <= triangle.maxY / BAND_HEIGHT; band++)
+				bins[band].push_back(index);
+		}
+		frameStats.occluderTriangles = triangles.size();
+		return true;
+	}
+
+	// draws the binned triangles on every worker and returns when the buffer is complete
+	void rasterize()
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			bandsLeft = bandCount;
+			nextBand = 0;
+			generation++;
+		}
+		jobReady.notify_all();
+		rasterizeBands();
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			bandsDone.wait(lock, [this] { return bandsLeft == 0; });
+		}
+		frameStats.rasterizedTriangles = rasterized;
+		frameStats.overBudget = frameStats.overBudget || bandsOverBudget;
+		frameStats.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// whether anything of the world box might show past the occluders: false only when every
+	// pixel under the box is nearer than the box's nearest corner. Boxes reaching behind the
+	// camera or off the buffer count as visible
+	bool testBox(const glm::mat4& viewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax)
+	{
+		frameStats.testedBoxes++;
+		float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 position((corner & 1) ? boxMax.x : boxMin.x, (corner & 2) ? boxMax.y : boxMin.y, (corner & 4) ? boxMax.z : boxMin.z);
+			glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+			if (clip.w <= MIN_W)
+				return true;
+			float inverseW = 1.0f / clip.w;
+			float x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+			float y = (clip.y * inverseW * 0.5f + 0.5f) * height;
+			minX = std::min(minX, x), maxX = std::max(maxX, x);
+			minY = std::min(minY, y), maxY = std::max(maxY, y);
+			nearest = std::min(nearest, clip.z * inverseW * 0.5f + 0.5f);
+		}
+
+		// every pixel the box's rectangle touches, even partly; clamped first, corners close to
+		// the camera plane project far beyond what an int holds
+		minX = std::max(minX, -1.0f), maxX = std::min(maxX, static_cast<float>(width));
+		minY = std::max(minY, -1.0f), maxY = std::min(maxY, static_cast<float>(height));
+		int x0 = std::max(0, static_cast<int>(std::floor(minX))), x1 = std::min(width - 1, static_cast<int>(std::floor(maxX)));
+		int y0 = std::max(0, static_cast<int>(std::floor(minY))), y1 = std::min(height - 1, static_cast<int>(std::floor(maxY)));
+		if (x0 > x1 || y0 > y1)
+			return true;
+
+		for (int tileY = y0 / TILE_SIZE; tileY <= y1 / TILE_SIZE; tileY++)
+		{
+			for (int tileX = x0 / TILE_SIZE; tileX <= x1 / TILE_SIZE; tileX++)
+			{
+				if (tileMaxDepth[tileY * tilesX + tileX] < nearest)
+					continue;
+				int tileX0 = std::max(x0, tileX * TILE_SIZE), tileX1 = std::min(x1, tileX * TILE_SIZE + TILE_SIZE - 1);
+				int tileY0 = std::max(y0, tileY * TILE_SIZE), tileY1 = std::min(y1, tileY * TILE_SIZE + TILE_SIZE - 1);
+				for (int y = tileY0; y <= tileY1; y++)
+				{
+					if (anyAtOrBehind(&depth[y * width], tileX0, tileX1, nearest))
+						return true;
+				}
+			}
+		}
+		frameStats.occludedBoxes++;
+		return false;
+	}
+
+	const OcclusionStats& stats() const { return frameStats; }
+	int bufferWidth() const { return width; }
+	int bufferHeight() const { return height; }
+	// depths in [0, 1], rows bottom up, for looking at the buffer
+	const float* depthBuffer() const { return depth.data(); }
+
+    private:
+	typedef std::chrono::steady_clock Clock;
+
+	// nearer than this the projection blows up; boxes or triangles reaching it are never culled or drawn
+	static constexpr float MIN_W = 1e-5f;
+	// how many triangles a band draws between looking at the clock
+	static const size_t DEADLINE_CHECK_INTERVAL = 16;
+
+	// screen space, counter clockwise (swapped into it when needed) so the edge functions are
+	// positive inside; the bounds are the pixels whose centers the triangle's box covers
+	struct Triangle {
+		float x[3], y[3], depth[3];
+		int minX, maxX, minY, maxY;
+	};
+
+	const int width, height;
+	const int tilesX, bandCount;
+	std::vector<float> depth;
+	std::vector<float> tileMaxDepth;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> bins; // triangle indices per band
+	OcclusionStats frameStats;
+	Clock::time_point start, deadline;
+
+	std::vector<std::thread> workers;
+	std::mutex jobMutex;
+	std::condition_variable jobReady, bandsDone;
+	bool stopping = false;
+	uint64_t generation = 0;
+	std::atomic<int> nextBand{ 0 };
+	std::atomic<int> bandsLeft{ 0 };
+	std::atomic<size_t> rasterized{ 0 };
+	std::atomic<bool> bandsOverBudget{ false };
+
+	bool setup(Triangle& triangle) const
+	{
+		float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		if (std::fabs(area) < 1e-6f)
+			return false;
+		if (area < 0.0f)
+		{
+			std::swap(triangle.x[1], triangle.x[2]);
+			std::swap(triangle.y[1], triangle.y[2]);
+			std::swap(triangle.depth[1], triangle.depth[2]);
+		}
+
+		// pixel i has its center at i + 0.5
+		float minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+		float maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+		float minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+		float maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+		if (maxX < 0.0f || maxY < 0.0f || minX > width || minY > height)
+			return false;
+		minX = std::max(minX, 0.0f), maxX = std::min(maxX, static_cast<float>(width));
+		minY = std::max(minY, 0.0f), maxY = std::min(maxY, static_cast<float>(height));
+		triangle.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5f)));
+		triangle.maxX = std::min(width - 1, static_cast<int>(std::floor(maxX - 0.5f)));
+		triangle.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5f)));
+		triangle.maxY = std::min(height - 1, static_cast<int>(std::floor(maxY - 0.5f)));
+		return triangle.minX <= triangle.maxX && triangle.minY <= triangle.maxY;
+	}
+
+	void workerLoop()
+	{
+		uint64_t seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(jobMutex);
+				jobReady.wait(lock, [this, seen] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			rasterizeBands();
+		}
+	}
+
+	void rasterizeBands()
+	{
+		for (;;)
+		{
+			int band = nextBand++;
+			if (band >= bandCount)
+				return;
+			rasterizeBand(band);
+			if (--bandsLeft == 0)
+			{
+				std::lock_guard<std::mutex> lock(jobMutex);
+				bandsDone.notify_all();
+			}
+		}
+	}
+
+	void rasterizeBand(int band)
+	{
+		int bandY0 = band * BAND_HEIGHT, bandY1 = bandY0 + BAND_HEIGHT - 1;
+		std::fill(depth.begin() + bandY0 * width, depth.begin() + (bandY1 + 1) * width, 1.0f);
+
+		const std::vector<uint32_t>& bin = bins[band];
+		size_t drawn = 0;
+		for (; drawn < bin.size(); drawn++)
+		{
+			if (drawn % DEADLINE_CHECK_INTERVAL == 0 && Clock::now() > deadline)
+			{
+				bandsOverBudget = true;
+				break;
+			}
+			drawTriangle(triangles[bin[drawn]], bandY0, bandY1);
+		}
+		rasterized += drawn;
+
+		for (int tileY = bandY0 / TILE_SIZE; tileY <= bandY1 / TILE_SIZE; tileY++)
+		{
+			for (int tileX = 0; tileX < tilesX; tileX++)
+				tileMaxDepth[tileY * tilesX + tileX] = maxDepth(tileX * TILE_SIZE, tileY * TILE_SIZE);
+		}
+	}
+
+	void drawTriangle(const Triangle& triangle, int bandY0, int bandY1)
+	{
+		// edge k runs from vertex k to k + 1: e(x, y) = a * x + b * y + c, positive inside. The
+		// row starts are worked out in double, far off screen vertices would lose the edges'
+		// sign to cancellation in float, and the pixels along a row step from there
+		double a[3], b[3], c[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int next = (k + 1) % 3;
+			a[k] = static_cast<double>(triangle.y[k]) - triangle.y[next];
+			b[k] = static_cast<double>(triangle.x[next]) - triangle.x[k];
+			c[k] = -a[k] * triangle.x[k] - b[k] * triangle.y[k];
+		}
+		// the depth plane, z = z0 + dzdx * (x - x0) + dzdy * (y - y0)
+		double dx1 = static_cast<double>(triangle.x[1]) - triangle.x[0], dy1 = static_cast<double>(triangle.y[1]) - triangle.y[0];
+		double dx2 = static_cast<double>(triangle.x[2]) - triangle.x[0], dy2 = static_cast<double>(triangle.y[2]) - triangle.y[0];
+		double dz1 = static_cast<double>(triangle.depth[1]) - triangle.depth[0], dz2 = static_cast<double>(triangle.depth[2]) - triangle.depth[0];
+		double determinant = dx1 * dy2 - dx2 * dy1;
+		double dzdx = (dz1 * dy2 - dz2 * dy1) / determinant;
+		double dzdy = (dx1 * dz2 - dx2 * dz1) / determinant;
+
+		int startX = triangle.minX & ~3; // whole groups of four, the buffer is a multiple of eight wide
+		double centerX = startX + 0.5;
+		int y0 = std::max(triangle.minY, bandY0), y1 = std::min(triangle.maxY, bandY1);
+		for (int y = y0; y <= y1; y++)
+		{
+			double centerY = y + 0.5;
+			float edgeRow[3];
+			for (int k = 0; k < 3; k++)
+				edgeRow[k] = static_cast<float>(a[k] * centerX + b[k] * centerY + c[k]);
+			float depthRow = static_cast<float>(triangle.depth[0] + dzdx * (centerX - triangle.x[0]) + dzdy * (centerY - triangle.y[0]));
+			float* row = &depth[y * width];
+#if defined(OCCLUSION_CULLER_SSE2)
+			const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+			const __m128 zero = _mm_setzero_ps();
+			__m128 stepA0 = _mm_set1_ps(static_cast<float>(a[0])), stepA1 = _mm_set1_ps(static_cast<float>(a[1])), stepA2 = _mm_set1_ps(static_cast<float>(a[2]));
+			__m128 stepDepth = _mm_set1_ps(static_cast<float>(dzdx));
+			__m128 edge0 = _mm_set1_ps(edgeRow[0]), edge1 = _mm_set1_ps(edgeRow[1]), edge2 = _mm_set1_ps(edgeRow[2]);
+			__m128 rowDepth = _mm_set1_ps(depthRow);
+			for (int x = startX; x <= triangle.maxX; x += 4)
+			{
+				__m128 offset = _mm_add_ps(_mm_set1_ps(static_cast<float>(x - startX)), lanes);
+				__m128 e0 = _mm_add_ps(edge0, _mm_mul_ps(stepA0, offset));
+				__m128 e1 = _mm_add_ps(edge1, _mm_mul_ps(stepA1, offset));
+				__m128 e2 = _mm_add_ps(edge2, _mm_mul_ps(stepA2, offset));
+				__m128 inside = _mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), zero);
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+				__m128 z = _mm_add_ps(rowDepth, _mm_mul_ps(stepDepth, offset));
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+#else
+			for (int x = triangle.minX; x <= triangle.maxX; x++)
+			{
+				float offset = static_cast<float>(x - startX);
+				float e0 = edgeRow[0] + static_cast<float>(a[0]) * offset;
+				float e1 = edgeRow[1] + static_cast<float>(a[1]) * offset;
+				float e2 = edgeRow[2] + static_cast<float>(a[2]) * offset;
+				if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f)
+					continue;
+				row[x] = std::min(row[x], depthRow + static_cast<float>(dzdx) * offset);
+			}
+#endif
+		}
+	}
+
+	float maxDepth(int x0, int y0) const
+	{
+#if defined(OCCLUSION_CULLER_SSE2)
+		__m128 farthest = _mm_setzero_ps();
+		for (int y = y0; y < y0 + TILE_SIZE; y++)
+		{
+			const float* row = &depth[y * width + x0];
+			farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+		}
+		farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+		farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(farthest);
+#else
+		float farthest = 0.0f;
+		for (int y = y0; y < y0 + TILE_SIZE; y++)
+		{
+			for (int x = x0; x < x0 + TILE_SIZE; x++)
+				farthest = std::max(farthest, depth[y * width + x]);
+		}
+		return farthest;
+#endif
+	}
+
+	// whether any of row[x0..x1] is as far as the box or farther; the occluders' own boxes
+	// touch their surfaces, so equal depths don't hide anything
+	static bool anyAtOrBehind(const float* row, int x0, int x1, float nearest)
+	{
+		int x = x0;
+#if defined(OCCLUSION_CULLER_SSE2)
+		__m128 boxDepth = _mm_set1_ps(nearest);
+		for (; x + 4 <= x1 + 1; x += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+				return true;
+		}
+#endif
+		for (; x <= x1; x++)
+		{
+			if (row[x] >= nearest)
+				return true;
+		}
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// number of worker threads used by the CPU tools when the caller doesn't ask for a specific count
+inline unsigned int defaultWorkerCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+// Runs fn(begin, end, workerIndex) over [0, count) on workerCount threads.
+// Work is handed out in chunks of grainSize from a shared atomic counter, so uneven
+// items (e.g. lightmap tiles that see more geometry) still balance across the workers.
+template <typename Fn>
+void parallelFor(size_t count, size_t grainSize, unsigned int workerCount, Fn fn)
+{
+	if (count == 0)
+		return;
+	if (grainSize == 0)
+		grainSize = 1;
+	if (workerCount == 0)
+		workerCount = defaultWorkerCount();
+
+	size_t chunks = (count + grainSize - 1) / grainSize;
+	workerCount = static_cast<unsigned int>(std::min<size_t>(workerCount, chunks));
+
+	std::atomic<size_t> next(0);
+	auto worker = [&](unsigned int workerIndex) {
+		for (;;)
+		{
+			size_t begin = next.fetch_add(grainSize);
+			if (begin >= count)
+				break;
+			fn(begin, std::min(begin + grainSize, count), workerIndex);
+		}
+	};
+
+	// the calling thread takes part as worker 0
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < workerCount; i++)
+		threads.emplace_back(worker, i);
+	worker(0);
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+#endif
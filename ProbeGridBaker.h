@@ -0,0 +1,228 @@
+#ifndef PROBE_GRID_BAKER_H
+#define PROBE_GRID_BAKER_H
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "BakeScene.h"
+#include "Parallel.h"
+
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+// Probe grid file layout: a ProbeGridHeader followed by SH_TEXELS_PER_PROBE blocks, each
+// holding one RGBA texel for every probe (x fastest, then y, then z). The renderer uploads the
+// blocks side by side along x of a single 3D texture of (size.x * 7, size.y, size.z).
+const uint32_t PROBE_GRID_MAGIC = 0x42525053; // "SPRB"
+const uint32_t PROBE_GRID_VERSION = 1;
+
+// L2 spherical harmonics: 9 RGB coefficients, packed into 7 RGBA texels
+const uint32_t SH_COEFFICIENT_COUNT = 9;
+const uint32_t SH_TEXELS_PER_PROBE = 7;
+
+struct ProbeGridHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size[3]; // probes along x, y and z
+	float boundsMin[3]; // world position of the first probe
+	float boundsMax[3]; // world position of the last probe
+};
+
+// the real SH basis functions for bands 0 to 2
+inline void shBasis(const glm::vec3& d, float basis[SH_COEFFICIENT_COUNT])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * d.y;
+	basis[2] = 0.488603f * d.z;
+	basis[3] = 0.488603f * d.x;
+	basis[4] = 1.092548f * d.x * d.y;
+	basis[5] = 1.092548f * d.y * d.z;
+	basis[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+	basis[7] = 1.092548f * d.x * d.z;
+	basis[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+struct ProbeGridSettings {
+	uint32_t size[3] = { 8, 8, 8 };
+	uint32_t samplesPerProbe = 1024; // rays gathering bounce light
+	float padding = 1.0f; // grid extends this far past the scene bounds
+	float albedo = 0.5f; // grey stand-in for the diffuse map when light bounces
+	unsigned int workerCount = 0; // 0 = one per core
+};
+
+struct ProbeGridStats {
+	uint64_t rays = 0;
+	double seconds = 0.0;
+	unsigned int workerCount = 0;
+};
+
+// Bakes the ambient lighting into a grid of L2 SH irradiance probes. Each probe gathers the
+// flat ambient terms of the static lights plus one bounce of their diffuse light off the
+// scene, projects that radiance into SH and convolves it with the cosine lobe. The stored
+// coefficients already include the basis constants, so the fragment shader only needs the
+// polynomial in the normal (see EvalProbeGrid in 1.colors.fs).
+class ProbeGridBaker
+{
+    public:
+	ProbeGridBaker(const ProbeGridSettings& settings = ProbeGridSettings()) : settings(settings)
+	{
+	}
+
+	void bake()
+	{
+		scene.build();
+		computeBounds();
+
+		size_t probeCount = static_cast<size_t>(settings.size[0]) * settings.size[1] * settings.size[2];
+		coefficients.assign(probeCount * SH_COEFFICIENT_COUNT, glm::vec3(0.0f));
+
+		unsigned int workerCount = settings.workerCount > 0 ? settings.workerCount : defaultWorkerCount();
+		std::atomic<uint64_t> rays(0);
+
+		auto start = std::chrono::steady_clock::now();
+		parallelFor(probeCount, 4, workerCount, [&](size_t begin, size_t end, unsigned int) {
+			uint64_t probeRays = 0;
+			for (size_t probe = begin; probe < end; probe++)
+				probeRays += bakeProbe(probe);
+			rays += probeRays;
+		});
+		auto finish = std::chrono::steady_clock::now();
+
+		stats.rays = rays;
+		stats.seconds = std::chrono::duration<double>(finish - start).count();
+		stats.workerCount = workerCount;
+	}
+
+	bool write(const char* path) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		ProbeGridHeader header = {};
+		header.magic = PROBE_GRID_MAGIC;
+		header.version = PROBE_GRID_VERSION;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			header.size[axis] = settings.size[axis];
+			header.boundsMin[axis] = boundsMin[axis];
+			header.boundsMax[axis] = boundsMax[axis];
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		// flatten the 27 floats of each probe into 7 RGBA texels, one block per texel index
+		size_t probeCount = coefficients.size() / SH_COEFFICIENT_COUNT;
+		std::vector<float> texels(probeCount * SH_TEXELS_PER_PROBE * 4, 0.0f);
+		for (size_t probe = 0; probe < probeCount; probe++)
+		{
+			for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT * 3; i++)
+			{
+				uint32_t block = i / 4;
+				texels[(block * probeCount + probe) * 4 + i % 4] = coefficients[probe * SH_COEFFICIENT_COUNT + i / 3][i % 3];
+			}
+		}
+		file.write(reinterpret_cast<const char*>(texels.data()), texels.size() * sizeof(float));
+		return file.good();
+	}
+
+	const ProbeGridStats& getStats() const { return stats; }
+
+    private:
+	ProbeGridSettings settings;
+	ProbeGridStats stats;
+	BakeScene scene;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	std::vector<glm::vec3> coefficients;
+
+	void computeBounds()
+	{
+		boundsMin = glm::vec3(FLT_MAX);
+		boundsMax = glm::vec3(-FLT_MAX);
+		for (unsigned int cube = 0; cube < NR_CUBES; cube++)
+		{
+			glm::mat4 model = cubeModelMatrix(cube);
+			for (unsigned int vertex = 0; vertex < CUBE_VERTEX_COUNT; vertex++)
+			{
+				const float* v = &cubeVertices[vertex * CUBE_VERTEX_STRIDE];
+				glm::vec3 position = glm::vec3(model * glm::vec4(v[0], v[1], v[2], 1.0f));
+				boundsMin = glm::min(boundsMin, position);
+				boundsMax = glm::max(boundsMax, position);
+			}
+		}
+		for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+		{
+			boundsMin = glm::min(boundsMin, pointLightPositions[i]);
+			boundsMax = glm::max(boundsMax, pointLightPositions[i]);
+		}
+		boundsMin -= glm::vec3(settings.padding);
+		boundsMax += glm::vec3(settings.padding);
+	}
+
+	glm::vec3 probePosition(size_t probe) const
+	{
+		glm::uvec3 index(probe % settings.size[0], (probe / settings.size[0]) % settings.size[1], probe / (settings.size[0] * settings.size[1]));
+		glm::vec3 t(0.5f);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (settings.size[axis] > 1)
+				t[axis] = index[axis] / float(settings.size[axis] - 1);
+		}
+		return glm::mix(boundsMin, boundsMax, t);
+	}
+
+	uint64_t bakeProbe(size_t probe)
+	{
+		glm::vec3 position = probePosition(probe);
+		BakeRandom random = { 0x9E3779B9u * static_cast<uint32_t>(probe + 1) };
+		uint64_t rays = 0;
+		float basis[SH_COEFFICIENT_COUNT];
+		glm::vec3 radiance[SH_COEFFICIENT_COUNT];
+		for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++)
+			radiance[i] = glm::vec3(0.0f);
+
+		// the flat ambient terms arrive equally from every direction, so they only touch band 0
+		glm::vec3 ambient = DIR_LIGHT_AMBIENT;
+		for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+		{
+			float distance = glm::length(pointLightPositions[i] - position);
+			ambient += POINT_LIGHT_AMBIENT / (POINT_LIGHT_CONSTANT + POINT_LIGHT_LINEAR * distance + POINT_LIGHT_QUADRATIC * (distance * distance));
+		}
+		radiance[0] += ambient * (4.0f * 3.14159265f * 0.282095f);
+
+		// Monte Carlo projection of the light bounced off the surrounding surfaces
+		if (settings.samplesPerProbe > 0)
+		{
+			float weight = 4.0f * 3.14159265f / settings.samplesPerProbe;
+			for (uint32_t sample = 0; sample < settings.samplesPerProbe; sample++)
+			{
+				glm::vec3 direction = uniformSampleSphere(random.next(), random.next());
+				glm::vec3 hitPosition, hitNormal;
+				if (!scene.trace(position, direction, hitPosition, hitNormal, rays))
+					continue;
+
+				glm::vec3 bounced = settings.albedo * scene.directLight(hitPosition, hitNormal, false, rays);
+				shBasis(direction, basis);
+				for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++)
+					radiance[i] += bounced * (basis[i] * weight);
+			}
+		}
+
+		// convolve with the clamped cosine (divided by pi, as the shader multiplies with the
+		// diffuse map directly) and fold in the basis constants
+		const float bandScale[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 4.0f };
+		const float basisConstant[SH_COEFFICIENT_COUNT] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+		for (uint32_t i = 0; i < SH_COEFFICIENT_COUNT; i++)
+		{
+			uint32_t band = i == 0 ? 0 : (i < 4 ? 1 : 2);
+			coefficients[probe * SH_COEFFICIENT_COUNT + i] = radiance[i] * (bandScale[band] * basisConstant[i]);
+		}
+		return rays;
+	}
+};
+
+#endif
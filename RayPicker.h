@@ -0,0 +1,107 @@
+#ifndef RAY_PICKER_H
+#define RAY_PICKER_H
+
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+#include "SceneBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Ray queries against the CullBoxes the frustum culler reads, for picking the object under the
+// cursor on the CPU: nothing is read back from the GPU, so a pick doesn't wait for the frame.
+// The slab test is written around the box's center: along each axis the ray is inside the slab
+// between (center - origin) / direction - extent / |direction| and the same plus, so a box costs
+// a multiply and an add per axis and bound, no min and max of the two planes. raycastBoxes runs
+// it CULL_LANES boxes at a time; a ray enters few of a million boxes, so the lanes that enter
+// one are taken one by one on the side, and the loop itself never branches on a hit.
+
+// 1 / direction, with the axes the ray runs parallel to given a huge finite slope instead of
+// an infinity, which would make 0 * infinity out of a box touching the origin's plane
+inline glm::vec3 rayInverseDirection(const glm::vec3& direction)
+{
+	glm::vec3 inverse;
+	for (int axis = 0; axis < 3; axis++)
+		inverse[axis] = std::fabs(direction[axis]) > 1e-20f ? 1.0f / direction[axis] : std::copysign(1e20f, direction[axis]);
+	return inverse;
+}
+
+// whether the ray enters the box within [0, tMax], and at which t; 0 when it starts inside
+inline bool rayEntersBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& center, const glm::vec3& extent,
+	float tMax, float& enterT)
+{
+	glm::vec3 middle = (center - origin) * inverseDirection;
+	glm::vec3 reach = extent * glm::abs(inverseDirection);
+	glm::vec3 tNear = middle - reach, tFar = middle + reach;
+	enterT = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exitT = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+	return enterT <= exitT;
+}
+
+// the same for a box of localExtent around the origin of model: the ray goes into the model's
+// space, where the box is axis aligned; the direction isn't renormalized, so t stays the world's
+inline bool rayEntersModelBox(const glm::vec3& origin, const glm::vec3& direction, const glm::mat4& model, const glm::vec3& localExtent,
+	float tMax, float& enterT)
+{
+	glm::mat4 toModel = glm::inverse(model);
+	glm::vec3 localOrigin = glm::vec3(toModel * glm::vec4(origin, 1.0f));
+	glm::vec3 localDirection = glm::vec3(toModel * glm::vec4(direction, 0.0f));
+	return rayEntersBox(localOrigin, rayInverseDirection(localDirection), glm::vec3(0.0f), localExtent, tMax, enterT);
+}
+
+// the nearest box the ray enters within [0, tMax]; hit.object is its index in boxes
+inline bool raycastBoxes(const glm::vec3& origin, const glm::vec3& direction, float tMax, const CullBoxes& boxes, SceneRayHit& hit)
+{
+	glm::vec3 inverseDirection = rayInverseDirection(direction);
+	size_t count = boxes.size();
+	size_t i = 0;
+	bool found = false;
+	hit.t = tMax;
+	auto test = [&](size_t box) {
+		float enterT;
+		glm::vec3 center(boxes.centerX[box], boxes.centerY[box], boxes.centerZ[box]);
+		glm::vec3 extent(boxes.extentX[box], boxes.extentY[box], boxes.extentZ[box]);
+		if (rayEntersBox(origin, inverseDirection, center, extent, hit.t, enterT) && enterT < hit.t)
+		{
+			hit.t = enterT;
+			hit.object = static_cast<uint32_t>(box);
+			found = true;
+		}
+	};
+#if defined(FRUSTUM_CULLER_AVX) || defined(FRUSTUM_CULLER_SSE2)
+	const int ALL_LANES = (1 << CULL_LANES) - 1;
+	CullFloats originX = cullSplat(origin.x), originY = cullSplat(origin.y), originZ = cullSplat(origin.z);
+	CullFloats inverseX = cullSplat(inverseDirection.x), inverseY = cullSplat(inverseDirection.y), inverseZ = cullSplat(inverseDirection.z);
+	CullFloats absX = cullSplat(std::fabs(inverseDirection.x)), absY = cullSplat(std::fabs(inverseDirection.y)), absZ = cullSplat(std::fabs(inverseDirection.z));
+	CullFloats zero = cullSplat(0.0f);
+	CullFloats nearest = cullSplat(hit.t);
+	for (; i + CULL_LANES <= count; i += CULL_LANES)
+	{
+		CullFloats middleX = cullMul(cullSub(cullLoad(&boxes.centerX[i]), originX), inverseX);
+		CullFloats middleY = cullMul(cullSub(cullLoad(&boxes.centerY[i]), originY), inverseY);
+		CullFloats middleZ = cullMul(cullSub(cullLoad(&boxes.centerZ[i]), originZ), inverseZ);
+		CullFloats reachX = cullMul(cullLoad(&boxes.extentX[i]), absX);
+		CullFloats reachY = cullMul(cullLoad(&boxes.extentY[i]), absY);
+		CullFloats reachZ = cullMul(cullLoad(&boxes.extentZ[i]), absZ);
+		CullFloats enter = cullMax(cullMax(cullSub(middleX, reachX), cullSub(middleY, reachY)), cullMax(cullSub(middleZ, reachZ), zero));
+		CullFloats exit = cullMin(cullMin(cullAdd(middleX, reachX), cullAdd(middleY, reachY)), cullMin(cullAdd(middleZ, reachZ), nearest));
+		// missed where the ray leaves before it enters
+		int missed = cullSignMask(cullSub(exit, enter));
+		if (missed == ALL_LANES)
+			continue;
+		for (int lane = 0; lane < CULL_LANES; lane++)
+		{
+			if (!((missed >> lane) & 1))
+				test(i + lane);
+		}
+		nearest = cullSplat(hit.t);
+	}
+#endif
+	for (; i < count; i++)
+		test(i);
+	return found;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// The static scene shared by the renderer and the offline tools (AssetTool).
+// Anything baked from it has to be re-baked when these values change.
+
+const unsigned int CUBE_VERTEX_COUNT = 36; // 6 faces, 2 triangles each
+const unsigned int CUBE_VERTEX_STRIDE = 8; // floats per vertex
+const unsigned int CUBE_FACE_COUNT = 6;
+
+const float cubeVertices[CUBE_VERTEX_COUNT * CUBE_VERTEX_STRIDE] = {
+	// positions          // normals           // texture coords
+	-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
+	0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 0.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f, 1.0f,
+	-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 1.0f,
+	-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f, 0.0f,
+
+	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
+	0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 0.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   1.0f, 1.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 1.0f,
+	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,   0.0f, 0.0f,
+
+	-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+	-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
+	-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+	-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+	-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
+	-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+
+	0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+	0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f,
+	0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+	0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f,
+	0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f, 0.0f,
+	0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f,
+
+	-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
+	0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 1.0f,
+	0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
+	0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f, 0.0f,
+	-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 0.0f,
+	-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f, 1.0f,
+
+	-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f,
+	-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f
+};
+
+const unsigned int NR_CUBES = 10;
+
+const glm::vec3 cubePositions[NR_CUBES] = {
+	glm::vec3(0.0f,  0.0f,  0.0f),
+	glm::vec3(2.0f,  5.0f, -15.0f),
+	glm::vec3(-1.5f, -2.2f, -2.5f),
+	glm::vec3(-3.8f, -2.0f, -12.3f),
+	glm::vec3(2.4f, -0.4f, -3.5f),
+	glm::vec3(-1.7f,  3.0f, -7.5f),
+	glm::vec3(1.3f, -2.0f, -2.5f),
+	glm::vec3(1.5f,  2.0f, -2.5f),
+	glm::vec3(1.5f,  0.2f, -1.5f),
+	glm::vec3(-1.3f,  1.0f, -1.5f)
+};
+
+// world transformation of the i-th container cube
+inline glm::mat4 cubeModelMatrix(unsigned int i)
+{
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(model, cubePositions[i]);
+	float angle = 20.0f * i;
+	model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+	return model;
+}
+
+// directional light
+const glm::vec3 DIR_LIGHT_DIRECTION(-0.2f, -1.0f, -0.3f);
+const glm::vec3 DIR_LIGHT_AMBIENT(0.01f, 0.2f, 0.01f);
+const glm::vec3 DIR_LIGHT_DIFFUSE(0.01f, 0.2f, 0.01f);
+const glm::vec3 DIR_LIGHT_SPECULAR(0.5f, 0.2f, 0.5f);
+
+// point lights
+const unsigned int NR_POINT_LIGHTS = 4;
+
+const glm::vec3 pointLightPositions[NR_POINT_LIGHTS] = {
+	glm::vec3(0.7f,  0.2f,  2.0f),
+	glm::vec3(2.3f, -3.3f, -4.0f),
+	glm::vec3(-4.0f,  2.0f, -12.0f),
+	glm::vec3(0.0f,  0.0f, -3.0f)
+};
+
+// the light markers are spheres in the bounds of the 0.2 cube they used to be, drawn through
+// the LOD chain "AssetTool bake-lods" simplifies from this one
+const unsigned int MARKER_SPHERE_SUBDIVISIONS = 4; // 5120 triangles
+const float MARKER_SPHERE_RADIUS = 0.1f;
+const unsigned int MARKER_LOD_MIN_TRIANGLES = 40;
+
+const glm::vec3 POINT_LIGHT_AMBIENT(0.05f, 0.05f, 0.05f);
+const glm::vec3 POINT_LIGHT_DIFFUSE(0.8f, 0.8f, 0.8f);
+const glm::vec3 POINT_LIGHT_SPECULAR(1.0f, 1.0f, 1.0f);
+
+// Point light intensity configuration
+const float POINT_LIGHT_CONSTANT = 1.0f;
+const float POINT_LIGHT_LINEAR = 0.7f;
+const float POINT_LIGHT_QUADRATIC = 1.8f;
+
+// the flashlight, attached to the camera every frame
+const glm::vec3 SPOT_LIGHT_AMBIENT(0.0f, 0.0f, 0.0f);
+const glm::vec3 SPOT_LIGHT_DIFFUSE(1.0f, 1.0f, 1.0f);
+const glm::vec3 SPOT_LIGHT_SPECULAR(1.0f, 1.0f, 1.0f);
+const float SPOT_LIGHT_CONSTANT = 1.0f;
+const float SPOT_LIGHT_LINEAR = 0.09f;
+const float SPOT_LIGHT_QUADRATIC = 0.032f;
+const float SPOT_LIGHT_CUTOFF_DEGREES = 7.5f;
+const float SPOT_LIGHT_OUTER_CUTOFF_DEGREES = 12.5f;
@@ -0,0 +1,626 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct SceneRayHit {
+	float t; // distance along the ray
+	uint32_t object; // the object that was hit
+};
+
+// A bounding volume hierarchy over the boxes of scene objects, for frustum culling and ray
+// queries. Unlike the TriangleBVH it changes along with the scene: insert() walks down to the
+// node the new leaf grows the tree's surface area the least next to, as in Box2D's dynamic
+// tree, and remove() splices the leaf's parent out. Objects that move every frame update()
+// their box and have every inner box refit() once afterwards; objects that move far move()
+// out of a margin and get reinserted where they now are. rebuild() makes the inner nodes
+// again top-down with binned SAH, for static sets or after a lot of churn.
+// A proxy is the index of an object's leaf; none of these change it until remove().
+class SceneBVH
+{
+    public:
+	uint32_t insert(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t object)
+	{
+		uint32_t leaf = allocateNode();
+		Node& node = nodes[leaf];
+		node.boundsMin = boundsMin;
+		node.boundsMax = boundsMax;
+		node.object = object;
+		node.height = 0;
+		objects++;
+		insertLeaf(leaf);
+		return leaf;
+	}
+
+	void remove(uint32_t proxy)
+	{
+		removeLeaf(proxy);
+		freeNode(proxy);
+		objects--;
+	}
+
+	// sets the box of a leaf and leaves the tree as it is; refit() before the next query
+	void update(uint32_t proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		nodes[proxy].boundsMin = boundsMin;
+		nodes[proxy].boundsMax = boundsMax;
+	}
+
+	// recomputes every inner box from its children, bottom up; the tree keeps its shape, so
+	// it gets looser the farther the objects move from where they were inserted
+	void refit()
+	{
+		if (refitOrderStale)
+			buildRefitOrder();
+		for (uint32_t index : refitOrder)
+		{
+			Node& node = nodes[index];
+			node.boundsMin = glm::min(nodes[node.children[0]].boundsMin, nodes[node.children[1]].boundsMin);
+			node.boundsMax = glm::max(nodes[node.children[0]].boundsMax, nodes[node.children[1]].boundsMax);
+		}
+	}
+
+	// keeps the leaf's box margin wider than the object's so small moves change nothing; once
+	// the object leaves it, the leaf is reinserted with a fresh margin. Returns whether it was
+	bool move(uint32_t proxy, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float margin)
+	{
+		const Node& node = nodes[proxy];
+		if (glm::all(glm::greaterThanEqual(boundsMin, node.boundsMin)) && glm::all(glm::lessThanEqual(boundsMax, node.boundsMax)))
+			return false;
+		removeLeaf(proxy);
+		nodes[proxy].boundsMin = boundsMin - glm::vec3(margin);
+		nodes[proxy].boundsMax = boundsMax + glm::vec3(margin);
+		insertLeaf(proxy);
+		return true;
+	}
+
+	// throws the inner nodes away and builds them again over the leaves with binned SAH
+	void rebuild()
+	{
+		// the leaf boxes are copied out, so the splits sweep over contiguous memory
+		std::vector<BuildItem> items;
+		items.reserve(objects);
+		for (uint32_t index = 0; index < nodes.size(); index++)
+		{
+			if (nodes[index].height == 0)
+				items.push_back(BuildItem{ nodes[index].boundsMin, index, nodes[index].boundsMax });
+			else if (nodes[index].height > 0)
+				freeNode(index);
+		}
+		root = items.empty() ? NO_NODE : buildRange(items, 0, static_cast<uint32_t>(items.size()));
+		if (root != NO_NODE)
+			nodes[root].parent = NO_NODE;
+		refitOrderStale = true;
+	}
+
+	// appends the objects inside or crossing the frustum to visible (cleared first) and returns
+	// how many there are. A node wholly inside a plane isn't tested against it again below, and
+	// one wholly inside all six hands over its subtree without any more tests
+	size_t cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+	{
+		visible.clear();
+		if (root == NO_NODE)
+			return 0;
+
+		glm::vec3 absNormals[6];
+		for (int p = 0; p < 6; p++)
+			absNormals[p] = glm::abs(glm::vec3(frustum.planes[p]));
+
+		const unsigned int ALL_PLANES = 0x3F;
+		stack.clear();
+		stack.push_back(root | (ALL_PLANES << 26));
+		while (!stack.empty())
+		{
+			uint32_t entry = stack.back();
+			stack.pop_back();
+			uint32_t index = entry & NODE_MASK;
+			unsigned int planes = entry >> 26;
+			const Node& node = nodes[index];
+
+			glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+			glm::vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+			bool outside = false;
+			for (int p = 0; p < 6 && !outside; p++)
+			{
+				if (!(planes & (1u << p)))
+					continue;
+				float along = glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w;
+				float reach = glm::dot(absNormals[p], extent);
+				outside = along + reach < 0.0f;
+				if (along - reach >= 0.0f)
+					planes &= ~(1u << p);
+			}
+			if (outside)
+				continue;
+
+			if (planes == 0)
+				collectObjects(index, visible);
+			else if (node.height == 0)
+				visible.push_back(node.object);
+			else
+			{
+				stack.push_back(node.children[0] | (planes << 26));
+				stack.push_back(node.children[1] | (planes << 26));
+			}
+		}
+		return visible.size();
+	}
+
+	// cull() for several views in one walk down the tree: visible[v] gets what's in frusta[v].
+	// Every node is fetched once for all of them and only tested against the views still
+	// looking at it, each one with its own planes left to test; views whose frusta overlap
+	// mostly accept and reject the same subtrees, so a second one costs little more than its
+	// plane tests. Returns the number of objects visible summed over the views
+	static const unsigned int MAX_CULL_VIEWS = 4; // a byte of state each
+	size_t cull(const Frustum* frusta, unsigned int viewCount, std::vector<uint32_t>* visible) const
+	{
+		if (viewCount > MAX_CULL_VIEWS)
+			viewCount = MAX_CULL_VIEWS;
+		for (unsigned int v = 0; v < viewCount; v++)
+			visible[v].clear();
+		if (root == NO_NODE || viewCount == 0)
+			return 0;
+
+		// a byte per view: the planes still to test and, above them, whether it's still looking
+		const uint32_t LOOKING = 0x40, ALL_PLANES = 0x3F;
+		uint32_t views = 0;
+		for (unsigned int v = 0; v < viewCount; v++)
+			views |= (LOOKING | ALL_PLANES) << (v * 8);
+
+		size_t total = 0;
+		viewStack.clear();
+		viewStack.push_back(std::make_pair(root, views));
+		while (!viewStack.empty())
+		{
+			uint32_t index = viewStack.back().first;
+			views = viewStack.back().second;
+			viewStack.pop_back();
+			const Node& node = nodes[index];
+
+			glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+			glm::vec3 extent = (node.boundsMax - node.boundsMin) * 0.5f;
+			bool looking = false, testing = false;
+			for (unsigned int v = 0; v < viewCount; v++)
+			{
+				uint32_t state = (views >> (v * 8)) & 0xFF;
+				if (!(state & LOOKING))
+					continue;
+				const Frustum& frustum = frusta[v];
+				for (int p = 0; p < 6; p++)
+				{
+					if (!(state & (1u << p)))
+						continue;
+					float along = glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w;
+					float reach = glm::dot(glm::abs(glm::vec3(frustum.planes[p])), extent);
+					if (along + reach < 0.0f)
+					{
+						state = 0;
+						break;
+					}
+					if (along - reach >= 0.0f)
+						state &= ~(1u << p);
+				}
+				views = (views & ~(0xFFu << (v * 8))) | (state << (v * 8));
+				looking = looking || state != 0;
+				testing = testing || (state & ALL_PLANES) != 0;
+			}
+			if (!looking)
+				continue;
+
+			if (node.height == 0 || !testing)
+			{
+				// a leaf, or a subtree inside every view still looking at it
+				for (unsigned int v = 0; v < viewCount; v++)
+				{
+					if (!((views >> (v * 8)) & LOOKING))
+						continue;
+					size_t before = visible[v].size();
+					if (node.height == 0)
+						visible[v].push_back(node.object);
+					else
+						collectObjects(index, visible[v]);
+					total += visible[v].size() - before;
+				}
+			}
+			else
+			{
+				viewStack.push_back(std::make_pair(node.children[0], views));
+				viewStack.push_back(std::make_pair(node.children[1], views));
+			}
+		}
+		return total;
+	}
+
+	// the closest object whose box the ray enters within (0, tMax)
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float tMax, SceneRayHit& hit) const
+	{
+		return raycast(origin, direction, tMax, [](uint32_t, float boxT, float& t) { t = boxT; return true; }, hit);
+	}
+
+	// the closest hit of intersect(object, boxT, t), which is called for every object whose box
+	// the ray enters (at boxT) before the closest hit so far, and sets t and returns true when
+	// the object itself is hit
+	template <typename Intersect>
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float tMax, Intersect intersect, SceneRayHit& hit) const
+	{
+		hit.t = tMax;
+		if (root == NO_NODE)
+			return false;
+		glm::vec3 invDirection = 1.0f / direction;
+		bool found = false;
+
+		float rootT;
+		if (!intersectBounds(nodes[root], origin, invDirection, hit.t, rootT))
+			return false;
+		stack.clear();
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+			float boxT;
+			if (!intersectBounds(node, origin, invDirection, hit.t, boxT))
+				continue;
+
+			if (node.height == 0)
+			{
+				float t;
+				if (intersect(node.object, boxT, t) && t < hit.t)
+				{
+					hit.t = t;
+					hit.object = node.object;
+					found = true;
+				}
+				continue;
+			}
+
+			// the nearer child goes on top, so it's visited first and shortens the ray for the other
+			float nearT, farT;
+			bool hitsFirst = intersectBounds(nodes[node.children[0]], origin, invDirection, hit.t, nearT);
+			bool hitsSecond = intersectBounds(nodes[node.children[1]], origin, invDirection, hit.t, farT);
+			uint32_t first = node.children[0], second = node.children[1];
+			if (hitsFirst && hitsSecond && farT < nearT)
+				std::swap(first, second);
+			if (hitsFirst && hitsSecond)
+			{
+				stack.push_back(second);
+				stack.push_back(first);
+			}
+			else if (hitsFirst || hitsSecond)
+				stack.push_back(hitsFirst ? node.children[0] : node.children[1]);
+		}
+		return found;
+	}
+
+	uint32_t object(uint32_t proxy) const { return nodes[proxy].object; }
+	size_t objectCount() const { return objects; }
+	size_t nodeCount() const { return nodes.size() - freeCount; }
+	int height() const { return root != NO_NODE ? nodes[root].height : 0; }
+
+	// the SAH cost of the tree relative to its root: the summed surface area of the inner nodes
+	// over the root's, lower is a better tree for the same objects
+	float surfaceAreaRatio() const
+	{
+		if (root == NO_NODE || nodes[root].height == 0)
+			return 0.0f;
+		float total = 0.0f;
+		for (const Node& node : nodes)
+		{
+			if (node.height > 0)
+				total += area(node.boundsMin, node.boundsMax);
+		}
+		return total / area(nodes[root].boundsMin, nodes[root].boundsMax);
+	}
+
+    private:
+	static const uint32_t NO_NODE = 0xFFFFFFFFu;
+	static const uint32_t NODE_MASK = (1u << 26) - 1; // cull() keeps the plane mask above it
+	static const unsigned int BIN_COUNT = 12;
+
+	struct Node {
+		glm::vec3 boundsMin;
+		uint32_t parent = NO_NODE;
+		glm::vec3 boundsMax;
+		uint32_t object = 0; // leaves only
+		uint32_t children[2] = { NO_NODE, NO_NODE }; // inner nodes only
+		int32_t height = -1; // 0 for a leaf, -1 when free
+		uint32_t nextFree = NO_NODE;
+	};
+
+	std::vector<Node> nodes;
+	uint32_t root = NO_NODE;
+	uint32_t freeList = NO_NODE;
+	size_t freeCount = 0;
+	size_t objects = 0;
+
+	std::vector<uint32_t> refitOrder; // inner nodes, every child before its parent
+	bool refitOrderStale = true;
+	mutable std::vector<uint32_t> stack;
+	mutable std::vector<std::pair<uint32_t, uint32_t>> viewStack; // node, per view state
+
+	uint32_t allocateNode()
+	{
+		uint32_t index;
+		if (freeList != NO_NODE)
+		{
+			index = freeList;
+			freeList = nodes[index].nextFree;
+			freeCount--;
+		}
+		else
+		{
+			index = static_cast<uint32_t>(nodes.size());
+			nodes.push_back(Node());
+		}
+		nodes[index] = Node();
+		return index;
+	}
+
+	void freeNode(uint32_t index)
+	{
+		nodes[index].height = -1;
+		nodes[index].nextFree = freeList;
+		freeList = index;
+		freeCount++;
+	}
+
+	static float area(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 extent = boundsMax - boundsMin;
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	void insertLeaf(uint32_t leaf)
+	{
+		refitOrderStale = true;
+		if (root == NO_NODE)
+		{
+			root = leaf;
+			nodes[leaf].parent = NO_NODE;
+			return;
+		}
+
+		// walk down to the best sibling: at every node, stop if pairing with the node itself
+		// costs less than going into either child; costs are the new parent's area plus what
+		// the ancestors on the way grow by (Box2D's dynamic tree, a descent instead of a search)
+		glm::vec3 leafMin = nodes[leaf].boundsMin, leafMax = nodes[leaf].boundsMax;
+		uint32_t best = root;
+		while (nodes[best].height > 0)
+		{
+			const Node& node = nodes[best];
+			float nodeArea = area(node.boundsMin, node.boundsMax);
+			float combinedArea = area(glm::min(leafMin, node.boundsMin), glm::max(leafMax, node.boundsMax));
+			float pairCost = 2.0f * combinedArea;
+			float inheritedCost = 2.0f * (combinedArea - nodeArea);
+			float childCosts[2];
+			for (int c = 0; c < 2; c++)
+			{
+				const Node& child = nodes[node.children[c]];
+				float grownArea = area(glm::min(leafMin, child.boundsMin), glm::max(leafMax, child.boundsMax));
+				childCosts[c] = inheritedCost + (child.height == 0 ? grownArea : grownArea - area(child.boundsMin, child.boundsMax));
+			}
+			if (pairCost < childCosts[0] && pairCost < childCosts[1])
+				break;
+			best = node.children[childCosts[0] <= childCosts[1] ? 0 : 1];
+		}
+
+		uint32_t oldParent = nodes[best].parent;
+		uint32_t parent = allocateNode();
+		nodes[parent].parent = oldParent;
+		nodes[parent].children[0] = best;
+		nodes[parent].children[1] = leaf;
+		nodes[best].parent = parent;
+		nodes[leaf].parent = parent;
+		if (oldParent == NO_NODE)
+			root = parent;
+		else
+			nodes[oldParent].children[nodes[oldParent].children[0] == best ? 0 : 1] = parent;
+		refitAncestors(parent);
+	}
+
+	void removeLeaf(uint32_t leaf)
+	{
+		refitOrderStale = true;
+		if (leaf == root)
+		{
+			root = NO_NODE;
+			return;
+		}
+
+		uint32_t parent = nodes[leaf].parent;
+		uint32_t grandparent = nodes[parent].parent;
+		uint32_t sibling = nodes[parent].children[nodes[parent].children[0] == leaf ? 1 : 0];
+		nodes[sibling].parent = grandparent;
+		freeNode(parent);
+		if (grandparent == NO_NODE)
+		{
+			root = sibling;
+			return;
+		}
+		nodes[grandparent].children[nodes[grandparent].children[0] == parent ? 0 : 1] = sibling;
+		refitAncestors(grandparent);
+	}
+
+	// bounds and heights from a changed node up to the root
+	void refitAncestors(uint32_t index)
+	{
+		while (index != NO_NODE)
+		{
+			Node& node = nodes[index];
+			const Node& left = nodes[node.children[0]];
+			const Node& right = nodes[node.children[1]];
+			node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+			node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+			node.height = 1 + std::max(left.height, right.height);
+			index = node.parent;
+		}
+	}
+
+	// breadth first from the root, then reversed
+	void buildRefitOrder()
+	{
+		refitOrder.clear();
+		if (root != NO_NODE && nodes[root].height > 0)
+			refitOrder.push_back(root);
+		for (size_t i = 0; i < refitOrder.size(); i++)
+		{
+			const Node& node = nodes[refitOrder[i]];
+			for (uint32_t child : node.children)
+			{
+				if (nodes[child].height > 0)
+					refitOrder.push_back(child);
+			}
+		}
+		std::reverse(refitOrder.begin(), refitOrder.end());
+		refitOrderStale = false;
+	}
+
+	void collectObjects(uint32_t index, std::vector<uint32_t>& visible) const
+	{
+		size_t bottom = stack.size();
+		stack.push_back(index);
+		while (stack.size() > bottom)
+		{
+			const Node& node = nodes[stack.back()];
+			stack.pop_back();
+			if (node.height == 0)
+				visible.push_back(node.object);
+			else
+			{
+				stack.push_back(node.children[0]);
+				stack.push_back(node.children[1]);
+			}
+		}
+	}
+
+	struct BuildItem {
+		glm::vec3 boundsMin;
+		uint32_t leaf;
+		glm::vec3 boundsMax;
+	};
+
+	// the inner nodes over items[first, last): split where binned SAH says, by the box centers
+	// (kept doubled, min + max, which bins the same)
+	uint32_t buildRange(std::vector<BuildItem>& items, uint32_t first, uint32_t last)
+	{
+		if (last - first == 1)
+			return items[first].leaf;
+
+		glm::vec3 centerMin(FLT_MAX), centerMax(-FLT_MAX);
+		for (uint32_t i = first; i < last; i++)
+		{
+			glm::vec3 center = items[i].boundsMin + items[i].boundsMax;
+			centerMin = glm::min(centerMin, center);
+			centerMax = glm::max(centerMax, center);
+		}
+
+		int bestAxis = -1;
+		unsigned int bestSplit = 0;
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centerMax[axis] - centerMin[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			glm::vec3 binMin[BIN_COUNT], binMax[BIN_COUNT];
+			unsigned int binCount[BIN_COUNT] = {};
+			for (unsigned int b = 0; b < BIN_COUNT; b++)
+			{
+				binMin[b] = glm::vec3(FLT_MAX);
+				binMax[b] = glm::vec3(-FLT_MAX);
+			}
+			float scale = BIN_COUNT / extent;
+			for (uint32_t i = first; i < last; i++)
+			{
+				const BuildItem& leaf = items[i];
+				unsigned int b = std::min(BIN_COUNT - 1, static_cast<unsigned int>((leaf.boundsMin[axis] + leaf.boundsMax[axis] - centerMin[axis]) * scale));
+				binCount[b]++;
+				binMin[b] = glm::min(binMin[b], leaf.boundsMin);
+				binMax[b] = glm::max(binMax[b], leaf.boundsMax);
+			}
+
+			float rightArea[BIN_COUNT - 1];
+			unsigned int rightCount[BIN_COUNT - 1];
+			glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+			unsigned int sweepCount = 0;
+			for (unsigned int b = BIN_COUNT - 1; b > 0; b--)
+			{
+				sweepCount += binCount[b];
+				sweepMin = glm::min(sweepMin, binMin[b]);
+				sweepMax = glm::max(sweepMax, binMax[b]);
+				rightCount[b - 1] = sweepCount;
+				rightArea[b - 1] = sweepCount > 0 ? area(sweepMin, sweepMax) : 0.0f;
+			}
+			sweepMin = glm::vec3(FLT_MAX);
+			sweepMax = glm::vec3(-FLT_MAX);
+			sweepCount = 0;
+			for (unsigned int b = 0; b < BIN_COUNT - 1; b++)
+			{
+				sweepCount += binCount[b];
+				sweepMin = glm::min(sweepMin, binMin[b]);
+				sweepMax = glm::max(sweepMax, binMax[b]);
+				if (sweepCount == 0 || rightCount[b] == 0)
+					continue;
+				float cost = area(sweepMin, sweepMax) * sweepCount + rightArea[b] * rightCount[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		// centers that all fall together can't be binned apart, halve the range instead
+		uint32_t middle = first + (last - first) / 2;
+		if (bestAxis >= 0)
+		{
+			float scale = BIN_COUNT / (centerMax[bestAxis] - centerMin[bestAxis]);
+			BuildItem* split = std::partition(&items[first], &items[first] + (last - first), [&](const BuildItem& leaf) {
+				float center = leaf.boundsMin[bestAxis] + leaf.boundsMax[bestAxis];
+				return std::min(BIN_COUNT - 1, static_cast<unsigned int>((center - centerMin[bestAxis]) * scale)) <= bestSplit;
+			});
+			middle = static_cast<uint32_t>(split - &items[0]);
+			if (middle == first || middle == last)
+				middle = first + (last - first) / 2;
+		}
+
+		uint32_t parent = allocateNode();
+		uint32_t left = buildRange(items, first, middle);
+		uint32_t right = buildRange(items, middle, last);
+		Node& node = nodes[parent];
+		node.children[0] = left;
+		node.children[1] = right;
+		node.boundsMin = glm::min(nodes[left].boundsMin, nodes[right].boundsMin);
+		node.boundsMax = glm::max(nodes[left].boundsMax, nodes[right].boundsMax);
+		node.height = 1 + std::max(nodes[left].height, nodes[right].height);
+		nodes[left].parent = parent;
+		nodes[right].parent = parent;
+		return parent;
+	}
+
+	// slab test; enterT is where the ray enters the box (0 when it starts inside)
+	static bool intersectBounds(const Node& node, const glm::vec3& origin, const glm::vec3& invDirection, float tMax, float& enterT)
+	{
+		glm::vec3 t0 = (node.boundsMin - origin) * invDirection;
+		glm::vec3 t1 = (node.boundsMax - origin) * invDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		enterT = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		return enterT <= exit;
+	}
+
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef SCENE_VIEW_H
+#define SCENE_VIEW_H
+
+#include <glad/glad.h>
+
+#include "Camera.h"
+#include "CameraBuffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// A secondary view of the scene from a camera of its own, shown in a rectangle of the window:
+// picture in picture, or a split screen. It costs a fraction of the main view: it's drawn into
+// a framebuffer of its own at resolutionScale of the size it's shown at, only every
+// updateInterval frames, and every frame in between the last picture is stretched into its
+// rectangle again with a blit. Its camera has its own CameraBuffer, so switching between the
+// views rebinds a buffer instead of uploading the matrices again.
+class SceneView
+{
+    public:
+	Camera camera;
+	std::vector<uint32_t> visibleCubes;
+	std::vector<uint32_t> visibleLights;
+
+	// the rectangle is given as fractions of the window, from its lower left corner
+	SceneView(const Camera& viewCamera, float viewLeft, float viewBottom, float viewWidth, float viewHeight, float scale, unsigned int interval)
+		: camera(viewCamera), left(viewLeft), bottom(viewBottom), width(viewWidth), height(viewHeight), resolutionScale(scale),
+		updateInterval(std::max(interval, 1u))
+	{
+		glGenFramebuffers(1, &framebuffer);
+		glGenRenderbuffers(2, renderbuffers);
+	}
+
+	~SceneView()
+	{
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(2, renderbuffers);
+	}
+
+	// whether the view gets drawn this frame: the first one, then every updateInterval
+	bool due(uint64_t frame) const
+	{
+		return !drawn || frame - drawnFrame >= updateInterval;
+	}
+
+	// sizes the target and the camera's aspect for the window, every frame before the camera is used
+	void fit(int windowWidth, int windowHeight)
+	{
+		int newWidth = std::max(static_cast<int>(windowWidth * width * resolutionScale), 1);
+		int newHeight = std::max(static_cast<int>(windowHeight * height * resolutionScale), 1);
+		if (newWidth != targetWidth || newHeight != targetHeight)
+			resize(newWidth, newHeight);
+		camera.SetPerspective(std::max(windowWidth * width, 1.0f) / std::max(windowHeight * height, 1.0f), NEAR_PLANE, FAR_PLANE);
+	}
+
+	// makes the target the one drawn into, cleared, with the view's camera published; the
+	// caller draws and then end()s
+	void begin(uint64_t frame)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glViewport(0, 0, targetWidth, targetHeight);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		cameraBuffer.publish(camera);
+		drawnFrame = frame;
+		drawn = true;
+	}
+
+	void end(int windowWidth, int windowHeight)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, windowWidth, windowHeight);
+	}
+
+	// copies the last picture into the view's rectangle of the window
+	void present(int windowWidth, int windowHeight) const
+	{
+		if (!drawn)
+			return;
+		int x = static_cast<int>(windowWidth * left), y = static_cast<int>(windowHeight * bottom);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, targetWidth, targetHeight, x, y, x + static_cast<int>(windowWidth * width), y + static_cast<int>(windowHeight * height),
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	int pixelWidth() const { return targetWidth; }
+	int pixelHeight() const { return targetHeight; }
+
+    private:
+	float left, bottom, width, height;
+	float resolutionScale;
+	unsigned int updateInterval;
+
+	CameraBuffer cameraBuffer;
+	GLuint framebuffer = 0;
+	GLuint renderbuffers[2] = {}; // color, depth
+	int targetWidth = 0;
+	int targetHeight = 0;
+	uint64_t drawnFrame = 0;
+	bool drawn = false;
+
+	void resize(int newWidth, int newHeight)
+	{
+		targetWidth = newWidth;
+		targetHeight = newHeight;
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, targetWidth, targetHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, targetWidth, targetHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+};
+
+#endif
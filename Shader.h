@@ -4,6 +4,9 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "GLExtensions.h"
+
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -14,8 +17,9 @@ class Shader
     public:
 	unsigned int ID;
 	// constructor generates the shader on the fly
+	// defines are inserted right after the #version line of both stages, e.g. "#define LIGHTS_SSBO\n"
 	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath)
+	Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "")
 	{
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
@@ -45,30 +49,39 @@ class Shader
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
 		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char* fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessary
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-        
+		build(vertexCode.data(), vertexCode.size(), fragmentCode.data(), fragmentCode.size(), defines);
+	}
+	// the same from sources already in memory, e.g. an AssetPack mapping; they're handed to
+	// glShaderSource as they are, they don't need to be zero terminated
+	// ------------------------------------------------------------------------
+	Shader(const char* vertexSource, size_t vertexLength, const char* fragmentSource, size_t fragmentLength, const std::string& defines = "")
+	{
+		build(vertexSource, vertexLength, fragmentSource, fragmentLength, defines);
+	}
+	// a compute program, from a file or from a source in memory; needs glCaps().computeShader
+	// ------------------------------------------------------------------------
+	explicit Shader(const char* computePath, const std::string& defines = "")
+	{
+		std::string computeCode;
+		std::ifstream cShaderFile;
+		cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try
+		{
+			cShaderFile.open(computePath);
+			std::stringstream cShaderStream;
+			cShaderStream << cShaderFile.rdbuf();
+			cShaderFile.close();
+			computeCode = cShaderStream.str();
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+		}
+		buildCompute(computeCode.data(), computeCode.size(), defines);
+	}
+	Shader(const char* computeSource, size_t computeLength, const std::string& defines = "")
+	{
+		buildCompute(computeSource, computeLength, defines);
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
@@ -134,8 +147,69 @@ class Shader
 	{
 		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
 	}
+	// ------------------------------------------------------------------------
+	// assigns a uniform block to a binding point, if the program has it
+	void bindUniformBlock(const std::string& name, unsigned int binding) const
+	{
+		GLuint index = glGetUniformBlockIndex(ID, name.c_str());
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, index, binding);
+	}
+	// ------------------------------------------------------------------------
+	// assigns a shader storage block to a binding point; needs glCaps().shaderStorage
+	void bindStorageBlock(const std::string& name, unsigned int binding) const
+	{
+		GLuint index = glCaps().GetProgramResourceIndex(ID, GL_SHADER_STORAGE_BLOCK, name.c_str());
+		if (index != GL_INVALID_INDEX)
+			glCaps().ShaderStorageBlockBinding(ID, index, binding);
+	}
     
     private:
+	// 2. compiles and links both stages; the defines go in as a string of their own between
+	// the #version line and the rest of the source, so the source is never copied
+	void build(const char* vertexSource, size_t vertexLength, const char* fragmentSource, size_t fragmentLength, const std::string& defines)
+	{
+		unsigned int vertex = compileStage(GL_VERTEX_SHADER, vertexSource, vertexLength, defines);
+		checkCompileErrors(vertex, "VERTEX");
+		unsigned int fragment = compileStage(GL_FRAGMENT_SHADER, fragmentSource, fragmentLength, defines);
+		checkCompileErrors(fragment, "FRAGMENT");
+		// shader Program
+		ID = glCreateProgram();
+		glAttachShader(ID, vertex);
+		glAttachShader(ID, fragment);
+		glLinkProgram(ID);
+		checkCompileErrors(ID, "PROGRAM");
+		// delete the shaders as they're linked into our program now and no longer necessary
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+	}
+
+	void buildCompute(const char* computeSource, size_t computeLength, const std::string& defines)
+	{
+		unsigned int compute = compileStage(GL_COMPUTE_SHADER, computeSource, computeLength, defines);
+		checkCompileErrors(compute, "COMPUTE");
+		ID = glCreateProgram();
+		glAttachShader(ID, compute);
+		glLinkProgram(ID);
+		checkCompileErrors(ID, "PROGRAM");
+		glDeleteShader(compute);
+	}
+
+	static unsigned int compileStage(GLenum type, const char* source, size_t length, const std::string& defines)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(source, '\n', length));
+		size_t versionLength = lineEnd ? lineEnd - source + 1 : length;
+		// a source of just the #version line needs a line break before the defines
+		const char* pieces[4] = { source, lineEnd ? "" : "\n", defines.data(), source + versionLength };
+		GLint lengths[4] = { static_cast<GLint>(versionLength), lineEnd ? 0 : 1, static_cast<GLint>(defines.size()),
+			static_cast<GLint>(length - versionLength) };
+
+		unsigned int shader = glCreateShader(type);
+		glShaderSource(shader, 4, pieces, lengths);
+		glCompileShader(shader);
+		return shader;
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,237 @@
+#ifndef TEXTURE_ARRAY_POOL_H
+#define TEXTURE_ARRAY_POOL_H
+
+#include <glad/glad.h>
+
+#include "BindlessTextures.h"
+#include "GLExtensions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// A layer of one of the pool's arrays; the array is looked up by index since growing an
+// array replaces its GL texture
+struct TextureLayer {
+	uint32_t array;
+	int32_t layer; // -1 when not in an array
+
+	bool operator==(const TextureLayer& other) const { return array == other.array && layer == other.layer; }
+	bool operator!=(const TextureLayer& other) const { return !(*this == other); }
+};
+
+const TextureLayer NO_LAYER = { 0, -1 };
+
+// Everything a layer must share with the rest of its array
+struct TextureArrayFormat {
+	GLint width;
+	GLint height;
+	GLint levels;
+	GLint internalFormat;
+	GLint compressed;
+	GLint wrap;
+	GLint minFilter;
+	GLint magFilter;
+	GLint swizzle[4];
+
+	bool operator==(const TextureArrayFormat& other) const { return std::memcmp(this, &other, sizeof(*this)) == 0; }
+};
+
+// Groups textures of the same size, format and sampling into GL_TEXTURE_2D_ARRAYs, so
+// materials only differ in the layer they sample and objects with different materials can
+// go into one instanced draw. adopt() moves a finished 2D texture into a free layer with
+// glCopyImageSubData (GL 4.3 or ARB_copy_image; without it there's nothing to adopt with and
+// the caller keeps binding 2D textures). A full array grows to twice its layers the same way,
+// copying all of its layers over at once. Given BindlessTextures, an array's handle is
+// retired before growing deletes it.
+class TextureArrayPool
+{
+    public:
+	TextureArrayPool()
+	{
+	}
+
+	~TextureArrayPool()
+	{
+		for (Array& array : arrays)
+		{
+			if (bindless)
+				bindless->retire(array.texture);
+			glDeleteTextures(1, &array.texture);
+		}
+	}
+
+	TextureArrayPool(const TextureArrayPool&) = delete;
+	TextureArrayPool& operator=(const TextureArrayPool&) = delete;
+
+	// copies every level of a 2D texture into a layer of the array of its format, NO_LAYER
+	// without glCopyImageSubData; the 2D texture is left alone, the caller deletes it. The
+	// active unit's 2D and array bindings are put back as they were
+	TextureLayer adopt(unsigned int texture2D)
+	{
+		if (!glCaps().copyImage)
+			return NO_LAYER;
+
+		GLint bound2D = 0, boundArray = 0;
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound2D);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &boundArray);
+
+		TextureArrayFormat format = {};
+		glBindTexture(GL_TEXTURE_2D, texture2D);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &format.width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &format.height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format.internalFormat);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &format.compressed);
+		GLint maxLevel = 0;
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+		format.levels = std::min(maxLevel, fullChainLevels(format.width, format.height) - 1) + 1;
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &format.wrap);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &format.minFilter);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &format.magFilter);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+
+		uint32_t index = 0;
+		while (index < arrays.size() && !(arrays[index].format == format))
+			index++;
+		if (index == arrays.size())
+		{
+			Array array;
+			array.format = format;
+			arrays.push_back(array);
+		}
+
+		Array& array = arrays[index];
+		if (array.freeLayers.empty())
+		{
+			// binding the deleted array again would make a new, empty texture of its name
+			unsigned int replaced = array.texture;
+			grow(array);
+			if (replaced != 0 && static_cast<unsigned int>(boundArray) == replaced)
+				boundArray = static_cast<GLint>(array.texture);
+		}
+		int32_t layer = array.freeLayers.back();
+		array.freeLayers.pop_back();
+
+		for (GLint level = 0; level < format.levels; level++)
+		{
+			glCaps().CopyImageSubData(texture2D, GL_TEXTURE_2D, level, 0, 0, 0, array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+				levelSize(format.width, level), levelSize(format.height, level), 1);
+		}
+		glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(bound2D));
+		glBindTexture(GL_TEXTURE_2D_ARRAY, static_cast<GLuint>(boundArray));
+		return TextureLayer{ index, layer };
+	}
+
+	void release(TextureLayer layer)
+	{
+		if (layer.layer >= 0 && layer.array < arrays.size())
+			arrays[layer.array].freeLayers.push_back(layer.layer);
+	}
+
+	// the GL_TEXTURE_2D_ARRAY holding a layer, 0 for NO_LAYER
+	unsigned int texture(TextureLayer layer) const
+	{
+		return layer.layer >= 0 && layer.array < arrays.size() ? arrays[layer.array].texture : 0;
+	}
+
+	size_t arrayCount() const { return arrays.size(); }
+
+	// NULL to stop retiring handles, before the BindlessTextures are deleted
+	void setBindless(BindlessTextures* textures) { bindless = textures; }
+
+	// layers in use over all arrays
+	size_t layerCount() const
+	{
+		size_t total = 0;
+		for (const Array& array : arrays)
+			total += array.capacity - array.freeLayers.size();
+		return total;
+	}
+
+    private:
+	static const GLsizei INITIAL_LAYERS = 4;
+
+	struct Array {
+		TextureArrayFormat format;
+		unsigned int texture = 0;
+		GLsizei capacity = 0;
+		std::vector<int32_t> freeLayers; // highest first, so layers fill from 0
+	};
+
+	std::vector<Array> arrays;
+	BindlessTextures* bindless = NULL;
+
+	static GLint fullChainLevels(GLint width, GLint height)
+	{
+		GLint levels = 1;
+		while ((width >> levels) > 0 || (height >> levels) > 0)
+			levels++;
+		return levels;
+	}
+
+	static GLsizei levelSize(GLint size, GLint level)
+	{
+		return std::max(size >> level, 1);
+	}
+
+	// bytes of one layer of a compressed level
+	static GLsizei compressedLevelBytes(GLint internalFormat, GLsizei width, GLsizei height)
+	{
+		GLsizei blockBytes = internalFormat == GL_COMPRESSED_RG_RGTC2 || internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM
+			|| internalFormat == GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM ? 16 : 8;
+		return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+	}
+
+	// replaces the array's texture with one of twice the layers, the old layers copied over (an
+	// array only grows when it's full, so those are all in use); leaves the new array bound
+	void grow(Array& array)
+	{
+		const TextureArrayFormat& format = array.format;
+		GLsizei capacity = array.capacity > 0 ? array.capacity * 2 : INITIAL_LAYERS;
+
+		unsigned int texture = 0;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+		for (GLint level = 0; level < format.levels; level++)
+		{
+			GLsizei width = levelSize(format.width, level), height = levelSize(format.height, level);
+			if (format.compressed)
+			{
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internalFormat, width, height, capacity, 0,
+					compressedLevelBytes(format.internalFormat, width, height) * capacity, NULL);
+			}
+			else
+			{
+				// any client format will do, no data is sent; GL_RED_INTEGER would not, so
+				// integer formats aren't pooled (the loader doesn't make any)
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internalFormat, width, height, capacity, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, format.levels - 1);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, format.wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, format.wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, format.minFilter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, format.magFilter);
+		glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+
+		if (array.texture != 0)
+		{
+			for (GLint level = 0; level < format.levels; level++)
+			{
+				glCaps().CopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+					levelSize(format.width, level), levelSize(format.height, level), array.capacity);
+			}
+			if (bindless)
+				bindless->retire(array.texture);
+			glDeleteTextures(1, &array.texture);
+		}
+
+		array.texture = texture;
+		for (GLsizei layer = capacity; layer-- > array.capacity;)
+			array.freeLayers.push_back(layer);
+		array.capacity = capacity;
+	}
+};
+
+#endif
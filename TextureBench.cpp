@@ -0,0 +1,327 @@
+// Texture load benchmark. Times the stages of loading a texture separately for every image
+// in a directory and for synthetic images up to 8K, and writes the numbers as JSON so two
+// builds can be compared. Runs without showing a window; without a GL context at all only
+// the CPU stages are measured.
+//
+// usage: TextureBench [images dir] [--runs N] [--max-size N] [--output file] [--label name]
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "AssetFiles.h"
+#include "MipGenerator.h"
+#include "TextureLoader.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// the stages, in the order a texture goes through them
+enum Stage {
+	STAGE_READ, // the file into memory
+	STAGE_DECODE, // stbi_load_from_memory
+	STAGE_CONVERT, // dropUnusedChannels
+	STAGE_CPU_MIPS, // generateMipChain, on one thread like a loader worker
+	STAGE_UPLOAD, // level 0 through an unpack buffer and glTexImage2D, waited on with glFinish
+	STAGE_DRIVER_MIPS, // glGenerateMipmap, waited on with glFinish
+	STAGE_COUNT
+};
+
+static const char* const STAGE_NAMES[STAGE_COUNT] = { "read", "decode", "convert", "cpuMips", "upload", "driverMips" };
+
+struct StageTimes {
+	std::vector<double> milliseconds;
+};
+
+struct ImageResult {
+	std::string name;
+	bool synthetic;
+	int width, height;
+	int channels; // after dropUnusedChannels
+	size_t fileBytes;
+	StageTimes stages[STAGE_COUNT];
+};
+
+static double elapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// nearest rank percentile of the sorted samples
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+	return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+// a size x size RGBA image as an uncompressed TGA: smooth gradients under noise, with an alpha
+// that isn't opaque so all four channels survive the conversion. There is no PNG encoder
+// here, so the decode time of these is stb's TGA reader, not a PNG inflate
+static std::vector<uint8_t> syntheticTga(int size)
+{
+	std::vector<uint8_t> file(18 + static_cast<size_t>(size) * size * 4, 0);
+	file[2] = 2; // uncompressed true color
+	file[12] = static_cast<uint8_t>(size & 0xFF);
+	file[13] = static_cast<uint8_t>(size >> 8);
+	file[14] = static_cast<uint8_t>(size & 0xFF);
+	file[15] = static_cast<uint8_t>(size >> 8);
+	file[16] = 32;
+	file[17] = 8 | 0x20; // 8 alpha bits, top left origin
+
+	std::minstd_rand random(static_cast<unsigned int>(size));
+	uint8_t* texel = file.data() + 18;
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++, texel += 4)
+		{
+			int noise = static_cast<int>(random() % 32);
+			texel[0] = static_cast<uint8_t>((x * 255 / size + noise) & 0xFF); // B
+			texel[1] = static_cast<uint8_t>((y * 255 / size + noise) & 0xFF); // G
+			texel[2] = static_cast<uint8_t>(((x + y) * 127 / size) & 0xFF); // R
+			texel[3] = static_cast<uint8_t>(128 + noise * 4);
+		}
+	}
+	return file;
+}
+
+// runs every stage once on an image; read is skipped (left to the caller) for synthetic ones
+static bool measureOnce(const std::vector<uint8_t>& bytes, bool withGL, ImageResult& result)
+{
+	auto start = std::chrono::steady_clock::now();
+	int width, height, channels;
+	unsigned char* pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels, 0);
+	if (!pixels)
+		return false;
+	result.stages[STAGE_DECODE].milliseconds.push_back(elapsedMilliseconds(start));
+
+	start = std::chrono::steady_clock::now();
+	dropUnusedChannels(pixels, static_cast<size_t>(width) * height, channels, false);
+	result.stages[STAGE_CONVERT].milliseconds.push_back(elapsedMilliseconds(start));
+
+	start = std::chrono::steady_clock::now();
+	MipChain chain = generateMipChain(pixels, width, height, channels, true, 1);
+	result.stages[STAGE_CPU_MIPS].milliseconds.push_back(elapsedMilliseconds(start));
+
+	result.width = width;
+	result.height = height;
+	result.channels = channels;
+
+	if (withGL)
+	{
+		size_t levelBytes = static_cast<size_t>(width) * height * channels;
+		unsigned int texture, unpackBuffer;
+		glGenTextures(1, &texture);
+		glGenBuffers(1, &unpackBuffer);
+		glFinish();
+
+		// staged like the loader stages an image, into fresh storage of an unpack buffer
+		start = std::chrono::steady_clock::now();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, levelBytes, NULL, GL_STREAM_DRAW);
+		void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, levelBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (staging)
+		{
+			std::memcpy(staging, pixels, levelBytes);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, AsyncTextureLoader::internalFormat(channels, false), width, height, 0,
+			AsyncTextureLoader::pixelFormat(channels), GL_UNSIGNED_BYTE, (void*)0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glFinish();
+		result.stages[STAGE_UPLOAD].milliseconds.push_back(elapsedMilliseconds(start));
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		start = std::chrono::steady_clock::now();
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glFinish();
+		result.stages[STAGE_DRIVER_MIPS].milliseconds.push_back(elapsedMilliseconds(start));
+
+		glDeleteTextures(1, &texture);
+		glDeleteBuffers(1, &unpackBuffer);
+	}
+	stbi_image_free(pixels);
+	return true;
+}
+
+static void writeJsonString(std::ostream& out, const std::string& text)
+{
+	out << '"';
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			out << '\\';
+		out << c;
+	}
+	out << '"';
+}
+
+// one object per image, with min, mean and p50/p90/p99 milliseconds and the MB/s at p50 of
+// every measured stage; MB are the decoded pixels, the same for every stage of an image
+static void writeJson(std::ostream& out, const std::string& label, int runs, const char* renderer, const std::vector<ImageResult>& results)
+{
+	out << "{\n  \"label\": ";
+	writeJsonString(out, label);
+	out << ",\n  \"runs\": " << runs << ",\n  \"renderer\": ";
+	if (renderer)
+		writeJsonString(out, renderer);
+	else
+		out << "null";
+	out << ",\n  \"images\": [";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const ImageResult& result = results[i];
+		double megabytes = static_cast<double>(result.width) * result.height * result.channels / (1024.0 * 1024.0);
+		out << (i > 0 ? "," : "") << "\n    {\n      \"name\": ";
+		writeJsonString(out, result.name);
+		out << ",\n      \"synthetic\": " << (result.synthetic ? "true" : "false") << ", \"width\": " << result.width
+			<< ", \"height\": " << result.height << ", \"channels\": " << result.channels << ", \"fileBytes\": " << result.fileBytes
+			<< ",\n      \"stages\": {";
+		bool first = true;
+		for (int stage = 0; stage < STAGE_COUNT; stage++)
+		{
+			std::vector<double> sorted = result.stages[stage].milliseconds;
+			if (sorted.empty())
+				continue;
+			std::sort(sorted.begin(), sorted.end());
+			double mean = 0.0;
+			for (double milliseconds : sorted)
+				mean += milliseconds / sorted.size();
+			double median = percentile(sorted, 50.0);
+			out << (first ? "" : ",") << "\n        \"" << STAGE_NAMES[stage] << "\": { \"minMs\": " << sorted.front()
+				<< ", \"meanMs\": " << mean << ", \"p50Ms\": " << median << ", \"p90Ms\": " << percentile(sorted, 90.0)
+				<< ", \"p99Ms\": " << percentile(sorted, 99.0) << ", \"mbPerSecond\": " << (median > 0.0 ? megabytes / (median / 1000.0) : 0.0) << " }";
+			first = false;
+		}
+		out << "\n      }\n    }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+static void printSummary(const ImageResult& result)
+{
+	std::cout << result.name << " " << result.width << "x" << result.height << "x" << result.channels << ":";
+	for (int stage = 0; stage < STAGE_COUNT; stage++)
+	{
+		std::vector<double> sorted = result.stages[stage].milliseconds;
+		if (sorted.empty())
+			continue;
+		std::sort(sorted.begin(), sorted.end());
+		std::cout << " " << STAGE_NAMES[stage] << " " << percentile(sorted, 50.0) << " ms";
+	}
+	std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "Assets\\Images";
+	std::string outputPath = "texture_bench.json";
+	std::string label = "";
+	int runs = 10;
+	int maxSize = 8192;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+			runs = std::max(std::atoi(argv[++i]), 1);
+		else if (std::strcmp(argv[i], "--max-size") == 0 && i + 1 < argc)
+			maxSize = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (std::strcmp(argv[i], "--label") == 0 && i + 1 < argc)
+			label = argv[++i];
+		else
+			directory = argv[i];
+	}
+
+	// a hidden window for the context; where there is none (no display) the GL stages are skipped
+	GLFWwindow* window = NULL;
+	if (glfwInit())
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		window = glfwCreateWindow(1, 1, "TextureBench", NULL, NULL);
+	}
+	if (window)
+	{
+		glfwMakeContextCurrent(window);
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			glfwDestroyWindow(window);
+			window = NULL;
+		}
+	}
+	const char* renderer = window ? reinterpret_cast<const char*>(glGetString(GL_RENDERER)) : NULL;
+	if (window)
+		std::cout << "Measuring on " << renderer << std::endl;
+	else
+		std::cout << "No GL context, only the CPU stages are measured" << std::endl;
+
+#ifdef _WIN32
+	const char separator = '\\';
+#else
+	const char separator = '/';
+#endif
+	std::vector<ImageResult> results;
+	for (const std::string& name : listImages(directory))
+	{
+		ImageResult result = {};
+		result.name = name;
+		result.synthetic = false;
+		std::vector<uint8_t> bytes;
+		bool measured = true;
+		for (int run = 0; run < runs && measured; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			measured = readFile(directory + separator + name, bytes);
+			result.stages[STAGE_READ].milliseconds.push_back(elapsedMilliseconds(start));
+			measured = measured && measureOnce(bytes, window != NULL, result);
+		}
+		if (!measured)
+		{
+			std::cout << "Couldn't load " << name << std::endl;
+			continue;
+		}
+		result.fileBytes = bytes.size();
+		printSummary(result);
+		results.push_back(result);
+	}
+
+	for (int size = 256; size <= maxSize; size *= 2)
+	{
+		ImageResult result = {};
+		result.name = "synthetic_" + std::to_string(size) + ".tga";
+		result.synthetic = true;
+		std::vector<uint8_t> bytes = syntheticTga(size);
+		result.fileBytes = bytes.size();
+		for (int run = 0; run < runs; run++)
+			measureOnce(bytes, window != NULL, result);
+		printSummary(result);
+		results.push_back(result);
+	}
+
+	std::ofstream output(outputPath);
+	writeJson(output, label, runs, renderer, results);
+	std::cout << "Wrote " << outputPath << std::endl;
+
+	if (window)
+		glfwDestroyWindow(window);
+	glfwTerminate();
+	return output ? 0 : -1;
+}
@@ -0,0 +1,238 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "BindlessTextures.h"
+#include "TextureArrayPool.h"
+#include "TextureLoader.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Refers to a texture owned by a TextureCache; generations work as in LightHandle, so a
+// handle released one time too many is detected instead of dropping somebody else's texture.
+struct TextureHandle {
+	uint32_t slot;
+	uint32_t generation; // 0 is never handed out
+
+	bool operator==(const TextureHandle& other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const TextureHandle& other) const { return !(*this == other); }
+};
+
+const TextureHandle INVALID_TEXTURE = { 0, 0 };
+
+// Hands out one shared texture per (normalized path, options) pair. acquire() on a known key
+// only bumps the reference count, so any number of materials can point at the same image for
+// the memory of one; release() of the last reference unloads the texture from the GPU.
+// Loading itself goes through the AsyncTextureLoader, so a new texture starts out as its
+// placeholder like any other. Given a TextureArrayPool, update() moves every texture that
+// has finished loading into a layer of the pool's arrays (unless the loader streams it);
+// layer() tells where it went.
+// Given BindlessTextures, a 2D texture's handle is retired before the texture is unloaded.
+class TextureCache
+{
+    public:
+	TextureCache(AsyncTextureLoader& loader, TextureArrayPool* arrays = NULL) : loader(loader), arrays(arrays)
+	{
+	}
+
+	~TextureCache()
+	{
+		for (Entry& entry : entries)
+		{
+			if (entry.references > 0)
+				unload(entry);
+		}
+	}
+
+	// call once per frame after the loader's update(); moves resident textures into the arrays
+	void update()
+	{
+		if (!arrays)
+			return;
+		for (Entry& entry : entries)
+		{
+			// streamed textures keep changing their levels, they stay 2D textures
+			if (entry.references == 0 || entry.texture == 0 || !loader.isResident(entry.texture) || loader.isStreamed(entry.texture))
+				continue;
+			TextureLayer layer = arrays->adopt(entry.texture);
+			if (layer == NO_LAYER)
+				continue;
+			entry.layer = layer;
+			entry.arrayBytes = loader.residentBytes(entry.texture);
+			if (bindless)
+				bindless->retire(entry.texture);
+			loader.unload(entry.texture);
+			entry.texture = 0;
+		}
+	}
+
+	TextureHandle acquire(const char* resourcePath, const TextureOptions& options = TextureOptions())
+	{
+		std::string key = makeKey(resourcePath, options);
+		std::unordered_map<std::string, uint32_t>::iterator found = slotsByKey.find(key);
+		if (found != slotsByKey.end())
+		{
+			Entry& entry = entries[found->second];
+			entry.references++;
+			return TextureHandle{ found->second, entry.generation };
+		}
+
+		uint32_t slot;
+		if (freeSlot != NO_SLOT)
+		{
+			slot = freeSlot;
+			freeSlot = entries[slot].nextFree;
+		}
+		else
+		{
+			slot = static_cast<uint32_t>(entries.size());
+			entries.push_back(Entry());
+		}
+
+		Entry& entry = entries[slot];
+		entry.key = key;
+		entry.texture = loader.load(resourcePath, options);
+		entry.layer = NO_LAYER;
+		entry.arrayBytes = 0;
+		entry.references = 1;
+		entry.nextFree = NO_SLOT;
+		slotsByKey[key] = slot;
+		return TextureHandle{ slot, entry.generation };
+	}
+
+	// another reference to an already acquired texture
+	TextureHandle acquire(TextureHandle handle)
+	{
+		if (!isValid(handle))
+			return INVALID_TEXTURE;
+		entries[handle.slot].references++;
+		return handle;
+	}
+
+	void release(TextureHandle handle)
+	{
+		if (!isValid(handle))
+			return;
+
+		Entry& entry = entries[handle.slot];
+		if (--entry.references > 0)
+			return;
+
+		unload(entry);
+		slotsByKey.erase(entry.key);
+		entry.key.clear();
+		entry.texture = 0;
+		entry.layer = NO_LAYER;
+		entry.generation++;
+		if (entry.generation == 0)
+			entry.generation = 1;
+		entry.nextFree = freeSlot;
+		freeSlot = handle.slot;
+	}
+
+	bool isValid(TextureHandle handle) const
+	{
+		return handle.generation != 0 && handle.slot < entries.size() && entries[handle.slot].generation == handle.generation
+			&& entries[handle.slot].references > 0;
+	}
+
+	// the GL_TEXTURE_2D to bind, 0 for an invalid handle or once the texture is in an array
+	unsigned int texture(TextureHandle handle) const
+	{
+		return isValid(handle) ? entries[handle.slot].texture : 0;
+	}
+
+	// whether the texture shows its image yet, in its 2D texture or an array layer
+	bool isResident(TextureHandle handle) const
+	{
+		if (!isValid(handle))
+			return false;
+		const Entry& entry = entries[handle.slot];
+		return entry.texture != 0 ? loader.isResident(entry.texture) : entry.layer.layer >= 0;
+	}
+
+	// the array layer holding the texture, NO_LAYER until update() has moved it there
+	TextureLayer layer(TextureHandle handle) const
+	{
+		return isValid(handle) ? entries[handle.slot].layer : NO_LAYER;
+	}
+
+	// NULL to stop retiring handles, before the BindlessTextures are deleted
+	void setBindless(BindlessTextures* textures) { bindless = textures; }
+
+	// textures currently held, and the references to them
+	size_t residentCount() const { return slotsByKey.size(); }
+	size_t referenceCount() const
+	{
+		size_t total = 0;
+		for (const Entry& entry : entries)
+			total += entry.references;
+		return total;
+	}
+
+	// GPU memory of every held texture
+	size_t residentBytes() const
+	{
+		size_t total = 0;
+		for (const Entry& entry : entries)
+		{
+			if (entry.references > 0)
+				total += entry.texture != 0 ? loader.residentBytes(entry.texture) : entry.arrayBytes;
+		}
+		return total;
+	}
+
+	// lower case, forward slashes, no "." or ".." segments, see normalizeAssetPath
+	static std::string normalizePath(const std::string& path)
+	{
+		return normalizeAssetPath(path);
+	}
+
+    private:
+	static const uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+	struct Entry {
+		std::string key;
+		unsigned int texture = 0;
+		TextureLayer layer = NO_LAYER;
+		size_t arrayBytes = 0; // what the texture took before it moved into its layer
+		uint32_t references = 0;
+		uint32_t generation = 1;
+		uint32_t nextFree = NO_SLOT;
+	};
+
+	AsyncTextureLoader& loader;
+	TextureArrayPool* arrays;
+	BindlessTextures* bindless = NULL;
+	std::vector<Entry> entries;
+	std::unordered_map<std::string, uint32_t> slotsByKey;
+	uint32_t freeSlot = NO_SLOT;
+
+	void unload(Entry& entry)
+	{
+		if (entry.texture != 0)
+		{
+			if (bindless)
+				bindless->retire(entry.texture);
+			loader.unload(entry.texture);
+		}
+		else if (arrays)
+		{
+			// only update() empties texture, and only when there's a pool to move it into
+			arrays->release(entry.layer);
+		}
+	}
+
+	static std::string makeKey(const char* resourcePath, const TextureOptions& options)
+	{
+		return normalizePath(resourcePath) + "|" + std::to_string(options.wrap) + "," + std::to_string(options.minFilter) + ","
+			+ std::to_string(options.magFilter) + "," + (options.srgb ? "srgb" : options.srgbEncoded ? "color" : "linear");
+	}
+};
+
+#endif
@@ -0,0 +1,500 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include "Ktx2.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COMPRESSOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// Offline BCn encoders for "AssetTool compress-textures":
+//  - BC1: opaque color, 4 bpp, endpoints from the principal axis plus a least squares refit
+//  - BC4: one channel (masks, specular), 4 bpp
+//  - BC5: two channels (normal maps), 8 bpp
+//  - BC7: color with alpha, 8 bpp, mode 6 only (one subset, 7.7.7.7 endpoints with p-bits)
+// Blocks are independent, so whole images are encoded across threads; the palette search of
+// each block, the inner loop, runs four pixels at a time with SSE2.
+
+// one 4x4 block, channels split so four pixels load as one vector
+struct BlockPixels {
+	float r[16];
+	float g[16];
+	float b[16];
+	float a[16];
+};
+
+// the nearest palette entry for each pixel and the summed squared error
+inline float nearestPaletteIndices(const BlockPixels& pixels, const float (*palette)[4], int paletteSize, uint8_t indices[16])
+{
+#ifdef TEXTURE_COMPRESSOR_SSE2
+	__m128 total = _mm_setzero_ps();
+	for (int group = 0; group < 16; group += 4)
+	{
+		__m128 r = _mm_loadu_ps(pixels.r + group);
+		__m128 g = _mm_loadu_ps(pixels.g + group);
+		__m128 b = _mm_loadu_ps(pixels.b + group);
+		__m128 a = _mm_loadu_ps(pixels.a + group);
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128 bestIndex = _mm_setzero_ps();
+		for (int entry = 0; entry < paletteSize; entry++)
+		{
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[entry][0]));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[entry][1]));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[entry][2]));
+			__m128 da = _mm_sub_ps(a, _mm_set1_ps(palette[entry][3]));
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+			__m128 closer = _mm_cmplt_ps(distance, best);
+			best = _mm_min_ps(distance, best);
+			bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps(static_cast<float>(entry))), _mm_andnot_ps(closer, bestIndex));
+		}
+		total = _mm_add_ps(total, best);
+		__m128i packed = _mm_cvtps_epi32(bestIndex);
+		int32_t lanes[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), packed);
+		for (int lane = 0; lane < 4; lane++)
+			indices[group + lane] = static_cast<uint8_t>(lanes[lane]);
+	}
+	float sums[4];
+	_mm_storeu_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float best = FLT_MAX;
+		for (int entry = 0; entry < paletteSize; entry++)
+		{
+			float dr = pixels.r[i] - palette[entry][0];
+			float dg = pixels.g[i] - palette[entry][1];
+			float db = pixels.b[i] - palette[entry][2];
+			float da = pixels.a[i] - palette[entry][3];
+			float distance = dr * dr + dg * dg + db * db + da * da;
+			if (distance < best)
+			{
+				best = distance;
+				indices[i] = static_cast<uint8_t>(entry);
+			}
+		}
+		total += best;
+	}
+	return total;
+#endif
+}
+
+// the direction of greatest variance of the block's pixels (channels RGBA, or RGB when
+// channelCount is 3), with their mean
+inline void principalAxis(const BlockPixels& pixels, int channelCount, float mean[4], float axis[4])
+{
+	const float* channels[4] = { pixels.r, pixels.g, pixels.b, pixels.a };
+	for (int c = 0; c < 4; c++)
+	{
+		mean[c] = 0.0f;
+		axis[c] = 0.0f;
+		if (c >= channelCount)
+			continue;
+		for (int i = 0; i < 16; i++)
+			mean[c] += channels[c][i];
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int x = 0; x < channelCount; x++)
+		{
+			for (int y = 0; y < channelCount; y++)
+				covariance[x][y] += (channels[x][i] - mean[x]) * (channels[y][i] - mean[y]);
+		}
+	}
+
+	// power iteration, starting along the bounding box diagonal
+	for (int c = 0; c < channelCount; c++)
+	{
+		float low = FLT_MAX, high = -FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			low = std::min(low, channels[c][i]);
+			high = std::max(high, channels[c][i]);
+		}
+		axis[c] = high - low;
+	}
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		for (int x = 0; x < channelCount; x++)
+		{
+			for (int y = 0; y < channelCount; y++)
+				next[x] += covariance[x][y] * axis[y];
+		}
+		float length = 0.0f;
+		for (int c = 0; c < channelCount; c++)
+			length += next[c] * next[c];
+		if (length < 1e-12f)
+			break;
+		length = std::sqrt(length);
+		for (int c = 0; c < channelCount; c++)
+			axis[c] = next[c] / length;
+	}
+}
+
+// least squares endpoints for fixed palette weights (weight of endpoint 1 per pixel)
+inline bool refitEndpoints(const BlockPixels& pixels, const float weights[16], float endpoint0[4], float endpoint1[4])
+{
+	const float* channels[4] = { pixels.r, pixels.g, pixels.b, pixels.a };
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float beta = weights[i];
+		float alpha = 1.0f - beta;
+		aa += alpha * alpha;
+		ab += alpha * beta;
+		bb += beta * beta;
+		for (int c = 0; c < 4; c++)
+		{
+			ax[c] += alpha * channels[c][i];
+			bx[c] += beta * channels[c][i];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+		return false;
+	for (int c = 0; c < 4; c++)
+	{
+		endpoint0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+		endpoint1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+inline uint16_t packRgb565(const float color[4])
+{
+	int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+	int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+	int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRgb565(uint16_t packed, float color[4])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = static_cast<float>((r << 3) | (r >> 2));
+	color[1] = static_cast<float>((g << 2) | (g >> 4));
+	color[2] = static_cast<float>((b << 3) | (b >> 2));
+	color[3] = 0.0f;
+}
+
+// BC1 palette order: endpoint 0, endpoint 1, 2/3 0 + 1/3 1, 1/3 0 + 2/3 1
+const float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+// encodes the 565 endpoint pair, returns the error
+inline float encodeBC1Endpoints(const BlockPixels& pixels, uint16_t color0, uint16_t color1, uint8_t out[8])
+{
+	// 4 color mode needs color0 > color1
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	uint8_t indices[16] = {};
+	float error = 0.0f;
+	if (color0 != color1)
+	{
+		float palette[4][4];
+		unpackRgb565(color0, palette[0]);
+		unpackRgb565(color1, palette[1]);
+		for (int c = 0; c < 4; c++)
+		{
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		BlockPixels opaque = pixels;
+		std::fill(opaque.a, opaque.a + 16, 0.0f);
+		error = nearestPaletteIndices(opaque, palette, 4, indices);
+	}
+	else
+	{
+		float color[4];
+		unpackRgb565(color0, color);
+		for (int i = 0; i < 16; i++)
+		{
+			float dr = pixels.r[i] - color[0], dg = pixels.g[i] - color[1], db = pixels.b[i] - color[2];
+			error += dr * dr + dg * dg + db * db;
+		}
+	}
+
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= static_cast<uint32_t>(indices[i]) << (2 * i);
+	out[0] = color0 & 0xFF;
+	out[1] = color0 >> 8;
+	out[2] = color1 & 0xFF;
+	out[3] = color1 >> 8;
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (bits >> (8 * i)) & 0xFF;
+	return error;
+}
+
+inline void encodeBC1Block(const BlockPixels& pixels, uint8_t out[8])
+{
+	float mean[4], axis[4];
+	principalAxis(pixels, 3, mean, axis);
+
+	float low = FLT_MAX, high = -FLT_MAX;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (pixels.r[i] - mean[0]) * axis[0] + (pixels.g[i] - mean[1]) * axis[1] + (pixels.b[i] - mean[2]) * axis[2];
+		low = std::min(low, t);
+		high = std::max(high, t);
+	}
+	float endpoint0[4], endpoint1[4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoint0[c] = std::min(std::max(mean[c] + axis[c] * high, 0.0f), 255.0f);
+		endpoint1[c] = std::min(std::max(mean[c] + axis[c] * low, 0.0f), 255.0f);
+	}
+
+	uint8_t best[8];
+	float bestError = encodeBC1Endpoints(pixels, packRgb565(endpoint0), packRgb565(endpoint1), best);
+
+	// refit the endpoints to the chosen indices once and keep whichever is better
+	uint32_t bits = best[4] | (best[5] << 8) | (best[6] << 16) | (static_cast<uint32_t>(best[7]) << 24);
+	float weights[16];
+	for (int i = 0; i < 16; i++)
+		weights[i] = BC1_WEIGHTS[(bits >> (2 * i)) & 3];
+	if (refitEndpoints(pixels, weights, endpoint0, endpoint1))
+	{
+		uint8_t refit[8];
+		uint16_t color0 = packRgb565(endpoint0), color1 = packRgb565(endpoint1);
+		// the refit can't be ordered after the fact without changing the weights it was made for
+		if (color0 > color1 && encodeBC1Endpoints(pixels, color0, color1, refit) < bestError)
+			std::memcpy(best, refit, 8);
+	}
+	std::memcpy(out, best, 8);
+}
+
+// one channel block, values 0..255
+inline void encodeBC4Block(const float values[16], uint8_t out[8])
+{
+	float low = 255.0f, high = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		low = std::min(low, values[i]);
+		high = std::max(high, values[i]);
+	}
+	int endpoint0 = static_cast<int>(high + 0.5f);
+	int endpoint1 = static_cast<int>(low + 0.5f);
+
+	uint64_t bits = 0;
+	if (endpoint0 > endpoint1)
+	{
+		// 8 value mode: positions 0..7 from endpoint 1 to endpoint 0, mapped to the BC4 index order
+		const uint64_t positionToIndex[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+		float scale = 7.0f / (endpoint0 - endpoint1);
+		for (int i = 0; i < 16; i++)
+		{
+			int position = static_cast<int>((values[i] - endpoint1) * scale + 0.5f);
+			position = std::min(std::max(position, 0), 7);
+			bits |= positionToIndex[position] << (3 * i);
+		}
+	}
+	out[0] = static_cast<uint8_t>(endpoint0);
+	out[1] = static_cast<uint8_t>(endpoint1);
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (bits >> (8 * i)) & 0xFF;
+}
+
+// BC7 mode 6 interpolation weights, out of 64
+const int BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// quantizes an endpoint to 7 bits a channel plus a shared p-bit, trying both p-bits; the first
+// is always taken, so a NaN endpoint (whose errors never compare less) still gets written
+inline void quantizeBC7Endpoint(const float endpoint[4], int quantized[4], int& pbit)
+{
+	float bestError = 0.0f;
+	for (int p = 0; p < 2; p++)
+	{
+		int candidate[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++)
+		{
+			candidate[c] = std::min(std::max(static_cast<int>((endpoint[c] - p) / 2.0f + 0.5f), 0), 127);
+			float d = endpoint[c] - (candidate[c] * 2 + p);
+			error += d * d;
+		}
+		if (p == 0 || error < bestError)
+		{
+			bestError = error;
+			pbit = p;
+			std::memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+struct BitWriter {
+	uint8_t* bytes;
+	int position = 0;
+
+	void write(uint32_t value, int count)
+	{
+		for (int i = 0; i < count; i++, position++)
+		{
+			if (value & (1u << i))
+				bytes[position >> 3] |= static_cast<uint8_t>(1u << (position & 7));
+		}
+	}
+};
+
+// encodes mode 6 with the given float endpoints, returns the error
+inline float encodeBC7Endpoints(const BlockPixels& pixels, const float endpoint0[4], const float endpoint1[4], uint8_t out[16])
+{
+	int quantized[2][4], pbits[2];
+	quantizeBC7Endpoint(endpoint0, quantized[0], pbits[0]);
+	quantizeBC7Endpoint(endpoint1, quantized[1], pbits[1]);
+
+	float palette[16][4];
+	for (int entry = 0; entry < 16; entry++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			int e0 = quantized[0][c] * 2 + pbits[0];
+			int e1 = quantized[1][c] * 2 + pbits[1];
+			palette[entry][c] = static_cast<float>((e0 * (64 - BC7_WEIGHTS_4[entry]) + e1 * BC7_WEIGHTS_4[entry] + 32) >> 6);
+		}
+	}
+	uint8_t indices[16];
+	float error = nearestPaletteIndices(pixels, palette, 16, indices);
+
+	// the first index has an implied zero top bit, flip the endpoints if it would be set
+	if (indices[0] >= 8)
+	{
+		for (int c = 0; c < 4; c++)
+			std::swap(quantized[0][c], quantized[1][c]);
+		std::swap(pbits[0], pbits[1]);
+		for (int i = 0; i < 16; i++)
+			indices[i] = static_cast<uint8_t>(15 - indices[i]);
+	}
+
+	std::memset(out, 0, 16);
+	BitWriter writer = { out };
+	writer.write(1u << 6, 7); // mode 6
+	for (int c = 0; c < 4; c++)
+	{
+		writer.write(quantized[0][c], 7);
+		writer.write(quantized[1][c], 7);
+	}
+	writer.write(pbits[0], 1);
+	writer.write(pbits[1], 1);
+	writer.write(indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		writer.write(indices[i], 4);
+	return error;
+}
+
+inline void encodeBC7Block(const BlockPixels& pixels, uint8_t out[16])
+{
+	float mean[4], axis[4];
+	principalAxis(pixels, 4, mean, axis);
+
+	float low = FLT_MAX, high = -FLT_MAX;
+	const float* channels[4] = { pixels.r, pixels.g, pixels.b, pixels.a };
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < 4; c++)
+			t += (channels[c][i] - mean[c]) * axis[c];
+		low = std::min(low, t);
+		high = std::max(high, t);
+	}
+	float endpoint0[4], endpoint1[4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoint0[c] = std::min(std::max(mean[c] + axis[c] * low, 0.0f), 255.0f);
+		endpoint1[c] = std::min(std::max(mean[c] + axis[c] * high, 0.0f), 255.0f);
+	}
+
+	float bestError = encodeBC7Endpoints(pixels, endpoint0, endpoint1, out);
+
+	// refit to the weights the indices picked, projected on the initial line
+	float weights[16];
+	float length = high - low;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < 4; c++)
+			t += (channels[c][i] - mean[c]) * axis[c];
+		int entry = length > 0.0f ? static_cast<int>((t - low) / length * 15.0f + 0.5f) : 0;
+		weights[i] = BC7_WEIGHTS_4[entry] / 64.0f;
+	}
+	if (refitEndpoints(pixels, weights, endpoint0, endpoint1))
+	{
+		uint8_t refit[16];
+		if (encodeBC7Endpoints(pixels, endpoint0, endpoint1, refit) < bestError)
+			std::memcpy(out, refit, 16);
+	}
+}
+
+// an 8 bit per channel RGBA image
+struct RgbaImage {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<uint8_t> pixels;
+};
+
+// encodes one mip level into vkFormat's blocks; edge blocks repeat the last row and column
+inline std::vector<uint8_t> compressImage(const RgbaImage& image, uint32_t vkFormat, unsigned int workerCount)
+{
+	uint32_t blocksX = (image.width + 3) / 4;
+	uint32_t blocksY = (image.height + 3) / 4;
+	uint32_t blockBytes = ktx2BlockBytes(vkFormat);
+	std::vector<uint8_t> blocks(static_cast<size_t>(blocksX) * blocksY * blockBytes);
+
+	parallelFor(blocksY, 1, workerCount, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t by = begin; by < end; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				BlockPixels pixels;
+				for (int i = 0; i < 16; i++)
+				{
+					uint32_t x = std::min(bx * 4 + i % 4, image.width - 1);
+					uint32_t y = std::min(static_cast<uint32_t>(by) * 4 + i / 4, image.height - 1);
+					const uint8_t* texel = &image.pixels[(y * image.width + x) * 4];
+					pixels.r[i] = texel[0];
+					pixels.g[i] = texel[1];
+					pixels.b[i] = texel[2];
+					pixels.a[i] = texel[3];
+				}
+
+				uint8_t* out = &blocks[(by * blocksX + bx) * blockBytes];
+				switch (vkFormat)
+				{
+				case KTX2_FORMAT_BC1_RGB_UNORM:
+				case KTX2_FORMAT_BC1_RGB_SRGB:
+					encodeBC1Block(pixels, out);
+					break;
+				case KTX2_FORMAT_BC4_UNORM:
+					encodeBC4Block(pixels.r, out);
+					break;
+				case KTX2_FORMAT_BC5_UNORM:
+					encodeBC4Block(pixels.r, out);
+					encodeBC4Block(pixels.g, out + 8);
+					break;
+				default:
+					encodeBC7Block(pixels, out);
+					break;
+				}
+			}
+		}
+	});
+	return blocks;
+}
+
+#endif
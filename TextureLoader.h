@@ -0,0 +1,978 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "GLExtensions.h"
+#include "Ktx2.h"
+#include "LockFreeQueue.h"
+#include "MipGenerator.h"
+#include "Parallel.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// How a texture is sampled and stored; part of the TextureCache key
+struct TextureOptions {
+	GLenum wrap = GL_MIRRORED_REPEAT;
+	GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	GLenum magFilter = GL_LINEAR;
+	bool srgb = false; // color data stored in sRGB, decoded to linear when sampled
+	// the image is sRGB encoded color, so its mips are filtered in linear light even when srgb
+	// is off; false for normals, masks and other data, which are filtered as stored
+	bool srgbEncoded = true;
+
+	bool operator==(const TextureOptions& other) const
+	{
+		return wrap == other.wrap && minFilter == other.minFilter && magFilter == other.magFilter && srgb == other.srgb
+			&& srgbEncoded == other.srgbEncoded;
+	}
+};
+
+// streamed textures start out with the levels up to this size, the finer ones come on request
+const uint32_t STREAM_INITIAL_SIZE = 64;
+
+// An image decoded by a worker, waiting for the GL thread to upload it
+struct DecodedImage {
+	unsigned int texture = 0;
+	uint32_t ticket = 0; // tells a reused texture name from the one that was requested
+	std::string path;
+	TextureOptions options;
+	MipChain* mips = NULL; // the decoded image with its mips, NULL when decoding failed
+	Ktx2Image* compressed = NULL; // read instead of mips for .ktx2 files, NULL when reading failed
+	uint32_t firstLevel = 0; // mips or compressed only hold the data of this level and the coarser ones
+	std::string levelSource; // a file the finer levels can be read back from when streaming, empty if none
+
+	// a single level of a streamed texture read back from levelSource, instead of mips or compressed
+	int streamLevel = -1;
+	uint64_t levelOffset = 0;
+	uint64_t levelBytes = 0;
+	std::vector<uint8_t>* levelData = NULL;
+
+	bool hasData() const { return mips || compressed || levelData; }
+
+	void free()
+	{
+		delete mips;
+		delete compressed;
+		delete levelData;
+		mips = NULL;
+		compressed = NULL;
+		levelData = NULL;
+	}
+};
+
+// Where a streamed texture stands, see AsyncTextureLoader::streamStats
+struct TextureStreamStats {
+	uint32_t levelCount;
+	uint32_t residentLevel; // the finest level on the GPU
+	uint32_t wantedLevel; // the finest level the last requestResolution asked for
+	size_t bytes; // GPU memory of the resident levels
+};
+
+// Loads textures without blocking the GL thread: load() hands back a texture showing a 1x1
+// placeholder right away, worker threads decode the file with stbi_load and build its mips
+// (see MipGenerator.h, or read them from the cache next to the file), and the decoded images
+// come back through a lock-free queue. update(), called once per frame on the GL thread,
+// copies them into a pixel unpack buffer, at most byteBudget bytes per frame, so an image
+// bigger than the budget is staged over several frames. Once it's complete GL copies every
+// level from the buffer into the texture and the placeholder is gone.
+// .ktx2 files from "AssetTool compress-textures" skip decoding: their block compressed mips
+// are staged the same way and go to glCompressedTexImage2D as they are.
+// With a streaming budget, textures whose levels can be read back from disk (the mip cache or
+// the .ktx2 file) only get the levels up to STREAM_INITIAL_SIZE at first, with
+// GL_TEXTURE_BASE_LEVEL on the finest one. requestResolution() tells how big a texture shows on
+// screen; update() then has the workers read the next finer level it needs, one level per
+// texture at a time, and evicts the finest levels of the least recently used textures when the
+// streamed textures would go over the budget.
+// Given an AssetPack, a texture the pack has (under the name of its mip cache or KTX2 file)
+// skips all of that: load() uploads its levels straight from the mapping and returns it resident.
+class AsyncTextureLoader
+{
+    public:
+	// generateMipsOnCpu false leaves the mips to glGenerateMipmap, timed, to compare against;
+	// streaming needs the CPU mips (their cache is what the levels are read back from), a
+	// streamingBudget of 0 keeps every texture fully resident
+	AsyncTextureLoader(unsigned int workerCount = 0, bool generateMipsOnCpu = true, size_t streamingBudget = 0)
+		: decoded(64), generateMipsOnCpu(generateMipsOnCpu), streamingBudget(generateMipsOnCpu ? streamingBudget : 0)
+	{
+		// the GL thread is busy rendering, so leave it its core
+		if (workerCount == 0)
+			workerCount = std::max(defaultWorkerCount(), 2u) - 1;
+		for (unsigned int i = 0; i < workerCount; i++)
+			workers.emplace_back(&AsyncTextureLoader::workerLoop, this);
+	}
+
+	~AsyncTextureLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			stopping = true;
+		}
+		jobReady.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+
+		DecodedImage image;
+		while (decoded.tryPop(image))
+			image.free();
+		uploading.free();
+		if (unpackBuffer != 0)
+			glDeleteBuffers(1, &unpackBuffer);
+	}
+
+	// returns a texture that shows the placeholder until the image is resident
+	unsigned int load(const char* resourcePath, const TextureOptions& options = TextureOptions())
+	{
+		unsigned int textureID = 0;
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, options.wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, options.wrap);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, options.minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, options.magFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+		if (pack)
+		{
+			size_t bytes = uploadPacked(resourcePath, options);
+			if (bytes > 0)
+			{
+				LiveTexture live = { ++lastTicket, bytes, true };
+				textures[textureID] = live;
+				packedTextureCount++;
+				return textureID;
+			}
+		}
+
+		DecodedImage job;
+		job.texture = textureID;
+		job.path = resourcePath;
+		job.options = options;
+		job.ticket = ++lastTicket;
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+			jobs.push_back(job);
+		}
+		jobReady.notify_one();
+		pending++;
+		LiveTexture live = { job.ticket, 4, false }; // the placeholder
+		textures[textureID] = live;
+		return textureID;
+	}
+
+	// deletes a texture from load(); one still being decoded is dropped once the worker is done
+	void unload(unsigned int textureID)
+	{
+		if (textures.erase(textureID) == 0)
+			return;
+		std::unordered_map<unsigned int, StreamedTexture>::iterator stream = streamed.find(textureID);
+		if (stream != streamed.end())
+		{
+			streamedBytes -= stream->second.bytes;
+			if (stream->second.inFlight)
+				reservedBytes -= stream->second.levels[stream->second.residentLevel - 1].gpuBytes;
+			streamed.erase(stream);
+		}
+		if (uploading.texture == textureID && uploading.hasData())
+			finishUpload();
+		glDeleteTextures(1, &textureID);
+	}
+
+	// whether a texture from load() shows its image yet
+	bool isResident(unsigned int textureID) const
+	{
+		std::unordered_map<unsigned int, LiveTexture>::const_iterator it = textures.find(textureID);
+		return it != textures.end() && it->second.resident;
+	}
+
+	// GPU memory held by a texture from load(), mip chain included
+	size_t residentBytes(unsigned int textureID) const
+	{
+		std::unordered_map<unsigned int, LiveTexture>::const_iterator it = textures.find(textureID);
+		return it != textures.end() ? it->second.bytes : 0;
+	}
+
+	// whether a texture's levels come and go with the streaming; its state isn't fixed, so it
+	// mustn't be copied into an array or get a bindless handle
+	bool isStreamed(unsigned int textureID) const
+	{
+		return streamed.count(textureID) > 0;
+	}
+
+	// the texture covers about this many pixels across on screen this frame; a texture used
+	// several times wants the finest level any of its uses asks for
+	void requestResolution(unsigned int textureID, float pixels)
+	{
+		std::unordered_map<unsigned int, StreamedTexture>::iterator it = streamed.find(textureID);
+		if (it == streamed.end())
+			return;
+		StreamedTexture& stream = it->second;
+		// the coarsest level still having a texel per pixel
+		float texels = static_cast<float>(std::max(stream.width, stream.height));
+		uint32_t level = 0;
+		while (level + 1 < stream.levels.size() && texels / 2.0f >= pixels)
+		{
+			texels /= 2.0f;
+			level++;
+		}
+		if (stream.lastUsedFrame != frame)
+			stream.wantedLevel = level;
+		else
+			stream.wantedLevel = std::min(stream.wantedLevel, level);
+		stream.lastUsedFrame = frame;
+	}
+
+	bool streamStats(unsigned int textureID, TextureStreamStats& stats) const
+	{
+		std::unordered_map<unsigned int, StreamedTexture>::const_iterator it = streamed.find(textureID);
+		if (it == streamed.end())
+			return false;
+		stats.levelCount = static_cast<uint32_t>(it->second.levels.size());
+		stats.residentLevel = it->second.residentLevel;
+		stats.wantedLevel = it->second.wantedLevel;
+		stats.bytes = it->second.bytes;
+		return true;
+	}
+
+	// the streaming budget and what the streamed textures take of it
+	size_t streamingBudgetBytes() const { return streamingBudget; }
+	size_t streamedResidentBytes() const { return streamedBytes; }
+	unsigned int streamedLevelCount() const { return streamedLevels; }
+	unsigned int evictedLevelCount() const { return evictedLevels; }
+
+	// uploads decoded images, at most byteBudget bytes of them (but always at least one byte),
+	// then asks the workers for the levels the last frame's requestResolution calls want
+	void update(size_t byteBudget)
+	{
+		uploadedBytes = 0;
+		while (uploadedBytes < byteBudget || uploadedBytes == 0)
+		{
+			if (!uploading.hasData())
+			{
+				if (!decoded.tryPop(uploading))
+					break;
+				stagedBytes = 0;
+				std::unordered_map<unsigned int, LiveTexture>::const_iterator live = textures.find(uploading.texture);
+				if (live == textures.end() || live->second.ticket != uploading.ticket)
+				{
+					// unloaded while it was decoding, the name may even have been reused since
+					finishUpload();
+					continue;
+				}
+				if (!uploading.hasData())
+				{
+					std::cout << "Unable to load image data. Path: " << (uploading.streamLevel >= 0 ? uploading.levelSource : uploading.path) << std::endl;
+					if (uploading.streamLevel >= 0)
+						stopStreaming(uploading.texture);
+					finishUpload();
+					continue;
+				}
+			}
+			size_t budget = byteBudget > uploadedBytes ? byteBudget - uploadedBytes : 0;
+			bool uploaded = uploading.levelData ? uploadLevel(budget) : uploading.compressed ? uploadCompressed(budget) : uploadMips(budget);
+			if (!uploaded)
+				break;
+		}
+
+		if (streamingBudget > 0)
+			requestLevels();
+		frame++;
+	}
+
+	// textures the pack has are uploaded from its mapping from then on; the pack has to stay
+	// open while the loader is in use
+	void usePack(const AssetPack* assetPack)
+	{
+		pack = assetPack && assetPack->isOpen() ? assetPack : NULL;
+	}
+
+	unsigned int packedCount() const { return packedTextureCount; }
+
+	// textures requested but not resident (or failed) yet
+	unsigned int pendingCount() const { return pending; }
+	bool idle() const { return pending == 0; }
+
+	// bytes sent to the GPU by the last update()
+	size_t lastUploadBytes() const { return uploadedBytes; }
+
+	// time spent building mip chains so far: summed over the workers for the CPU filter, or
+	// glGenerateMipmap waited on with glFinish without generateMipsOnCpu; cached chains are free
+	double mipGenerationSeconds() const { return mipGenerationMicroseconds.load() / 1e6; }
+	unsigned int mipCacheHits() const { return mipCacheHitCount.load(); }
+
+	// whether the running driver can use a KTX2 file as it is
+	static bool supportsCompressedFormat(uint32_t vkFormat)
+	{
+		return compressedFormat(vkFormat, false) != 0;
+	}
+
+	// the upload formats of an uncompressed image, public for the TextureBench
+	static GLenum pixelFormat(int channels)
+	{
+		if (channels == 1)
+			return GL_RED;
+		if (channels == 2)
+			return GL_RG;
+		if (channels == 3)
+			return GL_RGB;
+		return GL_RGBA;
+	}
+
+	// sized formats with as many channels as the image; gray images (1 channel, or 2 with
+	// alpha) are swizzled back to gray so the shaders sample them like RGB(A)
+	static GLenum internalFormat(int channels, bool srgb)
+	{
+		if (channels == 1)
+			return GL_R8;
+		if (channels == 2)
+			return GL_RG8;
+		if (channels == 3)
+			return srgb ? GL_SRGB8 : GL_RGB8;
+		return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+
+	// GPU bytes per texel of internalFormat; drivers pad RGB8 out to 4 bytes
+	static size_t bytesPerTexel(int channels)
+	{
+		return channels == 3 ? 4 : channels;
+	}
+
+    private:
+	std::vector<std::thread> workers;
+	std::deque<DecodedImage> jobs;
+	std::mutex jobMutex;
+	std::condition_variable jobReady;
+	std::atomic<bool> stopping{ false }; // also read without the lock by a worker waiting on a full queue
+
+	LockFreeQueue<DecodedImage> decoded;
+	DecodedImage uploading; // the image being spread over frames, if any
+	size_t stagedBytes = 0; // of the image being uploaded
+	unsigned int pending = 0;
+	size_t uploadedBytes = 0;
+	GLuint unpackBuffer = 0;
+
+	struct LiveTexture {
+		uint32_t ticket;
+		size_t bytes;
+		bool resident;
+	};
+	std::unordered_map<unsigned int, LiveTexture> textures; // every texture from load() not unloaded yet
+	uint32_t lastTicket = 0;
+
+	const AssetPack* pack = NULL;
+	unsigned int packedTextureCount = 0;
+
+	bool generateMipsOnCpu;
+	std::atomic<uint64_t> mipGenerationMicroseconds{ 0 };
+	std::atomic<unsigned int> mipCacheHitCount{ 0 };
+
+	struct StreamLevel {
+		uint64_t fileOffset; // in the level source
+		uint64_t fileBytes;
+		size_t gpuBytes;
+	};
+
+	struct StreamedTexture {
+		std::string levelSource;
+		uint32_t width;
+		uint32_t height;
+		GLenum internalFormat;
+		GLenum pixelFormat; // 0 for block compressed levels
+		std::vector<StreamLevel> levels;
+		uint32_t initialLevel; // never evicted below this
+		uint32_t residentLevel;
+		uint32_t wantedLevel;
+		uint64_t lastUsedFrame;
+		size_t bytes;
+		bool inFlight; // the next finer level is being read or uploaded
+		bool failed; // its level source couldn't be read, stays as it is
+	};
+	const size_t streamingBudget;
+	std::unordered_map<unsigned int, StreamedTexture> streamed;
+	size_t streamedBytes = 0; // GPU memory of every resident level of the streamed textures
+	size_t reservedBytes = 0; // of the levels being read or uploaded
+	unsigned int streamedLevels = 0;
+	unsigned int evictedLevels = 0;
+	uint64_t frame = 0;
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			DecodedImage image;
+			{
+				std::unique_lock<std::mutex> lock(jobMutex);
+				jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping)
+					return;
+				image = jobs.front();
+				jobs.pop_front();
+			}
+
+			if (image.streamLevel >= 0)
+			{
+				image.levelData = readLevel(image.levelSource, image.levelOffset, image.levelBytes);
+			}
+			else if (isKtx2(image.path))
+			{
+				image.compressed = new Ktx2Image();
+				if (!readKtx2(image.path.c_str(), *image.compressed))
+				{
+					delete image.compressed;
+					image.compressed = NULL;
+				}
+				else
+				{
+					image.levelSource = image.path;
+					if (streamingBudget > 0)
+						image.firstLevel = initialStreamLevel(image.compressed->width, image.compressed->height, image.compressed->levels.size());
+					keepLevels(*image.compressed, image.firstLevel);
+				}
+			}
+			else
+			{
+				image.mips = loadMipChain(image.path, image.options, image.levelSource);
+				if (image.mips && streamingBudget > 0 && !image.levelSource.empty())
+				{
+					image.firstLevel = initialStreamLevel(image.mips->width, image.mips->height, image.mips->levelCount());
+					keepLevels(*image.mips, image.firstLevel);
+				}
+			}
+			// the queue only fills up if the GL thread stalls, wait for it to drain; at shutdown
+			// nothing drains it any more, so the image is dropped instead
+			while (!decoded.tryPush(image))
+			{
+				if (stopping)
+				{
+					image.free();
+					return;
+				}
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// decodes an image file, and builds its mips or reads them from the cache; a new chain is
+	// written to the cache for the next launch. cachePath is left on the cache file when there
+	// is one matching the image, and empty otherwise
+	MipChain* loadMipChain(const std::string& path, const TextureOptions& options, std::string& cachePath)
+	{
+		cachePath.clear();
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return NULL;
+		std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		if (bytes.empty() || !file.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+			return NULL;
+
+		// the channels kept and the filtering depend on the color space, so each has its own cache
+		std::string cacheFile = path + mipCacheSuffix(options.srgb, options.srgbEncoded);
+		uint64_t hash = hashBytes(bytes.data(), bytes.size());
+		MipChain* chain = new MipChain();
+		if (generateMipsOnCpu && readMipCache(cacheFile.c_str(), bytes.size(), hash, *chain))
+		{
+			mipCacheHitCount++;
+			cachePath = cacheFile;
+			return chain;
+		}
+
+		int width, height, channels;
+		unsigned char* pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels, 0);
+		if (!pixels)
+		{
+			delete chain;
+			return NULL;
+		}
+		dropUnusedChannels(pixels, static_cast<size_t>(width) * height, channels, options.srgb);
+
+		if (generateMipsOnCpu)
+		{
+			// one thread per image, the other workers are busy with the other images
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			*chain = generateMipChain(pixels, width, height, channels, options.srgb || options.srgbEncoded, 1);
+			mipGenerationMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			if (writeMipCache(cacheFile.c_str(), bytes.size(), hash, *chain))
+				cachePath = cacheFile;
+		}
+		else
+		{
+			chain->width = width;
+			chain->height = height;
+			chain->channels = channels;
+			chain->levelOffsets.push_back(0);
+			chain->data.assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+		}
+		stbi_image_free(pixels);
+		return chain;
+	}
+
+	// reads one level of a streamed texture, NULL on failure
+	static std::vector<uint8_t>* readLevel(const std::string& path, uint64_t offset, uint64_t bytes)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return NULL;
+		std::vector<uint8_t>* data = new std::vector<uint8_t>(static_cast<size_t>(bytes));
+		file.seekg(static_cast<std::streamoff>(offset));
+		if (!file.read(reinterpret_cast<char*>(data->data()), bytes))
+		{
+			delete data;
+			return NULL;
+		}
+		return data;
+	}
+
+	// the finest level no bigger than STREAM_INITIAL_SIZE
+	static uint32_t initialStreamLevel(uint32_t width, uint32_t height, size_t levelCount)
+	{
+		uint32_t level = 0;
+		while (level + 1 < levelCount && std::max(width >> level, height >> level) > STREAM_INITIAL_SIZE)
+			level++;
+		return level;
+	}
+
+	// drops the levels finer than firstLevel from the data; the level offsets stay as they are,
+	// the data now starts at levelOffsets[firstLevel]
+	static void keepLevels(MipChain& chain, uint32_t firstLevel)
+	{
+		if (firstLevel > 0)
+			chain.data.erase(chain.data.begin(), chain.data.begin() + chain.levelOffsets[firstLevel]);
+	}
+
+	// only keeps the bytes of levels firstLevel and on (the header goes too); the data then starts
+	// at levelDataStart(). KTX2 stores the smallest level first, but any order of levels works
+	static void keepLevels(Ktx2Image& image, uint32_t firstLevel)
+	{
+		uint64_t begin = levelDataStart(image, firstLevel), end = begin;
+		for (size_t level = firstLevel; level < image.levels.size(); level++)
+			end = std::max(end, image.levels[level].byteOffset + image.levels[level].byteLength);
+		image.data.erase(image.data.begin() + end, image.data.end());
+		image.data.erase(image.data.begin(), image.data.begin() + begin);
+	}
+
+	static uint64_t levelDataStart(const Ktx2Image& image, uint32_t firstLevel)
+	{
+		uint64_t begin = image.levels[firstLevel].byteOffset;
+		for (size_t level = firstLevel; level < image.levels.size(); level++)
+			begin = std::min(begin, image.levels[level].byteOffset);
+		return begin;
+	}
+
+	static bool isKtx2(const std::string& path)
+	{
+		return path.size() >= 5 && path.compare(path.size() - 5, 5, ".ktx2") == 0;
+	}
+
+	// the GL format of a KTX2 image, 0 if the driver can't sample it; whether it's decoded as
+	// sRGB follows the texture's options, not the file, like the uncompressed path
+	static GLenum compressedFormat(uint32_t vkFormat, bool srgb)
+	{
+		const GLCapabilities& caps = glCaps();
+		switch (vkFormat)
+		{
+		case KTX2_FORMAT_BC1_RGB_UNORM:
+		case KTX2_FORMAT_BC1_RGB_SRGB:
+			return !caps.textureCompressionS3TC ? 0 : srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case KTX2_FORMAT_BC4_UNORM:
+			return GL_COMPRESSED_RED_RGTC1;
+		case KTX2_FORMAT_BC5_UNORM:
+			return GL_COMPRESSED_RG_RGTC2;
+		case KTX2_FORMAT_BC7_UNORM:
+		case KTX2_FORMAT_BC7_SRGB:
+			return !caps.textureCompressionBPTC ? 0 : srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+		}
+		return 0;
+	}
+
+	// repeats the red channel of a gray texture (1 channel, or 2 with alpha) into .rgb; 0 for
+	// a compressed one channel format, whose alpha is already one
+	static void swizzleGray(int channels)
+	{
+		if (channels > 2)
+			return;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+		if (channels > 0)
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, channels == 2 ? GL_GREEN : GL_ONE);
+	}
+
+	// uploads the levels of a packed texture into the bound texture, straight from the pack's
+	// mapping; returns the GPU bytes, 0 if the pack doesn't have the texture or GL can't take it
+	size_t uploadPacked(const char* resourcePath, const TextureOptions& options)
+	{
+		std::string path = resourcePath;
+		const AssetPackEntry* entry = pack->find(isKtx2(path) ? path : path + mipCacheSuffix(options.srgb, options.srgbEncoded), ASSET_TEXTURE);
+		if (!entry || entry->levelCount == 0)
+			return 0;
+		GLenum glFormat = entry->vkFormat != 0 ? compressedFormat(entry->vkFormat, options.srgb) : internalFormat(entry->channels, options.srgb);
+		if (glFormat == 0 || (entry->vkFormat == 0 && (entry->channels == 0 || entry->channels > 4)))
+			return 0;
+
+		// the pointers are client memory, not offsets into the unpack buffer
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		size_t bytes = 0;
+		for (uint32_t level = 0; level < entry->levelCount; level++)
+		{
+			GLsizei width = std::max<GLsizei>(entry->width >> level, 1);
+			GLsizei height = std::max<GLsizei>(entry->height >> level, 1);
+			if (entry->vkFormat != 0)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, level, glFormat, width, height, 0, static_cast<GLsizei>(entry->levelBytes[level]),
+					pack->levelData(*entry, level));
+				bytes += static_cast<size_t>(entry->levelBytes[level]);
+			}
+			else
+			{
+				glTexImage2D(GL_TEXTURE_2D, level, glFormat, width, height, 0, pixelFormat(entry->channels), GL_UNSIGNED_BYTE,
+					pack->levelData(*entry, level));
+				bytes += static_cast<size_t>(width) * height * bytesPerTexel(entry->channels);
+			}
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry->levelCount - 1);
+		if (entry->vkFormat == 0)
+			swizzleGray(entry->channels);
+		else if (glFormat == GL_COMPRESSED_RED_RGTC1)
+			swizzleGray(0);
+		return bytes;
+	}
+
+	// copies the next piece of data into the unpack buffer, at most budget bytes of it (always
+	// at least one byte); returns false when out of budget, sets staged once all of it is there
+	bool stage(const std::vector<uint8_t>& data, size_t budget, bool& staged)
+	{
+		staged = false;
+		if (budget == 0 && uploadedBytes > 0)
+			return false;
+		size_t pieceBytes = std::min(std::max<size_t>(budget, 1), data.size() - stagedBytes);
+
+		if (unpackBuffer == 0)
+			glGenBuffers(1, &unpackBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+		// fresh storage for every image, so the previous one's copy is never waited for
+		if (stagedBytes == 0)
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, data.size(), NULL, GL_STREAM_DRAW);
+
+		void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, stagedBytes, pieceBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (staging)
+		{
+			std::memcpy(staging, data.data() + stagedBytes, pieceBytes);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		stagedBytes += pieceBytes;
+		uploadedBytes += pieceBytes;
+		staged = stagedBytes >= data.size();
+		return true;
+	}
+
+	// stages the current image's mip chain, and once all of it is staged, has GL copy every
+	// level into the texture; returns false when out of budget
+	bool uploadMips(size_t budget)
+	{
+		const MipChain& chain = *uploading.mips;
+		bool staged;
+		if (!stage(chain.data, budget, staged))
+			return false;
+
+		if (staged)
+		{
+			// the whole image is staged: replace the placeholder
+			glBindTexture(GL_TEXTURE_2D, uploading.texture);
+			// rows of 1 and 3 channel images aren't 4 byte aligned
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			GLenum format = internalFormat(chain.channels, uploading.options.srgb);
+			size_t dataStart = chain.levelOffsets[uploading.firstLevel];
+			for (uint32_t level = uploading.firstLevel; level < chain.levelCount(); level++)
+			{
+				glTexImage2D(GL_TEXTURE_2D, level, format, chain.levelWidth(level), chain.levelHeight(level), 0,
+					pixelFormat(chain.channels), GL_UNSIGNED_BYTE, (void*)(uintptr_t)(chain.levelOffsets[level] - dataStart));
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			swizzleGray(chain.channels);
+			if (generateMipsOnCpu)
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, chain.levelCount() - 1);
+			}
+			else
+			{
+				// the driver path, waited on so the benchmark sees its real cost
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+				glGenerateMipmap(GL_TEXTURE_2D);
+				glFinish();
+				mipGenerationMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			}
+			LiveTexture& live = textures[uploading.texture];
+			if (uploading.firstLevel > 0)
+			{
+				StreamedTexture stream = newStream(chain.width, chain.height, format, pixelFormat(chain.channels));
+				for (uint32_t level = 0; level < chain.levelCount(); level++)
+				{
+					StreamLevel streamLevel = { sizeof(MipCacheHeader) + chain.levelOffsets[level], chain.levelBytes(level),
+						static_cast<size_t>(chain.levelWidth(level)) * chain.levelHeight(level) * bytesPerTexel(chain.channels) };
+					stream.levels.push_back(streamLevel);
+				}
+				live.bytes = startStream(stream);
+			}
+			else
+			{
+				// plus a third for the mips
+				live.bytes = static_cast<size_t>(chain.width) * chain.height * bytesPerTexel(chain.channels) * 4 / 3;
+			}
+			live.resident = true;
+
+			finishUpload();
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return true;
+	}
+
+	// uploadMips for a KTX2 image: the whole file is staged, the levels are copied out of it
+	bool uploadCompressed(size_t budget)
+	{
+		const Ktx2Image& image = *uploading.compressed;
+		bool staged;
+		if (!stage(image.data, budget, staged))
+			return false;
+
+		if (staged)
+		{
+			GLenum glFormat = compressedFormat(image.vkFormat, uploading.options.srgb);
+			if (glFormat == 0)
+			{
+				std::cout << "Unsupported compressed texture format " << image.vkFormat << ". Path: " << uploading.path << std::endl;
+			}
+			else
+			{
+				glBindTexture(GL_TEXTURE_2D, uploading.texture);
+				size_t bytes = 0;
+				uint64_t dataStart = levelDataStart(image, uploading.firstLevel);
+				for (size_t level = uploading.firstLevel; level < image.levels.size(); level++)
+				{
+					GLsizei width = std::max<GLsizei>(image.width >> level, 1);
+					GLsizei height = std::max<GLsizei>(image.height >> level, 1);
+					glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), glFormat, width, height, 0,
+						static_cast<GLsizei>(image.levels[level].byteLength), (void*)(uintptr_t)(image.levels[level].byteOffset - dataStart));
+					bytes += static_cast<size_t>(image.levels[level].byteLength);
+				}
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size() - 1));
+				if (uploading.firstLevel > 0)
+				{
+					StreamedTexture stream = newStream(image.width, image.height, glFormat, 0);
+					for (const Ktx2LevelIndex& level : image.levels)
+					{
+						StreamLevel streamLevel = { level.byteOffset, level.byteLength, static_cast<size_t>(level.byteLength) };
+						stream.levels.push_back(streamLevel);
+					}
+					bytes = startStream(stream);
+				}
+				// BC4 holds one channel; repeat it so .rgb reads the gray image that was compressed
+				if (glFormat == GL_COMPRESSED_RED_RGTC1)
+					swizzleGray(0);
+				LiveTexture& live = textures[uploading.texture];
+				live.bytes = bytes;
+				live.resident = true;
+			}
+
+			finishUpload();
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return true;
+	}
+
+	// done with the image in uploading, whether it made it to the GPU or not
+	void finishUpload()
+	{
+		if (uploading.streamLevel < 0)
+			pending--;
+		uploading.free();
+		uploading = DecodedImage();
+	}
+
+	StreamedTexture newStream(uint32_t width, uint32_t height, GLenum internalFormat, GLenum pixelFormat)
+	{
+		StreamedTexture stream;
+		stream.levelSource = uploading.levelSource;
+		stream.width = width;
+		stream.height = height;
+		stream.internalFormat = internalFormat;
+		stream.pixelFormat = pixelFormat;
+		stream.initialLevel = uploading.firstLevel;
+		stream.residentLevel = uploading.firstLevel;
+		stream.wantedLevel = uploading.firstLevel;
+		stream.lastUsedFrame = frame;
+		stream.bytes = 0;
+		stream.inFlight = false;
+		stream.failed = false;
+		return stream;
+	}
+
+	// the texture in uploading has its initial levels on the GPU: sample from the finest one on
+	// and track it from now on; returns the bytes it takes
+	size_t startStream(StreamedTexture& stream)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream.residentLevel);
+		for (size_t level = stream.residentLevel; level < stream.levels.size(); level++)
+			stream.bytes += stream.levels[level].gpuBytes;
+		streamedBytes += stream.bytes;
+		streamed[uploading.texture] = stream;
+		return stream.bytes;
+	}
+
+	void stopStreaming(unsigned int textureID)
+	{
+		std::unordered_map<unsigned int, StreamedTexture>::iterator it = streamed.find(textureID);
+		if (it == streamed.end() || !it->second.inFlight)
+			return;
+		reservedBytes -= it->second.levels[it->second.residentLevel - 1].gpuBytes;
+		it->second.inFlight = false;
+		it->second.failed = true;
+	}
+
+	// stages a streamed level, and once all of it is there, makes it the new base level
+	bool uploadLevel(size_t budget)
+	{
+		bool staged;
+		if (!stage(*uploading.levelData, budget, staged))
+			return false;
+
+		std::unordered_map<unsigned int, StreamedTexture>::iterator it = streamed.find(uploading.texture);
+		if (staged && it != streamed.end())
+		{
+			StreamedTexture& stream = it->second;
+			uint32_t level = static_cast<uint32_t>(uploading.streamLevel);
+			GLsizei width = std::max<GLsizei>(stream.width >> level, 1);
+			GLsizei height = std::max<GLsizei>(stream.height >> level, 1);
+			glBindTexture(GL_TEXTURE_2D, uploading.texture);
+			if (stream.pixelFormat == 0)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_2D, level, stream.internalFormat, width, height, 0,
+					static_cast<GLsizei>(uploading.levelData->size()), (void*)0);
+			}
+			else
+			{
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+				glTexImage2D(GL_TEXTURE_2D, level, stream.internalFormat, width, height, 0, stream.pixelFormat, GL_UNSIGNED_BYTE, (void*)0);
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+
+			size_t gpuBytes = stream.levels[level].gpuBytes;
+			reservedBytes -= gpuBytes;
+			streamedBytes += gpuBytes;
+			stream.bytes += gpuBytes;
+			textures[uploading.texture].bytes = stream.bytes;
+			stream.residentLevel = level;
+			stream.inFlight = false;
+			streamedLevels++;
+		}
+		if (staged)
+			finishUpload();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return true;
+	}
+
+	// has the workers read the next finer level of every texture that wants one, the most
+	// recently used textures first, as far as the budget goes
+	void requestLevels()
+	{
+		std::vector<unsigned int> wanting;
+		for (const std::pair<const unsigned int, StreamedTexture>& entry : streamed)
+		{
+			const StreamedTexture& stream = entry.second;
+			if (!stream.inFlight && !stream.failed && stream.wantedLevel < stream.residentLevel)
+				wanting.push_back(entry.first);
+		}
+		std::sort(wanting.begin(), wanting.end(), [this](unsigned int a, unsigned int b) {
+			return streamed[a].lastUsedFrame > streamed[b].lastUsedFrame;
+		});
+
+		for (unsigned int textureID : wanting)
+		{
+			StreamedTexture& stream = streamed[textureID];
+			uint32_t level = stream.residentLevel - 1;
+			if (!makeRoom(stream.levels[level].gpuBytes, textureID))
+				break;
+
+			DecodedImage job;
+			job.texture = textureID;
+			job.ticket = textures[textureID].ticket;
+			job.levelSource = stream.levelSource;
+			job.streamLevel = static_cast<int>(level);
+			job.levelOffset = stream.levels[level].fileOffset;
+			job.levelBytes = stream.levels[level].fileBytes;
+			{
+				std::lock_guard<std::mutex> lock(jobMutex);
+				jobs.push_back(job);
+			}
+			jobReady.notify_one();
+			stream.inFlight = true;
+			reservedBytes += stream.levels[level].gpuBytes;
+		}
+	}
+
+	// evicts levels, the finest level of the least recently used texture first, until bytes more
+	// fit the budget; only levels finer than a texture's initial ones go, and none a texture
+	// used in the last frame still wants. Returns false if that doesn't free enough
+	bool makeRoom(size_t bytes, unsigned int requester)
+	{
+		while (streamedBytes + reservedBytes + bytes > streamingBudget)
+		{
+			std::unordered_map<unsigned int, StreamedTexture>::iterator victim = streamed.end();
+			for (std::unordered_map<unsigned int, StreamedTexture>::iterator it = streamed.begin(); it != streamed.end(); ++it)
+			{
+				const StreamedTexture& stream = it->second;
+				bool needed = stream.lastUsedFrame == frame && stream.residentLevel >= stream.wantedLevel;
+				if (it->first == requester || stream.inFlight || needed || stream.residentLevel >= stream.initialLevel)
+					continue;
+				if (victim == streamed.end() || stream.lastUsedFrame < victim->second.lastUsedFrame)
+					victim = it;
+			}
+			if (victim == streamed.end())
+				return false;
+			evictLevel(victim->first, victim->second);
+		}
+		return true;
+	}
+
+	// drops a streamed texture's finest level; the next coarser one becomes the base level and
+	// the dropped one is redefined as empty, which releases its memory
+	void evictLevel(unsigned int textureID, StreamedTexture& stream)
+	{
+		uint32_t level = stream.residentLevel;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R8, 0, 0, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+		size_t gpuBytes = stream.levels[level].gpuBytes;
+		streamedBytes -= gpuBytes;
+		stream.bytes -= gpuBytes;
+		textures[textureID].bytes = stream.bytes;
+		stream.residentLevel = level + 1;
+		evictedLevels++;
+	}
+};
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef TRIANGLE_BVH_H
+#define TRIANGLE_BVH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+struct RayHit {
+	float t; // distance along the ray
+	unsigned int triangle; // index of the triangle that was hit
+	float u, v; // barycentric coordinates of the hit
+};
+
+// A static bounding volume hierarchy over triangles, built once with binned SAH.
+// Used by the offline bakers to answer closest-hit and shadow (any-hit) queries.
+class TriangleBVH
+{
+    public:
+	// builds the hierarchy; positions holds 3 consecutive vertices per triangle
+	void build(const std::vector<glm::vec3>& positions)
+	{
+		triangles.clear();
+		nodes.clear();
+		indices.clear();
+
+		size_t triangleCount = positions.size() / 3;
+		triangles.reserve(triangleCount);
+		indices.reserve(triangleCount);
+		for (size_t i = 0; i < triangleCount; i++)
+		{
+			Triangle triangle;
+			triangle.v0 = positions[i * 3];
+			triangle.edge1 = positions[i * 3 + 1] - triangle.v0;
+			triangle.edge2 = positions[i * 3 + 2] - triangle.v0;
+			triangles.push_back(triangle);
+			indices.push_back(static_cast<unsigned int>(i));
+		}
+
+		if (triangleCount == 0)
+			return;
+
+		// centroids and bounds are only needed while building
+		centroids.resize(triangleCount);
+		triangleMin.resize(triangleCount);
+		triangleMax.resize(triangleCount);
+		for (size_t i = 0; i < triangleCount; i++)
+		{
+			glm::vec3 a = positions[i * 3], b = positions[i * 3 + 1], c = positions[i * 3 + 2];
+			triangleMin[i] = glm::min(a, glm::min(b, c));
+			triangleMax[i] = glm::max(a, glm::max(b, c));
+			centroids[i] = (a + b + c) / 3.0f;
+		}
+
+		nodes.reserve(triangleCount * 2);
+		nodes.push_back(Node());
+		nodes[0].leftFirst = 0;
+		nodes[0].count = static_cast<unsigned int>(triangleCount);
+		updateBounds(0);
+		subdivide(0);
+
+		centroids.clear();
+		triangleMin.clear();
+		triangleMax.clear();
+	}
+
+	// finds the closest hit in (tMin, tMax); returns false if nothing was hit
+	bool intersect(const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax, RayHit& hit) const
+	{
+		if (nodes.empty())
+			return false;
+
+		glm::vec3 invDirection = 1.0f / direction;
+		hit.t = tMax;
+		bool found = false;
+
+		unsigned int stack[64];
+		unsigned int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			const Node& node = nodes[stack[--stackSize]];
+			if (!intersectBounds(node, origin, invDirection, hit.t))
+				continue;
+
+			if (node.count > 0)
+			{
+				for (unsigned int i = 0; i < node.count; i++)
+				{
+					unsigned int triangle = indices[node.leftFirst + i];
+					float t, u, v;
+					if (intersectTriangle(triangles[triangle], origin, direction, t, u, v) && t > tMin && t < hit.t)
+					{
+						hit.t = t;
+						hit.triangle = triangle;
+						hit.u = u;
+						hit.v = v;
+						found = true;
+					}
+				}
+			}
+			else
+			{
+				stack[stackSize++] = node.leftFirst;
+				stack[stackSize++] = node.leftFirst + 1;
+			}
+		}
+		return found;
+	}
+
+	// returns true as soon as anything blocks the segment (tMin, tMax)
+	bool occluded(const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax) const
+	{
+		if (nodes.empty())
+			return false;
+
+		glm::vec3 invDirection = 1.0f / direction;
+
+		unsigned int stack[64];
+		unsigned int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			const Node& node = nodes[stack[--stackSize]];
+			if (!intersectBounds(node, origin, invDirection, tMax))
+				continue;
+
+			if (node.count > 0)
+			{
+				for (unsigned int i = 0; i < node.count; i++)
+				{
+					float t, u, v;
+					if (intersectTriangle(triangles[indices[node.leftFirst + i]], origin, direction, t, u, v) && t > tMin && t < tMax)
+						return true;
+				}
+			}
+			else
+			{
+				stack[stackSize++] = node.leftFirst;
+				stack[stackSize++] = node.leftFirst + 1;
+			}
+		}
+		return false;
+	}
+
+	size_t nodeCount() const { return nodes.size(); }
+	size_t triangleCount() const { return triangles.size(); }
+
+    private:
+	// a triangle stored in the form the Moller-Trumbore test wants
+	struct Triangle {
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	// leaves have count > 0 and leftFirst is their first index; inner nodes have
+	// count == 0 and leftFirst is their left child (the right child is next to it)
+	struct Node {
+		glm::vec3 boundsMin;
+		unsigned int leftFirst;
+		glm::vec3 boundsMax;
+		unsigned int count;
+	};
+
+	static const unsigned int BIN_COUNT = 12;
+	static const unsigned int MAX_LEAF_SIZE = 4;
+
+	std::vector<Triangle> triangles;
+	std::vector<Node> nodes;
+	std::vector<unsigned int> indices;
+
+	// build-time data
+	std::vector<glm::vec3> centroids;
+	std::vector<glm::vec3> triangleMin;
+	std::vector<glm::vec3> triangleMax;
+
+	void updateBounds(unsigned int nodeIndex)
+	{
+		Node& node = nodes[nodeIndex];
+		node.boundsMin = glm::vec3(FLT_MAX);
+		node.boundsMax = glm::vec3(-FLT_MAX);
+		for (unsigned int i = 0; i < node.count; i++)
+		{
+			unsigned int triangle = indices[node.leftFirst + i];
+			node.boundsMin = glm::min(node.boundsMin, triangleMin[triangle]);
+			node.boundsMax = glm::max(node.boundsMax, triangleMax[triangle]);
+		}
+	}
+
+	static float area(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 extent = boundsMax - boundsMin;
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	void subdivide(unsigned int nodeIndex)
+	{
+		Node node = nodes[nodeIndex];
+		if (node.count <= MAX_LEAF_SIZE)
+			return;
+
+		// bin the centroids along each axis and pick the cheapest split plane
+		glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+		for (unsigned int i = 0; i < node.count; i++)
+		{
+			centroidMin = glm::min(centroidMin, centroids[indices[node.leftFirst + i]]);
+			centroidMax = glm::max(centroidMax, centroids[indices[node.leftFirst + i]]);
+		}
+
+		int bestAxis = -1;
+		unsigned int bestSplit = 0;
+		float bestCost = area(node.boundsMin, node.boundsMax) * node.count;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			glm::vec3 binMin[BIN_COUNT], binMax[BIN_COUNT];
+			unsigned int binCount[BIN_COUNT] = {};
+			for (unsigned int b = 0; b < BIN_COUNT; b++)
+			{
+				binMin[b] = glm::vec3(FLT_MAX);
+				binMax[b] = glm::vec3(-FLT_MAX);
+			}
+
+			float scale = BIN_COUNT / extent;
+			for (unsigned int i = 0; i < node.count; i++)
+			{
+				unsigned int triangle = indices[node.leftFirst + i];
+				unsigned int b = std::min(BIN_COUNT - 1, static_cast<unsigned int>((centroids[triangle][axis] - centroidMin[axis]) * scale));
+				binCount[b]++;
+				binMin[b] = glm::min(binMin[b], triangleMin[triangle]);
+				binMax[b] = glm::max(binMax[b], triangleMax[triangle]);
+			}
+
+			// sweep from the right to get the cost of every "right side" of a split
+			float rightArea[BIN_COUNT - 1];
+			unsigned int rightCount[BIN_COUNT - 1];
+			glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+			unsigned int sweepCount = 0;
+			for (unsigned int b = BIN_COUNT - 1; b > 0; b--)
+			{
+				sweepCount += binCount[b];
+				sweepMin = glm::min(sweepMin, binMin[b]);
+				sweepMax = glm::max(sweepMax, binMax[b]);
+				rightCount[b - 1] = sweepCount;
+				rightArea[b - 1] = sweepCount > 0 ? area(sweepMin, sweepMax) : 0.0f;
+			}
+
+			sweepMin = glm::vec3(FLT_MAX);
+			sweepMax = glm::vec3(-FLT_MAX);
+			sweepCount = 0;
+			for (unsigned int b = 0; b < BIN_COUNT - 1; b++)
+			{
+				sweepCount += binCount[b];
+				sweepMin = glm::min(sweepMin, binMin[b]);
+				sweepMax = glm::max(sweepMax, binMax[b]);
+				if (sweepCount == 0 || rightCount[b] == 0)
+					continue;
+				float cost = area(sweepMin, sweepMax) * sweepCount + rightArea[b] * rightCount[b];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		// splitting isn't worth it
+		if (bestAxis < 0)
+			return;
+
+		float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+		float scale = BIN_COUNT / extent;
+		unsigned int* first = &indices[node.leftFirst];
+		unsigned int* middle = std::partition(first, first + node.count, [&](unsigned int triangle) {
+			unsigned int b = std::min(BIN_COUNT - 1, static_cast<unsigned int>((centroids[triangle][bestAxis] - centroidMin[bestAxis]) * scale));
+			return b <= bestSplit;
+		});
+		unsigned int leftCount = static_cast<unsigned int>(middle - first);
+		if (leftCount == 0 || leftCount == node.count)
+			return;
+
+		unsigned int leftChild = static_cast<unsigned int>(nodes.size());
+		nodes.push_back(Node());
+		nodes.push_back(Node());
+		nodes[leftChild].leftFirst = node.leftFirst;
+		nodes[leftChild].count = leftCount;
+		nodes[leftChild + 1].leftFirst = node.leftFirst + leftCount;
+		nodes[leftChild + 1].count = node.count - leftCount;
+		nodes[nodeIndex].leftFirst = leftChild;
+		nodes[nodeIndex].count = 0;
+
+		updateBounds(leftChild);
+		updateBounds(leftChild + 1);
+		subdivide(leftChild);
+		subdivide(leftChild + 1);
+	}
+
+	static bool intersectBounds(const Node& node, const glm::vec3& origin, const glm::vec3& invDirection, float tMax)
+	{
+		glm::vec3 t0 = (node.boundsMin - origin) * invDirection;
+		glm::vec3 t1 = (node.boundsMax - origin) * invDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		return enter <= exit;
+	}
+
+	// Moller-Trumbore ray/triangle intersection
+	static bool intersectTriangle(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float& t, float& u, float& v)
+	{
+		glm::vec3 p = glm::cross(direction, triangle.edge2);
+		float determinant = glm::dot(triangle.edge1, p);
+		if (std::abs(determinant) < 1e-8f)
+			return false;
+
+		float invDeterminant = 1.0f / determinant;
+		glm::vec3 s = origin - triangle.v0;
+		u = glm::dot(s, p) * invDeterminant;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+
+		glm::vec3 q = glm::cross(s, triangle.edge1);
+		v = glm::dot(direction, q) * invDeterminant;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		t = glm::dot(triangle.edge2, q) * invDeterminant;
+		return true;
+	}
+};
+
+#endif